@@ -5,6 +5,7 @@
 */
 extern "C" {
 #include "taf.h"
+#include "tai.h"
 #include "sonLib.h"
 }
 #include "bioioC.h"
@@ -27,6 +28,7 @@ static void usage() {
             maximum_gap_string_length);
     fprintf(stderr, "-s --repeatCoordinatesEveryNColumns : Repeat TAF coordinates of each sequence at least every n columns. By default: %" PRIi64 "\n", repeat_coordinates_every_n_columns);
     fprintf(stderr, "-c --useCompression : Write the output using bgzip compression.\n");
+    fprintf(stderr, "-I --writeIndex : Write the .tai index of the output as it is written. Requires -o\n");
     fprintf(stderr, "-l --logLevel : Set the log level\n");
     fprintf(stderr, "-h --help : Print this help message\n");
 }
@@ -43,6 +45,7 @@ int taf_add_gap_bases_main(int argc, char *argv[]) {
     char *hal_file = NULL;
     bool run_length_encode_bases = 0;
     bool use_compression = 0;
+    bool write_index = 0;
 
     ///////////////////////////////////////////////////////////////////////////
     // Parse the inputs
@@ -57,10 +60,11 @@ int taf_add_gap_bases_main(int argc, char *argv[]) {
                                                 { "useCompression", no_argument, 0, 'c' },                                                
                                                 { "help", no_argument, 0, 'h' },
                                                 { "maximumGapStringLength", required_argument, 0, 'm' },
+                                                { "writeIndex", no_argument, 0, 'I' },
                                                 { 0, 0, 0, 0 } };
 
         int option_index = 0;
-        int64_t key = getopt_long(argc, argv, "l:i:o:a:s:chm:", long_options, &option_index);
+        int64_t key = getopt_long(argc, argv, "l:i:o:a:s:chm:I", long_options, &option_index);
         if (key == -1) {
             break;
         }
@@ -90,6 +94,9 @@ int taf_add_gap_bases_main(int argc, char *argv[]) {
             case 'm':
                 maximum_gap_string_length = atol(optarg);
                 break;
+            case 'I':
+                write_index = 1;
+                break;
             default:
                 usage();
                 return 1;
@@ -100,6 +107,10 @@ int taf_add_gap_bases_main(int argc, char *argv[]) {
         fprintf(stderr, "[taf] Sequences must be specified either via fasta arguments OR the -a option (but not both)\n");
         return 1;
     }
+    if (write_index && outputFile == NULL) {
+        fprintf(stderr, "[taf] -I/--writeIndex requires an output file (-o)\n");
+        return 1;
+    }
 #ifndef USE_HAL
     if (hal_file) {
         fprintf(stderr, "[taf] taf was not built with HAL support. Set HALDIR and recompile in order to use -a\n");
@@ -140,13 +151,14 @@ int taf_add_gap_bases_main(int argc, char *argv[]) {
     //////////////////////////////////////////////
 
     FILE *input = inputFile == NULL ? stdin : fopen(inputFile, "r");
-    LW *output = LW_construct(outputFile == NULL ? stdout : fopen(outputFile, "w"), use_compression);
-    LI *li = LI_construct(input);
+    LW *output = LW_construct2(outputFile == NULL ? stdout : fopen(outputFile, "w"), use_compression, taffy_thread_number, taffy_compression_level);
+    LI *li = LI_construct2(input, taffy_thread_number, taffy_prefetch);
 
     // Pass the header line to determine parameters and write the updated taf header
     Tag *tag = taf_read_header_2(li, &run_length_encode_bases);
     taf_write_header(tag, output);
     tag_destruct(tag);
+    TaiWriter *tai_writer = write_index ? tai_writer_construct(0, TAI_DEFAULT_INDEX_BLOCK_SIZE) : NULL;
 
     Alignment *alignment, *p_alignment = NULL;
     while((alignment = taf_read_block(p_alignment, run_length_encode_bases, li)) != NULL) {
@@ -156,6 +168,9 @@ int taf_add_gap_bases_main(int argc, char *argv[]) {
         }
 
         // Write the block
+        if(tai_writer != NULL) {
+            tai_writer_add_block(tai_writer, alignment, repeat_coordinates_every_n_columns, output);
+        }
         taf_write_block(p_alignment, alignment, run_length_encode_bases, repeat_coordinates_every_n_columns, output);
 
         // Clean up the previous alignment
@@ -176,6 +191,10 @@ int taf_add_gap_bases_main(int argc, char *argv[]) {
     if(inputFile != NULL) {
         fclose(input);
     }
+    if(tai_writer != NULL) {
+        tai_writer_write(tai_writer, output, outputFile);
+        tai_writer_destruct(tai_writer);
+    }
     LW_destruct(output, outputFile != NULL);
 
     if (fastas) {
@@ -20,6 +20,7 @@ static void usage(void) {
     fprintf(stderr, "-t --tagName [STRING] : REQUIRED: The name of the tag to annotate for the given wiggle\n");
     fprintf(stderr, "-s --repeatCoordinatesEveryNColumns : Repeat coordinates of each sequence at least every n columns. By default: %" PRIi64 "\n", repeat_coordinates_every_n_columns);
     fprintf(stderr, "-c --useCompression : Write the output using bgzip compression.\n");
+    fprintf(stderr, "-I --writeIndex : Write the .tai index of the output as it is written. Requires -o\n");
     fprintf(stderr, "-r --refPrefix : Prefix to prepend to chrom names in annotation file to form the sequence name.\n");
     fprintf(stderr, "-l --logLevel : Set the log level\n");
     fprintf(stderr, "-h --help : Print this help message\n");
@@ -34,16 +35,16 @@ static void label_alignment(Alignment *alignment, stHash *labels, char *tag_name
         assert(ref_row->strand); // Reference row is by convention on the positive strand
         stHash *seq_labels = stHash_search(labels, ref_row->sequence_name);
         if (seq_labels != NULL) {
+            alignment_make_row_bases(alignment);
+            Tag **column_tags = alignment_get_column_tags(alignment);
             int64_t start = ref_row->start;
             for (int64_t i = 0; i < alignment->column_number; i++) { // For each column
                 if (ref_row->bases[i] != '-') { // If a reference coordinate (not a gap)
                     double *label = stHash_search(seq_labels, (void *) start++);
                     if (label) {
-                        assert(tag_find(alignment->column_tags[i], tag_name) ==
-                               NULL); // No existing tag with this label
+                        assert(tag_find(column_tags[i], tag_name) == NULL); // No existing tag with this label
                         // Add the tag
-                        alignment->column_tags[i] = tag_construct(tag_name, stString_print("%f", label[0]),
-                                                                  alignment->column_tags[i]);
+                        column_tags[i] = tag_construct(tag_name, stString_print("%f", label[0]), column_tags[i]);
                     }
                 }
             }
@@ -63,6 +64,7 @@ int taf_annotate_main(int argc, char *argv[]) {
     char *wig_file = NULL;
     char *output_file = NULL;
     bool use_compression = 0;
+    bool write_index = 0;
     char *ref_prefix = "";
 
     ///////////////////////////////////////////////////////////////////////////
@@ -78,11 +80,12 @@ int taf_annotate_main(int argc, char *argv[]) {
                                                 { "repeatCoordinatesEveryNColumns", required_argument, 0, 's' },
                                                 { "useCompression", no_argument, 0, 'c' },
                                                 { "refPrefix", required_argument, 0, 'r' },
+                                                { "writeIndex", no_argument, 0, 'I' },
                                                 { "help", no_argument, 0, 'h' },
                                                 { 0, 0, 0, 0 } };
 
         int option_index = 0;
-        int64_t key = getopt_long(argc, argv, "l:i:o:w:s:cr:ht:", long_options, &option_index);
+        int64_t key = getopt_long(argc, argv, "l:i:o:w:s:cr:ht:I", long_options, &option_index);
         if (key == -1) {
             break;
         }
@@ -112,6 +115,9 @@ int taf_annotate_main(int argc, char *argv[]) {
             case 'r':
                 ref_prefix = optarg;
                 break;
+            case 'I':
+                write_index = 1;
+                break;
             case 'h':
                 usage();
                 return 0;
@@ -131,6 +137,9 @@ int taf_annotate_main(int argc, char *argv[]) {
     if(!wig_file) {
         st_errAbort("No wiggle file name given\n");
     }
+    if(write_index && !output_file) {
+        st_errAbort("-I/--writeIndex requires an output file (-o)\n");
+    }
 
     st_setLogLevelFromString(logLevelString);
     st_logInfo("Input file string : %s\n", taf_file);
@@ -149,7 +158,7 @@ int taf_annotate_main(int argc, char *argv[]) {
         fprintf(stderr, "Unable to open input TAF file: %s\n", taf_file);
         return 1;
     }
-    LI *li = LI_construct(taf_fh);
+    LI *li = LI_construct2(taf_fh, taffy_thread_number, taffy_prefetch);
 
     // Check is a taf file
     if (check_input_format(LI_peek_at_next_line(li)) != 0) {
@@ -170,7 +179,7 @@ int taf_annotate_main(int argc, char *argv[]) {
         fprintf(stderr, "Unable to open output file: %s\n", output_file);
         return 1;
     }
-    LW *output = LW_construct(output_fh, use_compression);
+    LW *output = LW_construct2(output_fh, use_compression, taffy_thread_number, taffy_compression_level);
 
     //////////////////////////////////////////////
     // Write the labelled taf
@@ -178,26 +187,36 @@ int taf_annotate_main(int argc, char *argv[]) {
 
     // Write the taf header
     taf_write_header(tag, output);
+    TaiWriter *tai_writer = write_index ? tai_writer_construct(0, TAI_DEFAULT_INDEX_BLOCK_SIZE) : NULL;
 
     // Now write the body of the taf file
     Alignment *alignment = NULL;
     Alignment *p_alignment = NULL;
+    // If the file is indexed and we have threads, parse it in parallel
+    TaiReader *tai_reader = tai_reader_open(taf_file, li, run_length_encode_bases, taffy_thread_number);
     // Keep reading blocks while available
-    while((alignment = taf_read_block(p_alignment, run_length_encode_bases, li)) != NULL) {
+    while((alignment = tai_reader != NULL ? tai_reader_next(tai_reader) :
+                       taf_read_block(p_alignment, run_length_encode_bases, li)) != NULL) {
         label_alignment(alignment, labels, tag_name); // Make any changes to the alignment for output
 
         // Write back the labelled taf
+        if (tai_writer != NULL) {
+            tai_writer_add_block(tai_writer, alignment, repeat_coordinates_every_n_columns, output);
+        }
         taf_write_block2(p_alignment, alignment, run_length_encode_bases,
                          repeat_coordinates_every_n_columns, output, 0, 0);
 
         // Clean up
         if (p_alignment) {
-            alignment_destruct(p_alignment, true);
+            alignment_recycle(p_alignment, true, li);
         }
         p_alignment = alignment;
     }
     if (p_alignment) {
-        alignment_destruct(p_alignment, true);
+        alignment_recycle(p_alignment, true, li);
+    }
+    if (tai_reader != NULL) {
+        tai_reader_destruct(tai_reader);
     }
 
     //////////////////////////////////////////////
@@ -208,6 +227,10 @@ int taf_annotate_main(int argc, char *argv[]) {
     if(taf_file != NULL) {
         fclose(taf_fh);
     }
+    if(tai_writer != NULL) {
+        tai_writer_write(tai_writer, output, output_file);
+        tai_writer_destruct(tai_writer);
+    }
     LW_destruct(output, output_file != NULL);
     tag_destruct(tag);
 
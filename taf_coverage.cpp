@@ -163,7 +163,7 @@ int taf_coverage_main(int argc, char *argv[]) {
 
     // Open TAF    
     FILE *input = inputFile == NULL ? stdin : fopen(inputFile, "r");
-    LI *li = LI_construct(input);
+    LI *li = LI_construct2(input, taffy_thread_number, taffy_prefetch);
 
     // Parse the header
     bool run_length_encode_bases;
@@ -177,12 +177,12 @@ int taf_coverage_main(int argc, char *argv[]) {
 
         // Clean up the previous alignment
         if(p_alignment != NULL) {
-            alignment_destruct(p_alignment, 1);
+            alignment_recycle(p_alignment, 1, li);
         }
         p_alignment = alignment; // Update the previous alignment
     }
     if(p_alignment != NULL) { // Clean up the final alignment
-        alignment_destruct(p_alignment, 1);
+        alignment_recycle(p_alignment, 1, li);
     }
 
     // add gaps from last covered base to ends of contigs
@@ -219,6 +219,7 @@ void update_block_coverage(Alignment* aln, Alignment* prev_aln, const string& re
                            ContigCoverageMap& contig_cov_map) {
     
     // random access rows
+    alignment_make_row_bases(aln);
     vector<Alignment_Row*> rows(aln->row_number, NULL);
 
     // remember parsed names
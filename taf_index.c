@@ -14,6 +14,9 @@ static void usage(void) {
     fprintf(stderr, "Index a TAF or MAF file, output goes in <file>.tai\n");
     fprintf(stderr, "-i --inputFile : Input taf or maf file [REQUIRED]\n");
     fprintf(stderr, "-b --blockSize : Write an index line for intervals of this many bp [default:10000]\n");
+    fprintf(stderr, "-x --binary : Write a binary index, which is memory mapped rather than parsed when loaded\n");
+    fprintf(stderr, "-a --allGenomes : Also write a secondary index of every sequence, not only the reference, "
+                    "in <file>.tsi, so that regions of any genome can be queried\n");
     fprintf(stderr, "-l --logLevel : Set the log level\n");
     fprintf(stderr, "-h --help : Print this help message\n");
 }
@@ -26,7 +29,9 @@ int taf_index_main(int argc, char *argv[]) {
      */
     char *logLevelString = NULL;
     char *taf_fn = NULL;
-    int64_t block_size = 10000;
+    int64_t block_size = TAI_DEFAULT_INDEX_BLOCK_SIZE;
+    bool binary = false;
+    bool all_genomes = false;
 
     ///////////////////////////////////////////////////////////////////////////
     // Parse the inputs
@@ -36,11 +41,13 @@ int taf_index_main(int argc, char *argv[]) {
         static struct option long_options[] = { { "logLevel", required_argument, 0, 'l' },
                                                 { "inputFile", required_argument, 0, 'i' },
                                                 { "blockSize", required_argument, 0, 'b' },
+                                                { "binary", no_argument, 0, 'x' },
+                                                { "allGenomes", no_argument, 0, 'a' },
                                                 { "help", no_argument, 0, 'h' },
                                                 { 0, 0, 0, 0 } };
 
         int option_index = 0;
-        int64_t key = getopt_long(argc, argv, "l:i:b:h", long_options, &option_index);
+        int64_t key = getopt_long(argc, argv, "l:i:b:xah", long_options, &option_index);
         if (key == -1) {
             break;
         }
@@ -55,6 +62,12 @@ int taf_index_main(int argc, char *argv[]) {
             case 'b':
                 block_size = atoi(optarg);
                 break;
+            case 'x':
+                binary = true;
+                break;
+            case 'a':
+                all_genomes = true;
+                break;
             case 'h':
                 usage();
                 return 0;
@@ -71,6 +84,8 @@ int taf_index_main(int argc, char *argv[]) {
     st_setLogLevelFromString(logLevelString);
     st_logInfo("Input file string : %s\n", taf_fn);
     st_logInfo("Block size : %" PRIi64 "\n", block_size);
+    st_logInfo("Binary index : %s\n", binary ? "true" : "false");
+    st_logInfo("Secondary index : %s\n", all_genomes ? "true" : "false");
     
     //////////////////////////////////////////////
     // Make the .tai index
@@ -88,13 +103,42 @@ int taf_index_main(int argc, char *argv[]) {
     char *tai_fn = tai_path(taf_fn);
     st_logInfo("Output index file : %s\n", tai_fn);
     FILE *tai_fh = fopen(tai_fn, "w");    
-    LI *li = LI_construct(taf_fh);
+    LI *li = LI_construct2(taf_fh, taffy_thread_number, taffy_prefetch);
     if (!LI_indexable(li)) {
         fprintf(stderr, "Input file must be either uncompressed or bgzipped: gzip not supported: %s\n", taf_fn);
         return 1;
     }
 
-    tai_create(li, tai_fh, block_size);
+    if (binary) {
+        tai_create_binary(li, tai_fh, block_size);
+    } else {
+        tai_create(li, tai_fh, block_size);
+    }
+
+    if (all_genomes) {
+        // Load the index just made, then scan the file again to index every sequence within its anchors
+        fclose(tai_fh);
+        tai_fh = fopen(tai_fn, "r");
+        if (tai_fh == NULL) {
+            fprintf(stderr, "Unable to open index file: %s\n", tai_fn);
+            return 1;
+        }
+        LI_seek(li, 0);
+        int64_t line_length;
+        LI_get_next_line_span(li, &line_length); // load the line at the seeked position
+        Tai *tai = tai_load(tai_fh, check_input_format(LI_peek_at_next_line(li)) == 1);
+        char *tsi_fn = tai_secondary_path(taf_fn);
+        st_logInfo("Output secondary index file : %s\n", tsi_fn);
+        FILE *tsi_fh = fopen(tsi_fn, "w");
+        if (tsi_fh == NULL) {
+            fprintf(stderr, "Unable to open secondary index file: %s\n", tsi_fn);
+            return 1;
+        }
+        tai_create_secondary(tai, li, tsi_fh);
+        fclose(tsi_fh);
+        free(tsi_fn);
+        tai_destruct(tai);
+    }
 
     //////////////////////////////////////////////
     // Cleanup
@@ -5,6 +5,7 @@
 */
 
 #include "taf.h"
+#include "tai.h"
 #include "sonLib.h"
 #include <getopt.h>
 #include <time.h>
@@ -29,6 +30,7 @@ static void usage(void) {
     fprintf(stderr, "-d --filterGapCausingDupes : Reduce the number of MAF blocks by filtering out rows that induce gaps > maximumGapLength. Rows are only filtered out if they are duplications (contig of same name appears elsewhere in block, or contig with same prefix up to \".\" appears in the same block).\n");
     fprintf(stderr, "-s --repeatCoordinatesEveryNColumns : Repeat coordinates of each sequence at least every n columns. By default: %" PRIi64 "\n", repeat_coordinates_every_n_columns);
     fprintf(stderr, "-c --useCompression : Write the output using bgzip compression.\n");
+    fprintf(stderr, "-I --writeIndex : Write the .tai index of the output as it is written. Requires -o\n");
     fprintf(stderr, "-a --halFile : HAL file for extracting gap sequence (MAF must be created with hal2maf *without* --onlySequenceNames)\n");
     fprintf(stderr, "-b --seqFiles : Fasta files for extracting gap sequence. Do not specify both this option and --halFile\n");
     fprintf(stderr, "-h --help : Print this help message\n");
@@ -131,6 +133,7 @@ static bool greedy_prune_by_gap(Alignment *alignment, int64_t maximum_gap_length
 
     bool pruned = false;
     if (can_prune) {
+        alignment_invalidate_column_bases(alignment);
         // remove the rows
         assert(stList_length(to_prune) > 0);
         Alignment_Row *p_row = NULL;
@@ -178,6 +181,7 @@ int taf_norm_main(int argc, char *argv[]) {
     bool output_maf = 0;
     bool use_compression = 0;
     bool filter_gap_causing_dupes = 0;
+    bool write_index = 0;
     stList *fasta_files = stList_construct();
     char *hal_file = NULL;
 
@@ -200,10 +204,11 @@ int taf_norm_main(int argc, char *argv[]) {
                                                 { "useCompression", no_argument, 0, 'c' },
                                                 { "halFile", required_argument, 0, 'a' },
                                                 { "seqFiles", required_argument, 0, 'b' },
+                                                { "writeIndex", no_argument, 0, 'I' },
                                                 { 0, 0, 0, 0 } };
 
         int option_index = 0;
-        int64_t key = getopt_long(argc, argv, "l:i:o:hcm:n:dkQ:q:s:a:b:", long_options, &option_index);
+        int64_t key = getopt_long(argc, argv, "l:i:o:hcm:n:dkQ:q:s:a:b:I", long_options, &option_index);
         if (key == -1) {
             break;
         }
@@ -248,6 +253,9 @@ int taf_norm_main(int argc, char *argv[]) {
             case 'a':
                 hal_file = optarg;
                 break;
+            case 'I':
+                write_index = 1;
+                break;
             case 'b':
                 // Parse the set of sequence files (this is a bit fragile - files can not start with a '-' character)
                 optind--;
@@ -275,12 +283,18 @@ int taf_norm_main(int argc, char *argv[]) {
     st_logInfo("Repeat coordinates every n bases : %" PRIi64 "\n", repeat_coordinates_every_n_columns);
     st_logInfo("Fraction shared rows to merge adjacent blocks : %f\n", fraction_shared_rows);
     st_logInfo("Write compressed output : %s\n", use_compression ? "true" : "false");
+    st_logInfo("Write index : %s\n", write_index ? "true" : "false");
     if (hal_file) {
         st_logInfo("HAL file string : %s\n", hal_file);
     } else {
         st_logInfo("Number of input FASTA files : %ld\n", argc - optind);
     }
 
+    if (write_index && outputFile == NULL) {
+        fprintf(stderr, "-I/--writeIndex requires an output file (-o)\n");
+        return 1;
+    }
+
     //////////////////////////////////////////////
     // Read in the sequences if joining over unaligned gaps
     //////////////////////////////////////////////
@@ -301,8 +315,8 @@ int taf_norm_main(int argc, char *argv[]) {
     //////////////////////////////////////////////
 
     FILE *input = inputFile == NULL ? stdin : fopen(inputFile, "r");
-    LW *output = LW_construct(outputFile == NULL ? stdout : fopen(outputFile, "w"), use_compression);
-    LI *li = LI_construct(input);
+    LW *output = LW_construct2(outputFile == NULL ? stdout : fopen(outputFile, "w"), use_compression, taffy_thread_number, taffy_compression_level);
+    LI *li = LI_construct2(input, taffy_thread_number, taffy_prefetch);
 
     // Pass the header line to determine parameters and write the updated taf header
     Tag *tag = taf_read_header_2(li, &run_length_encode_bases);
@@ -311,6 +325,7 @@ int taf_norm_main(int argc, char *argv[]) {
     }
     output_maf ? maf_write_header(tag, output) : taf_write_header(tag, output);
     tag_destruct(tag);
+    TaiWriter *tai_writer = write_index ? tai_writer_construct(output_maf, TAI_DEFAULT_INDEX_BLOCK_SIZE) : NULL;
 
     Alignment *alignment, *p_alignment = NULL, *p_p_alignment = NULL;
     while((alignment = get_next_taf_block(li, run_length_encode_bases)) != NULL) {
@@ -342,6 +357,9 @@ int taf_norm_main(int argc, char *argv[]) {
                 }
             }
             if (!merged) {
+                if(tai_writer != NULL) {
+                    tai_writer_add_block(tai_writer, p_alignment, repeat_coordinates_every_n_columns, output);
+                }
                 output_maf ? maf_write_block(p_alignment, output) : taf_write_block(p_p_alignment, p_alignment, run_length_encode_bases, repeat_coordinates_every_n_columns, output); // Write the maf block
                 if(p_p_alignment != NULL) {
                     alignment_destruct(p_p_alignment, 1); // Clean up the left-most block
@@ -355,6 +373,9 @@ int taf_norm_main(int argc, char *argv[]) {
         }
     }
     if(p_alignment != NULL) {
+        if(tai_writer != NULL) {
+            tai_writer_add_block(tai_writer, p_alignment, -1, output);
+        }
         output_maf ? maf_write_block(p_alignment, output) : taf_write_block(p_p_alignment, p_alignment, run_length_encode_bases, -1, output); // Write the last taf block
         alignment_destruct(p_alignment, 1);
         if(p_p_alignment != NULL) {
@@ -369,6 +390,10 @@ int taf_norm_main(int argc, char *argv[]) {
     if(inputFile != NULL) {
         fclose(input);
     }
+    if(tai_writer != NULL) {
+        tai_writer_write(tai_writer, output, outputFile);
+        tai_writer_destruct(tai_writer);
+    }
     LW_destruct(output, outputFile != NULL);
 
     if (fastas_map) {
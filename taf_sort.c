@@ -26,6 +26,7 @@ static void usage(void) {
                     "don't alter the sort of the reference row\n");
     fprintf(stderr, "-s --repeatCoordinatesEveryNColumns : Repeat TAF coordinates of each sequence at least every n columns. By default: %" PRIi64 "\n", repeat_coordinates_every_n_columns);
     fprintf(stderr, "-c --useCompression : Write the output using bgzip compression.\n");    
+    fprintf(stderr, "-I --writeIndex : Write the .tai index of the output as it is written. Requires -o\n");
     fprintf(stderr, "-l --logLevel : Set the log level\n");
     fprintf(stderr, "-h --help : Print this help message\n");
 }
@@ -48,7 +49,8 @@ stList *load_sort_file(char *sort_file) {
 
 void process_alignment_block(Alignment *pp_alignment, Alignment *p_alignment, stList *prefixes_to_filter_by,
                              stList * prefixes_to_pad, stList *prefixes_to_sort_by, stList *prefixes_to_dup_filter,
-                             bool run_length_encode_bases, bool ignore_first_row, LW *output) {
+                             bool run_length_encode_bases, bool ignore_first_row, LW *output, TaiWriter *tai_writer,
+                             LI *li) {
     if(p_alignment) {
         if(prefixes_to_filter_by) { //Remove rows matching a prefix
             alignment_filter_the_rows(p_alignment, prefixes_to_filter_by, ignore_first_row);
@@ -66,11 +68,14 @@ void process_alignment_block(Alignment *pp_alignment, Alignment *p_alignment, st
             alignment_filter_duplicate_rows(p_alignment, prefixes_to_dup_filter, ignore_first_row);
         }
         // Write the block
+        if(tai_writer != NULL) {
+            tai_writer_add_block(tai_writer, p_alignment, repeat_coordinates_every_n_columns, output);
+        }
         taf_write_block(pp_alignment, p_alignment,
                         run_length_encode_bases, repeat_coordinates_every_n_columns, output); // Write the block
     }
     if(pp_alignment != NULL) {
-        alignment_destruct(pp_alignment, 1); // Delete the left most block
+        alignment_recycle(pp_alignment, 1, li); // Done with the left most block
     }
 }
 
@@ -89,6 +94,7 @@ int taf_sort_main(int argc, char *argv[]) {
     char *dup_filter_file = NULL;
     bool ignore_first_row = 1;
     bool use_compression = 0;
+    bool write_index = 0;
 
     ///////////////////////////////////////////////////////////////////////////
     // Parse the inputs
@@ -105,11 +111,12 @@ int taf_sort_main(int argc, char *argv[]) {
                                                {"dontIgnoreFirstRow", no_argument, 0, 'r'},
                                                {"repeatCoordinatesEveryNColumns", required_argument, 0, 's'},
                                                {"useCompression", no_argument, 0, 'c'},
+                                               {"writeIndex", no_argument, 0, 'I'},
                                                {"help",       no_argument,       0, 'h'},
                                                {0, 0,                            0, 0}};
 
         int option_index = 0;
-        int64_t key = getopt_long(argc, argv, "l:i:o:n:hrf:p:d:s:c", long_options, &option_index);
+        int64_t key = getopt_long(argc, argv, "l:i:o:n:hrf:p:d:s:cI", long_options, &option_index);
         if (key == -1) {
             break;
         }
@@ -145,6 +152,9 @@ int taf_sort_main(int argc, char *argv[]) {
             case 'c':
                 use_compression = 1;
                 break;                                
+            case 'I':
+                write_index = 1;
+                break;
             case 'h':
                 usage();
                 return 0;
@@ -166,6 +176,12 @@ int taf_sort_main(int argc, char *argv[]) {
     st_logInfo("Pad file string : %s\n", pad_file);
     st_logInfo("Dup filter file string : %s\n", dup_filter_file);
     st_logInfo("Ignore first row : %s\n", ignore_first_row ? "True" : "False");
+    st_logInfo("Write index : %s\n", write_index ? "True" : "False");
+
+    if (write_index && output_file == NULL) {
+        fprintf(stderr, "-I/--writeIndex requires an output file (-o)\n");
+        return 1;
+    }
 
     //////////////////////////////////////////////
     // Read in the taf/maf blocks and sort order file
@@ -177,7 +193,7 @@ int taf_sort_main(int argc, char *argv[]) {
         fprintf(stderr, "Unable to open input file: %s\n", input_file);
         return 1;
     }
-    LI *li = LI_construct(input);
+    LI *li = LI_construct2(input, taffy_thread_number, taffy_prefetch);
 
     // Output taf
     FILE *output_fh = output_file == NULL ? stdout : fopen(output_file, "w");
@@ -185,7 +201,7 @@ int taf_sort_main(int argc, char *argv[]) {
         fprintf(stderr, "Unable to open output file: %s\n", output_file);
         return 1;
     }
-    LW *output = LW_construct(output_fh, use_compression);
+    LW *output = LW_construct2(output_fh, use_compression, taffy_thread_number, taffy_compression_level);
 
     // Sort/filter/pad files
     stList *prefixes_to_filter_by = load_sort_file(filter_file);
@@ -200,19 +216,23 @@ int taf_sort_main(int argc, char *argv[]) {
     // Write the header
     taf_write_header(tag, output);
     tag_destruct(tag);
+    // If not NULL, indexes the output as it is written
+    TaiWriter *tai_writer = write_index ? tai_writer_construct(0, TAI_DEFAULT_INDEX_BLOCK_SIZE) : NULL;
 
     // Write the alignment blocks
     Alignment *alignment, *p_alignment = NULL, *pp_alignment = NULL;
     while((alignment = taf_read_block(p_alignment, run_length_encode_bases, li)) != NULL) {
         process_alignment_block(pp_alignment, p_alignment, prefixes_to_filter_by, prefixes_to_pad,
-                                prefixes_to_sort_by, prefixes_to_dup_filter, run_length_encode_bases, ignore_first_row, output);
+                                prefixes_to_sort_by, prefixes_to_dup_filter, run_length_encode_bases, ignore_first_row, output,
+                                tai_writer, li);
         pp_alignment = p_alignment;
         p_alignment = alignment;
     }
     if(p_alignment) { // Write the final block
         process_alignment_block(pp_alignment, p_alignment, prefixes_to_filter_by, prefixes_to_pad,
-                                prefixes_to_sort_by, prefixes_to_dup_filter, run_length_encode_bases, ignore_first_row, output);
-        alignment_destruct(p_alignment, 1);
+                                prefixes_to_sort_by, prefixes_to_dup_filter, run_length_encode_bases, ignore_first_row, output,
+                                tai_writer, li);
+        alignment_recycle(p_alignment, 1, li);
     }
 
     //////////////////////////////////////////////
@@ -224,6 +244,10 @@ int taf_sort_main(int argc, char *argv[]) {
     if(input_file != NULL) {
         fclose(input);
     }
+    if(tai_writer != NULL) {
+        tai_writer_write(tai_writer, output, output_file);
+        tai_writer_destruct(tai_writer);
+    }
     LW_destruct(output, output_file != NULL);
 
     st_logInfo("taffy sort is done, %" PRIi64 " seconds have elapsed\n", time(NULL) - startTime);
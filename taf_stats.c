@@ -21,6 +21,24 @@ static void usage(void) {
     fprintf(stderr, "-h --help : Print this help message\n");
 }
 
+/*
+ * If the index summarizes the contigs, each as a single interval of contiguous blocks, print the intervals in the
+ * order of the file, as the scan of the blocks for -b would, and return true. Otherwise print nothing and return false.
+ */
+static bool print_intervals_from_index(Tai *tai) {
+    const char *name;
+    for (int64_t i = 0; i < tai->summary_number; i++) {
+        if (tai_contig_summary(tai, i, &name)->interval_number != 1) {
+            return 0;
+        }
+    }
+    for (int64_t i = 0; i < tai->summary_number; i++) {
+        const TaiContigSummary *summary = tai_contig_summary(tai, i, &name);
+        fprintf(stdout, "%s\t%" PRIi64 "\t%" PRIi64 "\n", name, summary->start, summary->end);
+    }
+    return tai->summary_number > 0;
+}
+
 int taf_stats_main(int argc, char *argv[]) {
     time_t startTime = time(NULL);
 
@@ -103,7 +121,7 @@ int taf_stats_main(int argc, char *argv[]) {
         fprintf(stderr, "Unable to open input TAF/MAF file: %s\n", taf_fn);
         return 1;
     }
-    LI *li = LI_construct(taf_fh);
+    LI *li = LI_construct2(taf_fh, taffy_thread_number, taffy_prefetch);
 
     // sniff the format
     int input_format = check_input_format(LI_peek_at_next_line(li));
@@ -120,19 +138,30 @@ int taf_stats_main(int argc, char *argv[]) {
         tag_destruct(taf_read_header_2(li, &run_length_encode_bases));
     }
 
-    // load the index if it's required by the given options
+    // load the index if it's required by the given options, or if there is one that may answer them
     bool index_required = seq_lengths;
     char *tai_fn = NULL;
     FILE *tai_fh = NULL;
     Tai *tai = NULL;
-    if (index_required) {
+    if (index_required || (seq_intervals && taf_fn != NULL)) {
         tai_fn = tai_path(taf_fn);
         tai_fh = fopen(tai_fn, "r");
-        if (tai_fh == NULL) {
+        if (tai_fh == NULL && index_required) {
             fprintf(stderr, "Required index %s not found. Please run taffy index first\n", tai_fn);
             return 1;
         }
-        tai = tai_load(tai_fh, input_format == 1);
+        if (tai_fh != NULL && !tai_is_current(tai_fh, taf_fn)) {
+            if (index_required) {
+                fprintf(stderr, "The index %s is older than the input file, so may be out of date\n", tai_fn);
+            } else { // a stale index may not match the file, so the intervals are found by reading it
+                st_logInfo("Not using the index %s, which is older than the input file\n", tai_fn);
+                fclose(tai_fh);
+                tai_fh = NULL;
+            }
+        }
+        if (tai_fh != NULL) {
+            tai = tai_load(tai_fh, input_format == 1);
+        }
     }
 
     // do the stats
@@ -145,13 +174,18 @@ int taf_stats_main(int argc, char *argv[]) {
         }
         stHash_destruct(seq_to_len);
         stList_destruct(seq_names);
+    } else if (seq_intervals && tai != NULL && print_intervals_from_index(tai)) {
+        st_logInfo("Printed the sequence intervals from the summaries of the contigs in the index\n");
     } else if (seq_intervals) {
         Alignment *alignment = NULL;
         Alignment *p_alignment = NULL;
         char *cur_seq = NULL;
         int64_t cur_start = -1;
         int64_t cur_end = 0;
-        while((alignment = taf_read_block(p_alignment, run_length_encode_bases, li)) != NULL) {
+        // If the file is indexed and we have threads, parse it in parallel
+        TaiReader *tai_reader = tai_reader_open(taf_fn, li, run_length_encode_bases, taffy_thread_number);
+        while((alignment = tai_reader != NULL ? tai_reader_next(tai_reader) :
+                           taf_read_block(p_alignment, run_length_encode_bases, li)) != NULL) {
             if (alignment->row_number > 0) {
                 if (!cur_seq || strcmp(cur_seq, alignment->row->sequence_name) != 0 || alignment->row->start != cur_end) {
                     if (cur_seq) {
@@ -166,12 +200,15 @@ int taf_stats_main(int argc, char *argv[]) {
                 }
             }
             if (p_alignment) {
-                alignment_destruct(p_alignment, true);
+                alignment_recycle(p_alignment, true, li);
             }
             p_alignment = alignment;
         }
         if (p_alignment) {
-            alignment_destruct(p_alignment, true);
+            alignment_recycle(p_alignment, true, li);
+        }
+        if (tai_reader != NULL) {
+            tai_reader_destruct(tai_reader);
         }
         if (cur_seq) {
             fprintf(stdout, "%s\t%" PRIi64 "\t%" PRIi64 "\n", cur_seq, cur_start, cur_end);
@@ -183,8 +220,14 @@ int taf_stats_main(int argc, char *argv[]) {
     if(alignment_stats) {
         int64_t total_blocks = 0, total_columns = 0, total_aligned_bases = 0, total_gaps = 0, total_column_depth = 0;
         Alignment *alignment, *p_alignment = NULL;
+        // If the file is an indexed TAF and we have threads, parse it in parallel
+        TaiReader *tai_reader = input_format == 0 ? tai_reader_open(taf_fn, li, run_length_encode_bases,
+                                                                    taffy_thread_number) : NULL;
         while(1) {
-            if(input_format == 0) {
+            if(tai_reader != NULL) {
+                alignment = tai_reader_next(tai_reader);
+            }
+            else if(input_format == 0) {
                 alignment = taf_read_block(p_alignment, run_length_encode_bases, li);
             }
             else {
@@ -196,24 +239,37 @@ int taf_stats_main(int argc, char *argv[]) {
             total_blocks++;
             total_columns += alignment_length(alignment);
             total_column_depth += alignment_length(alignment) * alignment->row_number;
-            Alignment_Row *row = alignment->row;
-            while (row != NULL) {
-                for (int64_t i = 0; i < alignment_length(alignment); i++) {
-                    if (row->bases[i] == '-') {
-                        total_gaps++;
-                    } else {
-                        total_aligned_bases++;
+            if (alignment->column_runs != NULL) { // Count the gaps from the runs, if the input was run length encoded
+                int64_t gaps = 0;
+                for (int64_t i = 0; i < alignment->column_run_starts[alignment->column_number]; i++) {
+                    gaps += alignment->column_runs[i].base == '-' ? alignment->column_runs[i].length : 0;
+                }
+                total_gaps += gaps;
+                total_aligned_bases += alignment->column_number * alignment->row_number - gaps;
+            } else {
+                alignment_make_row_bases(alignment);
+                Alignment_Row *row = alignment->row;
+                while (row != NULL) {
+                    for (int64_t i = 0; i < alignment_length(alignment); i++) {
+                        if (row->bases[i] == '-') {
+                            total_gaps++;
+                        } else {
+                            total_aligned_bases++;
+                        }
                     }
+                    row = row->n_row;
                 }
-                row = row->n_row;
             }
             if(p_alignment != NULL) {
-                alignment_destruct(p_alignment, 1);
+                alignment_recycle(p_alignment, 1, li);
             }
             p_alignment = alignment;
         }
         if(p_alignment != NULL) {
-            alignment_destruct(p_alignment, 1);
+            alignment_recycle(p_alignment, 1, li);
+        }
+        if(tai_reader != NULL) {
+            tai_reader_destruct(tai_reader);
         }
         fprintf(stdout, "Total blocks:\t%" PRIi64 "\n", total_blocks);
         fprintf(stdout, "Total columns:\t%" PRIi64 "\n", total_columns);
@@ -229,8 +285,8 @@ int taf_stats_main(int argc, char *argv[]) {
     // Cleanup
     //////////////////////////////////////////////
 
-    if (index_required) {
-        free(tai_fn);
+    free(tai_fn);
+    if (tai != NULL) {
         tai_destruct(tai);
     }
     
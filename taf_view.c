@@ -24,9 +24,12 @@ static void usage(void) {
     fprintf(stderr, "-o --outputFile : Output file. If not specified outputs to stdout\n");
     fprintf(stderr, "-m --maf : Output in MAF format [default=TAF format]\n");
     fprintf(stderr, "-p --paf : Output in all-to-one (referenced on first row) PAF format [default=TAF format]\n");
-    fprintf(stderr, "-P --paf-all : Output in all-to-all PAF format [default=TAF format]\n");
+    fprintf(stderr, "-P --paf-all : Output in all-to-all PAF format, omitting pairs of rows with nothing aligned [default=TAF format]\n");
     fprintf(stderr, "-C --cs : Output PAF cigars in cs instead of cg format\n");
     fprintf(stderr, "-r --region  : Print only SEQ:START-END, where SEQ is a row-0 sequence name, and START-END are 0-based open-ended like BED\n");
+    fprintf(stderr, "-R --regions : Print only the regions of the given BED file, which must be of row-0 sequences, sorting and merging overlapping regions. "
+                    "With threads (--threads), regions of different sequences are read in parallel\n");
+    fprintf(stderr, "-S --splitRegions : With -R, print each region, unmerged, to its own file, OUTPUT.SEQ_START_END.FORMAT, where OUTPUT is given by -o\n");
     fprintf(stderr, "-s --repeatCoordinatesEveryNColumns : Repeat TAF coordinates of each sequence at least every n columns. By default: %" PRIi64 "\n", repeat_coordinates_every_n_columns);
     fprintf(stderr, "-u --runLengthEncodeBases : Run length encode output bases in TAF\n");
     fprintf(stderr, "-a --showOnlyReferenceDifferences : Replace matches with the reference (first row) with a * character\n");
@@ -36,6 +39,7 @@ static void usage(void) {
     fprintf(stderr, "-t --phylogeny [newick tree file] : Specify a file containing the phylogeny for the alignment, where species names must be prefixes of sequence names\n");
     fprintf(stderr, "-d --omitCoordinates : When printing TAF, just print the columns omitting the coordinates. THIS IS FOR VISUALIZATION ONLY - DOES NOT PRODUCE A VALID TAF \n");
     fprintf(stderr, "-c --useCompression : Write the output using bgzip compression.\n");
+    fprintf(stderr, "-I --writeIndex : Write the .tai index of the TAF or MAF output as it is written. Requires -o\n");
     fprintf(stderr, "-n --nameMapFile : Apply the given two-column tab-separated name mapping to all assembly names in alignment\n");
     fprintf(stderr, "-l --logLevel : Set the log level\n");
     fprintf(stderr, "-h --help : Print this help message\n");
@@ -72,6 +76,225 @@ static void modify_alignment(Alignment *alignment) {
     }
 }
 
+/*
+ * The output options of view, for the functions below that write blocks for a BlockWriter
+ */
+typedef struct _view_output {
+    bool taf_output;
+    bool maf_output;
+    bool run_length_encode_bases;
+    bool color_bases;
+    bool omit_coordinates;
+    PafWriter *paf_writer; // If not NULL, writes all-to-all PAF with its own threads
+    bool all_to_all_paf;
+    bool paf_cs;
+    TaiWriter *tai_writer; // If not NULL, indexes the output as it is written to lw
+    LW *lw;
+} View_Output;
+
+static void prepare_block(Alignment *alignment, void *extra) {
+    View_Output *output = extra;
+    if (output->taf_output && !output->omit_coordinates) {
+        taf_update_coordinates_reported(alignment, repeat_coordinates_every_n_columns);
+    }
+}
+
+static void index_block(Alignment *alignment, void *extra) {
+    View_Output *output = extra;
+    if (output->tai_writer != NULL) {
+        tai_writer_add_block(output->tai_writer, alignment, repeat_coordinates_every_n_columns, output->lw);
+    }
+}
+
+static void encode_block(Alignment *p_alignment, Alignment *alignment, LW *lw, void *extra) {
+    View_Output *output = extra;
+    if (output->taf_output) {
+        taf_write_block3(p_alignment, alignment, output->run_length_encode_bases, repeat_coordinates_every_n_columns,
+                         lw, output->color_bases, output->omit_coordinates);
+    } else if (output->maf_output) {
+        maf_write_block2(alignment, lw, output->color_bases);
+    } else if (output->paf_writer != NULL) {
+        paf_writer_write_block(output->paf_writer, alignment);
+    } else {
+        paf_write_block(alignment, lw, output->all_to_all_paf, output->paf_cs);
+    }
+}
+
+/*
+ * Write the header to lw and make the writer of the blocks following it, making the writers of view_output that belong
+ * to lw. If li is not NULL, the blocks written are recycled to it.
+ */
+static BlockWriter *view_output_open(View_Output *view_output, LW *lw, Tag *tag, bool write_index, LI *li) {
+    if (view_output->maf_output) {
+        maf_write_header(tag, lw);
+    } else if (view_output->taf_output) {
+        taf_write_header(tag, lw);
+    }
+    view_output->lw = lw;
+    view_output->tai_writer = write_index ? tai_writer_construct(view_output->maf_output, TAI_DEFAULT_INDEX_BLOCK_SIZE) : NULL;
+    view_output->paf_writer = NULL;
+    if (!view_output->taf_output && !view_output->maf_output && view_output->all_to_all_paf) {
+        view_output->paf_writer = paf_writer_construct(lw, view_output->all_to_all_paf, view_output->paf_cs,
+                                                       taffy_thread_number);
+    }
+    // Each block is encoded on the writer's threads, except for all-to-all PAF, which writes the pairs of rows of each
+    // block in parallel
+    return block_writer_construct(lw, prepare_block, encode_block, index_block, view_output, li,
+                                  view_output->paf_writer != NULL ? 1 : taffy_thread_number, taffy_blocks_in_flight);
+}
+
+/*
+ * Finish writing the blocks to the output, writing its index if there is one, output_file being the file of the output
+ */
+static void view_output_close(View_Output *view_output, BlockWriter *block_writer, char *output_file) {
+    block_writer_destruct(block_writer);
+    if (view_output->paf_writer != NULL) {
+        paf_writer_destruct(view_output->paf_writer);
+    }
+    if (view_output->tai_writer != NULL) {
+        tai_writer_write(view_output->tai_writer, view_output->lw, output_file);
+        tai_writer_destruct(view_output->tai_writer);
+    }
+}
+
+static int region_cmp(const void *a, const void *b) {
+    const TaiRegion *r1 = a, *r2 = b;
+    int i = strcmp(r1->sequence, r2->sequence);
+    if (i != 0) {
+        return i;
+    }
+    return r1->start < r2->start ? -1 : (r1->start > r2->start ? 1 : (r1->length < r2->length ? -1 : r1->length > r2->length));
+}
+
+/*
+ * Load the regions of a BED file, applying the name mapping (if not NULL) to their sequences as for a single region.
+ * The regions are returned sorted by sequence and start and, if merge is true, with overlapping or abutting regions
+ * merged.
+ */
+static TaiRegion *load_regions(char *regions_file, stHash *genome_name_map, bool merge, int64_t *region_number) {
+    FILE *fh = fopen(regions_file, "r");
+    if (fh == NULL) {
+        fprintf(stderr, "Unable to open regions file: %s\n", regions_file);
+        exit(1);
+    }
+    LI *li = LI_construct(fh);
+    int64_t capacity = 16;
+    TaiRegion *regions = st_malloc(capacity * sizeof(TaiRegion));
+    *region_number = 0;
+    char *line;
+    while ((line = LI_get_next_line(li)) != NULL) {
+        stList *tokens = stString_split(line);
+        if (stList_length(tokens) == 0 || ((char *)stList_get(tokens, 0))[0] == '#' ||
+            strcmp(stList_get(tokens, 0), "track") == 0 || strcmp(stList_get(tokens, 0), "browser") == 0) {
+            stList_destruct(tokens);
+            free(line);
+            continue;
+        }
+        int64_t start, end;
+        char c;
+        if (stList_length(tokens) < 3 || sscanf(stList_get(tokens, 1), "%" SCNi64 "%c", &start, &c) != 1 ||
+            sscanf(stList_get(tokens, 2), "%" SCNi64 "%c", &end, &c) != 1 || start < 0 || end < start) {
+            fprintf(stderr, "Invalid line in regions file %s: %s\n", regions_file, line);
+            exit(1);
+        }
+        if (*region_number == capacity) {
+            capacity *= 2;
+            regions = st_realloc(regions, capacity * sizeof(TaiRegion));
+        }
+        TaiRegion *region = &regions[(*region_number)++];
+        char *mapped_sequence = genome_name_map != NULL ? apply_genome_name_mapping(genome_name_map, stList_get(tokens, 0)) : NULL;
+        region->sequence = mapped_sequence != NULL ? mapped_sequence : stString_copy(stList_get(tokens, 0));
+        region->start = start;
+        region->length = end - start;
+        stList_destruct(tokens);
+        free(line);
+    }
+    LI_destruct(li);
+    fclose(fh);
+
+    qsort(regions, *region_number, sizeof(TaiRegion), region_cmp);
+    if (merge && *region_number > 0) {
+        int64_t j = 0;
+        for (int64_t i = 1; i < *region_number; i++) {
+            if (strcmp(regions[i].sequence, regions[j].sequence) == 0 &&
+                regions[i].start <= regions[j].start + regions[j].length) {
+                int64_t end = regions[i].start + regions[i].length;
+                if (end > regions[j].start + regions[j].length) {
+                    regions[j].length = end - regions[j].start;
+                }
+                free(regions[i].sequence);
+            } else {
+                regions[++j] = regions[i];
+            }
+        }
+        *region_number = j + 1;
+    }
+    return regions;
+}
+
+/*
+ * The file a region is written to with --splitRegions
+ */
+static char *region_output_file(char *output_file, TaiRegion *region, View_Output *view_output) {
+    return stString_print("%s.%s_%" PRIi64 "_%" PRIi64 ".%s", output_file, region->sequence, region->start,
+                          region->start + region->length,
+                          view_output->taf_output ? "taf" : (view_output->maf_output ? "maf" : "paf"));
+}
+
+/*
+ * The writing of the blocks of a batch of regions, to a single output or, if split, to an output per region
+ */
+typedef struct _region_output {
+    TaiRegion *regions;
+    int64_t region_number;
+    int64_t region; // The region being written
+    bool split;
+    char *output_file;
+    bool use_compression;
+    Tag *tag;
+    bool write_index;
+    View_Output view_output;
+    LW *lw;
+    BlockWriter *block_writer;
+    char *region_file; // If split, the file of the region being written
+    bool region_written; // Set once a block of the region has been written
+} Region_Output;
+
+/*
+ * Move on to the next region, finishing the output of the last if split
+ */
+static void region_output_next(Region_Output *output) {
+    if (output->region >= 0) {
+        TaiRegion *region = &output->regions[output->region];
+        if (!output->region_written) {
+            fprintf(stderr, "Region %s:%" PRIi64 "-%" PRIi64 " not found in taffy index, skipping\n", region->sequence,
+                    region->start, region->start + region->length);
+        }
+        if (output->split) {
+            view_output_close(&output->view_output, output->block_writer, output->region_file);
+            LW_destruct(output->lw, 1);
+            free(output->region_file);
+        }
+    }
+    if (++output->region < output->region_number && output->split) {
+        output->region_file = region_output_file(output->output_file, &output->regions[output->region],
+                                                 &output->view_output);
+        FILE *fh = fopen(output->region_file, "w");
+        if (fh == NULL) {
+            fprintf(stderr, "Unable to open output file: %s\n", output->region_file);
+            exit(1);
+        }
+        output->lw = LW_construct2(fh, output->use_compression, taffy_thread_number, taffy_compression_level);
+        output->block_writer = view_output_open(&output->view_output, output->lw, output->tag, output->write_index, NULL);
+    }
+    output->region_written = 0;
+}
+
+static void region_output_write(Region_Output *output, Alignment *alignment) {
+    block_writer_write(output->block_writer, alignment);
+    output->region_written = 1;
+}
+
 int taf_view_main(int argc, char *argv[]) {
     time_t startTime = time(NULL);
 
@@ -87,11 +310,14 @@ int taf_view_main(int argc, char *argv[]) {
     bool all_to_all_paf = false;
     bool paf_cs = false;
     char *region = NULL;
+    char *regions_file = NULL;
+    bool split_regions = false;
     bool use_compression = false;
     char *nameMapFile = NULL;
     char *phylogeny_file = NULL;
     static bool color_bases = false;
     bool omit_coordinates = false;
+    bool write_index = false;
 
     ///////////////////////////////////////////////////////////////////////////
     // Parse the inputs
@@ -113,13 +339,16 @@ int taf_view_main(int argc, char *argv[]) {
                                                 { "omitCoordinates", required_argument, 0, 'd' },
                                                 { "repeatCoordinatesEveryNColumns", required_argument, 0, 's' },
                                                 { "region", required_argument, 0, 'r' },
+                                                { "regions", required_argument, 0, 'R' },
+                                                { "splitRegions", no_argument, 0, 'S' },
                                                 { "useCompression", no_argument, 0, 'c' },
                                                 { "nameMapFile", required_argument, 0, 'n' },
+                                                { "writeIndex", no_argument, 0, 'I' },
                                                 { "help", no_argument, 0, 'h' },
                                                 { 0, 0, 0, 0 } };
 
         int option_index = 0;
-        int64_t key = getopt_long(argc, argv, "l:i:o:mPpCaucs:r:n:habxt:d", long_options, &option_index);
+        int64_t key = getopt_long(argc, argv, "l:i:o:mPpCaucs:r:R:Sn:habxt:dI", long_options, &option_index);
         if (key == -1) {
             break;
         }
@@ -170,12 +399,21 @@ int taf_view_main(int argc, char *argv[]) {
             case 'r':
                 region = optarg;
                 break;
+            case 'R':
+                regions_file = optarg;
+                break;
+            case 'S':
+                split_regions = 1;
+                break;
             case 'c':
                 use_compression = 1;
                 break;
             case 'n':
                 nameMapFile = optarg;
                 break;
+            case 'I':
+                write_index = 1;
+                break;
             case 'h':
                 usage();
                 return 0;
@@ -211,6 +449,22 @@ int taf_view_main(int argc, char *argv[]) {
         fprintf(stderr, "-C/--cs cannot be used without either -p or -P\n");
         return 1;
     }
+    if (region != NULL && regions_file != NULL) {
+        fprintf(stderr, "-r/--region and -R/--regions cannot be used together\n");
+        return 1;
+    }
+    if (regions_file != NULL && inputFile == NULL) {
+        fprintf(stderr, "-R/--regions requires an indexed input file (-i)\n");
+        return 1;
+    }
+    if (split_regions && (regions_file == NULL || outputFile == NULL)) {
+        fprintf(stderr, "-S/--splitRegions requires -R/--regions and an output file (-o)\n");
+        return 1;
+    }
+    if (write_index && (outputFile == NULL || paf_output || color_bases || omit_coordinates)) {
+        fprintf(stderr, "-I/--writeIndex requires an output file (-o) of valid TAF or MAF\n");
+        return 1;
+    }
 
     FILE *input = inputFile == NULL ? stdin : fopen(inputFile, "r");
     if (input == NULL) {
@@ -218,8 +472,9 @@ int taf_view_main(int argc, char *argv[]) {
         return 1;
     }
 
-    FILE *output_fh = outputFile == NULL ? stdout : fopen(outputFile, "w");
-    if (output_fh == NULL) {
+    // With --splitRegions the output file is the prefix of the file of each region
+    FILE *output_fh = split_regions ? NULL : (outputFile == NULL ? stdout : fopen(outputFile, "w"));
+    if (output_fh == NULL && !split_regions) {
         fprintf(stderr, "Unable to open output file: %s\n", outputFile);
         return 1;
     }
@@ -239,8 +494,9 @@ int taf_view_main(int argc, char *argv[]) {
         genome_name_map = load_genome_name_mapping(nameMapFile);
     }
     
-    LW *output = LW_construct(output_fh, use_compression);
-    LI *li = LI_construct(input);
+    LW *output = split_regions ? NULL : LW_construct2(output_fh, use_compression, taffy_thread_number,
+                                                      taffy_compression_level);
+    LI *li = LI_construct2(input, taffy_thread_number, taffy_prefetch);
 
     // sniff the format
     int input_format = check_input_format(LI_peek_at_next_line(li));
@@ -274,17 +530,29 @@ int taf_view_main(int argc, char *argv[]) {
             tag = tag_construct("run_length_encode_bases", "1", tag);
         }
     }
-    if (maf_output) {
-        maf_write_header(tag, output);
-    } else if (taf_output) {
-        taf_write_header(tag, output);
+    // Without a region, the whole file is parsed in parallel if it is TAF and indexed, or MAF, and we have threads
+    TaiReader *tai_reader = NULL;
+    MafReader *maf_reader = NULL;
+    if (!region && !regions_file) {
+        if (taf_input) {
+            tai_reader = tai_reader_open(inputFile, li, run_length_encode_input_bases, taffy_thread_number);
+        } else {
+            maf_reader = maf_reader_open(li, taffy_thread_number);
+        }
     }
-    tag_destruct(tag);
-
-    // three cases below:
+    // Each block is given to the writer once the block after it has been read (and linked to it), and is then encoded
+    // on the writer's threads. Blocks read in parallel are not read from li, so are not recycled to it.
+    bool parallel_read = tai_reader != NULL || maf_reader != NULL || (regions_file != NULL && taffy_thread_number > 1);
+    View_Output view_output = { taf_output, maf_output, run_length_encode_output_bases, color_bases, omit_coordinates,
+                                NULL, all_to_all_paf, paf_cs, NULL, NULL };
+    BlockWriter *block_writer = output == NULL ? NULL :
+                                view_output_open(&view_output, output, tag, write_index, parallel_read ? NULL : li);
+
+    // four cases below:
     // 1) generic maf/taf index lookup if (region)
-    // 2) scan whole taf
-    // 3) scan whole maf    
+    // 2) index lookup of each of a batch of regions if (regions_file)
+    // 3) scan whole taf
+    // 4) scan whole maf
     if (region) {
         int64_t region_start;
         int64_t region_length;
@@ -309,13 +577,34 @@ int taf_view_main(int argc, char *argv[]) {
             fprintf(stderr, "Index %s not found. Please run taffy index first\n", tai_fn);
             return 1;
         }
+        if (!tai_is_current(tai_fh, inputFile)) {
+            fprintf(stderr, "The index %s is older than the input file, so may be out of date\n", tai_fn);
+        }
 
         Tai* tai = tai_load(tai_fh, !taf_input);
 
         TaiIt *tai_it = tai_iterator(tai, li, run_length_encode_input_bases, region_seq, region_start, region_length);
+        Tai *tsi = NULL;
+        char *tsi_fn = tai_secondary_path(inputFile);
+        FILE *tsi_fh = NULL;
+        if (!tai_has_next(tai_it) && (tsi_fh = fopen(tsi_fn, "r")) != NULL && !tai_is_current(tsi_fh, inputFile)) {
+            fprintf(stderr, "The secondary index %s is older than the input file, so is not used\n", tsi_fn);
+            fclose(tsi_fh);
+            tsi_fh = NULL;
+        }
+        if (tsi_fh != NULL) {
+            // the region is not of the reference, so query the secondary index, of every sequence, if there is one
+            st_logInfo("Region not found in the index, querying the secondary index %s\n", tsi_fn);
+            tsi = tai_load_secondary(tsi_fh, !taf_input);
+            tai_iterator_destruct(tai_it);
+            tai_it = tai_secondary_iterator(tsi, li, run_length_encode_input_bases, region_seq, region_start,
+                                            region_length);
+        }
         if (!tai_has_next(tai_it)) {
             fprintf(stderr, "Region %s:%" PRIi64 "-%" PRIi64 " not found in taffy index\n", region_seq, region_start,
                     region_start + region_length);
+            view_output_close(&view_output, block_writer, outputFile); // Stop the writer's threads before freeing output
+            LW_destruct(output, outputFile != NULL); // Write out the header
             return 1;
         }
         Alignment *alignment = NULL;
@@ -328,61 +617,129 @@ int taf_view_main(int argc, char *argv[]) {
             if (genome_name_map) {
                 apply_genome_name_mapping_to_alignment(genome_name_map, alignment);
             }
-            if (taf_output) {
-                taf_write_block2(p_alignment, alignment, run_length_encode_output_bases,
-                                 repeat_coordinates_every_n_columns, output, color_bases, omit_coordinates);
-            } else if (maf_output) {
-                maf_write_block2(alignment, output, color_bases);
-            } else {
-                assert(paf_output == true);
-                paf_write_block(alignment, output, all_to_all_paf, paf_cs);
-            }
-            if (p_alignment) {
-                alignment_destruct(p_alignment, true);
+            if (p_alignment != NULL) {
+                block_writer_write(block_writer, p_alignment);
             }
             p_alignment = alignment;
         }
-        if (p_alignment) {
-            alignment_destruct(p_alignment, true);
+        if (p_alignment != NULL) {
+            block_writer_write(block_writer, p_alignment);
         }
 
+        tai_iterator_destruct(tai_it);
         tai_destruct(tai);
+        if (tsi != NULL) {
+            tai_destruct(tsi);
+        }
 
         if(tai_fh != NULL) {
             fclose(tai_fh);
         }
-        free(tai_fn);        
+        if(tsi_fh != NULL) {
+            fclose(tsi_fh);
+        }
+        free(tai_fn);
+        free(tsi_fn);
+    } else if (regions_file) {
+        int64_t region_number;
+        TaiRegion *regions = load_regions(regions_file, genome_name_map, !split_regions, &region_number);
+        st_logInfo("Loaded %" PRIi64 " regions\n", region_number);
+
+        char *tai_fn = tai_path(inputFile);
+        FILE *tai_fh = fopen(tai_fn, "r");
+        if (tai_fh == NULL) {
+            fprintf(stderr, "Index %s not found. Please run taffy index first\n", tai_fn);
+            return 1;
+        }
+        Tai *tai = tai_load(tai_fh, !taf_input);
+        fclose(tai_fh);
+        free(tai_fn);
+
+        Region_Output region_output = { regions, region_number, -1, split_regions, outputFile, use_compression, tag,
+                                        write_index, view_output, output, block_writer, NULL, 0 };
+        Alignment *alignment = NULL;
+        Alignment *p_alignment = NULL;
+        if (taffy_thread_number > 1) {
+            // read the regions of different sequences in parallel, each worker reading through its own file handle,
+            // and write their blocks here in order
+            TaiRegionReader *reader = tai_region_reader_construct(tai, inputFile, regions, region_number,
+                                                                  run_length_encode_input_bases, taffy_thread_number);
+            int64_t i;
+            while ((alignment = tai_region_reader_next(reader, &i)) != NULL) {
+                modify_alignment(alignment); // Make any changes to the alignment for output
+
+                // apply the name mapping to the alignment block
+                if (genome_name_map) {
+                    apply_genome_name_mapping_to_alignment(genome_name_map, alignment);
+                }
+                while (region_output.region < i) {
+                    region_output_next(&region_output);
+                }
+                region_output_write(&region_output, alignment);
+            }
+            tai_region_reader_destruct(reader);
+        } else {
+            // read the regions in turn, reading on from one to the next where they share anchors of the index
+            TaiIt *tai_it = tai_regions_iterator(tai, run_length_encode_input_bases);
+            while (region_output.region + 1 < region_number) {
+                region_output_next(&region_output);
+                TaiRegion *r = &regions[region_output.region];
+                st_logInfo("Region: contig=%s start=%" PRIi64 " length=%" PRIi64 "\n", r->sequence, r->start, r->length);
+                tai_iterator_next_region(tai_it, tai, li, r->sequence, r->start, r->length);
+                p_alignment = NULL;
+                while ((alignment = tai_next(tai_it, li)) != NULL) {
+                    modify_alignment(alignment); // Make any changes to the alignment for output
+
+                    // apply the name mapping to the alignment block
+                    if (genome_name_map) {
+                        apply_genome_name_mapping_to_alignment(genome_name_map, alignment);
+                    }
+                    if (p_alignment != NULL) {
+                        region_output_write(&region_output, p_alignment);
+                    }
+                    p_alignment = alignment;
+                }
+                if (p_alignment != NULL) {
+                    region_output_write(&region_output, p_alignment);
+                }
+            }
+            tai_iterator_destruct(tai_it);
+        }
+        while (region_output.region < region_number) { // finish the last region, and any after it with no blocks
+            region_output_next(&region_output);
+        }
+        tai_destruct(tai);
+        for (int64_t i = 0; i < region_number; i++) {
+            free(regions[i].sequence);
+        }
+        free(regions);
     } else if (taf_input) {
         Alignment *alignment = NULL;
         Alignment *p_alignment = NULL;        
-        while((alignment = taf_read_block(p_alignment, run_length_encode_input_bases, li)) != NULL) {
+        while((alignment = tai_reader != NULL ? tai_reader_next(tai_reader) :
+                           taf_read_block(p_alignment, run_length_encode_input_bases, li)) != NULL) {
             modify_alignment(alignment); // Make any changes to the alignment for output
 
             // apply the name mapping to the alignment block
             if (genome_name_map) {
                 apply_genome_name_mapping_to_alignment(genome_name_map, alignment);
             }
-            if (taf_output) {
-                taf_write_block2(p_alignment, alignment, run_length_encode_output_bases,
-                                 repeat_coordinates_every_n_columns, output, color_bases, omit_coordinates);
-            } else if (maf_output) {
-                maf_write_block2(alignment, output, color_bases);
-            } else {
-                assert(paf_output == true);
-                paf_write_block(alignment, output, all_to_all_paf, paf_cs);
-            }                    
-            if (p_alignment) {
-                alignment_destruct(p_alignment, true);
+            if (p_alignment != NULL) {
+                block_writer_write(block_writer, p_alignment);
             }
             p_alignment = alignment;
         }
-        if (p_alignment) {
-            alignment_destruct(p_alignment, true);
-        }            
+        if (p_alignment != NULL) {
+            block_writer_write(block_writer, p_alignment);
+        }
+        if (tai_reader != NULL) {
+            tai_reader_destruct(tai_reader);
+        }
     } else {
         assert(maf_input == true);
+        // The blocks parsed in parallel are linked and written in order here
         Alignment *alignment, *p_alignment = NULL;
-        while((alignment = maf_read_block(li)) != NULL) {
+        while((alignment = maf_reader != NULL ? maf_reader_next(maf_reader) : maf_read_block(li)) != NULL) {
             modify_alignment(alignment); // Make any changes to the alignment for output
 
             // apply the name mapping to the alignment block
@@ -391,23 +748,15 @@ int taf_view_main(int argc, char *argv[]) {
             }            
             if(p_alignment != NULL) {
                 alignment_link_adjacent(p_alignment, alignment, 1);
-            }
-            if (taf_output) {
-                taf_write_block2(p_alignment, alignment, run_length_encode_output_bases,
-                                 repeat_coordinates_every_n_columns, output, color_bases, omit_coordinates);
-            } else if (maf_output) {
-                maf_write_block2(alignment, output, color_bases);
-            } else {
-                assert(paf_output == true);
-                paf_write_block(alignment, output, all_to_all_paf, paf_cs);
-            }
-            if(p_alignment != NULL) {
-                alignment_destruct(p_alignment, 1);
+                block_writer_write(block_writer, p_alignment);
             }
             p_alignment = alignment;
         }
         if(p_alignment != NULL) {
-            alignment_destruct(p_alignment, 1);
+            block_writer_write(block_writer, p_alignment);
+        }
+        if(maf_reader != NULL) {
+            maf_reader_destruct(maf_reader);
         }
     }
     
@@ -415,11 +764,17 @@ int taf_view_main(int argc, char *argv[]) {
     // Cleanup
     //////////////////////////////////////////////
 
+    if(block_writer != NULL) {
+        view_output_close(&view_output, block_writer, outputFile); // Before LI_destruct, as it recycles the blocks to li
+    }
+    tag_destruct(tag);
     LI_destruct(li);
     if(inputFile != NULL) {
         fclose(input);
     }
-    LW_destruct(output, outputFile != NULL);
+    if(output != NULL) {
+        LW_destruct(output, outputFile != NULL);
+    }
 
     if (genome_name_map != NULL) {
         stHash_destruct(genome_name_map);
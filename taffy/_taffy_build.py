@@ -6,10 +6,7 @@ ffibuilder = FFI()
 ffibuilder.cdef("""
     typedef struct BGZF BGZF;
 
-    typedef struct _LW {
-        FILE *fh;
-        BGZF *bgzf;
-    } LW;
+    typedef struct _LW LW;
     
     LW *LW_construct(FILE *fh, bool use_compression);
     
@@ -23,12 +20,7 @@ ffibuilder.cdef("""
     
     int fclose(FILE *stream);
 
-    typedef struct _LI {
-        BGZF *bgzf;
-        char *line;
-        int64_t prev_pos; // position before reading the current buffer
-        int64_t pos;      // position after reading the curent buffer    
-    } LI;
+    typedef struct _LI LI;
     
     LI *LI_construct(FILE *fh);
 
@@ -45,12 +37,37 @@ ffibuilder.cdef("""
     };
     
     typedef struct _row Alignment_Row;
+
+    typedef struct _alignment_arena Alignment_Arena; // Allocator for the rows of a block, see alignment_row_construct
+
+    typedef struct _base_run { // A run of identical bases down a column of an alignment
+        char base;
+        int64_t length;
+    } Base_Run;
     
     typedef struct _alignment {
         int64_t row_number; // Convenient counter of number rows in the alignment
         int64_t column_number; // Convenient counter of number of columns in this alignment
         Alignment_Row *row; // An alignment is just a sequence of rows
-        Tag **column_tags; // The tags for each column, each stored as a sequence of tags
+        Tag **column_tags; // The tags for each column, each stored as a sequence of tags. NULL if the tags have
+        // not yet been parsed, see alignment_get_column_tags
+        char *column_tag_text; // If not NULL, the unparsed text of the tags of the columns as read
+        int64_t *column_tag_text_starts; // If column_tag_text is not NULL, the tags of column i are the text from
+        // column_tag_text[column_tag_text_starts[i]] up to column_tag_text[column_tag_text_starts[i+1]]
+        char *bases; // If not NULL, a row major matrix of the bases of the rows, each row's bases (NUL terminated)
+        // following the previous row's. Rows whose bases_matrix is this matrix have bases that are views into it
+        char *column_bases; // If not NULL, a column major (column_number x row_number, not NUL terminated) copy of
+        // the bases, as read by taf_read_block or built on demand by alignment_get_column_bases
+        bool row_bases_pending; // If true, the bases of the rows are yet to be made from column_bases (or from
+        // column_runs if column_bases is NULL), see alignment_make_row_bases
+        Base_Run *column_runs; // If not NULL, the bases of the columns as runs, as read from run length encoded input
+        // or built on demand by alignment_get_column_runs
+        int64_t *column_run_starts; // If column_runs is not NULL, the runs of column i are column_runs[column_run_starts[i]]
+        // up to (but excluding) column_runs[column_run_starts[i+1]]
+        int64_t column_tags_size, column_tag_text_size, column_tag_text_starts_size, column_bases_size, column_runs_size,
+                column_run_starts_size; // The sizes in bytes allocated for the buffers above (or less, if not known),
+        // at which alignment_recycle gives them back to be reused
+        Alignment_Arena *arena; // If not NULL, the arena the rows of the block are allocated from
     } Alignment;
     
     struct _row { // Each row encodes the information about an aligned sequence
@@ -65,6 +82,11 @@ ffibuilder.cdef("""
         Alignment_Row *n_row;  // the next row in the alignment
         int64_t bases_since_coordinates_reported; // this number is used by taf write coordinates to
         // indicate how many bases ago were the row's coordinates printed
+        char *bases_matrix; // If not NULL, bases is a view into this reference counted matrix (see
+        // alignment_bases_matrix_construct) rather than being owned by the row
+        bool sequence_name_interned; // If true, sequence_name is from sequence_name_intern, and so is shared rather
+        // than being owned by the row
+        Alignment_Arena *arena; // If not NULL, the row was allocated from this arena by alignment_row_construct
     };
     
     /*
@@ -99,6 +121,12 @@ ffibuilder.cdef("""
      */
     void alignment_destruct(Alignment *alignment, bool cleanup_rows);
     
+    /*
+     * As alignment_destruct, but keep the allocations of the alignment with the line iterator it was read from, to be
+     * reused by the next block read from it
+     */
+    void alignment_recycle(Alignment *alignment, bool cleanup_rows, LI *li);
+    
     /*
      * Use the O(ND) alignment to diff the rows between two alignments and connect together their rows
      * so that we can determine which rows in the right_alignment are a continuation of rows in the
@@ -137,12 +165,23 @@ ffibuilder.cdef("""
      */
     char *alignment_row_to_string(Alignment_Row *row);
     
+    /*
+     * Get the tags of the columns of the alignment, parsing them first if they were read but have not yet been
+     * parsed. Use this rather than reading alignment->column_tags directly.
+     */
+    Tag **alignment_get_column_tags(Alignment *alignment);
+
     /*
      * Read a column of the alignment into the buffer. The buffer must be initialized and be at least
      * of length alignment->row_number.
      */
     void alignment_get_column_in_buffer(Alignment *alignment, int64_t column_index, char *buffer);
     
+    /*
+     * Make the bases of the rows of a block read by taf_read_block, which are only made when first needed
+     */
+    void alignment_make_row_bases(Alignment *alignment);
+
     /*
      * Read a column of the alignment and return as a string
      */
@@ -221,6 +260,11 @@ ffibuilder.cdef("""
      * region of it found in the TAF. 
      */
     int tai_create(LI *li, FILE* idx_fh, int64_t index_block_size);
+
+    /*
+     * As tai_create, but write a binary index, which is mapped into memory when loaded rather than parsed.
+     */
+    int tai_create_binary(LI *li, FILE* idx_fh, int64_t index_block_size);
     
     /*
      * Load the index from disk
@@ -231,6 +275,22 @@ ffibuilder.cdef("""
      * Free the index
      */
     void tai_destruct(Tai* idx);
+
+    typedef struct _TaiContigSummary {
+        int64_t name;
+        int64_t sequence_length;
+        int64_t start;
+        int64_t end;
+        int64_t aligned_bases;
+        int64_t interval_number;
+        int64_t run_number;
+    } TaiContigSummary;
+
+    /*
+     * Get the summary of the i-th contig of the index, in the order the contigs are found in the file, setting name to
+     * its name. Returns NULL if there is no such summary, e.g. if the index has no summaries.
+     */
+    const TaiContigSummary *tai_contig_summary(Tai *idx, int64_t i, const char **name);
     
     /*
      * Query the taf index
@@ -238,6 +298,17 @@ ffibuilder.cdef("""
      * length can be -1 for everything
      */
     TaiIt *tai_iterator(Tai* idx, LI *li, bool run_length_encode_bases, const char *contig, int64_t start, int64_t length);
+
+    /*
+     * Make an iterator for a batch of regions, each queried in turn with tai_iterator_next_region, reading on from one
+     * region to the next where they share anchors of the index
+     */
+    TaiIt *tai_regions_iterator(Tai *tai, bool run_length_encode_bases);
+
+    /*
+     * Move a regions iterator on to the next region
+     */
+    void tai_iterator_next_region(TaiIt *tai_it, Tai *tai, LI *li, const char *contig, int64_t start, int64_t length);
     
     /*
      * Iterate through a region as obtained via the iterator
@@ -282,6 +353,7 @@ ffibuilder.set_source("taffy._taffy_cffi",
                                "taffy/submodules/sonLib/C/impl/sonLibFile.c",
                                "taffy/impl/line_iterator.c",
                                "taffy/impl/alignment_block.c",
+                               "taffy/impl/block_writer.c",
                                # "taffy/impl/merge_adjacent_alignments.c" - this is excluded because it uses abPOA
                                "taffy/impl/maf.c",
                                "taffy/impl/ond.c",
@@ -1,6 +1,7 @@
 #include "taf.h"
 #include "ond.h"
 #include "sonLib.h"
+#include <pthread.h>
 
 #define ANSI_COLOR_RED     "\x1b[41m"
 #define ANSI_COLOR_GREEN   "\x1b[42m"
@@ -104,6 +105,228 @@ Tag *tag_parse(char *tag_string, char *delimiter, Tag *p_tag) {
     return tag;
 }
 
+/*
+ * A bases matrix is preceded by a count of the alignment and rows that reference it, followed by the size in bytes
+ * allocated for the matrix.
+ */
+#define BASES_MATRIX_HEADER_SIZE ((int64_t)(2 * sizeof(int64_t)))
+
+static int64_t *bases_matrix_reference_count(char *matrix) {
+    return (int64_t *)(matrix - BASES_MATRIX_HEADER_SIZE);
+}
+
+static int64_t *bases_matrix_size(char *matrix) {
+    return bases_matrix_reference_count(matrix) + 1;
+}
+
+static void bases_matrix_release(char *matrix) {
+    int64_t *reference_count = bases_matrix_reference_count(matrix);
+    assert(*reference_count > 0);
+    if(--(*reference_count) == 0) {
+        free(reference_count);
+    }
+}
+
+char *alignment_bases_matrix_construct(int64_t row_number, int64_t column_number) {
+    int64_t size = row_number * (column_number + 1);
+    char *matrix = (char *)st_malloc(BASES_MATRIX_HEADER_SIZE + size) + BASES_MATRIX_HEADER_SIZE;
+    *bases_matrix_reference_count(matrix) = 0;
+    *bases_matrix_size(matrix) = size;
+    return matrix;
+}
+
+char *alignment_bases_matrix_resize(char *matrix, int64_t row_number, int64_t column_number) {
+    if(matrix == NULL) {
+        return alignment_bases_matrix_construct(row_number, column_number);
+    }
+    assert(*bases_matrix_reference_count(matrix) == 0);
+    int64_t size = row_number * (column_number + 1);
+    if(size > *bases_matrix_size(matrix)) {
+        matrix = (char *)st_realloc(bases_matrix_reference_count(matrix), BASES_MATRIX_HEADER_SIZE + size) +
+                 BASES_MATRIX_HEADER_SIZE;
+        *bases_matrix_size(matrix) = size;
+    }
+    return matrix;
+}
+
+/*
+ * As alignment_set_bases_matrix, but keeping any column major copies of the bases, for when the matrix has the same
+ * bases.
+ */
+static void set_bases_matrix(Alignment *alignment, char *matrix) {
+    (*bases_matrix_reference_count(matrix))++; // Reference held by the alignment
+    if(alignment->bases != NULL) {
+        bases_matrix_release(alignment->bases);
+    }
+    alignment->bases = matrix;
+    Alignment_Row *row = alignment->row;
+    for(int64_t i=0; i<alignment->row_number; i++) {
+        assert(row != NULL);
+        (*bases_matrix_reference_count(matrix))++; // Reference held by the row, taken before the old
+        // bases are released in case they are in the same matrix
+        alignment_row_set_bases(row, matrix + i * (alignment->column_number + 1));
+        row->bases_matrix = matrix;
+        row = row->n_row;
+    }
+    assert(row == NULL);
+}
+
+void alignment_set_bases_matrix(Alignment *alignment, char *matrix) {
+    alignment_invalidate_column_bases(alignment);
+    set_bases_matrix(alignment, matrix);
+}
+
+void alignment_row_set_bases(Alignment_Row *row, char *bases) {
+    if(row->bases_matrix != NULL) {
+        bases_matrix_release(row->bases_matrix);
+        row->bases_matrix = NULL;
+    }
+    else if(row->bases != NULL) {
+        free(row->bases);
+    }
+    row->bases = bases;
+}
+
+/*
+ * The pool of interned sequence names, an open addressing hash table of the names.
+ */
+static struct {
+    pthread_mutex_t mutex;
+    char **names;
+    int64_t size, capacity; // capacity is zero or a power of two
+} sequence_name_pool = { PTHREAD_MUTEX_INITIALIZER, NULL, 0, 0 };
+
+/*
+ * The names each thread has interned, in a direct mapped cache indexed by the hash of the name. The rows of a block
+ * are mostly of the sequences of the blocks before it, so their names are found here without taking the pool's mutex,
+ * which the threads parsing blocks in parallel would otherwise all contend for. As interned names are never freed, a
+ * cached name stays valid for the life of the process.
+ */
+#define SEQUENCE_NAME_CACHE_SIZE 1024 // A power of two
+
+typedef struct _sequence_name_cache_entry {
+    char *name; // NULL if the entry is empty
+    uint64_t hash;
+} Sequence_Name_Cache_Entry;
+
+static __thread Sequence_Name_Cache_Entry sequence_name_cache[SEQUENCE_NAME_CACHE_SIZE];
+
+static uint64_t sequence_name_hash(const char *name, int64_t length) { // FNV-1a
+    uint64_t h = 14695981039346656037ULL;
+    for(int64_t i=0; i<length; i++) {
+        h = (h ^ (unsigned char)name[i]) * 1099511628211ULL;
+    }
+    return h;
+}
+
+/*
+ * Find the slot in the pool holding the name, or the empty slot where it should go.
+ */
+static char **sequence_name_pool_find(const char *name, int64_t length, uint64_t hash) {
+    int64_t mask = sequence_name_pool.capacity - 1;
+    for(int64_t i=hash & mask;; i=(i+1) & mask) {
+        char *n = sequence_name_pool.names[i];
+        if(n == NULL || (strncmp(n, name, length) == 0 && n[length] == '\0')) {
+            return &sequence_name_pool.names[i];
+        }
+    }
+}
+
+char *sequence_name_intern(const char *name, int64_t length) {
+    uint64_t hash = sequence_name_hash(name, length);
+    Sequence_Name_Cache_Entry *entry = &sequence_name_cache[hash & (SEQUENCE_NAME_CACHE_SIZE - 1)];
+    if(entry->name != NULL && entry->hash == hash &&
+       strncmp(entry->name, name, length) == 0 && entry->name[length] == '\0') {
+        return entry->name;
+    }
+    pthread_mutex_lock(&sequence_name_pool.mutex);
+    if(2 * (sequence_name_pool.size + 1) > sequence_name_pool.capacity) { // Keep the table at most half full
+        char **names = sequence_name_pool.names;
+        int64_t capacity = sequence_name_pool.capacity;
+        sequence_name_pool.capacity = capacity == 0 ? 1024 : 2 * capacity;
+        sequence_name_pool.names = st_calloc(sequence_name_pool.capacity, sizeof(char *));
+        for(int64_t i=0; i<capacity; i++) {
+            if(names[i] != NULL) {
+                int64_t l = strlen(names[i]);
+                *sequence_name_pool_find(names[i], l, sequence_name_hash(names[i], l)) = names[i];
+            }
+        }
+        free(names);
+    }
+    char **slot = sequence_name_pool_find(name, length, hash);
+    if(*slot == NULL) {
+        *slot = stString_getSubString(name, 0, length);
+        sequence_name_pool.size++;
+    }
+    char *interned_name = *slot;
+    entry->name = interned_name;
+    entry->hash = hash;
+    pthread_mutex_unlock(&sequence_name_pool.mutex);
+    return interned_name;
+}
+
+void alignment_row_set_sequence_name(Alignment_Row *row, char *sequence_name, bool interned) {
+    if(row->sequence_name != NULL && !row->sequence_name_interned) {
+        free(row->sequence_name);
+    }
+    row->sequence_name = sequence_name;
+    row->sequence_name_interned = interned;
+}
+
+/*
+ * The rows of a block are allocated in chunks from an arena, rather than one at a time. The arena is reference
+ * counted by the block and each of its rows, being freed once they have all been destroyed.
+ */
+#define ARENA_MIN_CHUNK_ROWS 64
+
+typedef struct _arena_chunk Arena_Chunk;
+
+struct _arena_chunk {
+    Arena_Chunk *p_chunk; // The previously allocated chunk
+    int64_t row_number;
+    Alignment_Row rows[];
+};
+
+struct _alignment_arena {
+    int64_t reference_count;
+    Arena_Chunk *chunk; // The chunk rows are currently allocated from
+    int64_t rows_used; // The number of rows of the chunk allocated
+};
+
+static void arena_release(Alignment_Arena *arena) {
+    assert(arena->reference_count > 0);
+    if(--arena->reference_count == 0) {
+        Arena_Chunk *chunk = arena->chunk;
+        while(chunk != NULL) {
+            Arena_Chunk *p_chunk = chunk->p_chunk;
+            free(chunk);
+            chunk = p_chunk;
+        }
+        free(arena);
+    }
+}
+
+Alignment_Row *alignment_row_construct(Alignment *alignment) {
+    Alignment_Arena *arena = alignment->arena;
+    if(arena == NULL) {
+        arena = alignment->arena = st_calloc(1, sizeof(Alignment_Arena));
+        arena->reference_count = 1; // The reference of the alignment
+    }
+    if(arena->chunk == NULL || arena->rows_used == arena->chunk->row_number) { // Get a new chunk, twice as big
+        int64_t row_number = arena->chunk == NULL ? ARENA_MIN_CHUNK_ROWS : 2 * arena->chunk->row_number;
+        Arena_Chunk *chunk = st_malloc(sizeof(Arena_Chunk) + row_number * sizeof(Alignment_Row));
+        chunk->p_chunk = arena->chunk;
+        chunk->row_number = row_number;
+        arena->chunk = chunk;
+        arena->rows_used = 0;
+    }
+    Alignment_Row *row = &arena->chunk->rows[arena->rows_used++];
+    memset(row, 0, sizeof(Alignment_Row));
+    row->arena = arena;
+    arena->reference_count++;
+    return row;
+}
+
 void alignment_row_destruct(Alignment_Row *row) {
     if(row->l_row != NULL) { // If there is a preceding, left row then unlink it
         assert(row->l_row->r_row == row);
@@ -113,16 +336,39 @@ void alignment_row_destruct(Alignment_Row *row) {
         assert(row->r_row->l_row == row);
         row->r_row->l_row = NULL;
     }
-    if(row->bases != NULL) {
-        free(row->bases);
-    }
-    if(row->sequence_name != NULL) {
-        free(row->sequence_name);
-    }
+    alignment_row_set_bases(row, NULL);
+    alignment_row_set_sequence_name(row, NULL, 0);
     if(row->left_gap_sequence != NULL) {
         free(row->left_gap_sequence);
     }
-    free(row);
+    if(row->arena != NULL) {
+        arena_release(row->arena);
+    }
+    else {
+        free(row);
+    }
+}
+
+/*
+ * Free the runs of the columns of the alignment.
+ */
+static void free_column_runs(Alignment *alignment) {
+    free(alignment->column_runs);
+    alignment->column_runs = NULL;
+    alignment->column_runs_size = 0;
+    free(alignment->column_run_starts);
+    alignment->column_run_starts = NULL;
+    alignment->column_run_starts_size = 0;
+}
+
+/*
+ * Free the column major copies of the bases of the alignment.
+ */
+static void free_column_bases(Alignment *alignment) {
+    free(alignment->column_bases);
+    alignment->column_bases = NULL;
+    alignment->column_bases_size = 0;
+    free_column_runs(alignment);
 }
 
 void alignment_destruct(Alignment *alignment, bool cleanup_rows) {
@@ -134,14 +380,200 @@ void alignment_destruct(Alignment *alignment, bool cleanup_rows) {
             alignment_row_destruct(r);
         }
     }
-    assert(alignment->column_tags != NULL);  // Clean up column tags
-    for(int64_t i=0; i<alignment->column_number; i++) {
-        tag_destruct(alignment->column_tags[i]);
+    if(alignment->column_tags != NULL) {  // Clean up column tags
+        for(int64_t i=0; i<alignment->column_number; i++) {
+            tag_destruct(alignment->column_tags[i]);
+        }
+        free(alignment->column_tags);
+    }
+    free(alignment->column_tag_text);
+    free(alignment->column_tag_text_starts);
+    if(alignment->bases != NULL) {
+        bases_matrix_release(alignment->bases);
+    }
+    free_column_bases(alignment);
+    if(alignment->arena != NULL) {
+        arena_release(alignment->arena);
     }
-    free(alignment->column_tags);
     free(alignment);
 }
 
+/*
+ * The allocations of the blocks recycled to a line iterator.
+ */
+struct _alignment_pool {
+    Alignment *alignment; // An empty alignment, possibly with an arena with no rows allocated, or NULL
+    void *buffers[ALIGNMENT_POOL_BUFFER_NUMBER]; // A buffer of each kind, or NULL
+    int64_t buffer_sizes[ALIGNMENT_POOL_BUFFER_NUMBER];
+};
+
+static void alignment_pool_free_buffer(Alignment_Pool_Buffer kind, void *buffer) {
+    if(kind == ALIGNMENT_POOL_BASES_MATRIX) {
+        free(bases_matrix_reference_count(buffer));
+    }
+    else {
+        free(buffer);
+    }
+}
+
+/*
+ * Free the allocations recycled to a line iterator, called by LI_destruct.
+ */
+static void alignment_pool_destruct(void *p) {
+    Alignment_Pool *pool = p;
+    if(pool->alignment != NULL) {
+        alignment_destruct(pool->alignment, 0);
+    }
+    for(int64_t i=0; i<ALIGNMENT_POOL_BUFFER_NUMBER; i++) {
+        if(pool->buffers[i] != NULL) {
+            alignment_pool_free_buffer(i, pool->buffers[i]);
+        }
+    }
+    free(pool);
+}
+
+/*
+ * Get the pool of li, making it if it has none.
+ */
+static Alignment_Pool *alignment_pool_get(LI *li) {
+    if(li->alignment_pool == NULL) {
+        li->alignment_pool = st_calloc(1, sizeof(Alignment_Pool));
+        li->alignment_pool_destruct = alignment_pool_destruct;
+    }
+    return li->alignment_pool;
+}
+
+Alignment *alignment_pool_take_alignment(LI *li) {
+    Alignment_Pool *pool = li != NULL ? li->alignment_pool : NULL;
+    if(pool == NULL || pool->alignment == NULL) {
+        return st_calloc(1, sizeof(Alignment));
+    }
+    Alignment *alignment = pool->alignment;
+    pool->alignment = NULL;
+    return alignment;
+}
+
+void *alignment_pool_take_buffer(LI *li, Alignment_Pool_Buffer kind, int64_t *size) {
+    Alignment_Pool *pool = li != NULL ? li->alignment_pool : NULL;
+    if(pool == NULL || pool->buffers[kind] == NULL) {
+        *size = 0;
+        return NULL;
+    }
+    void *buffer = pool->buffers[kind];
+    *size = pool->buffer_sizes[kind];
+    pool->buffers[kind] = NULL;
+    return buffer;
+}
+
+Tag **alignment_pool_take_column_tags(LI *li, int64_t column_number, int64_t *size) {
+    Tag **column_tags = alignment_pool_take_buffer(li, ALIGNMENT_POOL_COLUMN_TAGS, size);
+    if(column_tags == NULL || *size < column_number * (int64_t)sizeof(Tag *)) {
+        *size = column_number * sizeof(Tag *) + 1;
+        column_tags = st_realloc(column_tags, *size);
+    }
+    memset(column_tags, 0, column_number * sizeof(Tag *));
+    return column_tags;
+}
+
+void alignment_pool_return_buffer(LI *li, Alignment_Pool_Buffer kind, void *buffer, int64_t size) {
+    if(buffer == NULL) {
+        return;
+    }
+    if(li == NULL) {
+        alignment_pool_free_buffer(kind, buffer);
+        return;
+    }
+    Alignment_Pool *pool = alignment_pool_get(li);
+    if(pool->buffers[kind] != NULL) { // Keep the larger of the two
+        if(pool->buffer_sizes[kind] >= size) {
+            alignment_pool_free_buffer(kind, buffer);
+            return;
+        }
+        alignment_pool_free_buffer(kind, pool->buffers[kind]);
+    }
+    pool->buffers[kind] = buffer;
+    pool->buffer_sizes[kind] = size;
+}
+
+/*
+ * Empty an arena that no rows are allocated from, so that its rows can be allocated again. If the rows were spread
+ * over several chunks they are replaced by one chunk as large as all of them.
+ */
+static void arena_reset(Alignment_Arena *arena) {
+    assert(arena->reference_count == 1);
+    if(arena->chunk != NULL && arena->chunk->p_chunk != NULL) {
+        int64_t row_number = 0;
+        while(arena->chunk != NULL) {
+            Arena_Chunk *chunk = arena->chunk;
+            row_number += chunk->row_number;
+            arena->chunk = chunk->p_chunk;
+            free(chunk);
+        }
+        arena->chunk = st_malloc(sizeof(Arena_Chunk) + row_number * sizeof(Alignment_Row));
+        arena->chunk->p_chunk = NULL;
+        arena->chunk->row_number = row_number;
+    }
+    arena->rows_used = 0;
+}
+
+void alignment_recycle(Alignment *alignment, bool cleanup_rows, LI *li) {
+    if(li == NULL) { // Nowhere to keep the allocations
+        alignment_destruct(alignment, cleanup_rows);
+        return;
+    }
+    if(cleanup_rows) {
+        Alignment_Row *row = alignment->row;
+        while (row != NULL) {
+            Alignment_Row *r = row;
+            row = row->n_row;
+            alignment_row_destruct(r);
+        }
+    }
+    // The buffers are given back at the sizes they were allocated at, as the shape of the block may have changed since
+    if(alignment->column_tags != NULL) {
+        for(int64_t i=0; i<alignment->column_number; i++) {
+            tag_destruct(alignment->column_tags[i]);
+        }
+    }
+    alignment_pool_return_buffer(li, ALIGNMENT_POOL_COLUMN_TAGS, alignment->column_tags, alignment->column_tags_size);
+    alignment_pool_return_buffer(li, ALIGNMENT_POOL_COLUMN_TAG_TEXT, alignment->column_tag_text,
+                                 alignment->column_tag_text_size);
+    alignment_pool_return_buffer(li, ALIGNMENT_POOL_COLUMN_TAG_TEXT_STARTS, alignment->column_tag_text_starts,
+                                 alignment->column_tag_text_starts_size);
+    if(alignment->bases != NULL) {
+        if(*bases_matrix_reference_count(alignment->bases) == 1) { // No row still views the matrix
+            *bases_matrix_reference_count(alignment->bases) = 0;
+            alignment_pool_return_buffer(li, ALIGNMENT_POOL_BASES_MATRIX, alignment->bases,
+                                         *bases_matrix_size(alignment->bases));
+        }
+        else {
+            bases_matrix_release(alignment->bases);
+        }
+    }
+    alignment_pool_return_buffer(li, ALIGNMENT_POOL_COLUMN_BASES, alignment->column_bases,
+                                 alignment->column_bases_size);
+    alignment_pool_return_buffer(li, ALIGNMENT_POOL_COLUMN_RUNS, alignment->column_runs, alignment->column_runs_size);
+    alignment_pool_return_buffer(li, ALIGNMENT_POOL_COLUMN_RUN_STARTS, alignment->column_run_starts,
+                                 alignment->column_run_starts_size);
+
+    // Keep the alignment, and its arena if no row allocated from it remains
+    Alignment_Arena *arena = alignment->arena;
+    if(arena != NULL && arena->reference_count > 1) {
+        arena_release(arena);
+        arena = NULL;
+    }
+    Alignment_Pool *pool = alignment_pool_get(li);
+    if(pool->alignment != NULL) {
+        alignment_destruct(pool->alignment, 0);
+    }
+    memset(alignment, 0, sizeof(Alignment));
+    if(arena != NULL) {
+        arena_reset(arena);
+        alignment->arena = arena;
+    }
+    pool->alignment = alignment;
+}
+
 stList *alignment_get_rows_in_a_list(Alignment_Row *row) {
     stList *l = stList_construct();
     while(row != NULL) {
@@ -152,6 +584,7 @@ stList *alignment_get_rows_in_a_list(Alignment_Row *row) {
 }
 
 void alignment_set_rows(Alignment *alignment, stList *rows) {
+    alignment_invalidate_column_bases(alignment);
     alignment->row_number = stList_length(rows);
     if(stList_length(rows) > 0) {
         alignment->row = stList_get(rows, 0);
@@ -165,8 +598,10 @@ void alignment_set_rows(Alignment *alignment, stList *rows) {
 }
 
 bool alignment_row_is_predecessor(Alignment_Row *left_row, Alignment_Row *right_row) {
-    // Do the rows match
-    return strcmp(left_row->sequence_name, right_row->sequence_name) == 0 && left_row->strand == right_row->strand &&
+    // Do the rows match, interned names being equal only if they are the same pointer
+    return (left_row->sequence_name_interned && right_row->sequence_name_interned ?
+            left_row->sequence_name == right_row->sequence_name :
+            strcmp(left_row->sequence_name, right_row->sequence_name) == 0) && left_row->strand == right_row->strand &&
             left_row->start + left_row->length <= right_row->start;
 }
 
@@ -247,6 +682,7 @@ int64_t alignment_max_gap_length(Alignment *left_alignment) {
 }
 
 char *alignment_to_string(Alignment *alignment) {
+    alignment_make_row_bases(alignment);
     stList *strings = stList_construct3(0, free);
     Alignment_Row *row = alignment->row;
     while(row != NULL) {
@@ -259,6 +695,7 @@ char *alignment_to_string(Alignment *alignment) {
 }
 
 void alignment_row_mask_identical_bases(Alignment *alignment, Alignment_Row *ref, Alignment_Row *non_ref, char mask_char) {
+    alignment_invalidate_column_bases(alignment);
     for(int64_t i=0; i<alignment->column_number; i++) {
         if(ref->bases[i] == non_ref->bases[i]) {
             non_ref->bases[i] = mask_char;
@@ -266,7 +703,75 @@ void alignment_row_mask_identical_bases(Alignment *alignment, Alignment_Row *ref
     }
 }
 
+/*
+ * Mask the bases that match the first (reference) base of their column in the column major bases of a block whose
+ * rows are yet to be made.
+ */
+static void mask_reference_column_bases(Alignment *alignment, char mask_char) {
+    for(int64_t i=0; i<alignment->column_number; i++) {
+        char *column = alignment->column_bases + i * alignment->row_number;
+        for(int64_t j=1; j<alignment->row_number; j++) {
+            if(column[j] == column[0]) {
+                column[j] = mask_char;
+            }
+        }
+    }
+}
+
+/*
+ * As mask_reference_column_bases, but masking the runs of a block read as runs. As the bases of a run are all the
+ * same each run is masked whole, except for the first run of a column, whose first base is the reference base, which
+ * is split in two. Adjacent runs of the same base are joined.
+ */
+static void mask_reference_column_runs(Alignment *alignment, char mask_char) {
+    int64_t column_number = alignment->column_number, *column_run_starts = alignment->column_run_starts;
+    Base_Run *runs = alignment->column_runs;
+    // Splitting the first run of each column adds at most one run to the column
+    int64_t size = sizeof(Base_Run) * (column_run_starts[column_number] + column_number + 1);
+    Base_Run *masked_runs = st_malloc(size);
+    int64_t k = 0;
+    for(int64_t i=0; i<column_number; i++) {
+        int64_t start = column_run_starts[i], end = column_run_starts[i+1];
+        column_run_starts[i] = k;
+        if(start == end) { // There are no rows
+            continue;
+        }
+        char reference_base = runs[start].base;
+        masked_runs[k].base = reference_base;
+        masked_runs[k++].length = 1;
+        int64_t first_run_rest = runs[start].length - 1;
+        for(int64_t j=start; j<end; j++) {
+            int64_t length = j == start ? first_run_rest : runs[j].length;
+            char base = j == start || runs[j].base == reference_base ? mask_char : runs[j].base;
+            if(length == 0) {
+                continue;
+            }
+            if(masked_runs[k-1].base == base) {
+                masked_runs[k-1].length += length;
+            }
+            else {
+                masked_runs[k].base = base;
+                masked_runs[k++].length = length;
+            }
+        }
+    }
+    column_run_starts[column_number] = k;
+    free(runs);
+    alignment->column_runs = masked_runs;
+    alignment->column_runs_size = size;
+}
+
 void alignment_mask_reference_bases(Alignment *alignment, char mask_char) {
+    if(alignment->row_bases_pending) { // Mask the bases as read, which the rows will be made from
+        if(alignment->column_bases != NULL) {
+            mask_reference_column_bases(alignment, mask_char);
+            free_column_runs(alignment); // Any runs were built from the bases before they were masked
+        }
+        else {
+            mask_reference_column_runs(alignment, mask_char);
+        }
+        return;
+    }
     Alignment_Row *ref_row = alignment->row;
     if(ref_row) {
         Alignment_Row *non_ref_row = ref_row->n_row;
@@ -300,12 +805,15 @@ Tag *parse_header(stList *tokens, char *header_prefix, char *delimiter) {
 }
 
 void write_header(Tag *tag, LW *lw, char *header_prefix, char *delimiter, char *end) {
-    LW_write(lw, "%s", header_prefix);
+    LW_write_string(lw, header_prefix);
     while(tag != NULL) {
-        LW_write(lw, " %s%s%s", tag->key, delimiter, tag->value);
+        LW_write_char(lw, ' ');
+        LW_write_string(lw, tag->key);
+        LW_write_string(lw, delimiter);
+        LW_write_string(lw, tag->value);
         tag = tag->n_tag;
     }
-    LW_write(lw, "%s", end);
+    LW_write_string(lw, end);
 }
 
 int64_t alignment_number_of_common_rows(Alignment *left_alignment, Alignment *right_alignment) {
@@ -321,29 +829,182 @@ int64_t alignment_number_of_common_rows(Alignment *left_alignment, Alignment *ri
     return shared_rows;
 }
 
-void alignment_get_column_in_buffer(Alignment *alignment, int64_t column_index, char *buffer) {
+/*
+ * Size of the square tiles in which the bases are transposed, so that both the reads and writes of a tile stay in cache
+ */
+#define TRANSPOSE_TILE_SIZE 64
+
+/*
+ * Transpose the column major bases of a block into a row major matrix of NUL terminated rows, a tile at a time.
+ */
+static void transpose_columns(const char *columns, int64_t row_number, int64_t column_number, char *matrix) {
+    int64_t stride = column_number + 1;
+    for(int64_t i=0; i<column_number; i+=TRANSPOSE_TILE_SIZE) {
+        int64_t tile_columns = column_number - i < TRANSPOSE_TILE_SIZE ? column_number - i : TRANSPOSE_TILE_SIZE;
+        for(int64_t j=0; j<row_number; j+=TRANSPOSE_TILE_SIZE) {
+            int64_t tile_rows = row_number - j < TRANSPOSE_TILE_SIZE ? row_number - j : TRANSPOSE_TILE_SIZE;
+            for(int64_t k=0; k<tile_columns; k++) {
+                const char *column = columns + (i + k) * row_number + j;
+                char *m = matrix + j * stride + i + k;
+                for(int64_t l=0; l<tile_rows; l++) {
+                    m[l * stride] = column[l];
+                }
+            }
+        }
+    }
+    for(int64_t j=0; j<row_number; j++) {
+        matrix[j * stride + column_number] = '\0';
+    }
+}
+
+/*
+ * As transpose_columns, but expanding the runs of the columns of a block, a tile at a time.
+ */
+static void transpose_column_runs(const Base_Run *runs, const int64_t *column_run_starts, int64_t row_number,
+                                  int64_t column_number, char *matrix) {
+    int64_t stride = column_number + 1;
+    int64_t run_indices[TRANSPOSE_TILE_SIZE], run_offsets[TRANSPOSE_TILE_SIZE]; // Where each column of the tile is
+    // up to in its runs
+    for(int64_t i=0; i<column_number; i+=TRANSPOSE_TILE_SIZE) {
+        int64_t tile_columns = column_number - i < TRANSPOSE_TILE_SIZE ? column_number - i : TRANSPOSE_TILE_SIZE;
+        for(int64_t k=0; k<tile_columns; k++) {
+            run_indices[k] = column_run_starts[i + k];
+            run_offsets[k] = 0;
+        }
+        for(int64_t j=0; j<row_number; j+=TRANSPOSE_TILE_SIZE) {
+            int64_t tile_rows = row_number - j < TRANSPOSE_TILE_SIZE ? row_number - j : TRANSPOSE_TILE_SIZE;
+            for(int64_t k=0; k<tile_columns; k++) {
+                char *m = matrix + j * stride + i + k;
+                for(int64_t l=0; l<tile_rows;) {
+                    const Base_Run *run = runs + run_indices[k];
+                    int64_t n = run->length - run_offsets[k] < tile_rows - l ? run->length - run_offsets[k] :
+                                tile_rows - l;
+                    for(int64_t o=0; o<n; o++) {
+                        m[(l + o) * stride] = run->base;
+                    }
+                    l += n;
+                    if((run_offsets[k] += n) == run->length) {
+                        run_indices[k]++;
+                        run_offsets[k] = 0;
+                    }
+                }
+            }
+        }
+    }
+    for(int64_t j=0; j<row_number; j++) {
+        matrix[j * stride + column_number] = '\0';
+    }
+}
+
+void alignment_make_row_bases(Alignment *alignment) {
+    if(alignment->row_bases_pending) {
+        alignment->row_bases_pending = 0;
+        char *matrix = alignment_bases_matrix_construct(alignment->row_number, alignment->column_number);
+        if(alignment->column_bases != NULL) {
+            transpose_columns(alignment->column_bases, alignment->row_number, alignment->column_number, matrix);
+        }
+        else { // The block was read as runs
+            assert(alignment->column_runs != NULL);
+            transpose_column_runs(alignment->column_runs, alignment->column_run_starts, alignment->row_number,
+                                  alignment->column_number, matrix);
+        }
+        set_bases_matrix(alignment, matrix); // The column major copies of the bases are still those of the rows
+    }
+}
+
+char *alignment_get_column_bases(Alignment *alignment) {
+    if(alignment->column_bases == NULL && alignment->row_bases_pending) { // Expand the runs the block was read as,
+        // which are of the columns one after another
+        assert(alignment->column_runs != NULL);
+        char *column_bases = st_malloc(sizeof(char) * (alignment->row_number * alignment->column_number + 1));
+        char *c = column_bases;
+        for(int64_t i=0; i<alignment->column_run_starts[alignment->column_number]; i++) {
+            memset(c, alignment->column_runs[i].base, alignment->column_runs[i].length);
+            c += alignment->column_runs[i].length;
+        }
+        assert(c == column_bases + alignment->row_number * alignment->column_number);
+        alignment->column_bases = column_bases;
+        alignment->column_bases_size = alignment->row_number * alignment->column_number + 1;
+    }
+    else if(alignment->column_bases == NULL) {
+        int64_t row_number = alignment->row_number, column_number = alignment->column_number;
+        char *column_bases = st_malloc(sizeof(char) * (row_number * column_number + 1));
+        Alignment_Row *tile_row = alignment->row;
+        char *rows[TRANSPOSE_TILE_SIZE];
+        for(int64_t i=0; i<row_number; i+=TRANSPOSE_TILE_SIZE) {
+            int64_t tile_rows = row_number - i < TRANSPOSE_TILE_SIZE ? row_number - i : TRANSPOSE_TILE_SIZE;
+            for(int64_t k=0; k<tile_rows; k++) { // Get the bases of the next tile of rows
+                assert(tile_row != NULL);
+                rows[k] = tile_row->bases;
+                tile_row = tile_row->n_row;
+            }
+            for(int64_t j=0; j<column_number; j+=TRANSPOSE_TILE_SIZE) {
+                int64_t tile_columns = column_number - j < TRANSPOSE_TILE_SIZE ? column_number - j : TRANSPOSE_TILE_SIZE;
+                for(int64_t k=0; k<tile_rows; k++) {
+                    for(int64_t l=0; l<tile_columns; l++) {
+                        column_bases[(j + l) * row_number + i + k] = rows[k][j + l];
+                    }
+                }
+            }
+        }
+        assert(tile_row == NULL);
+        alignment->column_bases = column_bases;
+        alignment->column_bases_size = row_number * column_number + 1;
+    }
+    return alignment->column_bases;
+}
+
+Base_Run *alignment_get_column_runs(Alignment *alignment, int64_t column_index, int64_t *run_number) {
     assert(column_index >= 0);
     assert(column_index < alignment->column_number);
-    Alignment_Row *row = alignment->row;
-    for(int64_t i=0; i<alignment->row_number; i++) {
-        buffer[i] = row->bases[column_index];
-        row = row->n_row;
+    if(alignment->column_runs == NULL) { // Build the runs of every column
+        char *column_bases = alignment_get_column_bases(alignment);
+        int64_t *column_run_starts = st_malloc(sizeof(int64_t) * (alignment->column_number + 1));
+        Base_Run *runs = NULL;
+        int64_t runs_length = 0, runs_capacity = 0;
+        for(int64_t i=0; i<alignment->column_number; i++) {
+            column_run_starts[i] = runs_length;
+            char *column = column_bases + i * alignment->row_number;
+            for(int64_t j=0; j<alignment->row_number;) {
+                int64_t k = j + 1;
+                while(k < alignment->row_number && column[k] == column[j]) {
+                    k++;
+                }
+                if(runs_length == runs_capacity) {
+                    runs_capacity = 2 * runs_capacity + 16;
+                    runs = st_realloc(runs, sizeof(Base_Run) * runs_capacity);
+                }
+                runs[runs_length].base = column[j];
+                runs[runs_length++].length = k - j;
+                j = k;
+            }
+        }
+        column_run_starts[alignment->column_number] = runs_length;
+        alignment->column_run_starts = column_run_starts;
+        alignment->column_run_starts_size = sizeof(int64_t) * (alignment->column_number + 1);
+        alignment->column_runs = runs != NULL ? runs : st_malloc(sizeof(Base_Run));
+        alignment->column_runs_size = sizeof(Base_Run) * (runs != NULL ? runs_capacity : 1);
     }
-    assert(row == NULL);
+    *run_number = alignment->column_run_starts[column_index + 1] - alignment->column_run_starts[column_index];
+    return alignment->column_runs + alignment->column_run_starts[column_index];
+}
+
+void alignment_invalidate_column_bases(Alignment *alignment) {
+    alignment_make_row_bases(alignment); // The rows are about to be changed, so must have their own bases
+    free_column_bases(alignment);
+}
+
+void alignment_get_column_in_buffer(Alignment *alignment, int64_t column_index, char *buffer) {
+    assert(column_index >= 0);
+    assert(column_index < alignment->column_number);
+    memcpy(buffer, alignment_get_column_bases(alignment) + column_index * alignment->row_number,
+           alignment->row_number);
 }
 
 char *alignment_get_column(Alignment *alignment, int64_t column_index) {
     char *column_string = st_malloc(sizeof(char) * (alignment->row_number+1));
     column_string[alignment->row_number] = '\0';
-    assert(column_index >= 0);
-    assert(column_index < alignment->column_number);
-    Alignment_Row *row = alignment->row;
-    for(int64_t i=0; i<alignment->row_number; i++) {
-        assert(row != NULL);
-        column_string[i] = row->bases[column_index];
-        row = row->n_row;
-    }
-    assert(row == NULL);
+    alignment_get_column_in_buffer(alignment, column_index, column_string);
     return column_string;
 }
 
@@ -351,11 +1012,10 @@ int32_t *alignment_get_column_as_int_array(Alignment *alignment, int64_t column_
     int32_t *column_array = st_malloc(sizeof(int32_t) * alignment->row_number);
     assert(column_index >= 0);
     assert(column_index < alignment->column_number);
-    Alignment_Row *row = alignment->row;
+    char *column = alignment_get_column_bases(alignment) + column_index * alignment->row_number;
     for(int64_t i=0; i<alignment->row_number; i++) {
-        assert(row != NULL);
         int32_t j;
-        switch(row->bases[column_index]) {
+        switch(column[i]) {
             case '-':
                 j = 4;
                 break;
@@ -379,8 +1039,6 @@ int32_t *alignment_get_column_as_int_array(Alignment *alignment, int64_t column_
                 j = 5;
         }
         column_array[i] = j;
-        row = row->n_row;
     }
-    assert(row == NULL);
     return column_array;
-}
\ No newline at end of file
+}
@@ -0,0 +1,172 @@
+#include "taf.h"
+#include "sonLib.h"
+#include <pthread.h>
+
+/*
+ * A block given to a BlockWriter, and the buffer it is encoded to
+ */
+typedef struct _block_writer_slot {
+    Alignment *p_alignment;
+    Alignment *alignment;
+    LW *lw;
+    bool encoded;
+} BlockWriterSlot;
+
+struct _BlockWriter {
+    LW *lw;
+    LI *li;
+    BlockWriterPrepare prepare;
+    BlockWriterEncoder encode;
+    BlockWriterBeforeWrite before_write;
+    void *extra;
+    Alignment *p_alignment; // The last block given to the writer
+    Alignment *written_alignment; // The last block written to lw, freed once the block after it is written
+    BlockWriterSlot *slots; // A ring of the blocks in flight
+    int64_t slot_number;
+    int64_t blocks_given;
+    int64_t blocks_taken; // The number of blocks taken by the threads to encode
+    int64_t blocks_written;
+    pthread_t *threads;
+    int64_t thread_number;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond; // Signalled when there is a block to encode
+    pthread_cond_t done_cond; // Signalled when a block is encoded
+    bool stop;
+};
+
+static void block_writer_free_block(BlockWriter *writer, Alignment *alignment) {
+    if(alignment != NULL) {
+        alignment_recycle(alignment, 1, writer->li);
+    }
+}
+
+static void *block_writer_worker(void *arg) {
+    BlockWriter *writer = arg;
+    pthread_mutex_lock(&writer->mutex);
+    while(1) {
+        while(!writer->stop && writer->blocks_taken == writer->blocks_given) {
+            pthread_cond_wait(&writer->cond, &writer->mutex);
+        }
+        if(writer->blocks_taken == writer->blocks_given) { // Stopped, with nothing left to encode
+            break;
+        }
+        BlockWriterSlot *slot = &writer->slots[writer->blocks_taken++ % writer->slot_number];
+        pthread_mutex_unlock(&writer->mutex);
+        writer->encode(slot->p_alignment, slot->alignment, slot->lw, writer->extra);
+        pthread_mutex_lock(&writer->mutex);
+        slot->encoded = 1;
+        pthread_cond_signal(&writer->done_cond);
+    }
+    pthread_mutex_unlock(&writer->mutex);
+    return NULL;
+}
+
+BlockWriter *block_writer_construct(LW *lw, BlockWriterPrepare prepare, BlockWriterEncoder encode,
+                                    BlockWriterBeforeWrite before_write, void *extra, LI *li,
+                                    int64_t thread_number, int64_t max_blocks_in_flight) {
+    BlockWriter *writer = st_calloc(1, sizeof(BlockWriter));
+    writer->lw = lw;
+    writer->li = li;
+    writer->prepare = prepare;
+    writer->encode = encode;
+    writer->before_write = before_write;
+    writer->extra = extra;
+    writer->thread_number = thread_number > 1 ? thread_number : 0; // Without threads blocks are written directly
+    if(writer->thread_number > 0) {
+        writer->slot_number = max_blocks_in_flight > 0 ? max_blocks_in_flight :
+                              BLOCK_WRITER_BLOCKS_PER_THREAD * writer->thread_number;
+        writer->slots = st_calloc(writer->slot_number, sizeof(BlockWriterSlot));
+        for(int64_t i=0; i<writer->slot_number; i++) {
+            writer->slots[i].lw = LW_construct(NULL, 0);
+        }
+        pthread_mutex_init(&writer->mutex, NULL);
+        pthread_cond_init(&writer->cond, NULL);
+        pthread_cond_init(&writer->done_cond, NULL);
+        writer->threads = st_malloc(writer->thread_number * sizeof(pthread_t));
+        for(int64_t i=0; i<writer->thread_number; i++) {
+            if(pthread_create(&writer->threads[i], NULL, block_writer_worker, writer) != 0) {
+                st_errAbort("Unable to start %" PRIi64 " block writing threads\n", writer->thread_number);
+            }
+        }
+    }
+    return writer;
+}
+
+/*
+ * Wait for the oldest block in flight to be encoded, then write it out, freeing the block before it. Called
+ * holding the mutex.
+ */
+static void block_writer_write_next(BlockWriter *writer) {
+    BlockWriterSlot *slot = &writer->slots[writer->blocks_written % writer->slot_number];
+    while(!slot->encoded) {
+        pthread_cond_wait(&writer->done_cond, &writer->mutex);
+    }
+    // The threads do not touch the slot until it is reused, so can keep encoding while it is written
+    pthread_mutex_unlock(&writer->mutex);
+    if(writer->before_write != NULL) {
+        writer->before_write(slot->alignment, writer->extra);
+    }
+    LW_write_bytes(writer->lw, slot->lw->buffer, slot->lw->buffer_length);
+    slot->lw->buffer_length = 0;
+    block_writer_free_block(writer, writer->written_alignment);
+    writer->written_alignment = slot->alignment;
+    pthread_mutex_lock(&writer->mutex);
+    writer->blocks_written++;
+}
+
+void block_writer_write(BlockWriter *writer, Alignment *alignment) {
+    if(writer->prepare != NULL) {
+        writer->prepare(alignment, writer->extra);
+    }
+    if(writer->thread_number == 0) {
+        if(writer->before_write != NULL) {
+            writer->before_write(alignment, writer->extra);
+        }
+        writer->encode(writer->p_alignment, alignment, writer->lw, writer->extra);
+        block_writer_free_block(writer, writer->p_alignment);
+        writer->p_alignment = alignment;
+        return;
+    }
+    pthread_mutex_lock(&writer->mutex);
+    while(writer->blocks_given - writer->blocks_written == writer->slot_number) { // Make room for the block
+        block_writer_write_next(writer);
+    }
+    BlockWriterSlot *slot = &writer->slots[writer->blocks_given++ % writer->slot_number];
+    slot->p_alignment = writer->p_alignment;
+    slot->alignment = alignment;
+    slot->encoded = 0;
+    writer->p_alignment = alignment;
+    pthread_cond_signal(&writer->cond);
+    // Write out any blocks already encoded
+    while(writer->blocks_written < writer->blocks_given &&
+          writer->slots[writer->blocks_written % writer->slot_number].encoded) {
+        block_writer_write_next(writer);
+    }
+    pthread_mutex_unlock(&writer->mutex);
+}
+
+void block_writer_destruct(BlockWriter *writer) {
+    if(writer->thread_number > 0) {
+        pthread_mutex_lock(&writer->mutex);
+        while(writer->blocks_written < writer->blocks_given) {
+            block_writer_write_next(writer);
+        }
+        writer->stop = 1;
+        pthread_cond_broadcast(&writer->cond);
+        pthread_mutex_unlock(&writer->mutex);
+        for(int64_t i=0; i<writer->thread_number; i++) {
+            pthread_join(writer->threads[i], NULL);
+        }
+        for(int64_t i=0; i<writer->slot_number; i++) {
+            LW_destruct(writer->slots[i].lw, 0);
+        }
+        pthread_mutex_destroy(&writer->mutex);
+        pthread_cond_destroy(&writer->cond);
+        pthread_cond_destroy(&writer->done_cond);
+        free(writer->slots);
+        free(writer->threads);
+    }
+    // The last block written, if any
+    block_writer_free_block(writer, writer->thread_number > 0 ? writer->written_alignment : writer->p_alignment);
+    free(writer);
+}
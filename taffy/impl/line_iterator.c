@@ -1,44 +1,401 @@
 #include "line_iterator.h"
 #include "sonLib.h"
+#include <ctype.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #ifdef USE_HTSLIB
 #include "htslib/bgzf.h"
+#include "htslib/hfile.h"
 #include "htslib/kstring.h"
 #endif
 
-LI *LI_construct(FILE *fh) {
-    LI *li = st_calloc(1, sizeof(LI));
+/*
+ * Positions in a memory mapped file. With htslib these are expressed as bgzf virtual offsets (as bgzf_tell
+ * does for uncompressed files) so that an index is interchangeable between the two ways of reading the file.
+ */
+static int64_t li_mmap_tell(LI *li) {
 #ifdef USE_HTSLIB
-    li->bgzf = bgzf_dopen(fileno(fh), "r");
-    assert(li->bgzf != NULL);
-    if (bgzf_compression(li->bgzf) == 2) {
-        if (bgzf_index_build_init(li->bgzf) != 0) {
-            assert(false);
+    return ((li->data_offset & ~((int64_t)0xFFFF)) << 16) | (li->data_offset & 0xFFFF);
+#else
+    return li->data_offset;
+#endif
+}
+
+static int64_t li_mmap_offset(int64_t position) {
+#ifdef USE_HTSLIB
+    return (position >> 16) + (position & 0xFFFF);
+#else
+    return position;
+#endif
+}
+
+/*
+ * Memory map fh if it is an uncompressed, non-empty regular file that has not yet been read from.
+ * Returns true if successful.
+ */
+static bool li_mmap(LI *li, FILE *fh) {
+    int fd = fileno(fh);
+    struct stat st;
+    if(fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size < 2 ||
+       ftell(fh) != 0 || lseek(fd, 0, SEEK_CUR) != 0) {
+        return 0;
+    }
+    char *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if(data == MAP_FAILED) {
+        return 0;
+    }
+    if((unsigned char)data[0] == 0x1f && (unsigned char)data[1] == 0x8b) { // Is gzipped, so read through a stream
+        munmap(data, st.st_size);
+        return 0;
+    }
+    madvise(data, st.st_size, MADV_SEQUENTIAL);
+    li->data = data;
+    li->data_length = st.st_size;
+    li->data_offset = 0;
+    return 1;
+}
+
+static int64_t li_stream_position(LI *li) {
+#ifdef USE_HTSLIB
+    return bgzf_tell(li->bgzf);
+#else
+    return ftell(li->fh);
+#endif
+}
+
+/*
+ * Read the next line from the stream into *buffer, stripping the newline. Returns the length of the line
+ * or -1 if at EOF.
+ */
+static int64_t li_stream_read_line(LI *li, char **buffer, size_t *buffer_capacity) {
+#ifdef USE_HTSLIB
+    kstring_t ks = { 0, *buffer_capacity, *buffer };
+    int64_t length = bgzf_getline(li->bgzf, '\n', &ks);
+    *buffer = ks.s;
+    *buffer_capacity = ks.m;
+#else
+    int64_t length = getline(buffer, buffer_capacity, li->fh);
+    if(length > 0 && (*buffer)[length-1] == '\n') {
+        (*buffer)[--length] = '\0';
+    }
+#endif
+    return length;
+}
+
+/*
+ * Read ahead. A background thread fills a ring of chunks, each holding a block of consecutive NUL terminated
+ * lines, which are then consumed in order by li_read_line. The consumer holds on to its current chunk and the
+ * one before it (which may contain the last line returned) and releases older chunks back to the thread.
+ */
+
+#define LI_PREFETCH_CHUNK_SIZE (1 << 18) // The number of bytes of lines read into a chunk at a time
+
+typedef struct _LI_Chunk {
+    char *data; // the lines, each NUL terminated
+    int64_t data_length;
+    int64_t data_capacity;
+    int64_t *line_offsets; // the offset in data of each line
+    int64_t *line_lengths;
+    int64_t *line_positions; // the position in the file of each line
+    int64_t line_number;
+    int64_t line_capacity;
+    int64_t end_position; // the position in the file following the last line
+    bool eof; // true if the end of the file follows the last line
+} LI_Chunk;
+
+typedef struct _LI_Prefetch {
+    pthread_t thread;
+    bool thread_running;
+    pthread_mutex_t mutex;
+    pthread_cond_t chunk_filled;
+    pthread_cond_t chunk_released;
+    bool stop; // set to ask the thread to exit
+    LI_Chunk *chunks; // the ring, chunk i is in chunks[i % chunk_number]
+    int64_t chunk_number;
+    int64_t produced; // the number of chunks filled by the thread
+    int64_t consumed; // the number of chunks taken by the consumer
+    int64_t released; // the number of chunks released by the consumer
+    LI_Chunk *chunk; // the consumer's current chunk
+    int64_t line_index; // the index in chunk of the next line to return
+    bool eof; // true if the current chunk is the last
+    int64_t position; // the position in the file of the line following li->line
+    char *buffer; // the thread's line buffer
+    size_t buffer_capacity;
+} LI_Prefetch;
+
+static void li_prefetch_fill_chunk(LI *li, LI_Chunk *chunk) {
+    LI_Prefetch *p = li->prefetch;
+    chunk->data_length = 0;
+    chunk->line_number = 0;
+    chunk->eof = 0;
+    while(chunk->data_length < LI_PREFETCH_CHUNK_SIZE) {
+        int64_t position = li_stream_position(li);
+        int64_t length = li_stream_read_line(li, &p->buffer, &p->buffer_capacity);
+        if(length < 0) {
+            chunk->eof = 1;
+            break;
+        }
+        if(chunk->data_length + length + 1 > chunk->data_capacity) {
+            chunk->data_capacity = 2 * (chunk->data_length + length + 1);
+            chunk->data = st_realloc(chunk->data, chunk->data_capacity);
+        }
+        if(chunk->line_number == chunk->line_capacity) {
+            chunk->line_capacity = 2 * chunk->line_capacity + 64;
+            chunk->line_offsets = st_realloc(chunk->line_offsets, chunk->line_capacity * sizeof(int64_t));
+            chunk->line_lengths = st_realloc(chunk->line_lengths, chunk->line_capacity * sizeof(int64_t));
+            chunk->line_positions = st_realloc(chunk->line_positions, chunk->line_capacity * sizeof(int64_t));
         }
+        memcpy(chunk->data + chunk->data_length, p->buffer, length);
+        chunk->data[chunk->data_length + length] = '\0';
+        chunk->line_offsets[chunk->line_number] = chunk->data_length;
+        chunk->line_lengths[chunk->line_number] = length;
+        chunk->line_positions[chunk->line_number++] = position;
+        chunk->data_length += length + 1;
     }
-    kstring_t ks = KS_INITIALIZE;
-    li->prev_pos = bgzf_tell(li->bgzf);
-    li->pos = li->prev_pos;
-    bgzf_getline(li->bgzf, '\n', &ks);
-    li->line = ks_release(&ks);
+    chunk->end_position = li_stream_position(li);
+}
+
+static void *li_prefetch_run(void *arg) {
+    LI *li = arg;
+    LI_Prefetch *p = li->prefetch;
+    while(1) {
+        // Wait for a free chunk
+        pthread_mutex_lock(&p->mutex);
+        while(!p->stop && p->produced - p->released >= p->chunk_number) {
+            pthread_cond_wait(&p->chunk_released, &p->mutex);
+        }
+        if(p->stop) {
+            pthread_mutex_unlock(&p->mutex);
+            return NULL;
+        }
+        LI_Chunk *chunk = &p->chunks[p->produced % p->chunk_number];
+        pthread_mutex_unlock(&p->mutex);
+
+        li_prefetch_fill_chunk(li, chunk);
+
+        pthread_mutex_lock(&p->mutex);
+        p->produced++;
+        pthread_cond_signal(&p->chunk_filled);
+        pthread_mutex_unlock(&p->mutex);
+        if(chunk->eof) {
+            return NULL;
+        }
+    }
+}
+
+static void li_prefetch_start(LI *li) {
+    LI_Prefetch *p = li->prefetch;
+    p->stop = 0;
+    if(pthread_create(&p->thread, NULL, li_prefetch_run, li) != 0) {
+        st_errAbort("Unable to start the line prefetch thread");
+    }
+    p->thread_running = 1;
+}
+
+/*
+ * Stop the thread and discard any chunks that have been read ahead but not consumed.
+ */
+static void li_prefetch_stop(LI *li) {
+    LI_Prefetch *p = li->prefetch;
+    if(p->thread_running) {
+        pthread_mutex_lock(&p->mutex);
+        p->stop = 1;
+        pthread_cond_signal(&p->chunk_released);
+        pthread_mutex_unlock(&p->mutex);
+        pthread_join(p->thread, NULL);
+        p->thread_running = 0;
+    }
+    p->produced = p->consumed;
+    p->eof = 0;
+    if(p->chunk != NULL) { // Read from a new chunk next
+        p->line_index = p->chunk->line_number;
+    }
+}
+
+static void li_prefetch_construct(LI *li, int64_t prefetch) {
+    LI_Prefetch *p = st_calloc(1, sizeof(LI_Prefetch));
+    pthread_mutex_init(&p->mutex, NULL);
+    pthread_cond_init(&p->chunk_filled, NULL);
+    pthread_cond_init(&p->chunk_released, NULL);
+    p->chunk_number = prefetch + 2; // Plus the two chunks held by the consumer
+    p->chunks = st_calloc(p->chunk_number, sizeof(LI_Chunk));
+    p->position = li_stream_position(li);
+    li->prefetch = p;
+    li_prefetch_start(li);
+}
+
+static void li_prefetch_destruct(LI *li) {
+    LI_Prefetch *p = li->prefetch;
+    li_prefetch_stop(li);
+    for(int64_t i=0; i<p->chunk_number; i++) {
+        free(p->chunks[i].data);
+        free(p->chunks[i].line_offsets);
+        free(p->chunks[i].line_lengths);
+        free(p->chunks[i].line_positions);
+    }
+    free(p->chunks);
+    free(p->buffer);
+    pthread_mutex_destroy(&p->mutex);
+    pthread_cond_destroy(&p->chunk_filled);
+    pthread_cond_destroy(&p->chunk_released);
+    free(p);
+    li->prefetch = NULL;
+}
+
+/*
+ * Take the next chunk from the thread, waiting for it if necessary.
+ */
+static void li_prefetch_next_chunk(LI_Prefetch *p) {
+    pthread_mutex_lock(&p->mutex);
+    if(p->released < p->consumed - 1) { // Release all but the current chunk
+        p->released = p->consumed - 1;
+        pthread_cond_signal(&p->chunk_released);
+    }
+    while(p->consumed == p->produced) {
+        pthread_cond_wait(&p->chunk_filled, &p->mutex);
+    }
+    p->chunk = &p->chunks[p->consumed++ % p->chunk_number];
+    pthread_mutex_unlock(&p->mutex);
+    p->line_index = 0;
+    p->eof = p->chunk->eof;
+}
+
+static void li_prefetch_read_line(LI *li) {
+    LI_Prefetch *p = li->prefetch;
+    while(p->chunk == NULL || p->line_index >= p->chunk->line_number) {
+        if(p->eof) {
+            li->line = NULL;
+            li->line_length = 0;
+            p->position = p->chunk->end_position;
+            return;
+        }
+        li_prefetch_next_chunk(p);
+    }
+    LI_Chunk *chunk = p->chunk;
+    int64_t i = p->line_index++;
+    li->line = chunk->data + chunk->line_offsets[i];
+    li->line_length = chunk->line_lengths[i];
+    p->position = p->line_index < chunk->line_number ? chunk->line_positions[p->line_index] : chunk->end_position;
+}
+
+static int64_t li_position(LI *li) {
+    if(li->data != NULL) {
+        return li_mmap_tell(li);
+    }
+    if(li->prefetch != NULL) {
+        return li->prefetch->position;
+    }
+    return li_stream_position(li);
+}
+
+/*
+ * Read the next line into li->line, switching buffers so that the previous line remains valid.
+ */
+static void li_read_line(LI *li) {
+    li->line_peeked = 0;
+    li->buffer_index = 1 - li->buffer_index;
+    if(li->data != NULL) { // Memory mapped, just find the end of the line
+        if(li->data_offset >= li->data_length) {
+            li->line = NULL;
+            li->line_length = 0;
+            return;
+        }
+        char *line = li->data + li->data_offset;
+        char *end = memchr(line, '\n', li->data_length - li->data_offset);
+        int64_t length = end == NULL ? li->data_length - li->data_offset : end - line;
+        li->data_offset += end == NULL ? length : length + 1;
+#ifdef USE_HTSLIB
+        if(length > 0 && line[length-1] == '\r') { // Strip windows line endings, as bgzf_getline does
+            length--;
+        }
+#endif
+        li->line = line;
+        li->line_length = length;
+        return;
+    }
+    if(li->prefetch != NULL) {
+        li_prefetch_read_line(li);
+        return;
+    }
+    int64_t i = li->buffer_index;
+    int64_t length = li_stream_read_line(li, &li->buffers[i], &li->buffer_capacities[i]);
+    li->line = length < 0 ? NULL : li->buffers[i];
+    li->line_length = length < 0 ? 0 : length;
+}
+
+int64_t taffy_thread_number = 1;
+
+int64_t taffy_prefetch = 0;
+
+int64_t taffy_blocks_in_flight = 0;
+
+LI *LI_construct2(FILE *fh, int64_t thread_number, int64_t prefetch) {
+    LI *li = st_calloc(1, sizeof(LI));
+    if(li_mmap(li, fh)) {
+#ifndef USE_HTSLIB
+        li->fh = fh;
+#endif
+    }
+    else {
+#ifdef USE_HTSLIB
+        li->bgzf = bgzf_dopen(fileno(fh), "r");
+        assert(li->bgzf != NULL);
+        if (bgzf_compression(li->bgzf) == 2) {
+            if (thread_number > 1) { // Decompress blocks in parallel, seeking remains supported by the pool
+                if (bgzf_mt(li->bgzf, thread_number, 256) != 0) {
+                    fprintf(stderr, "Unable to start %" PRIi64 " bgzf decompression threads\n", thread_number);
+                    exit(1);
+                }
+            }
+            else if (bgzf_index_build_init(li->bgzf) != 0) {
+                assert(false);
+            }
+        }
 #else
-    li->fh = fh;
-    li->prev_pos = ftell(li->fh);
-    li->pos = li->prev_pos;
-    li->line = stFile_getLineFromFile(fh);
+        li->fh = fh;
 #endif
+    }
+    li->prev_pos = li_position(li);
+    li->pos = li->prev_pos;
+    if(prefetch > 0 && li->data == NULL) {
+        li_prefetch_construct(li, prefetch);
+    }
+    li_read_line(li);
     return li;
 }
 
+LI *LI_construct(FILE *fh) {
+    return LI_construct2(fh, 1, 0);
+}
+
 void LI_destruct(LI *li) {
+    if(li->prefetch != NULL) {
+        li_prefetch_destruct(li);
+    }
+    if(li->data != NULL) {
+        munmap(li->data, li->data_length);
+    }
 #ifdef USE_HTSLIB
-    bgzf_close(li->bgzf);
+    if(li->bgzf != NULL) {
+        bgzf_close(li->bgzf);
+    }
 #endif
+    free(li->buffers[0]);
+    free(li->buffers[1]);
+    if(li->alignment_pool != NULL) {
+        li->alignment_pool_destruct(li->alignment_pool);
+    }
     free(li);
 }
 
 bool LI_indexable(LI *li) {
     assert(li != NULL);
+    if(li->data != NULL) {
+        return true;
+    }
 #ifdef USE_HTSLIB
     int bc = bgzf_compression(li->bgzf);
     return bc == 0 || bc == 2;
@@ -47,57 +404,240 @@ bool LI_indexable(LI *li) {
 #endif
 }
 
-char *LI_get_next_line(LI *li) {
+static int64_t li_line_length(LI *li) {
+    return li->line_peeked && li->line != NULL ? strlen(li->line) : li->line_length;
+}
+
+char *LI_get_next_line_span(LI *li, int64_t *length) {
     char *l = li->line;
+    *length = li_line_length(li);
     li->prev_pos = li->pos;
-#ifdef USE_HTSLIB
-    kstring_t ks = KS_INITIALIZE;
-    li->pos = bgzf_tell(li->bgzf);
-    bgzf_getline(li->bgzf, '\n', &ks);
-    li->line = ks_release(&ks);
-#else
-    li->pos = ftell(li->fh);
-    li->line = stFile_getLineFromFile(li->fh);
-#endif
+    li->pos = li_position(li);
+    li_read_line(li);
     return l;
 }
 
+char *LI_get_next_line(LI *li) {
+    int64_t length;
+    char *l = LI_get_next_line_span(li, &length);
+    if(l == NULL) {
+        return NULL;
+    }
+    char *line = st_malloc(length + 1);
+    memcpy(line, l, length);
+    line[length] = '\0';
+    return line;
+}
+
 char *LI_peek_at_next_line(LI *li) {
+    if(li->line != NULL && li->data != NULL && !li->line_peeked) {
+        // Copy the memory mapped line into a buffer so it is NUL terminated and editable
+        int64_t i = li->buffer_index;
+        if(li->buffer_capacities[i] < li->line_length + 1) {
+            li->buffer_capacities[i] = 2 * (li->line_length + 1);
+            li->buffers[i] = st_realloc(li->buffers[i], li->buffer_capacities[i]);
+        }
+        memcpy(li->buffers[i], li->line, li->line_length);
+        li->buffers[i][li->line_length] = '\0';
+        li->line = li->buffers[i];
+    }
+    li->line_peeked = 1;
     return li->line;
 }
 
+char *LI_peek_at_next_line_span(LI *li, int64_t *length) {
+    *length = li_line_length(li);
+    return li->line;
+}
+
+stList *LI_split_span(const char *line, int64_t length) {
+    stList *tokens = stList_construct3(0, free);
+    int64_t i=0;
+    while(1) {
+        while(i < length && isspace(line[i])) { // Skip whitespace
+            i++;
+        }
+        if(i >= length) {
+            break;
+        }
+        int64_t j = i;
+        while(j < length && !isspace(line[j])) {
+            j++;
+        }
+        char *token = st_malloc(j - i + 1);
+        memcpy(token, line + i, j - i);
+        token[j - i] = '\0';
+        stList_append(tokens, token);
+        i = j;
+    }
+    return tokens;
+}
+
 void LI_seek(LI *li, int64_t position) {
     li->prev_pos = position;
     li->pos = position;
+    if(li->data != NULL) {
+        li->data_offset = li_mmap_offset(position);
+        assert(li->data_offset >= 0 && li->data_offset <= li->data_length);
+        return;
+    }
+    if(li->prefetch != NULL) { // Drain the read ahead lines, then restart reading from the new position
+        li_prefetch_stop(li);
+        li->prefetch->position = position;
+    }
 #ifdef USE_HTSLIB
     int ret = bgzf_seek(li->bgzf, position, SEEK_SET);
 #else
     int ret = fseek(li->fh, position, SEEK_SET);
 #endif
     assert(ret == 0);
+    if(li->prefetch != NULL) {
+        li_prefetch_start(li);
+    }
 }
 
 int64_t LI_tell(LI *li) {
     return li->prev_pos;
 }
 
-LW *LW_construct(FILE *fh, bool use_compression) {
+int64_t LI_tell_next(LI *li) {
+    return li->pos;
+}
+
+int64_t taffy_compression_level = -1;
+
+LW *LW_construct2(FILE *fh, bool use_compression, int64_t thread_number, int64_t compression_level) {
     LW *lw = st_calloc(1, sizeof(LW));
     lw->fh = fh;
     if(use_compression) {
 #ifdef USE_HTSLIB
-        lw->bgzf = bgzf_dopen(fileno(fh), "w");
+        assert(compression_level >= -1 && compression_level <= 9);
+        char mode[3] = { 'w', compression_level < 0 ? '\0' : '0' + compression_level, '\0' };
+        lw->bgzf = bgzf_dopen(fileno(fh), mode);
         assert(lw->bgzf);
         assert(bgzf_compression(lw->bgzf) == 2);
         if (bgzf_index_build_init(lw->bgzf) != 0) {
             assert(false);
         }
+        if (thread_number > 1) { // Compress blocks in parallel, the pool writes them out in order
+            if (bgzf_mt(lw->bgzf, thread_number, 256) != 0) {
+                fprintf(stderr, "Unable to start %" PRIi64 " bgzf compression threads\n", thread_number);
+                exit(1);
+            }
+        }
 #endif
     }
     return lw;
 }
 
+LW *LW_construct(FILE *fh, bool use_compression) {
+    return LW_construct2(fh, use_compression, 1, -1);
+}
+
+#define LW_FLUSH_SIZE (1 << 20) // Write the buffered output to the stream once there is at least this much
+
+void LW_flush(LW *lw) {
+    if(lw->buffer_length == 0 || lw->fh == NULL) { // Nothing to write, or the output is kept in memory
+        return;
+    }
+#ifdef USE_HTSLIB
+    if(lw->bgzf) {
+        if(bgzf_write(lw->bgzf, lw->buffer, lw->buffer_length) != lw->buffer_length) {
+            st_errAbort("Failed to write to bgzf stream");
+        }
+        lw->position += lw->buffer_length;
+        lw->buffer_length = 0;
+        return;
+    }
+#endif
+    if(fwrite(lw->buffer, 1, lw->buffer_length, lw->fh) != lw->buffer_length) {
+        st_errAbort("Failed to write to output stream");
+    }
+    lw->position += lw->buffer_length;
+    lw->buffer_length = 0;
+}
+
+int64_t LW_tell(LW *lw) {
+    return lw->position + lw->buffer_length;
+}
+
+#ifdef USE_HTSLIB
+static uint64_t read_uint64_le(FILE *fh) { // As bgzf writes the integers of its index
+    unsigned char b[8];
+    if(fread(b, 1, 8, fh) != 8) {
+        st_errAbort("Truncated bgzf index");
+    }
+    uint64_t i = 0;
+    for(int64_t j=7; j>=0; j--) {
+        i = (i << 8) | b[j];
+    }
+    return i;
+}
+#endif
+
+void LW_file_positions(LW *lw, const char *file, int64_t *positions, int64_t position_number) {
+    LW_flush(lw);
+#ifdef USE_HTSLIB
+    if(lw->bgzf) {
+        // The bgzf index gives the offsets in the file and in the uncompressed output of the start of each bgzf
+        // block after the first. It can only be got by writing it out, so is written to a temporary file and read back.
+        FILE *fh = tmpfile();
+        hFILE *index_fh = fh == NULL ? NULL : hdopen(dup(fileno(fh)), "w"); // Its own descriptor, closed by hclose
+        if(index_fh == NULL) {
+            st_errAbort("Unable to make a temporary file for the bgzf index of %s\n", file);
+        }
+        if(bgzf_index_dump_hfile(lw->bgzf, index_fh, file) != 0 || hclose(index_fh) != 0) {
+            st_errAbort("Unable to write the bgzf index of %s\n", file);
+        }
+        rewind(fh);
+        int64_t block_number = read_uint64_le(fh) + 1;
+        int64_t *block_offsets = st_malloc(block_number * sizeof(int64_t)); // In the file
+        int64_t *block_positions = st_malloc(block_number * sizeof(int64_t)); // In the uncompressed output
+        block_offsets[0] = 0;
+        block_positions[0] = 0;
+        for(int64_t i=1; i<block_number; i++) {
+            block_offsets[i] = read_uint64_le(fh);
+            block_positions[i] = read_uint64_le(fh);
+        }
+        fclose(fh);
+        for(int64_t i=0; i<position_number; i++) { // Find the last block starting at or before each position
+            int64_t j = 0, k = block_number;
+            while(k - j > 1) {
+                int64_t l = j + (k - j) / 2;
+                if(block_positions[l] <= positions[i]) {
+                    j = l;
+                }
+                else {
+                    k = l;
+                }
+            }
+            assert(positions[i] - block_positions[j] < 65536);
+            positions[i] = (block_offsets[j] << 16) | (positions[i] - block_positions[j]);
+        }
+        free(block_offsets);
+        free(block_positions);
+    }
+#endif
+}
+
+/*
+ * Make sure there is room to append length more bytes to the buffer.
+ */
+static inline void lw_reserve(LW *lw, int64_t length) {
+    if(lw->buffer_length + length > lw->buffer_capacity) {
+        lw->buffer_capacity = 2 * (lw->buffer_length + length) + LW_FLUSH_SIZE;
+        lw->buffer = st_realloc(lw->buffer, lw->buffer_capacity);
+    }
+}
+
+static inline void lw_maybe_flush(LW *lw) {
+    if(lw->buffer_length >= LW_FLUSH_SIZE) {
+        LW_flush(lw);
+    }
+}
+
 void LW_destruct(LW *lw, bool clean_up_file_handle) {
+    LW_flush(lw);
 #ifdef USE_HTSLIB
     if(lw->bgzf) {
         if(bgzf_flush(lw->bgzf)) {
@@ -108,44 +648,85 @@ void LW_destruct(LW *lw, bool clean_up_file_handle) {
         }
     }
 #endif
-    if(clean_up_file_handle) {
-        fclose(lw->fh);
+    if(lw->fh != NULL) { // Unless the output was kept in memory
+        if(clean_up_file_handle) {
+            fclose(lw->fh);
+        }
+        else {
+            fflush(lw->fh);
+        }
     }
+    free(lw->buffer);
     free(lw);
 }
 
 int LW_write(LW *lw, const char *string, ...) {
-#ifdef USE_HTSLIB
-    int i;
+    // Format the string onto the end of the buffer, growing the buffer if it is too small
     va_list ap;
-    if(lw->bgzf) { // Use bgzf compression
-        // Figure out how long the string is to build the buffer
-        va_start(ap, string);
-        int j = vsnprintf(NULL, 0, string, ap)+1;
-        assert(j >= 0);
-        va_end(ap);
-        // Now write the string into the buffer
-        va_start(ap, string);
-        char ret[j];
-        i = vsnprintf(ret, j, string, ap);
-        assert(ret[i] == '\0');
-        // Finally, write the buffer to the bgzf stream
-        i = bgzf_write(lw->bgzf, ret, i);
-        assert(i+1 == j);
-        va_end(ap);
-    }
-    else { // No compression, just fprintf to the stream
+    va_start(ap, string);
+    int i = vsnprintf(lw->buffer + lw->buffer_length, lw->buffer_capacity - lw->buffer_length, string, ap);
+    va_end(ap);
+    assert(i >= 0);
+    if(lw->buffer_length + i >= lw->buffer_capacity) {
+        lw_reserve(lw, i + 1);
         va_start(ap, string);
-        i = vfprintf(lw->fh, string, ap);
+        vsnprintf(lw->buffer + lw->buffer_length, lw->buffer_capacity - lw->buffer_length, string, ap);
         va_end(ap);
     }
+    lw->buffer_length += i;
+    lw_maybe_flush(lw);
     return i;
-#else
-    va_list ap;
-    va_start(ap, string);
-    int i = vfprintf(lw->fh, string, ap);
-    va_end(ap);
-    return i;
-#endif
 }
 
+void LW_write_char(LW *lw, char c) {
+    lw_reserve(lw, 1);
+    lw->buffer[lw->buffer_length++] = c;
+    lw_maybe_flush(lw);
+}
+
+void LW_write_char_run(LW *lw, char c, int64_t n) {
+    lw_reserve(lw, n);
+    memset(lw->buffer + lw->buffer_length, c, n);
+    lw->buffer_length += n;
+    lw_maybe_flush(lw);
+}
+
+void LW_write_bytes(LW *lw, const char *bytes, int64_t length) {
+    lw_reserve(lw, length);
+    memcpy(lw->buffer + lw->buffer_length, bytes, length);
+    lw->buffer_length += length;
+    lw_maybe_flush(lw);
+}
+
+void LW_write_string(LW *lw, const char *string) {
+    LW_write_bytes(lw, string, strlen(string));
+}
+
+void LW_write_int64(LW *lw, int64_t i) {
+    char digits[21]; // Enough for the sign and 19 digits of an int64
+    int64_t j = sizeof(digits);
+    uint64_t k = i < 0 ? -(uint64_t)i : (uint64_t)i;
+    do {
+        digits[--j] = '0' + k % 10;
+        k /= 10;
+    } while(k > 0);
+    if(i < 0) {
+        digits[--j] = '-';
+    }
+    LW_write_bytes(lw, digits + j, sizeof(digits) - j);
+}
+
+void LW_write_newline(LW *lw) {
+    LW_write_char(lw, '\n');
+}
+
+char *LW_reserve(LW *lw, int64_t length) {
+    lw_reserve(lw, length);
+    return lw->buffer + lw->buffer_length;
+}
+
+void LW_commit(LW *lw, int64_t length) {
+    assert(lw->buffer_length + length <= lw->buffer_capacity);
+    lw->buffer_length += length;
+    lw_maybe_flush(lw);
+}
@@ -4,75 +4,380 @@
 #include "taf.h"
 #include "sonLib.h"
 #include "line_iterator.h"
+#include <pthread.h>
 
-Alignment *maf_read_block(LI *li) {
-    while(1) {
-        char *line = LI_get_next_line(li);
+static inline bool is_space(char c) { // As isspace in the C locale
+    return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+/*
+ * Get the next whitespace separated field of line[*i, end), setting its length and moving *i past it.
+ * Returns NULL if there are no more fields.
+ */
+static inline const char *next_field(const char *line, int64_t *i, int64_t end, int64_t *field_length) {
+    int64_t j = *i;
+    while(j < end && is_space(line[j])) {
+        j++;
+    }
+    int64_t k = j;
+    while(k < end && !is_space(line[k])) {
+        k++;
+    }
+    *i = k;
+    *field_length = k - j;
+    return k > j ? line + j : NULL;
+}
+
+/*
+ * As next_field, but aborts if the s line is missing the field.
+ */
+static const char *next_s_line_field(const char *line, int64_t *i, int64_t end, int64_t *field_length) {
+    const char *field = next_field(line, i, end, field_length);
+    if(field == NULL) {
+        st_errAbort("MAF s line has too few fields: %.*s\n", (int)end, line);
+    }
+    return field;
+}
+
+static int64_t parse_int(const char *field, int64_t field_length) { // As atol
+    int64_t i = 0, j = 0;
+    bool negative = field_length > 0 && field[0] == '-';
+    if(field_length > 0 && (field[0] == '-' || field[0] == '+')) {
+        i++;
+    }
+    while(i < field_length && field[i] >= '0' && field[i] <= '9') {
+        j = j * 10 + (field[i++] - '0');
+    }
+    return negative ? -j : j;
+}
+
+/*
+ * Get the type of a line, which is the first field if it is a single character (e.g. 'a', 's', 'i', 'e' or 'q'),
+ * '\0' if the line is blank or '#' otherwise. Sets *i to the offset following the first field.
+ */
+static char line_type(const char *line, int64_t length, int64_t *i) {
+    int64_t field_length;
+    *i = 0;
+    const char *field = next_field(line, i, length, &field_length);
+    return field == NULL ? '\0' : (field_length == 1 ? field[0] : '#');
+}
+
+/*
+ * Parse the fields of an s line, following the "s", into a new row, copying the bases into the next row of the
+ * growing matrix of bases of the block.
+ */
+static Alignment_Row *parse_s_line(const char *line, int64_t i, int64_t length, Alignment *alignment,
+                                   char **matrix, int64_t *row_capacity) {
+    Alignment_Row *row = alignment_row_construct(alignment);
+    int64_t field_length;
+    const char *field = next_s_line_field(line, &i, length, &field_length);
+    row->sequence_name = sequence_name_intern(field, field_length);
+    row->sequence_name_interned = 1;
+    field = next_s_line_field(line, &i, length, &field_length);
+    row->start = parse_int(field, field_length);
+    field = next_s_line_field(line, &i, length, &field_length);
+    row->length = parse_int(field, field_length);
+    field = next_s_line_field(line, &i, length, &field_length);
+    assert(field_length == 1 && (field[0] == '+' || field[0] == '-'));
+    row->strand = field[0] == '+';
+    field = next_s_line_field(line, &i, length, &field_length);
+    row->sequence_length = parse_int(field, field_length);
+    field = next_s_line_field(line, &i, length, &field_length); // The bases
+
+    // Copy the bases straight into the matrix
+    if(alignment->row_number == 0) {
+        alignment->column_number = field_length;
+    }
+    else if(field_length != alignment->column_number) {
+        st_errAbort("MAF s line has %" PRIi64 " bases, but the block has %" PRIi64 " columns: %.*s\n",
+                    field_length, alignment->column_number, (int)length, line);
+    }
+    if(alignment->row_number == *row_capacity) {
+        *row_capacity = 2 * *row_capacity + 16;
+        *matrix = alignment_bases_matrix_resize(*matrix, *row_capacity, alignment->column_number);
+    }
+    char *bases = *matrix + alignment->row_number * (alignment->column_number + 1);
+    memcpy(bases, field, field_length);
+    bases[field_length] = '\0';
+    return row;
+}
+
+/*
+ * The lines of MAF blocks, read either from a line iterator or from a buffer of lines, as the workers of a
+ * MafReader parse them.
+ */
+typedef struct _Maf_Lines {
+    LI *li; // If not NULL the lines are read from li, which also provides the recycled allocations of the blocks
+    const char *text; // Otherwise the lines are text[offset, length), each terminated by a newline
+    int64_t length;
+    int64_t offset;
+} Maf_Lines;
+
+static const char *maf_lines_next(Maf_Lines *lines, int64_t *length) {
+    if(lines->li != NULL) {
+        return LI_get_next_line_span(lines->li, length);
+    }
+    if(lines->offset >= lines->length) {
+        return NULL;
+    }
+    const char *line = lines->text + lines->offset;
+    const char *end = memchr(line, '\n', lines->length - lines->offset);
+    *length = end == NULL ? lines->length - lines->offset : end - line;
+    lines->offset += *length + 1;
+    return line;
+}
+
+static Alignment *maf_read_block_2(Maf_Lines *lines) {
+    int64_t length, i;
+    const char *line;
+    char type;
+    while(1) { // Find the "a" line starting the block
+        line = maf_lines_next(lines, &length);
         if(line == NULL) {
             return NULL;
         }
-        stList *tokens = stString_split(line);
-        free(line);
-        if(stList_length(tokens) == 0) {
-            stList_destruct(tokens);
+        type = line_type(line, length, &i);
+        if(type == 'a') {
+            break;
+        }
+        assert(type != 's'); // Can not be an s line without a prior a line - we will ignore this line
+    }
+
+    // Read the rows of the block, up to the next blank line
+    LI *li = lines->li;
+    Alignment *alignment = alignment_pool_take_alignment(li);
+    Alignment_Row **p_row = &(alignment->row);
+    int64_t matrix_size;
+    char *matrix = alignment_pool_take_buffer(li, ALIGNMENT_POOL_BASES_MATRIX, &matrix_size);
+    int64_t row_capacity = 0;
+    while((line = maf_lines_next(lines, &length)) != NULL && (type = line_type(line, length, &i)) != '\0') {
+        if(type != 's') {
+            assert(type == 'i' || type == 'e' || type == 'q'); // Must be an "i", "e" or "q" line, which we ignore
             continue;
         }
-        if(strcmp(stList_get(tokens, 0), "a") == 0) { // If is an "a" line
-            stList_destruct(tokens);
-            Alignment *alignment = st_calloc(1, sizeof(Alignment));
-            Alignment_Row **p_row = &(alignment->row);
-            while(1) {
-                line = LI_get_next_line(li);
-                if(line == NULL) {
-                    return alignment;
-                }
-                tokens = stString_split(line);
-                free(line);
-                if(stList_length(tokens) == 0) {
-                    stList_destruct(tokens);
-                    return alignment;
-                }
-                if(strcmp(stList_get(tokens, 0), "s") != 0) {
-                    assert(strcmp(stList_get(tokens, 0), "i") == 0 || strcmp(stList_get(tokens, 0), "e") == 0); // Must be an "i" or "e" line, which we ignore
-                    stList_destruct(tokens);
-                    continue;
-                }
-                assert(strcmp(stList_get(tokens, 0), "s") == 0); // Must be an "s" line
-                Alignment_Row *row = st_calloc(1, sizeof(Alignment_Row));
-                alignment->row_number++;
-                *p_row = row;
-                p_row = &(row->n_row);
-                row->sequence_name = stString_copy(stList_get(tokens, 1));
-                row->start = atol(stList_get(tokens, 2));
-                row->length = atol(stList_get(tokens, 3));
-                assert(strcmp(stList_get(tokens, 4), "+") == 0 || strcmp(stList_get(tokens, 4), "-") == 0);
-                row->strand = strcmp(stList_get(tokens, 4), "+") == 0;
-                row->sequence_length = atol(stList_get(tokens, 5));
-                row->bases = stString_copy(stList_get(tokens, 6));
-                stList_destruct(tokens);
-                if(alignment->row_number == 1) {
-                    alignment->column_number = strlen(row->bases);
-                    alignment->column_tags = st_calloc(alignment->column_number, sizeof(Tag *));
-                }
-                else {
-                    assert(alignment->column_number == strlen(row->bases));
-                }
+        Alignment_Row *row = parse_s_line(line, i, length, alignment, &matrix, &row_capacity);
+        alignment->row_number++;
+        *p_row = row;
+        p_row = &(row->n_row);
+    }
+    alignment->column_tags = alignment_pool_take_column_tags(li, alignment->column_number,
+                                                             &alignment->column_tags_size);
+    if(alignment->row_number > 0) { // Make the rows views of the matrix of bases
+        alignment_set_bases_matrix(alignment, alignment_bases_matrix_resize(matrix, alignment->row_number,
+                                                                            alignment->column_number));
+    }
+    else { // Keep any recycled matrix for the next block
+        alignment_pool_return_buffer(li, ALIGNMENT_POOL_BASES_MATRIX, matrix, matrix_size);
+    }
+    return alignment;
+}
+
+Alignment *maf_read_block(LI *li) {
+    Maf_Lines lines = { li, NULL, 0, 0 };
+    return maf_read_block_2(&lines);
+}
+
+/*
+ * A batch of consecutive blocks of a MAF file, read as text by one worker of a MafReader at a time and then
+ * parsed by the worker while the others read and parse the following batches.
+ */
+typedef struct _MafReaderBatch {
+    const char *text; // The lines of the blocks, each terminated by a newline, in the memory mapped file if the
+    // file is memory mapped, otherwise in buffer
+    int64_t length;
+    char *buffer;
+    int64_t capacity;
+    stList *blocks; // The blocks parsed from the text, in order
+    bool parsed;
+} MafReaderBatch;
+
+struct _MafReader {
+    LI *li;
+    int64_t batch_size;
+    MafReaderBatch *batches; // A ring of window batches, batch i being batches[i % window]
+    int64_t window;
+    int64_t batches_read; // The number of batches read from li
+    int64_t batch; // The batch the next block is returned from
+    int64_t block; // The index in the batch's blocks of the next block returned
+    bool eof; // Set once all the lines of li have been read
+    pthread_t *threads;
+    int64_t thread_number;
+    pthread_mutex_t read_mutex; // Held by the worker reading from li
+    pthread_mutex_t mutex;
+    pthread_cond_t cond; // Signalled when a batch is read, parsed or finished with
+    bool stop;
+};
+
+static bool is_a_line(const char *line, int64_t length) {
+    int64_t i;
+    return line_type(line, length, &i) == 'a';
+}
+
+/*
+ * Read the lines of the blocks of a batch, at least batch_size bytes of them unless the file ends, stopping at the
+ * "a" line of the next block.
+ */
+static void maf_reader_read_batch(MafReader *reader, MafReaderBatch *batch) {
+    LI *li = reader->li;
+    batch->length = 0;
+    int64_t length;
+    const char *line = LI_peek_at_next_line_span(li, &length);
+    // If the lines are in the memory mapped file they follow one another, so are used in place
+    bool in_place = line != NULL && li->data != NULL && line >= li->data && line < li->data + li->data_length;
+    batch->text = in_place ? line : batch->buffer;
+    while((line = LI_peek_at_next_line_span(li, &length)) != NULL) {
+        if(batch->length >= reader->batch_size && is_a_line(line, length)) {
+            break;
+        }
+        if(!in_place) {
+            if(batch->length + length + 1 > batch->capacity) {
+                batch->capacity = 2 * (batch->length + length + 1);
+                batch->buffer = st_realloc(batch->buffer, batch->capacity);
             }
-            return alignment;
+            memcpy(batch->buffer + batch->length, line, length);
+            batch->buffer[batch->length + length] = '\n';
+            batch->text = batch->buffer;
+        }
+        assert(batch->text + batch->length == line || !in_place);
+        batch->length += length + 1;
+        LI_get_next_line_span(li, &length);
+    }
+    if(in_place && batch->text + batch->length > li->data + li->data_length) { // The last line has no newline
+        batch->length = li->data + li->data_length - batch->text;
+    }
+}
+
+static void *maf_reader_worker(void *arg) {
+    MafReader *reader = arg;
+    while(1) {
+        // Read the next batch, one worker at a time
+        pthread_mutex_lock(&reader->read_mutex);
+        pthread_mutex_lock(&reader->mutex);
+        while(!reader->stop && !reader->eof &&
+              reader->batches_read >= reader->batch + reader->window) { // Don't get too far ahead
+            pthread_cond_wait(&reader->cond, &reader->mutex);
+        }
+        if(reader->stop || reader->eof) {
+            pthread_mutex_unlock(&reader->mutex);
+            pthread_mutex_unlock(&reader->read_mutex);
+            break;
+        }
+        MafReaderBatch *batch = &reader->batches[reader->batches_read % reader->window];
+        pthread_mutex_unlock(&reader->mutex);
+        maf_reader_read_batch(reader, batch);
+        pthread_mutex_lock(&reader->mutex);
+        if(batch->length == 0) {
+            reader->eof = 1;
         }
         else {
-            assert(strcmp(stList_get(tokens, 0), "s") != 0); // Can not be an s line without a prior a line - we will ignore this line
-            stList_destruct(tokens);
+            reader->batches_read++;
+        }
+        pthread_cond_broadcast(&reader->cond);
+        pthread_mutex_unlock(&reader->mutex);
+        pthread_mutex_unlock(&reader->read_mutex);
+        if(batch->length == 0) {
+            break;
+        }
+
+        // Parse it
+        Maf_Lines lines = { NULL, batch->text, batch->length, 0 };
+        Alignment *alignment;
+        while((alignment = maf_read_block_2(&lines)) != NULL) {
+            stList_append(batch->blocks, alignment);
+        }
+        pthread_mutex_lock(&reader->mutex);
+        batch->parsed = 1;
+        pthread_cond_broadcast(&reader->cond);
+        pthread_mutex_unlock(&reader->mutex);
+    }
+    return NULL;
+}
+
+MafReader *maf_reader_construct(LI *li, int64_t thread_number, int64_t batch_size) {
+    MafReader *reader = st_calloc(1, sizeof(MafReader));
+    reader->li = li;
+    reader->batch_size = batch_size;
+    reader->window = 2 * thread_number;
+    reader->batches = st_calloc(reader->window, sizeof(MafReaderBatch));
+    for(int64_t i=0; i<reader->window; i++) {
+        reader->batches[i].blocks = stList_construct();
+    }
+    reader->thread_number = thread_number;
+    pthread_mutex_init(&reader->read_mutex, NULL);
+    pthread_mutex_init(&reader->mutex, NULL);
+    pthread_cond_init(&reader->cond, NULL);
+    reader->threads = st_malloc(thread_number * sizeof(pthread_t));
+    for(int64_t i=0; i<thread_number; i++) {
+        if(pthread_create(&reader->threads[i], NULL, maf_reader_worker, reader) != 0) {
+            st_errAbort("Unable to start %" PRIi64 " MAF parsing threads\n", thread_number);
+        }
+    }
+    return reader;
+}
+
+MafReader *maf_reader_open(LI *li, int64_t thread_number) {
+    return thread_number > 1 ? maf_reader_construct(li, thread_number, MAF_READER_BATCH_SIZE) : NULL;
+}
+
+Alignment *maf_reader_next(MafReader *reader) {
+    pthread_mutex_lock(&reader->mutex);
+    while(1) {
+        while(reader->batch == reader->batches_read && !reader->eof) { // Wait for the batch to be read
+            pthread_cond_wait(&reader->cond, &reader->mutex);
         }
+        if(reader->batch == reader->batches_read) { // There are no more batches
+            pthread_mutex_unlock(&reader->mutex);
+            return NULL;
+        }
+        MafReaderBatch *batch = &reader->batches[reader->batch % reader->window];
+        while(!batch->parsed) {
+            pthread_cond_wait(&reader->cond, &reader->mutex);
+        }
+        if(reader->block < stList_length(batch->blocks)) {
+            pthread_mutex_unlock(&reader->mutex);
+            return stList_get(batch->blocks, reader->block++);
+        }
+        // Done with the batch, so let the workers read another into its place
+        stList_setLength(batch->blocks, 0);
+        batch->parsed = 0;
+        reader->batch++;
+        reader->block = 0;
+        pthread_cond_broadcast(&reader->cond);
+    }
+}
+
+void maf_reader_destruct(MafReader *reader) {
+    pthread_mutex_lock(&reader->mutex);
+    reader->stop = 1;
+    pthread_cond_broadcast(&reader->cond);
+    pthread_mutex_unlock(&reader->mutex);
+    for(int64_t i=0; i<reader->thread_number; i++) {
+        pthread_join(reader->threads[i], NULL);
+    }
+    for(int64_t i=reader->batch; i<reader->batches_read; i++) { // Clean up the blocks not returned
+        MafReaderBatch *batch = &reader->batches[i % reader->window];
+        for(int64_t j=i == reader->batch ? reader->block : 0; j<stList_length(batch->blocks); j++) {
+            alignment_destruct(stList_get(batch->blocks, j), 1);
+        }
+    }
+    for(int64_t i=0; i<reader->window; i++) {
+        stList_destruct(reader->batches[i].blocks);
+        free(reader->batches[i].buffer);
     }
+    pthread_mutex_destroy(&reader->read_mutex);
+    pthread_mutex_destroy(&reader->mutex);
+    pthread_cond_destroy(&reader->cond);
+    free(reader->batches);
+    free(reader->threads);
+    free(reader);
 }
 
 Tag *parse_header(stList *tokens, char *header_prefix, char *delimiter);
 
 Tag *maf_read_header(LI *li) {
-    char *line = LI_get_next_line(li);
-    stList *tokens = stString_split(line);
-    free(line);
+    int64_t length;
+    char *line = LI_get_next_line_span(li, &length);
+    stList *tokens = LI_split_span(line, length);
     Tag *tag = parse_header(tokens, "##maf", "=");
     stList_destruct(tokens);
 
@@ -80,18 +385,30 @@ Tag *maf_read_header(LI *li) {
 }
 
 void maf_write_block2(Alignment *alignment, LW *lw, bool color_bases) {
-    LW_write(lw, "a\n");
+    alignment_make_row_bases(alignment);
+    LW_write_string(lw, "a\n");
     Alignment_Row *row = alignment->row;
     while(row != NULL) {
         char *bases = color_bases ? color_base_string(row->bases, alignment->column_number) : row->bases;
-        LW_write(lw, "s\t%s\t%" PRIi64 "\t%" PRIi64 "\t%s\t%" PRIi64 "\t%s\n", row->sequence_name, row->start, row->length,
-                row->strand ? "+" : "-", row->sequence_length, bases);
+        LW_write_string(lw, "s\t");
+        LW_write_string(lw, row->sequence_name);
+        LW_write_char(lw, '\t');
+        LW_write_int64(lw, row->start);
+        LW_write_char(lw, '\t');
+        LW_write_int64(lw, row->length);
+        LW_write_char(lw, '\t');
+        LW_write_char(lw, row->strand ? '+' : '-');
+        LW_write_char(lw, '\t');
+        LW_write_int64(lw, row->sequence_length);
+        LW_write_char(lw, '\t');
+        LW_write_string(lw, bases);
+        LW_write_newline(lw);
         row = row->n_row;
         if(color_bases) {
             free(bases);
         }
     }
-    LW_write(lw, "\n"); // Add a blank line at the end of the block
+    LW_write_newline(lw); // Add a blank line at the end of the block
 }
 
 void maf_write_block(Alignment *alignment, LW *lw) {
@@ -404,6 +404,9 @@ int64_t align_interstitial_gaps_abpoa(Alignment *alignment) {
 }
 
 Alignment *alignment_merge_adjacent(Alignment *left_alignment, Alignment *right_alignment) {
+    alignment_make_row_bases(left_alignment);
+    alignment_make_row_bases(right_alignment);
+
     // First un-link any rows that are substitutions as these can't be merged
     Alignment_Row *r_row = right_alignment->row;
     while(r_row != NULL) {
@@ -420,10 +423,11 @@ Alignment *alignment_merge_adjacent(Alignment *left_alignment, Alignment *right_
     while(r_row != NULL) {
         if(r_row->l_row == NULL) { // Is an insertion
             // Make a new l_row
-            Alignment_Row *l_row = st_calloc(1, sizeof(Alignment_Row));
+            Alignment_Row *l_row = alignment_row_construct(left_alignment);
 
             // Set coordinates
-            l_row->sequence_name = stString_copy(r_row->sequence_name);
+            alignment_row_set_sequence_name(l_row, r_row->sequence_name_interned ? r_row->sequence_name :
+                                                   stString_copy(r_row->sequence_name), r_row->sequence_name_interned);
             l_row->start = r_row->start;
             l_row->length = 0; // is an empty alignment
             l_row->sequence_length = r_row->sequence_length;
@@ -461,9 +465,7 @@ Alignment *alignment_merge_adjacent(Alignment *left_alignment, Alignment *right_
         if(l_row->r_row == NULL) {
             // Is a deletion, so add in trailing gaps equal in length to the right alignment length plus any interstitial
             // gap
-            char *bases = stString_print("%s%s", l_row->bases, right_gap);
-            free(l_row->bases);
-            l_row->bases = bases;
+            alignment_row_set_bases(l_row, stString_print("%s%s", l_row->bases, right_gap));
         }
         else {
             Alignment_Row *r_row = l_row->r_row;
@@ -476,9 +478,8 @@ Alignment *alignment_merge_adjacent(Alignment *left_alignment, Alignment *right_
             // Is not a deletion, so merge together two adjacent rows
             assert(r_row->left_gap_sequence != NULL);
             assert(strlen(r_row->left_gap_sequence) == interstitial_alignment_length);
-            char *bases = stString_print("%s%s%s", l_row->bases, r_row->left_gap_sequence, r_row->bases);
-            free(l_row->bases); // clean up
-            l_row->bases = bases;
+            alignment_row_set_bases(l_row, stString_print("%s%s%s", l_row->bases, r_row->left_gap_sequence,
+                                                          r_row->bases));
 
             // Update the left row's length coordinate
             int64_t interstitial_bases = r_row->start - (l_row->start + l_row->length);
@@ -503,6 +504,8 @@ Alignment *alignment_merge_adjacent(Alignment *left_alignment, Alignment *right_
     int64_t total_column_number = left_alignment->column_number + right_alignment->column_number + interstitial_alignment_length;
 
     // Fix the tags
+    alignment_get_column_tags(left_alignment); // Make sure the tags are parsed
+    alignment_get_column_tags(right_alignment);
     if(left_alignment->column_tags != NULL) {
         assert(right_alignment->column_tags != NULL);
         Tag **combined_column_tags = st_malloc(sizeof(Tag *) * total_column_number); // Allocate an expanded set of columns
@@ -518,10 +521,12 @@ Alignment *alignment_merge_adjacent(Alignment *left_alignment, Alignment *right_
         }
         free(left_alignment->column_tags); // Cleanup, but not the tag strings which we copied
         left_alignment->column_tags = combined_column_tags;
+        left_alignment->column_tags_size = sizeof(Tag *) * total_column_number;
     }
 
     // Fix column number
     left_alignment->column_number = total_column_number;
+    alignment_invalidate_column_bases(left_alignment);
 
     // Clean up
     alignment_destruct(right_alignment, 1);  // Delete the right alignment
@@ -1,6 +1,22 @@
 #include "taf.h"
 #include "sonLib.h"
 #include "line_iterator.h"
+#include <pthread.h>
+
+// classify an alignment column between a query and target base: 'M' match, '*' mismatch (only distinguished
+// for cs cigars), 'I' insertion, 'D' deletion or '.' if both are gaps
+static inline char paf_column_event(char q_base, char t_base, bool cs_cigar) {
+    if (t_base != '-' && q_base != '-') {
+        return t_base != q_base && cs_cigar ? '*' : 'M';
+    }
+    if (t_base == '-' && q_base != '-') {
+        return 'I';
+    }
+    if (t_base != '-' && q_base == '-') {
+        return 'D';
+    }
+    return '.';
+}
 
 // write a single PAF row from the pairwise alignment between the given two MAF block rows
 static void paf_write_row(Alignment_Row *q_row, Alignment_Row *t_row, int64_t num_col, bool cs_cigar, LW *lw) {
@@ -28,140 +44,296 @@ static void paf_write_row(Alignment_Row *q_row, Alignment_Row *t_row, int64_t nu
         target_end = target_start + t_row->length;
     }
 
+    // count the matches and block length so the columns can be written before the cigar
     int64_t num_matches = 0;
     int64_t block_length = 0;
+    for (int64_t i = 0; i < num_col; ++i) {
+        int64_t pos = flip_cigar ? num_col - 1 - i : i;
+        char event = paf_column_event(q_row->bases[pos], t_row->bases[pos], cs_cigar);
+        if (event != '.') {
+            ++block_length;
+            if (event == 'M' || event == '*') {
+                ++num_matches;
+            }
+        }
+    }
 
-    char *cigar_string = (char*)st_malloc(32 * num_col);
-    cigar_string[0] = '\0';
-    char *buffer = (char*)st_malloc(32 * num_col);
-    char *query_buffer = NULL;
-    int64_t query_buffer_length = 0;
-    char *target_buffer = NULL;
-    int64_t target_buffer_length = 0;
-    if (cs_cigar) {
-        query_buffer = (char*)st_malloc(32 * num_col);
-        target_buffer = (char*)st_malloc(32 * num_col);
-    }
-    char current_event[2] = {'.', '\0'};
-    int64_t current_start = -1;
+    // write the columns
+    LW_write_string(lw, query_name); LW_write_char(lw, '\t');
+    LW_write_int64(lw, query_length); LW_write_char(lw, '\t');
+    LW_write_int64(lw, query_start); LW_write_char(lw, '\t');
+    LW_write_int64(lw, query_end); LW_write_char(lw, '\t');
+    LW_write_char(lw, relative_strand); LW_write_char(lw, '\t');
+    LW_write_string(lw, target_name); LW_write_char(lw, '\t');
+    LW_write_int64(lw, target_length); LW_write_char(lw, '\t');
+    LW_write_int64(lw, target_start); LW_write_char(lw, '\t');
+    LW_write_int64(lw, target_end); LW_write_char(lw, '\t');
+    LW_write_int64(lw, num_matches); LW_write_char(lw, '\t');
+    LW_write_int64(lw, block_length); LW_write_char(lw, '\t');
+    LW_write_int64(lw, 255);
+    LW_write_string(lw, cs_cigar ? "\tcs:Z:" : "\tcg:Z:");
+
+    // stream the cigar straight to the output, one event at a time
+    char current_event = '.';
     int64_t current_length = 0;
-    
     for (int64_t i = 0; i < num_col; ++i) {
-        // scan the next column
         int64_t pos = flip_cigar ? num_col - 1 - i : i;
-        char event = '.';
-        if (t_row->bases[pos] != '-' && q_row->bases[pos] != '-') {
-            if (t_row->bases[pos] != q_row->bases[pos] && cs_cigar) {
-                event = '*';
-            } else {
-                event = 'M';
+        char event = paf_column_event(q_row->bases[pos], t_row->bases[pos], cs_cigar);
+        if (event == '.') {
+            continue;
+        }
+        // start a new event if it differs from the current one (substitutions are always one column long)
+        if (event != current_event || event == '*') {
+            if (!cs_cigar && current_event != '.') {
+                LW_write_int64(lw, current_length);
+                LW_write_char(lw, current_event);
+            }
+            if (cs_cigar) {
+                LW_write_char(lw, event == 'M' ? '=' : (event == 'I' ? '+' : (event == 'D' ? '-' : '*')));
             }
-            ++num_matches;
-        } else if (t_row->bases[pos] == '-' && q_row->bases[pos] != '-') {
-            event = 'I';
-        } else if (t_row->bases[pos] != '-' && q_row->bases[pos] == '-') {
-            event = 'D';
-        } else {
-            assert(t_row->bases[pos] == '-' &&  q_row->bases[pos] == '-');
+            current_event = event;
+            current_length = 0;
+        }
+        ++current_length;
+        if (cs_cigar) {
+            if (event == '*' || event == 'D') {
+                LW_write_char(lw, t_row->bases[pos]);
+            }
+            if (event != 'D') {
+                LW_write_char(lw, q_row->bases[pos]);
+            }
+        }
+    }
+    // finalize trailing event
+    if (!cs_cigar && current_event != '.') {
+        LW_write_int64(lw, current_length);
+        LW_write_char(lw, current_event);
+    }
+    LW_write_newline(lw);
+}
+
+/*
+ * The number of pairs of rows in a block below which a PafWriter writes the block on the calling thread
+ */
+#define PAF_WRITER_MIN_PARALLEL_PAIRS 256
+
+/*
+ * A range of the pairs of rows of a block, written by one thread into its own in memory output.
+ */
+typedef struct _PafWriterChunk {
+    int64_t start; // The index of the first pair
+    int64_t end; // One past the index of the last pair
+    LW *lw;
+} PafWriterChunk;
+
+struct _PafWriter {
+    LW *lw;
+    bool all_to_all;
+    bool cs_cigar;
+    // The block being written: its rows as an array, with for each a bitmask of its non-gap columns
+    Alignment *alignment;
+    Alignment_Row **rows;
+    int64_t row_capacity;
+    uint64_t *masks;
+    int64_t mask_words; // The number of words in the mask of each row
+    int64_t mask_capacity;
+    PafWriterChunk *chunks;
+    int64_t chunk_number;
+    int64_t next_chunk; // The next chunk of the block for a thread to write
+    int64_t chunks_written;
+    int64_t block_number; // Incremented for each block written in parallel, to wake the workers
+    pthread_t *threads;
+    int64_t thread_number;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond; // Signalled when there is a block to write
+    pthread_cond_t done_cond; // Signalled when the last chunk of a block is written
+    bool stop;
+};
+
+/*
+ * Returns non-zero if the rows have a column in which both have a base, i.e. there is something to align.
+ */
+static bool paf_rows_overlap(PafWriter *writer, int64_t i, int64_t j) {
+    uint64_t *mask_i = writer->masks + i * writer->mask_words, *mask_j = writer->masks + j * writer->mask_words;
+    for (int64_t k = 0; k < writer->mask_words; k++) {
+        if (mask_i[k] & mask_j[k]) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * The number of pairs of rows written for a block of row_number rows: each row against the first row, or every pair
+ * if all_to_all.
+ */
+static int64_t paf_pair_number(PafWriter *writer, int64_t row_number) {
+    return row_number < 2 ? 0 : (writer->all_to_all ? row_number * (row_number - 1) / 2 : row_number - 1);
+}
+
+/*
+ * Write the pairs of rows [start, end) of the block, ordered by target row and then query row, skipping, if
+ * all_to_all, pairs of rows without overlapping bases.
+ */
+static void paf_write_pairs(PafWriter *writer, int64_t start, int64_t end, LW *lw) {
+    int64_t row_number = writer->alignment->row_number, column_number = writer->alignment->column_number;
+    // Find the target row, t, and query row, q, of the first pair
+    int64_t t = 0, p = start;
+    while (p >= row_number - 1 - t) {
+        p -= row_number - 1 - t++;
+    }
+    int64_t q = t + 1 + p;
+    for (p = start; p < end; p++) {
+        if (!writer->all_to_all || paf_rows_overlap(writer, q, t)) {
+            paf_write_row(writer->rows[q], writer->rows[t], column_number, writer->cs_cigar, lw);
         }
+        if (++q == row_number) {
+            t++;
+            q = t + 1;
+        }
+    }
+}
+
+static void paf_writer_write_chunk(PafWriter *writer, PafWriterChunk *chunk) {
+    paf_write_pairs(writer, chunk->start, chunk->end, chunk->lw);
+}
 
-        // print the previous event if we need to start a new event
-        if (event != '.' && (event != current_event[0] || event == '*')) {
-            if (current_start >= 0) {
-                if (cs_cigar) {
-                    query_buffer[query_buffer_length] = '\0';
-                    target_buffer[target_buffer_length] = '\0';
-                    if (current_event[0] == 'M') {
-                        assert(current_length == query_buffer_length && current_length == target_buffer_length);
-                        sprintf(buffer, "=%s", query_buffer);
-                    } else if (current_event[0] == '*') {
-                        assert(current_length == 1 && query_buffer_length == 1 && target_buffer_length == 1);
-                        sprintf(buffer, "*%s%s", target_buffer, query_buffer);
-                    } else if (current_event[0] == 'I') {
-                        assert(target_buffer_length == 0 && query_buffer_length > 0 && current_length == query_buffer_length);
-                        sprintf(buffer, "+%s", query_buffer);
-                    } else {
-                        assert(current_event[0] == 'D');
-                        assert(query_buffer_length == 0 && target_buffer_length > 0 && current_length == target_buffer_length);
-                        sprintf(buffer, "-%s", target_buffer);
-                    }
-                    strcat(cigar_string, buffer);
-                } else {
-                    sprintf(buffer, "%" PRIi64 "", current_length);
-                    strcat(cigar_string, buffer);
-                    strcat(cigar_string, current_event);
-                }
+static void *paf_writer_worker(void *arg) {
+    PafWriter *writer = arg;
+    int64_t block_number = 0;
+    pthread_mutex_lock(&writer->mutex);
+    while (1) {
+        while (!writer->stop && block_number == writer->block_number) {
+            pthread_cond_wait(&writer->cond, &writer->mutex);
+        }
+        if (writer->stop) {
+            break;
+        }
+        block_number = writer->block_number;
+        while (writer->next_chunk < writer->chunk_number) {
+            PafWriterChunk *chunk = &writer->chunks[writer->next_chunk++];
+            pthread_mutex_unlock(&writer->mutex);
+            paf_writer_write_chunk(writer, chunk);
+            pthread_mutex_lock(&writer->mutex);
+            if (++writer->chunks_written == writer->chunk_number) {
+                pthread_cond_signal(&writer->done_cond);
             }
-            current_event[0] = event;
-            current_start = i;
-            current_length = 0;
-            query_buffer_length = 0;
-            target_buffer_length = 0;
         }
+    }
+    pthread_mutex_unlock(&writer->mutex);
+    return NULL;
+}
 
-        // update the current event
-        if (event != '.') {
-            ++block_length;
-            ++current_length;
-            if (cs_cigar) {
-                if (t_row->bases[pos] != '-') {
-                    target_buffer[target_buffer_length++] = t_row->bases[pos];
-                }
-                if (q_row->bases[pos] != '-') {
-                    query_buffer[query_buffer_length++] = q_row->bases[pos];
-                }
+PafWriter *paf_writer_construct(LW *lw, bool all_to_all, bool cs_cigar, int64_t thread_number) {
+    PafWriter *writer = st_calloc(1, sizeof(PafWriter));
+    writer->lw = lw;
+    writer->all_to_all = all_to_all;
+    writer->cs_cigar = cs_cigar;
+    writer->thread_number = thread_number > 1 ? thread_number : 0; // The calling thread writes small blocks
+    if (writer->thread_number > 0) {
+        // Split the pairs of each block into more chunks than threads, to balance the work between the threads
+        writer->chunk_number = 4 * writer->thread_number;
+        writer->chunks = st_calloc(writer->chunk_number, sizeof(PafWriterChunk));
+        for (int64_t i = 0; i < writer->chunk_number; i++) {
+            writer->chunks[i].lw = LW_construct(NULL, 0);
+        }
+        pthread_mutex_init(&writer->mutex, NULL);
+        pthread_cond_init(&writer->cond, NULL);
+        pthread_cond_init(&writer->done_cond, NULL);
+        writer->threads = st_malloc(writer->thread_number * sizeof(pthread_t));
+        for (int64_t i = 0; i < writer->thread_number; i++) {
+            if (pthread_create(&writer->threads[i], NULL, paf_writer_worker, writer) != 0) {
+                st_errAbort("Unable to start %" PRIi64 " PAF writing threads\n", writer->thread_number);
             }
         }
+    }
+    return writer;
+}
 
+void paf_writer_write_block(PafWriter *writer, Alignment *alignment) {
+    int64_t row_number = alignment->row_number, column_number = alignment->column_number;
+    int64_t pair_number = paf_pair_number(writer, row_number);
+    if (pair_number == 0) {
+        return;
     }
 
-    // finalize trailing event
-    if (current_start < num_col && current_start >= 0 && current_event[0] != '.') {
-        // note, this code block is (must be) identical to above. todo: factor out
-        if (cs_cigar) {
-            query_buffer[query_buffer_length] = '\0';
-            target_buffer[target_buffer_length] = '\0';
-            if (current_event[0] == 'M') {
-                assert(current_length == query_buffer_length && current_length == target_buffer_length);
-                sprintf(buffer, "=%s", query_buffer);
-            } else if (current_event[0] == '*') {
-                assert(current_length == 1 && query_buffer_length == 1 && target_buffer_length == 1);
-                sprintf(buffer, "*%s%s", target_buffer, query_buffer);
-            } else if (current_event[0] == 'I') {
-                assert(target_buffer_length == 0 && query_buffer_length > 0 && current_length == query_buffer_length);
-                sprintf(buffer, "+%s", query_buffer);
-            } else {
-                assert(current_event[0] == 'D');
-                assert(query_buffer_length == 0 && target_buffer_length > 0 && current_length == target_buffer_length);
-                sprintf(buffer, "-%s", target_buffer);
+    // Get the rows as an array and, if all_to_all, the bitmasks of their bases, to skip the pairs that do not overlap
+    alignment_make_row_bases(alignment);
+    writer->alignment = alignment;
+    if (row_number > writer->row_capacity) {
+        writer->row_capacity = 2 * row_number;
+        writer->rows = st_realloc(writer->rows, writer->row_capacity * sizeof(Alignment_Row *));
+    }
+    writer->mask_words = writer->all_to_all ? (column_number + 63) / 64 : 0;
+    if (row_number * writer->mask_words > writer->mask_capacity) {
+        writer->mask_capacity = 2 * row_number * writer->mask_words;
+        writer->masks = st_realloc(writer->masks, writer->mask_capacity * sizeof(uint64_t));
+    }
+    Alignment_Row *row = alignment->row;
+    for (int64_t i = 0; i < row_number; i++, row = row->n_row) {
+        assert(row != NULL);
+        writer->rows[i] = row;
+        if (writer->all_to_all) {
+            uint64_t *mask = writer->masks + i * writer->mask_words;
+            memset(mask, 0, writer->mask_words * sizeof(uint64_t));
+            for (int64_t j = 0; j < column_number; j++) {
+                mask[j / 64] |= (uint64_t)(row->bases[j] != '-') << (j % 64);
             }
-            strcat(cigar_string, buffer);
-        } else {
-            sprintf(buffer, "%" PRIi64 "", current_length);
-            strcat(cigar_string, buffer);
-            strcat(cigar_string, current_event);
         }
     }
+    assert(row == NULL);
 
-    // write it out
-    LW_write(lw, "%s\t%ld\t%ld\t%ld\t%c", query_name, query_length, query_start, query_end, relative_strand);
-    LW_write(lw, "\t%s\t%ld\t%ld\t%ld", target_name, target_length, target_start, target_end);
-    LW_write(lw, "\t%ld\t%ld\t%ld\tc%c:Z:%s\n", num_matches, block_length, 255, cs_cigar ? 's' : 'g', cigar_string);
-    
-    free(cigar_string);
-    free(buffer);
-    free(query_buffer);
-    free(target_buffer);
+    if (writer->thread_number == 0 || pair_number < PAF_WRITER_MIN_PARALLEL_PAIRS) {
+        paf_write_pairs(writer, 0, pair_number, writer->lw);
+        return;
+    }
 
+    // Write the chunks of pairs in parallel, then copy their output to the writer's in order
+    pthread_mutex_lock(&writer->mutex);
+    for (int64_t i = 0; i < writer->chunk_number; i++) {
+        writer->chunks[i].start = pair_number * i / writer->chunk_number;
+        writer->chunks[i].end = pair_number * (i + 1) / writer->chunk_number;
+    }
+    writer->next_chunk = 0;
+    writer->chunks_written = 0;
+    writer->block_number++;
+    pthread_cond_broadcast(&writer->cond);
+    while (writer->chunks_written < writer->chunk_number) {
+        pthread_cond_wait(&writer->done_cond, &writer->mutex);
+    }
+    pthread_mutex_unlock(&writer->mutex);
+    for (int64_t i = 0; i < writer->chunk_number; i++) {
+        LW *chunk_lw = writer->chunks[i].lw;
+        LW_write_bytes(writer->lw, chunk_lw->buffer, chunk_lw->buffer_length);
+        chunk_lw->buffer_length = 0;
+    }
 }
 
-void paf_write_block(Alignment *alignment, LW *lw, bool all_to_all, bool cs_cigar) {
-    for (Alignment_Row *t_row = alignment->row; t_row != NULL; t_row = t_row->n_row) {
-        for (Alignment_Row *q_row = t_row->n_row; q_row != NULL; q_row = q_row->n_row) {            
-            paf_write_row(q_row, t_row, alignment->column_number, cs_cigar, lw);
-        }        
-        if (!all_to_all) {
-            break;
+void paf_writer_destruct(PafWriter *writer) {
+    if (writer->thread_number > 0) {
+        pthread_mutex_lock(&writer->mutex);
+        writer->stop = 1;
+        pthread_cond_broadcast(&writer->cond);
+        pthread_mutex_unlock(&writer->mutex);
+        for (int64_t i = 0; i < writer->thread_number; i++) {
+            pthread_join(writer->threads[i], NULL);
         }
+        for (int64_t i = 0; i < writer->chunk_number; i++) {
+            LW_destruct(writer->chunks[i].lw, 0);
+        }
+        pthread_mutex_destroy(&writer->mutex);
+        pthread_cond_destroy(&writer->cond);
+        pthread_cond_destroy(&writer->done_cond);
+        free(writer->chunks);
+        free(writer->threads);
     }
+    free(writer->rows);
+    free(writer->masks);
+    free(writer);
+}
+
+void paf_write_block(Alignment *alignment, LW *lw, bool all_to_all, bool cs_cigar) {
+    PafWriter *writer = paf_writer_construct(lw, all_to_all, cs_cigar, 1);
+    paf_writer_write_block(writer, alignment);
+    paf_writer_destruct(writer);
 }
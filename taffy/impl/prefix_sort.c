@@ -107,6 +107,7 @@ void alignment_sort_the_rows(Alignment *p_alignment, Alignment *alignment, stLis
 
 static void remove_rows(Alignment *alignment, int (*delete_row)(Alignment_Row *, void *),
                         void *extra_arg, bool ignore_first_row) {
+    alignment_invalidate_column_bases(alignment);
     Alignment_Row *row = alignment->row, **p_row = &(alignment->row);
     if(ignore_first_row && row != NULL) {  // Keep the first row
         p_row = &(row->n_row);  // Update pointers
@@ -137,6 +138,7 @@ void alignment_filter_the_rows(Alignment *alignment, stList *prefixes_to_filter_
 }
 
 void alignment_show_only_lineage_differences(Alignment *alignment, char mask_char, stList *sequence_prefixes, stList *tree_nodes) {
+    alignment_invalidate_column_bases(alignment);
     // First create map of tree nodes to bases
     stHash *tree_nodes_to_bases = stHash_construct2(NULL, (void (*)(void *))stList_destruct);
     Alignment_Row *row = alignment->row;
@@ -214,6 +216,7 @@ static int alignment_row_cmp_fn(Alignment_Row *r1, Alignment_Row *r2) {
 }
 
 void alignment_pad_the_rows(Alignment *p_alignment, Alignment *alignment, stList *sequence_prefixes) {
+    alignment_invalidate_column_bases(alignment);
     // Get the rows in a list
     stList *rows = alignment_get_rows_in_a_list(alignment->row);
     assert(stList_length(rows) == (alignment->row_number)); // Quick sanity check
@@ -235,7 +238,7 @@ void alignment_pad_the_rows(Alignment *p_alignment, Alignment *alignment, stList
         Alignment_Row *r = stList_binarySearch(rows, sp,(int (*)(const void *a, const void *b))get_closest_row_cmp_fn);
 
         if(r == NULL) { // If there isn't a corresponding row, add one to the alignment at the end setting the coordinates to zero
-            r = st_calloc(1, sizeof(Alignment_Row));
+            r = alignment_row_construct(alignment);
             alignment->row_number++; // Increment the row number
             r->sequence_name = stString_copy(sp->prefix);
             r->bases = st_calloc(alignment->column_number+1, sizeof(char));
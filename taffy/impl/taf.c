@@ -1,5 +1,8 @@
 #include "taf.h"
 #include "sonLib.h"
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 /*
  * Returns non-zero if the tokens list contains the coordinate marker ':'
@@ -26,27 +29,174 @@ char *parse_coordinates(int64_t *j, stList *tokens, int64_t *start, bool *strand
     return sequence_name;
 }
 
+/*
+ * The column line parser works directly on the (not necessarily NUL terminated) span of each line,
+ * finding the separators and tokens in a single pass without building a list of tokens.
+ */
+
+static inline bool is_space(char c) { // As isspace in the C locale
+    return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+/*
+ * Get the next whitespace separated token in line[*i, end), setting its length and moving *i past it.
+ * Returns NULL if there are no more tokens.
+ */
+static inline const char *next_token(const char *line, int64_t *i, int64_t end, int64_t *token_length) {
+    int64_t j = *i;
+    while(j < end && is_space(line[j])) {
+        j++;
+    }
+    if(j >= end) {
+        *i = j;
+        return NULL;
+    }
+    int64_t k = j;
+    while(k < end && !is_space(line[k])) {
+        k++;
+    }
+    *i = k;
+    *token_length = k - j;
+    return line + j;
+}
+
+/*
+ * Returns the offset of the first token in line[start, length) consisting of just the character c, or -1.
+ */
+static int64_t find_separator(const char *line, int64_t start, int64_t length, char c) {
+    const char *p = line + start, *end = line + length;
+    while(p < end && (p = memchr(p, c, end - p)) != NULL) {
+        if((p == line || is_space(p[-1])) && (p + 1 == end || is_space(p[1]))) {
+            return p - line;
+        }
+        p++;
+    }
+    return -1;
+}
+
+/*
+ * Parse an integer token, as atol would.
+ */
+static int64_t parse_int(const char *token, int64_t token_length) {
+    int64_t i = 0, j = 0;
+    bool negative = token_length > 0 && token[0] == '-';
+    if(token_length > 0 && (token[0] == '-' || token[0] == '+')) {
+        i++;
+    }
+    while(i < token_length && token[i] >= '0' && token[i] <= '9') {
+        j = j * 10 + (token[i++] - '0');
+    }
+    return negative ? -j : j;
+}
+
+static inline bool is_token(const char *token, int64_t token_length, char c) {
+    return token != NULL && token_length == 1 && token[0] == c;
+}
+
+/*
+ * Parse the sequence_name, start, strand and sequence_length fields for a row from line[*i, end), returning the
+ * interned sequence name.
+ */
+static char *parse_coordinates_span(const char *line, int64_t *i, int64_t end, int64_t *start, bool *strand,
+                                    int64_t *sequence_length) {
+    int64_t token_length;
+    const char *token = next_token(line, i, end, &token_length);
+    assert(token != NULL);
+    char *sequence_name = sequence_name_intern(token, token_length);
+    token = next_token(line, i, end, &token_length);
+    assert(token != NULL);
+    *start = parse_int(token, token_length);
+    token = next_token(line, i, end, &token_length);
+    assert(is_token(token, token_length, '+') || is_token(token, token_length, '-'));
+    *strand = token[0] == '+';
+    token = next_token(line, i, end, &token_length);
+    assert(token != NULL);
+    *sequence_length = parse_int(token, token_length);
+    return sequence_name;
+}
+
+/*
+ * The rows of the block being built, held as a gap buffer so that the coordinate operations, whose row
+ * indices are ascending (bar one rewind from the deletions to the other operations), are applied in a
+ * sweep in time linear in the number of rows. rows[0, left) are the rows before the cursor and
+ * rows[right, capacity) the rows from the cursor on.
+ */
+typedef struct _Row_Buffer {
+    Alignment_Row **rows;
+    int64_t left;
+    int64_t right;
+    int64_t capacity;
+    int64_t allocated; // The number of rows there is space for in rows, at least capacity
+} Row_Buffer;
+
+/*
+ * Move the cursor to the row with the given index.
+ */
+static void row_buffer_seek(Row_Buffer *b, int64_t row_index) {
+    while(b->left < row_index) {
+        assert(b->right < b->capacity);
+        b->rows[b->left++] = b->rows[b->right++];
+    }
+    while(b->left > row_index) {
+        b->rows[--b->right] = b->rows[--b->left];
+    }
+}
+
+/*
+ * Insert the row at the cursor, so that it is before the row previously at the cursor.
+ */
+static void row_buffer_insert(Row_Buffer *b, Alignment_Row *row) {
+    if(b->left == b->right) { // Grow the gap
+        int64_t capacity = 2 * b->capacity + 16;
+        if(capacity > b->allocated) {
+            b->rows = st_realloc(b->rows, capacity * sizeof(Alignment_Row *));
+            b->allocated = capacity;
+        }
+        int64_t right_length = b->capacity - b->right;
+        memmove(b->rows + capacity - right_length, b->rows + b->right, right_length * sizeof(Alignment_Row *));
+        b->right = capacity - right_length;
+        b->capacity = capacity;
+    }
+    b->rows[--b->right] = row;
+}
+
 /*
  * Make the block being parsed by copying the previous block and then editing it with the
- * list of coordinate changes.
+ * coordinate changes in line[i, end).
  */
-static Alignment *parse_coordinates_and_establish_block(Alignment *p_block, stList *tokens) {
+static Alignment *parse_coordinates_and_establish_block(Alignment *p_block, const char *line, int64_t i,
+                                                        int64_t end, LI *li) {
     // Make a new block
-    Alignment *alignment = st_calloc(1, sizeof(Alignment));
+    Alignment *alignment = alignment_pool_take_alignment(li);
 
     // Copy the rows of the previous block
-    Alignment_Row **p_row = &(alignment->row), *l_row = p_block == NULL ? NULL : p_block->row;
+    Row_Buffer b;
+    b.capacity = p_block == NULL ? 0 : p_block->row_number;
+    int64_t size;
+    b.rows = alignment_pool_take_buffer(li, ALIGNMENT_POOL_ROWS, &size);
+    b.allocated = size / (int64_t)sizeof(Alignment_Row *);
+    if(b.allocated < b.capacity + 1) {
+        b.allocated = b.capacity + 1;
+        b.rows = st_realloc(b.rows, b.allocated * sizeof(Alignment_Row *));
+    }
+    b.left = 0;
+    b.right = 0;
+    Alignment_Row *l_row = p_block == NULL ? NULL : p_block->row;
     while(l_row != NULL) {
-        Alignment_Row *row = st_calloc(1, sizeof(Alignment_Row));
+        Alignment_Row *row = alignment_row_construct(alignment);
         alignment->row_number++; // Increment the row number
         // Copy the relevant fields
         row->start = l_row->start + l_row->length;
-        row->sequence_name = stString_copy(l_row->sequence_name);
+        if(l_row->sequence_name_interned) { // Share the name
+            row->sequence_name = l_row->sequence_name;
+        }
+        else {
+            row->sequence_name = sequence_name_intern(l_row->sequence_name, strlen(l_row->sequence_name));
+        }
+        row->sequence_name_interned = 1;
         row->sequence_length = l_row->sequence_length;
         row->strand = l_row->strand;
-        // Link up the previous and current rows
-        *p_row = row;
-        p_row = &(row->n_row);
+        b.rows[b.right++] = row;
         // Link corresponding left and right rows
         l_row->r_row = row;
         row->l_row = l_row;
@@ -54,79 +204,166 @@ static Alignment *parse_coordinates_and_establish_block(Alignment *p_block, stLi
         l_row = l_row->n_row;
     }
     assert(p_block == NULL || alignment->row_number == p_block->row_number);
+    b.right = 0; // The cursor starts at the first row
 
-    // Now parse the tokens to edit the rows
-    int64_t j;
-    has_coordinates(tokens, &j); j++; // Get 1+ the coordinate of the ';' token
-    while(j < stList_length(tokens) && strcmp(stList_get(tokens, j), "@") != 0) { // Iterate through the tokens
-        char *op_type = stList_get(tokens, j++); // This is the operation
-        assert(strlen(op_type) == 1); // Must be a single character in length
-        int64_t row_index = atol(stList_get(tokens, j++)); // Get the index of the affected row
-        int64_t i=0;
-        Alignment_Row **row = &(alignment->row); // Get the pointer to the pointer to the row being modded
-        while(i++ < row_index) {
-            assert(*row != NULL);
-            row = &((*row)->n_row);
-        }
+    // Now parse the coordinate operations to edit the rows
+    int64_t token_length;
+    const char *op_type;
+    while((op_type = next_token(line, &i, end, &token_length)) != NULL) { // Iterate through the operations
+        assert(token_length == 1); // Must be a single character in length
+        const char *token = next_token(line, &i, end, &token_length);
+        assert(token != NULL);
+        int64_t row_index = parse_int(token, token_length); // Get the index of the affected row
+        row_buffer_seek(&b, row_index);
         if(op_type[0] == 'i') { // Is inserting a row
             alignment->row_number++;
-            Alignment_Row *new_row = st_calloc(1, sizeof(Alignment_Row)); // Make the new row
+            Alignment_Row *new_row = alignment_row_construct(alignment); // Make the new row
             // Connect it up, putting the new row immediately before the old one
-            new_row->n_row = *row;
-            *row = new_row;
+            row_buffer_insert(&b, new_row);
             // Fill it out
-            new_row->sequence_name = parse_coordinates(&j, tokens, &new_row->start, &new_row->strand, &new_row->sequence_length);
-        } else if(op_type[0] == 's') { // Is substituting a row
-            free((*row)->sequence_name); // clean up
-            (*row)->sequence_name = parse_coordinates(&j, tokens, &(*row)->start, &(*row)->strand, &(*row)->sequence_length);            
+            new_row->sequence_name = parse_coordinates_span(line, &i, end, &new_row->start, &new_row->strand,
+                                                            &new_row->sequence_length);
+            new_row->sequence_name_interned = 1;
+            continue;
+        }
+        assert(b.right < b.capacity);
+        Alignment_Row *row = b.rows[b.right]; // The row being modded
+        if(op_type[0] == 's') { // Is substituting a row
+            alignment_row_set_sequence_name(row, parse_coordinates_span(line, &i, end, &row->start, &row->strand,
+                                                                        &row->sequence_length), 1);
         } else if(op_type[0] == 'd') { // Is deleting a row
             // Remove the row from the list of rows
             alignment->row_number--;
-            Alignment_Row *r = *row;
-            *row = r->n_row;
+            b.right++;
             // Now delete the row
-            alignment_row_destruct(r);
+            alignment_row_destruct(row);
         } else if(op_type[0] == 'g') { // Is making a gap without the sequence specified
-            int64_t gap_length = atol(stList_get(tokens, j++)); // Get the index of the affected row
-            (*row)->start += gap_length;
+            token = next_token(line, &i, end, &token_length);
+            assert(token != NULL);
+            row->start += parse_int(token, token_length); // Add the length of the gap
         } else { // Is making a gap with the sequence specified
             assert(op_type[0] == 'G');
-            (*row)->left_gap_sequence = stString_copy(stList_get(tokens, j++));
-            (*row)->start += strlen((*row)->left_gap_sequence);
+            token = next_token(line, &i, end, &token_length);
+            assert(token != NULL);
+            row->left_gap_sequence = stString_getSubString(token, 0, token_length);
+            row->start += token_length;
         }
     }
 
+    // Link up the rows in order
+    row_buffer_seek(&b, 0);
+    Alignment_Row **p_row = &(alignment->row);
+    for(int64_t j=b.right; j<b.capacity; j++) {
+        *p_row = b.rows[j];
+        p_row = &(b.rows[j]->n_row);
+    }
+    *p_row = NULL;
+    assert(b.capacity - b.right == alignment->row_number);
+    alignment_pool_return_buffer(li, ALIGNMENT_POOL_ROWS, b.rows, b.allocated * sizeof(Alignment_Row *));
+
     return alignment;
 }
 
 /*
- * Parse the base alignment for the column.
+ * The columns of a block as they are parsed.
  */
-char *get_bases(int64_t column_length, stList *tokens, bool run_length_encode_bases) {
+typedef struct _column_buffer {
+    char *columns; // Unless the bases are run length encoded, the bases of each column, one after another
+    int64_t column_number, columns_size; // The sizes of the buffers are their allocated sizes in bytes
+    char *tag_text; // The unparsed tags of each column, one after another
+    int64_t *tag_text_starts; // The offset in tag_text of the tags of each column
+    int64_t tag_text_length, tag_text_size, tag_text_starts_size;
+    Base_Run *runs; // If the bases are run length encoded, the runs of each column, one after another, which are
+    // kept without expanding them into columns
+    int64_t *column_run_starts; // The index in runs of the first run of each column
+    int64_t run_number, runs_size, column_run_starts_size;
+} Column_Buffer;
+
+/*
+ * Make sure the buffer, of *size bytes, has room for length bytes, doubling it if it must grow.
+ */
+static void *reserve_buffer(void *buffer, int64_t *size, int64_t length) {
+    if(length > *size) {
+        *size = 2 * length;
+        buffer = st_realloc(buffer, *size);
+    }
+    return buffer;
+}
+
+/*
+ * Start the buffers of the columns of a block with those of blocks recycled to li, if there are any.
+ */
+static void take_column_buffers(Column_Buffer *buffer, bool run_length_encode_bases, LI *li) {
+    buffer->tag_text = alignment_pool_take_buffer(li, ALIGNMENT_POOL_COLUMN_TAG_TEXT, &buffer->tag_text_size);
+    buffer->tag_text_starts = alignment_pool_take_buffer(li, ALIGNMENT_POOL_COLUMN_TAG_TEXT_STARTS,
+                                                         &buffer->tag_text_starts_size);
+    if(run_length_encode_bases) {
+        buffer->runs = alignment_pool_take_buffer(li, ALIGNMENT_POOL_COLUMN_RUNS, &buffer->runs_size);
+        buffer->column_run_starts = alignment_pool_take_buffer(li, ALIGNMENT_POOL_COLUMN_RUN_STARTS,
+                                                               &buffer->column_run_starts_size);
+    }
+    else {
+        buffer->columns = alignment_pool_take_buffer(li, ALIGNMENT_POOL_COLUMN_BASES, &buffer->columns_size);
+    }
+}
+
+/*
+ * Parse the base alignment for the column from line[0, end), adding the runs to buffer if the bases are run length
+ * encoded, otherwise copying the bases into column.
+ */
+static void parse_bases(const char *line, int64_t end, int64_t column_length, bool run_length_encode_bases,
+                        char *column, Column_Buffer *buffer) {
+    int64_t i = 0;
     if(run_length_encode_bases) { // Case the bases are encoded using run length encoding
-        char *column = st_calloc(column_length+1, sizeof(char));
-        column[column_length] = '\0'; // Make into a properly terminated string
-        int64_t i=0, j=0;
+        int64_t j = 0, token_length;
         while(j < column_length) {
-            assert(i < stList_length(tokens));
-            char *base_token = stList_get(tokens, i++);
-            assert(strlen(base_token) == 1); // The base must be a single character
-            int64_t k = atol(stList_get(tokens, i++));
+            const char *base_token = next_token(line, &i, end, &token_length);
+            assert(base_token != NULL && token_length == 1); // The base must be a single character
+            const char *count_token = next_token(line, &i, end, &token_length);
+            assert(count_token != NULL);
+            int64_t k = parse_int(count_token, token_length);
             assert(k > 0); // Each count must be greater than zero
-            while(k-- > 0) {
-                column[j++] = base_token[0];
-            }
-            assert(j <= column_length);
+            assert(j + k <= column_length); // Must be a contiguous run of bases equal in length to the number of rows
+            j += k;
+            buffer->runs = reserve_buffer(buffer->runs, &buffer->runs_size, // Keep the run
+                                          (buffer->run_number + 1) * sizeof(Base_Run));
+            buffer->runs[buffer->run_number].base = base_token[0];
+            buffer->runs[buffer->run_number++].length = k;
+        }
+        return;
+    }
+    // Otherwise column is just a string of bases without whitespace, which we know the length of so can copy
+    // without scanning for its end
+    if(column_length > 0) {
+        while(i < end && is_space(line[i])) {
+            i++;
         }
-        assert(j == column_length);
-        assert(strlen(column) == column_length); // Final sanity check: Must be a contiguous run of bases equal
-        // in length to the number of rows
-        return column;
+        // Must be a contiguous run of bases equal in length to the number of rows
+        assert(i + column_length <= end && (i + column_length == end || is_space(line[i + column_length])));
+        assert(memchr(line + i, ' ', column_length) == NULL);
+        memcpy(column, line + i, column_length);
     }
-    // Otherwise column is just a string of bases without whitespace
-    char *column = stString_copy(stList_get(tokens, 0));
-    assert(strlen(column) == column_length); // Must be a contiguous run of bases equal in length to the number of rows
-    return column;
+}
+
+/*
+ * Parse the column tags in line[i, length).
+ */
+static Tag *parse_tags_span(const char *line, int64_t i, int64_t length) {
+    Tag *first_tag = NULL, **p_tag = &first_tag;
+    int64_t token_length;
+    const char *token;
+    while((token = next_token(line, &i, length, &token_length)) != NULL) {
+        const char *delimiter = memchr(token, ':', token_length);
+        if(delimiter == NULL || memchr(delimiter + 1, ':', token + token_length - delimiter - 1) != NULL) {
+            st_errAbort("Tag not separated by ':' character: %.*s\n", (int)token_length, token);
+        }
+        Tag *tag = st_calloc(1, sizeof(Tag));
+        tag->key = stString_getSubString(token, 0, delimiter - token);
+        tag->value = stString_getSubString(delimiter + 1, 0, token + token_length - delimiter - 1);
+        *p_tag = tag;
+        p_tag = &(tag->n_tag);
+    }
+    return first_tag;
 }
 
 /*
@@ -137,14 +374,14 @@ static stList *get_first_line(LI *li) {
     while(1) { // Loop to find the tokens for the first line
         // Read column with coordinates first, using previous alignment block and the coordinates
         // to create the set of rows
-        char *line = LI_get_next_line(li);
+        int64_t length;
+        char *line = LI_get_next_line_span(li, &length);
 
         if (line == NULL) { // At end of file
             return NULL;
         }
         // Tokenize the line
-        tokens = stString_split(line);
-        free(line);
+        tokens = LI_split_span(line, length);
 
         if (stList_length(tokens) == 0) { // Is a white space only line, just ignore it
             stList_destruct(tokens);
@@ -158,112 +395,329 @@ static stList *get_first_line(LI *li) {
     return tokens;
 }
 
-Tag *parse_tags(stList *tokens, int64_t starting_token, char *delimiter);
-
-static Tag *parse_tags_for_column(stList *tokens) {
-    int64_t i=0;
-    while(i<stList_length(tokens)) {
-        if(strcmp(stList_get(tokens, i++), "@") == 0) {
-            break; // We have found the token representing the start of the tags
+/*
+ * Parse the bases of a column line into the next column of the block being built, growing the column major
+ * buffer of bases (or of runs) as needed, and keep its tags as text to be parsed if they are asked for. tags_start is the
+ * offset of the '@' separator, or -1 if there are no tags.
+ */
+static void add_column(const char *line, int64_t length, int64_t bases_end, int64_t tags_start, int64_t row_number,
+                       bool run_length_encode_bases, Column_Buffer *buffer) {
+    // Room for this column, and for the end offsets of the last column
+    buffer->tag_text_starts = reserve_buffer(buffer->tag_text_starts, &buffer->tag_text_starts_size,
+                                             (buffer->column_number + 2) * sizeof(int64_t));
+    char *column = NULL;
+    if(run_length_encode_bases) {
+        buffer->column_run_starts = reserve_buffer(buffer->column_run_starts, &buffer->column_run_starts_size,
+                                                   (buffer->column_number + 2) * sizeof(int64_t));
+        buffer->column_run_starts[buffer->column_number] = buffer->run_number;
+    }
+    else {
+        buffer->columns = reserve_buffer(buffer->columns, &buffer->columns_size,
+                                         (buffer->column_number + 1) * row_number + 1);
+        column = buffer->columns + buffer->column_number * row_number;
+    }
+    parse_bases(line, bases_end, row_number, run_length_encode_bases, column, buffer);
+    buffer->tag_text_starts[buffer->column_number++] = buffer->tag_text_length;
+    if(tags_start >= 0) {
+        while(length > tags_start + 1 && is_space(line[length - 1])) { // Trim any trailing white space
+            length--;
+        }
+        if(length > tags_start + 1) { // There are tags
+            int64_t tags_length = length - (tags_start + 1);
+            buffer->tag_text = reserve_buffer(buffer->tag_text, &buffer->tag_text_size,
+                                              buffer->tag_text_length + tags_length);
+            memcpy(buffer->tag_text + buffer->tag_text_length, line + tags_start + 1, tags_length);
+            buffer->tag_text_length += tags_length;
         }
     }
-    return parse_tags(tokens, i, ":");
 }
 
 Alignment *taf_read_block(Alignment *p_block, bool run_length_encode_bases, LI *li) {
-    stList *tokens = get_first_line(li); // Get the first non-empty line
+    // Get the first non-empty line that is not a comment
+    int64_t length, i, token_length;
+    char *line;
     while(1) {
-        if (tokens == NULL) { // If there are no more lines to be had return NULL
+        line = LI_get_next_line_span(li, &length);
+        if(line == NULL) { // If there are no more lines to be had return NULL
             return NULL;
         }
-
-        if(((char *) stList_get(tokens, 0))[0] != '#') { // If it is not a comment line
+        i = 0;
+        const char *token = next_token(line, &i, length, &token_length);
+        if(token != NULL && token[0] != '#') { // If it is not a white space only or comment line
             break;
         }
-
-        stList_destruct(tokens); // Clean up the comment line
-        tokens = get_first_line(li); // Get the next line
     }
 
     // Find the coordinates
-    Alignment *block = parse_coordinates_and_establish_block(p_block, tokens);
+    int64_t coordinates_start = find_separator(line, 0, length, ';');
+    int64_t tags_start = find_separator(line, coordinates_start >= 0 ? coordinates_start + 1 : 0, length, '@');
+    int64_t bases_end = coordinates_start >= 0 ? coordinates_start : (tags_start >= 0 ? tags_start : length);
+    Alignment *block = parse_coordinates_and_establish_block(p_block, line,
+                                                             coordinates_start >= 0 ? coordinates_start + 1 : length,
+                                                             tags_start >= 0 ? tags_start : length, li);
 
     // Now add in all subsequent columns until we get one with coordinates, which we push back
-    stList *alignment_columns = stList_construct3(0, free);
-    stList *tag_lists = stList_construct();
-    stList_append(alignment_columns, get_bases(block->row_number, tokens, run_length_encode_bases));
-    stList_append(tag_lists, parse_tags_for_column(tokens)); // Get any tags for the column
-    stList_destruct(tokens); // Clean up the first row
+    Column_Buffer buffer = { 0 };
+    take_column_buffers(&buffer, run_length_encode_bases, li);
+    add_column(line, length, bases_end, tags_start, block->row_number, run_length_encode_bases, &buffer);
     while(1) {
-        char *line = LI_peek_at_next_line(li);
+        line = LI_peek_at_next_line_span(li, &length);
 
         if(line == NULL) { // We have reached the end of the file
             break;
         }
 
-        // tokenize the line
-        tokens = stString_split(line);
-
-        if(stList_length(tokens) == 0) { // Is a white space only line, just ignore it
-            free(LI_get_next_line(li)); // pull the line and clean it up
-            stList_destruct(tokens); // clean up
+        i = 0;
+        if(next_token(line, &i, length, &token_length) == NULL) { // Is a white space only line, just ignore it
+            LI_get_next_line_span(li, &length); // pull the line
             continue;
         }
 
-        int64_t i;
-        if(has_coordinates(tokens, &i)) { // If it has coordinates we have reached the end of the block, so break
-            // and don't pull the line
-            stList_destruct(tokens); // clean up
+        if(find_separator(line, 0, length, ';') >= 0) { // If it has coordinates we have reached the end of the
+            // block, so break and don't pull the line
             break;
         }
 
-        // Add the bases from the line as a column to the alignment
-        stList_append(alignment_columns, get_bases(block->row_number, tokens, run_length_encode_bases));
+        // Add the bases and any tags from the line as a column to the alignment
+        tags_start = find_separator(line, 0, length, '@');
+        add_column(line, length, tags_start >= 0 ? tags_start : length, tags_start, block->row_number,
+                   run_length_encode_bases, &buffer);
 
-        // Parse the tags for the column
-        stList_append(tag_lists, parse_tags_for_column(tokens)); // Get any tags for the column
+        LI_get_next_line_span(li, &length); // pull the line
+    }
 
-        free(LI_get_next_line(li)); // pull the line and clean up the memory for the line
-        stList_destruct(tokens); // clean up the tokens
+    // Set the column number and tags, keeping any tags as text until they are asked for
+    int64_t column_number = buffer.column_number;
+    block->column_number = column_number;
+    if(buffer.tag_text_length > 0) {
+        buffer.tag_text_starts[column_number] = buffer.tag_text_length;
+        block->column_tag_text = buffer.tag_text;
+        block->column_tag_text_size = buffer.tag_text_size;
+        block->column_tag_text_starts = buffer.tag_text_starts;
+        block->column_tag_text_starts_size = buffer.tag_text_starts_size;
+    }
+    else {
+        block->column_tags = alignment_pool_take_column_tags(li, column_number, &block->column_tags_size);
+        alignment_pool_return_buffer(li, ALIGNMENT_POOL_COLUMN_TAG_TEXT, buffer.tag_text, buffer.tag_text_size);
+        alignment_pool_return_buffer(li, ALIGNMENT_POOL_COLUMN_TAG_TEXT_STARTS, buffer.tag_text_starts,
+                                     buffer.tag_text_starts_size);
     }
 
-    // Set the column number
-    assert(stList_length(tag_lists) == stList_length(alignment_columns));
-    block->column_number = stList_length(alignment_columns);
+    // Keep the bases as the columns (or runs) read, the rows only being given their bases when they are needed
+    // (see alignment_make_row_bases)
+    block->row_bases_pending = 1;
+    int64_t row_number = block->row_number;
+    int64_t *lengths = st_calloc(row_number + 1, sizeof(int64_t));
+    if(run_length_encode_bases) {
+        buffer.column_run_starts[column_number] = buffer.run_number;
+        block->column_run_starts = buffer.column_run_starts;
+        block->column_run_starts_size = buffer.column_run_starts_size;
+        block->column_runs = buffer.runs;
+        block->column_runs_size = buffer.runs_size;
 
-    // Set the tag strings
-    block->column_tags = st_malloc(sizeof(Tag *) * block->column_number);
-    for(int64_t i=0; i<block->column_number; i++) {
-        block->column_tags[i] = stList_get(tag_lists, i);
+        // Set the lengths of the rows: each run of bases adds one to the lengths of its rows, so sum the changes in
+        // length from one row to the next
+        for(int64_t i=0; i<column_number; i++) {
+            int64_t j = 0;
+            for(int64_t k=buffer.column_run_starts[i]; k<buffer.column_run_starts[i+1]; k++) {
+                if(buffer.runs[k].base != '-') {
+                    lengths[j]++;
+                    lengths[j + buffer.runs[k].length]--;
+                }
+                j += buffer.runs[k].length;
+            }
+        }
+        for(int64_t j=1; j<row_number; j++) {
+            lengths[j] += lengths[j-1];
+        }
     }
-    stList_destruct(tag_lists);
+    else {
+        block->column_bases = buffer.columns;
+        block->column_bases_size = buffer.columns_size;
 
-    //Now parse the actual alignments into the rows
-    Alignment_Row *row = block->row;
-    int64_t j = 0, k = block->column_number;
-    while(row != NULL) {
-        char *bases = st_malloc(sizeof(char) * (k+1));
-        bases[k] = '\0';
-        int64_t length = 0;
-        for(int64_t i=0; i<k; i++) {
-            char *column = stList_get(alignment_columns, i);
-            bases[i] = column[j];
-            if(bases[i] != '-') {
-                length++;
+        // Set the lengths of the rows, counting the bases of each row down the columns
+        for(int64_t i=0; i<column_number; i++) {
+            const char *column = buffer.columns + i * row_number;
+            for(int64_t j=0; j<row_number; j++) {
+                lengths[j] += column[j] != '-';
             }
         }
-        row->bases = bases;
-        row->length = length;
-        row = row->n_row; j++;
     }
-    assert(j == block->row_number);
-
-    // Clean up
-    stList_destruct(alignment_columns);
+    int64_t j = 0;
+    for(Alignment_Row *row = block->row; row != NULL; row = row->n_row) {
+        row->length = lengths[j++];
+    }
+    free(lengths);
 
     return block;
 }
 
+void taf_link_block(Alignment *p_block, Alignment *block, const char *line, int64_t length) {
+    // Make the rows the block would have had if read following p_block
+    int64_t coordinates_start = find_separator(line, 0, length, ';');
+    assert(coordinates_start >= 0);
+    int64_t tags_start = find_separator(line, coordinates_start + 1, length, '@');
+    Alignment *linked_block = parse_coordinates_and_establish_block(p_block, line, coordinates_start + 1,
+                                                                    tags_start >= 0 ? tags_start : length, NULL);
+    assert(linked_block->row_number == block->row_number);
+
+    // Move their links to the previous block's rows over to the block's rows
+    Alignment_Row *linked_row = linked_block->row;
+    for(Alignment_Row *row = block->row; row != NULL; row = row->n_row) {
+        assert(linked_row->sequence_name == row->sequence_name && linked_row->start == row->start);
+        if(linked_row->l_row != NULL) {
+            row->l_row = linked_row->l_row;
+            row->l_row->r_row = row;
+            linked_row->l_row = NULL;
+        }
+        if(linked_row->left_gap_sequence != NULL) {
+            free(row->left_gap_sequence);
+            row->left_gap_sequence = linked_row->left_gap_sequence;
+            linked_row->left_gap_sequence = NULL;
+        }
+        linked_row = linked_row->n_row;
+    }
+    alignment_destruct(linked_block, 1);
+}
+
+char *taf_parse_anchor_line(const char *line, int64_t length, bool run_length_encode_bases, int64_t *start,
+                            bool *strand) {
+    // Most lines only have bases, which a byte search for the separator rejects without tokenizing the line
+    int64_t coordinates_start = find_separator(line, 0, length, ';');
+    if(coordinates_start < 0) {
+        return NULL;
+    }
+    int64_t tags_start = find_separator(line, coordinates_start + 1, length, '@');
+    int64_t end = tags_start >= 0 ? tags_start : length;
+
+    // Count the rows, from the bases
+    int64_t row_number = 0, i = 0, token_length;
+    const char *token;
+    if(run_length_encode_bases) {
+        while(next_token(line, &i, coordinates_start, &token_length) != NULL) {
+            token = next_token(line, &i, coordinates_start, &token_length); // The length of the run
+            assert(token != NULL);
+            row_number += parse_int(token, token_length);
+        }
+    }
+    else if(next_token(line, &i, coordinates_start, &token_length) != NULL) {
+        row_number = token_length;
+    }
+
+    // Count the rows given coordinates, getting those of the first row
+    char *sequence_name = NULL;
+    int64_t coordinate_number = 0;
+    i = coordinates_start + 1;
+    while((token = next_token(line, &i, end, &token_length)) != NULL) {
+        assert(token_length == 1); // The operation must be a single character in length
+        char op_type = token[0];
+        token = next_token(line, &i, end, &token_length); // The index of the affected row
+        assert(token != NULL);
+        if(op_type == 'i' || op_type == 's') { // We have coordinates!
+            coordinate_number++;
+            if(parse_int(token, token_length) == 0) {
+                token = next_token(line, &i, end, &token_length);
+                assert(token != NULL);
+                free(sequence_name);
+                sequence_name = stString_getSubString(token, 0, token_length);
+                token = next_token(line, &i, end, &token_length);
+                assert(token != NULL);
+                *start = parse_int(token, token_length);
+                token = next_token(line, &i, end, &token_length);
+                assert(is_token(token, token_length, '+') || is_token(token, token_length, '-'));
+                *strand = token[0] == '+';
+                next_token(line, &i, end, &token_length); // Skip the sequence length
+            }
+            else {
+                for(int64_t k=0; k<4; k++) { // Skip the coordinates
+                    next_token(line, &i, end, &token_length);
+                }
+            }
+        }
+        else if(op_type == 'g' || op_type == 'G') {
+            next_token(line, &i, end, &token_length); // Skip the gap length or sequence
+        }
+        else {
+            assert(op_type == 'd');
+        }
+    }
+
+    if(coordinate_number == row_number && sequence_name != NULL) {
+        return sequence_name;
+    }
+    free(sequence_name);
+    *start = -1;
+    return NULL;
+}
+
+bool taf_parse_first_row(const char *line, int64_t length, char *base, char **sequence_name, int64_t *start,
+                         bool *strand, int64_t *sequence_length) {
+    // The bases come first, the first being that of the first row, be they run length encoded or not
+    int64_t coordinates_start = find_separator(line, 0, length, ';');
+    *base = length > 0 && coordinates_start != 0 && !is_space(line[0]) ? line[0] : '\0';
+    if(coordinates_start < 0) {
+        return 0;
+    }
+    int64_t tags_start = find_separator(line, coordinates_start + 1, length, '@');
+    int64_t end = tags_start >= 0 ? tags_start : length;
+
+    // Apply the operations on the first row, in order, as parse_coordinates_and_establish_block does
+    int64_t i = coordinates_start + 1, token_length;
+    const char *token;
+    while((token = next_token(line, &i, end, &token_length)) != NULL) {
+        assert(token_length == 1); // The operation must be a single character in length
+        char op_type = token[0];
+        token = next_token(line, &i, end, &token_length); // The index of the affected row
+        assert(token != NULL);
+        bool first_row = parse_int(token, token_length) == 0;
+        if(op_type == 'i' || op_type == 's') { // Inserting a row before the first, or substituting it
+            if(first_row) {
+                *sequence_name = parse_coordinates_span(line, &i, end, start, strand, sequence_length);
+            }
+            else {
+                for(int64_t k=0; k<4; k++) { // Skip the coordinates
+                    next_token(line, &i, end, &token_length);
+                }
+            }
+        }
+        else if(op_type == 'g' || op_type == 'G') {
+            token = next_token(line, &i, end, &token_length); // The gap length or sequence
+            assert(token != NULL);
+            if(first_row) {
+                *start += op_type == 'g' ? parse_int(token, token_length) : token_length;
+            }
+        }
+        else {
+            assert(op_type == 'd');
+            if(first_row) {
+                *sequence_name = NULL;
+            }
+        }
+    }
+    return 1;
+}
+
+Tag **alignment_get_column_tags(Alignment *alignment) {
+    if(alignment->column_tags == NULL) {
+        alignment->column_tags = st_calloc(alignment->column_number, sizeof(Tag *));
+        alignment->column_tags_size = alignment->column_number * sizeof(Tag *);
+        if(alignment->column_tag_text != NULL) { // Parse the tags as read
+            for(int64_t i=0; i<alignment->column_number; i++) {
+                alignment->column_tags[i] = parse_tags_span(alignment->column_tag_text,
+                                                            alignment->column_tag_text_starts[i],
+                                                            alignment->column_tag_text_starts[i+1]);
+            }
+            free(alignment->column_tag_text);
+            alignment->column_tag_text = NULL;
+            alignment->column_tag_text_size = 0;
+            free(alignment->column_tag_text_starts);
+            alignment->column_tag_text_starts = NULL;
+            alignment->column_tag_text_starts_size = 0;
+        }
+    }
+    return alignment->column_tags;
+}
+
 Tag *parse_header(stList *tokens, char *header_prefix, char *delimiter);
 
 Tag *taf_read_header(LI *li) {
@@ -286,23 +740,28 @@ Tag *taf_read_header_2(LI *li, bool *run_length_encode_bases) {
 static void write_base(char base, int64_t base_count, LW *lw, bool run_length_encode_bases, bool color_bases) {
     if(base != '\0') {
         if(run_length_encode_bases) {
-            LW_write(lw, "%c %" PRIi64 " ", base, base_count);
+            LW_write_char(lw, base);
+            LW_write_char(lw, ' ');
+            LW_write_int64(lw, base_count);
+            LW_write_char(lw, ' ');
         }
-        else {
+        else if(color_bases) {
+            char *colored_base_string = color_base_char(base);
             for (int64_t i = 0; i < base_count; i++) {
-                if(color_bases) {
-                    char *colored_base_string = color_base_char(base);
-                    LW_write(lw, colored_base_string);
-                    free(colored_base_string);
-                }
-                else {
-                    LW_write(lw, "%c", base);
-                }
+                LW_write_string(lw, colored_base_string);
             }
+            free(colored_base_string);
+        }
+        else {
+            LW_write_char_run(lw, base, base_count);
         }
     }
 }
 
+/*
+ * Writes a column by walking the rows, one base at a time. Used to write colored bases, the columns of blocks
+ * without colored bases are written a line at a time by write_column_bases and write_column_runs.
+ */
 void write_column(Alignment_Row *row, int64_t column, LW *lw, bool run_length_encode_bases, bool color_bases) {
     char base = '\0';
     int64_t base_count = 0;
@@ -320,12 +779,194 @@ void write_column(Alignment_Row *row, int64_t column, LW *lw, bool run_length_en
     write_base(base, base_count, lw, run_length_encode_bases, color_bases);
 }
 
-void write_coordinates(Alignment_Row *p_row, Alignment_Row *row, int64_t repeat_coordinates_every_n_columns, LW *lw) {
+/*
+ * The most bytes a run takes when run length encoded: the base, a space, the up to 19 digits of its length and a
+ * space.
+ */
+#define MAX_RUN_LENGTH_ENCODED_RUN_SIZE 22
+
+/*
+ * Format a run of base_count copies of base as "base base_count " at p, returning the end of the formatted run.
+ */
+static inline char *format_run(char *p, char base, int64_t base_count) {
+    *p++ = base;
+    *p++ = ' ';
+    if(base_count < 10) { // The common case
+        *p++ = '0' + base_count;
+    }
+    else {
+        char digits[19];
+        int64_t j = sizeof(digits);
+        do {
+            digits[--j] = '0' + base_count % 10;
+            base_count /= 10;
+        } while(base_count > 0);
+        memcpy(p, digits + j, sizeof(digits) - j);
+        p += sizeof(digits) - j;
+    }
+    *p++ = ' ';
+    return p;
+}
+
+/*
+ * Get the length of the run of copies of bases[0] at the start of bases[0, length), comparing 16 bases at a time
+ * with SSE2, or 8 at a time as a word on other little endian machines.
+ */
+static inline int64_t base_run_length(const char *bases, int64_t length) {
+    char base = bases[0];
+    int64_t i = 1;
+#ifdef __SSE2__
+    __m128i b = _mm_set1_epi8(base);
+    for(; i + 16 <= length; i += 16) {
+        int mismatches = ~_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(bases + i)), b)) & 0xFFFF;
+        if(mismatches != 0) {
+            return i + __builtin_ctz(mismatches);
+        }
+    }
+#elif defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    uint64_t b = 0x0101010101010101ULL * (unsigned char)base;
+    for(; i + 8 <= length; i += 8) {
+        uint64_t w;
+        memcpy(&w, bases + i, sizeof(w));
+        if((w ^= b) != 0) { // The lowest non-zero byte is the first that differs
+            return i + (__builtin_ctzll(w) >> 3);
+        }
+    }
+#endif
+    while(i < length && bases[i] == base) {
+        i++;
+    }
+    return i;
+}
+
+/*
+ * Write the bases of a column, which are contiguous, formatting the line in the output buffer in one go.
+ */
+static void write_column_bases(const char *column, int64_t row_number, LW *lw, bool run_length_encode_bases) {
+    if(!run_length_encode_bases) { // The bases are the line
+        LW_write_bytes(lw, column, row_number);
+        return;
+    }
+    char *line = LW_reserve(lw, MAX_RUN_LENGTH_ENCODED_RUN_SIZE * row_number), *p = line;
+    for(int64_t j=0; j<row_number;) {
+        int64_t k = base_run_length(column + j, row_number - j);
+        p = format_run(p, column[j], k);
+        j += k;
+    }
+    LW_commit(lw, p - line);
+}
+
+/*
+ * As write_column_bases, but writing the column from its runs, merging any adjacent runs of the same base.
+ */
+static void write_column_runs(Alignment *alignment, int64_t column, LW *lw, bool run_length_encode_bases) {
+    int64_t run_number;
+    Base_Run *runs = alignment_get_column_runs(alignment, column, &run_number);
+    char *line, *p;
+    if(!run_length_encode_bases) {
+        line = p = LW_reserve(lw, alignment->row_number);
+        for(int64_t i=0; i<run_number; i++) {
+            memset(p, runs[i].base, runs[i].length);
+            p += runs[i].length;
+        }
+    }
+    else {
+        line = p = LW_reserve(lw, MAX_RUN_LENGTH_ENCODED_RUN_SIZE * run_number);
+        for(int64_t i=0; i<run_number;) {
+            char base = runs[i].base;
+            int64_t base_count = runs[i++].length;
+            while(i < run_number && runs[i].base == base) {
+                base_count += runs[i++].length;
+            }
+            p = format_run(p, base, base_count);
+        }
+    }
+    LW_commit(lw, p - line);
+}
+
+void write_header(Tag *tag, LW *lw, char *header_prefix, char *delimiter, char *end);
+
+/*
+ * Write the tags of a column, if any. Tags that have not been parsed are written as they were read.
+ */
+static void write_column_tags(Alignment *alignment, int64_t column, LW *lw) {
+    if(alignment->column_tags != NULL) {
+        if(alignment->column_tags[column] != NULL) {
+            write_header(alignment->column_tags[column], lw, " @", ":", "");
+        }
+    }
+    else if(alignment->column_tag_text != NULL) {
+        int64_t start = alignment->column_tag_text_starts[column], end = alignment->column_tag_text_starts[column+1];
+        if(end > start) {
+            LW_write_string(lw, " @");
+            LW_write_bytes(lw, alignment->column_tag_text + start, end - start);
+        }
+    }
+}
+
+static void write_row_coordinates(LW *lw, char op, int64_t i, Alignment_Row *row) {
+    // Writes " op i sequence_name start strand sequence_length"
+    LW_write_char(lw, ' ');
+    LW_write_char(lw, op);
+    LW_write_char(lw, ' ');
+    LW_write_int64(lw, i);
+    LW_write_char(lw, ' ');
+    LW_write_string(lw, row->sequence_name);
+    LW_write_char(lw, ' ');
+    LW_write_int64(lw, row->start);
+    LW_write_char(lw, ' ');
+    LW_write_char(lw, row->strand ? '+' : '-');
+    LW_write_char(lw, ' ');
+    LW_write_int64(lw, row->sequence_length);
+}
+
+/*
+ * Returns the coordinates line operation for row, the ith row of its block: 'i' if the row is inserted, 's' if it
+ * substitutes for another row or its coordinates are reported again, otherwise 'g' (written as a g or G gap operation if
+ * there are unaligned bases before the row). Reads only the bases_since_coordinates_reported counter of the row's
+ * left row, so can be run for a block while the block after it is being read.
+ */
+static char row_coordinates_op(Alignment_Row *row, bool report_everything, int64_t repeat_coordinates_every_n_columns) {
+    if(row->l_row == NULL || !alignment_row_is_predecessor(row->l_row, row)) {
+        return row->l_row == NULL ? 'i' : 's';
+    }
+    if(report_everything || (repeat_coordinates_every_n_columns > 0 &&
+       row->l_row->bases_since_coordinates_reported + row->l_row->length > repeat_coordinates_every_n_columns)) {
+        return 's'; // Report the coordinates again so they are easy to find
+    }
+    return 'g';
+}
+
+void taf_update_coordinates_reported(Alignment *alignment, int64_t repeat_coordinates_every_n_columns) {
+    // in order to randomly seek in the taf file, we need rows that we can use for anchors that
+    // have coordinates for every base. in particular, we need such rows at the beginning of every
+    // reference contig, and somewhat evenly spaced along every reference contig.
+    // this flag detects such cases (looking at row 0) and then triggers every other row to report
+    // coordinates if it is set.
+    bool report_everything = false;
     int64_t i = 0;
-    LW_write(lw, " ;");
+    for(Alignment_Row *row = alignment->row; row != NULL; row = row->n_row, i++) {
+        char op = row_coordinates_op(row, report_everything, repeat_coordinates_every_n_columns);
+        row->bases_since_coordinates_reported = op == 'g' ?
+                row->l_row->bases_since_coordinates_reported + row->l_row->length : 0;
+        if(i == 0) {
+            report_everything = op != 'g';
+        }
+    }
+}
+
+bool taf_block_is_anchor(Alignment *alignment, int64_t repeat_coordinates_every_n_columns) {
+    // If the first row reports its coordinates every row does, see taf_update_coordinates_reported
+    return alignment->row != NULL && row_coordinates_op(alignment->row, 0, repeat_coordinates_every_n_columns) != 'g';
+}
+
+static void write_coordinates(Alignment_Row *p_row, Alignment_Row *row, int64_t repeat_coordinates_every_n_columns, LW *lw) {
+    int64_t i = 0;
+    LW_write_string(lw, " ;");
     while(p_row != NULL) { // Write any row deletions
         if(p_row->r_row == NULL) { // if the row is deleted
-            LW_write(lw, " d %" PRIi64 "", i);
+            LW_write_string(lw, " d ");
+            LW_write_int64(lw, i);
         }
         else { // Only update the index is the row is not deleted
             i++;
@@ -333,90 +974,90 @@ void write_coordinates(Alignment_Row *p_row, Alignment_Row *row, int64_t repeat_
         p_row = p_row->n_row;
     }
     i = 0;
-    // in order to randomly seek in the taf file, we need rows that we can use for anchors that
-    // have coordinates for every base. in particular, we need such rows at the beginning of every
-    // reference contig, and somewhat evenly spaced along every reference contig.
-    // this flag detects such cases (looking at row 0) and then triggers every other row to report
-    // coordinates if it is set.
-    bool report_everything = false; 
+    bool report_everything = false; // As in taf_update_coordinates_reported
     while(row != NULL) { // Now write the new rows
-        if(row->l_row == NULL) { // if the row is inserted
-            LW_write(lw, " i %" PRIi64 " %s %" PRIi64 " %c %" PRIi64 "",
-                    i, row->sequence_name, row->start, row->strand ? '+' : '-', row->sequence_length);
-            row->bases_since_coordinates_reported = 0;
-            if (i == 0) {
-                report_everything = true;
-            }
+        char op = row_coordinates_op(row, report_everything, repeat_coordinates_every_n_columns);
+        if(op != 'g') {
+            write_row_coordinates(lw, op, i, row);
         }
         else {
-            bool is_predecessor = alignment_row_is_predecessor(row->l_row, row);
-            if (!is_predecessor && i == 0) {
-                report_everything = true;
-            }
-            if(is_predecessor) {
-                row->bases_since_coordinates_reported = row->l_row->bases_since_coordinates_reported + row->l_row->length;
-                if(report_everything || (repeat_coordinates_every_n_columns > 0 &&
-                   row->bases_since_coordinates_reported > repeat_coordinates_every_n_columns)) { // Report the coordinates again
-                    // so they are easy to find
-                    row->bases_since_coordinates_reported = 0;
-                    LW_write(lw, " s %" PRIi64 " %s %" PRIi64 " %c %" PRIi64 "",
-                            i, row->sequence_name, row->start, row->strand ? '+' : '-', row->sequence_length);
-                    if (i == 0) {
-                        report_everything = true;
-                    }
+            int64_t gap_length = row->start - (row->l_row->start + row->l_row->length);
+            if(gap_length > 0) { // if there is an indel
+                if(row->left_gap_sequence != NULL) {
+                    assert(strlen(row->left_gap_sequence) == gap_length);
+                    LW_write_string(lw, " G ");
+                    LW_write_int64(lw, i);
+                    LW_write_char(lw, ' ');
+                    LW_write_string(lw, row->left_gap_sequence);
                 }
                 else {
-                    int64_t gap_length = row->start - (row->l_row->start + row->l_row->length);
-                    if(gap_length > 0) { // if there is an indel
-                        if(row->left_gap_sequence != NULL) {
-                            assert(strlen(row->left_gap_sequence) == gap_length);
-                            LW_write(lw, " G %" PRIi64 " %s", i, row->left_gap_sequence);
-                        }
-                        else {
-                            LW_write(lw, " g %" PRIi64 " %" PRIi64 "", i, gap_length);
-                        }
-                    }
+                    LW_write_string(lw, " g ");
+                    LW_write_int64(lw, i);
+                    LW_write_char(lw, ' ');
+                    LW_write_int64(lw, gap_length);
                 }
             }
-            else { // Substitute one row for another
-                row->bases_since_coordinates_reported = 0;
-                LW_write(lw, " s %" PRIi64 " %s %" PRIi64 " %c %" PRIi64 "",
-                        i, row->sequence_name, row->start, row->strand ? '+' : '-', row->sequence_length);
-            }
+        }
+        if(i == 0) {
+            report_everything = op != 'g';
         }
         row = row->n_row; i++;
     }
 }
 
-void write_header(Tag *tag, LW *lw, char *header_prefix, char *delimiter, char *end);
-
-void taf_write_block2(Alignment *p_alignment, Alignment *alignment, bool run_length_encode_bases,
-                     int64_t repeat_coordinates_every_n_columns, LW *lw, bool color_bases, bool omit_coordinates) {
+void taf_write_block3(Alignment *p_alignment, Alignment *alignment, bool run_length_encode_bases,
+                      int64_t repeat_coordinates_every_n_columns, LW *lw, bool color_bases, bool omit_coordinates) {
     Alignment_Row *row = alignment->row;
     if(row != NULL) {
-        int64_t column_no = strlen(row->bases);
+        if(color_bases) { // Colored bases are written by walking the rows
+            alignment_make_row_bases(alignment);
+        }
+        int64_t column_no = alignment->row_bases_pending ? alignment->column_number : strlen(row->bases);
         assert(column_no > 0);
-        write_column(row, 0, lw, run_length_encode_bases, color_bases);
-        if(!omit_coordinates) {
-            write_coordinates(p_alignment != NULL ? p_alignment->row : NULL, row, repeat_coordinates_every_n_columns,
-                              lw);
-            if (alignment->column_tags != NULL && alignment->column_tags[0] != NULL) {
-                write_header(alignment->column_tags[0], lw, " @", ":", "");
-            }
-            LW_write(lw, "\n");
+        // The column major copies of the bases are only sure to match the rows while the rows are yet to be made,
+        // as until then the rows can't be changed, so otherwise build them again from the rows
+        if(!color_bases && !alignment->row_bases_pending) {
+            alignment_invalidate_column_bases(alignment);
         }
-        for(int64_t i=1; i<column_no; i++) {
-            write_column(row, i, lw, run_length_encode_bases, color_bases);
+        // Unless coloring the bases, write each column as a whole line: from its runs if we have them (e.g. the block
+        // was read from run length encoded input), otherwise from the column major copy of the bases
+        bool use_runs = !color_bases && alignment->column_runs != NULL;
+        const char *column_bases = !color_bases && !use_runs ? alignment_get_column_bases(alignment) : NULL;
+        assert(color_bases || column_no == alignment->column_number);
+        for(int64_t i=0; i<column_no; i++) {
+            if(color_bases) {
+                write_column(row, i, lw, run_length_encode_bases, color_bases);
+            }
+            else if(use_runs) {
+                write_column_runs(alignment, i, lw, run_length_encode_bases);
+            }
+            else {
+                write_column_bases(column_bases + i * alignment->row_number, alignment->row_number, lw,
+                                   run_length_encode_bases);
+            }
             if(!omit_coordinates) {
-                if (alignment->column_tags != NULL && alignment->column_tags[i] != NULL) {
-                    write_header(alignment->column_tags[i], lw, " @", ":", "");
+                if(i == 0) {
+                    write_coordinates(p_alignment != NULL ? p_alignment->row : NULL, row,
+                                      repeat_coordinates_every_n_columns, lw);
                 }
+                write_column_tags(alignment, i, lw);
+            }
+            if(i > 0 || !omit_coordinates) {
+                LW_write_newline(lw);
             }
-            LW_write(lw, "\n");
         }
     }
 }
 
+void taf_write_block2(Alignment *p_alignment, Alignment *alignment, bool run_length_encode_bases,
+                      int64_t repeat_coordinates_every_n_columns, LW *lw, bool color_bases, bool omit_coordinates) {
+    if(!omit_coordinates) {
+        taf_update_coordinates_reported(alignment, repeat_coordinates_every_n_columns);
+    }
+    taf_write_block3(p_alignment, alignment, run_length_encode_bases, repeat_coordinates_every_n_columns, lw,
+                     color_bases, omit_coordinates);
+}
+
 void taf_write_block(Alignment *p_alignment, Alignment *alignment, bool run_length_encode_bases,
                        int64_t repeat_coordinates_every_n_columns, LW *lw) {
     taf_write_block2(p_alignment, alignment, run_length_encode_bases, repeat_coordinates_every_n_columns, lw, 0, 0);
@@ -541,8 +1182,9 @@ void apply_genome_name_mapping_to_alignment(stHash *genome_name_map, Alignment *
     for (Alignment_Row *row = aln->row; row != NULL; row = row->n_row) {
         char *mapped_sequence_name = apply_genome_name_mapping(genome_name_map, row->sequence_name);
         if (mapped_sequence_name != NULL) {
-            free(row->sequence_name);
-            row->sequence_name = mapped_sequence_name;
+            alignment_row_set_sequence_name(row, sequence_name_intern(mapped_sequence_name,
+                                                                      strlen(mapped_sequence_name)), 1);
+            free(mapped_sequence_name);
         }
     }
 }
@@ -3,7 +3,11 @@
 #include "htslib/bgzf.h"
 #include "htslib/kstring.h"
 #include <ctype.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <time.h>
+#include <unistd.h>
 
 char *tai_path(const char *taf_path) {
     char *ret = (char*)st_calloc(strlen(taf_path) + 5, sizeof(char));
@@ -11,6 +15,10 @@ char *tai_path(const char *taf_path) {
     return ret;    
 }
 
+char *tai_secondary_path(const char *taf_path) {
+    return stString_print("%s.tsi", taf_path);
+}
+
 char *tai_parse_region(const char *region, int64_t *start, int64_t *length) {
     int64_t n = strlen(region);
     char *colon = strrchr(region, ':');
@@ -55,71 +63,6 @@ char *tai_parse_region(const char *region, int64_t *start, int64_t *length) {
     return contig_length > 0 && *length > 0 && *start >=0 ? stString_getSubString(region, 0, contig_length) : NULL;
 }
 
-// gets the "reference" (first row) coordinate information
-// but only returns everything if there's a coordinate for every row in the column
-// this can happen when everything is an "i" like on the first line
-// or when everything is an "s" like on a repeat-coordinates-every-n-columns line
-static char *parse_coordinates_line(stList *tokens, int64_t *start, bool *strand,
-                                    bool run_length_encode_bases) {
-    int64_t j = -1;
-    if (!has_coordinates(tokens, &j)) {
-        return NULL;
-    }
-
-    int64_t num_bases = 0;
-    // todo: really should go through api for this one
-    if (run_length_encode_bases) {
-        assert(j > 1);
-        for (int64_t i = 0; i < j; ++i) {
-            char *token = (char*)stList_get(tokens, i);
-            if (isdigit(token[0])) {
-                num_bases += atol(token);
-            }
-        }
-    } else {
-        assert(j == 1);
-        num_bases = strlen(stList_get(tokens, 0));
-    }
-    int64_t num_coordinates = 0;
-    char *seq = NULL;
-    int64_t sequence_length;
-    bool dummy;
-    int64_t n = stList_length(tokens);
-
-    ++j;
-    while (j < n && strcmp(stList_get(tokens, j), "@") != 0) {
-        // copied from taf.c
-        char *op_type = stList_get(tokens, j++); // This is the operation
-        assert(strlen(op_type) == 1); // Must be a single character in length
-        int64_t row_index = atol(stList_get(tokens, j++)); // Get the index of the affected row
-        if(op_type[0] == 'i' || op_type[0] == 's') { // We have coordinates!
-            num_coordinates++;
-            if (row_index == 0) {
-                seq = parse_coordinates(&j, tokens, start, strand, &sequence_length);
-            } else {
-                // we parse but don't use
-                // todo: smoother api
-                char *s = parse_coordinates(&j, tokens, &sequence_length, &dummy, &sequence_length);
-                free(s);
-            }
-        } else if (op_type[0] == 'd') {
-        } else if (op_type[0] == 'g') {
-            j++;
-        } else {
-            assert(op_type[0] == 'G');
-            j++;
-        }
-    }
-
-    if (num_coordinates == num_bases) {
-        assert(seq != NULL);
-        return seq;
-    }
-
-    *start = -1;
-    return NULL;
-}
-
 // this is rather hacky: because our index points to
 // taf lines where all coordinates are listed as "s", but we
 // want to start new block parsers on these lines, we have to
@@ -145,7 +88,7 @@ static void change_s_coordinates_to_i(char *line) {
                 found_s = found_s || op_type[0] == 's';
                 op_type[0] = 'i';
                 // only parse to increment j (would rather use api than just add 4)
-                parse_coordinates(&j, tokens, &dummy_int, &dummy_bool, &dummy_int);
+                free(parse_coordinates(&j, tokens, &dummy_int, &dummy_bool, &dummy_int));
             } else if (op_type[0] == 'd') {
                 mask[j-2] = true;
                 mask[j-1] = true;
@@ -180,6 +123,7 @@ static void change_s_coordinates_to_i(char *line) {
                 }
             }
         }
+        free(mask);
     } else {
         fprintf(stderr, "Error loading coordinates from indexed taf line: %s\n", line);
         exit(1);
@@ -188,18 +132,146 @@ static void change_s_coordinates_to_i(char *line) {
     stList_destruct(tokens);
 }
 
+/*
+ * The summaries of the contigs of a file as it is indexed (see TaiContigSummary), the name of each summary being the
+ * index of the name in names, in the order the contigs are first found.
+ */
+typedef struct _TaiSummarizer {
+    stList *names;
+    stHash *contigs; // name to index in names + 1
+    TaiContigSummary *summaries;
+    int64_t *ends; // The end of the last interval of each contig added,
+    int64_t last; // and the contig of the last interval added, or -1
+    int64_t capacity;
+    bool secondary; // If set, the intervals of a contig continue each other without being adjacent in the file
+} TaiSummarizer;
+
+static TaiSummarizer *tai_summarizer_construct(bool secondary) {
+    TaiSummarizer *summarizer = st_calloc(1, sizeof(TaiSummarizer));
+    summarizer->names = stList_construct3(0, free);
+    summarizer->contigs = stHash_construct3(stHash_stringKey, stHash_stringEqualKey, NULL, NULL);
+    summarizer->last = -1;
+    summarizer->secondary = secondary;
+    return summarizer;
+}
+
+static void tai_summarizer_destruct(TaiSummarizer *summarizer) {
+    stHash_destruct(summarizer->contigs);
+    stList_destruct(summarizer->names);
+    free(summarizer->summaries);
+    free(summarizer->ends);
+    free(summarizer);
+}
+
+/*
+ * Get the summary of the contig, adding an empty one if it is new.
+ */
+static TaiContigSummary *tai_summarizer_get(TaiSummarizer *summarizer, const char *name) {
+    int64_t contig = (int64_t)stHash_search(summarizer->contigs, (void *)name);
+    if (contig == 0) { // Not seen before
+        stList_append(summarizer->names, stString_copy(name));
+        contig = stList_length(summarizer->names);
+        stHash_insert(summarizer->contigs, stList_peek(summarizer->names), (void *)contig);
+        if (contig > summarizer->capacity) {
+            summarizer->capacity = 2 * summarizer->capacity + 64;
+            summarizer->summaries = st_realloc(summarizer->summaries, summarizer->capacity * sizeof(TaiContigSummary));
+            summarizer->ends = st_realloc(summarizer->ends, summarizer->capacity * sizeof(int64_t));
+        }
+        TaiContigSummary *summary = &summarizer->summaries[contig - 1];
+        summary->name = contig - 1;
+        summary->sequence_length = -1;
+        summary->start = -1;
+        summary->end = -1;
+        summary->aligned_bases = 0;
+        summary->interval_number = 0;
+        summary->run_number = 0;
+        summarizer->ends[contig - 1] = -1;
+    }
+    return &summarizer->summaries[contig - 1];
+}
+
+/*
+ * Add [start, start + length) of the contig, of the given length, as aligned by the next block (or blocks) of the file
+ */
+static void tai_summarizer_add(TaiSummarizer *summarizer, const char *name, int64_t start, int64_t length,
+                               int64_t sequence_length) {
+    TaiContigSummary *summary = tai_summarizer_get(summarizer, name);
+    if (summary->interval_number == 0) {
+        summary->start = start;
+        summary->end = start + length;
+    } else {
+        summary->start = start < summary->start ? start : summary->start;
+        summary->end = start + length > summary->end ? start + length : summary->end;
+    }
+    // as taffy stats -b, a block starts a new interval unless it follows on from the contig in the block before it
+    bool new_run = !summarizer->secondary && summarizer->last != summary->name;
+    if (summarizer->ends[summary->name] != start || new_run) {
+        summary->interval_number++;
+    }
+    summary->run_number += new_run;
+    summary->sequence_length = sequence_length;
+    summary->aligned_bases += length;
+    summarizer->ends[summary->name] = start + length;
+    summarizer->last = summary->name;
+}
+
+/*
+ * Write the summaries to a text index
+ */
+static void tai_summarizer_write(TaiSummarizer *summarizer, FILE *idx_fh) {
+    for (int64_t i = 0; i < stList_length(summarizer->names); i++) {
+        TaiContigSummary *summary = &summarizer->summaries[i];
+        fprintf(idx_fh, "#contig\t%s\t%" PRIi64 "\t%" PRIi64 "\t%" PRIi64 "\t%" PRIi64 "\t%" PRIi64 "\t%" PRIi64 "\n",
+                (char *)stList_get(summarizer->names, i), summary->sequence_length, summary->start, summary->end,
+                summary->aligned_bases, summary->interval_number, summary->run_number);
+    }
+}
+
 static int tai_create_taf(LI *li, FILE *idx_fh, int64_t index_block_size, bool run_length_encode_bases) {
     char *prev_ref = NULL;
     int64_t prev_pos = 0;
     int64_t prev_file_pos = 0;
 
-    // scan the taf line by line
-    for (char *line = LI_get_next_line(li); line != NULL; line = LI_get_next_line(li)) {
-        stList* tokens = stString_split(line);
+    // follow the reference (first) row through every line to summarize the contigs, counting its bases in runs of
+    // contiguous columns
+    TaiSummarizer *summarizer = tai_summarizer_construct(0);
+    bool summarize = 1;
+    char *ref_name = NULL, *run_name = NULL; // interned
+    int64_t ref_pos = 0, ref_length = 0, run_start = 0, run_bases = 0, run_length = 0;
+    bool ref_strand = 1;
+
+    // scan the taf line by line, only parsing the anchor lines
+    int64_t length;
+    for (char *line = LI_get_next_line_span(li, &length); line != NULL; line = LI_get_next_line_span(li, &length)) {
+        char base;
+        bool coordinates = taf_parse_first_row(line, length, &base, &ref_name, &ref_pos, &ref_strand, &ref_length);
+        if (coordinates && (ref_name != run_name || ref_pos != run_start + run_bases)) { // the run is broken
+            if (run_name != NULL) {
+                tai_summarizer_add(summarizer, run_name, run_start, run_bases, run_length);
+            }
+            run_name = ref_name;
+            run_start = ref_pos;
+            run_bases = 0;
+            run_length = ref_length;
+        }
+        if (base != '\0') {
+            if (ref_name == NULL && summarize) {
+                st_logInfo("A reference row is not given coordinates, so the contigs are not summarized\n");
+                summarize = 0;
+            }
+            if (base != '-') {
+                ref_pos++;
+                run_bases++;
+            }
+        }
+        if (!coordinates) {
+            continue;
+        }
+
         int64_t pos;
         assert(sizeof(int64_t) == sizeof(off_t));
         bool strand;
-        char *ref = parse_coordinates_line(tokens, &pos, &strand, run_length_encode_bases);
+        char *ref = taf_parse_anchor_line(line, length, run_length_encode_bases, &pos, &strand);
         if (ref != NULL) {
             // shouldn't need to handle negative strand on reference, right?
             assert(strand == true);
@@ -219,12 +291,19 @@ static int tai_create_taf(LI *li, FILE *idx_fh, int64_t index_block_size, bool r
                 prev_ref = ref;
                 prev_pos = pos;
                 prev_file_pos = file_pos;
+            } else {
+                free(ref);
             }
         }
-        stList_destruct(tokens);
-        free(line);
     }
     free(prev_ref);
+    if (run_name != NULL) {
+        tai_summarizer_add(summarizer, run_name, run_start, run_bases, run_length);
+    }
+    if (summarize) {
+        tai_summarizer_write(summarizer, idx_fh);
+    }
+    tai_summarizer_destruct(summarizer);
     return 0;
 }
 
@@ -233,6 +312,8 @@ static int tai_create_maf(LI *li, FILE *idx_fh, int64_t index_block_size) {
     int64_t prev_pos = 0;
     int64_t prev_file_pos = 0;
 
+    TaiSummarizer *summarizer = tai_summarizer_construct(0);
+
     // scan the maf block by block line by line
     Alignment *alignment, *p_alignment = NULL;
     int64_t file_pos = LI_tell(li);
@@ -248,6 +329,7 @@ static int tai_create_maf(LI *li, FILE *idx_fh, int64_t index_block_size) {
         bool same_ref = prev_ref && strcmp(alignment->row->sequence_name, prev_ref) == 0;
         int64_t pos = alignment->row->start;
         char *ref = alignment->row->sequence_name;
+        tai_summarizer_add(summarizer, ref, pos, alignment->row->length, alignment->row->sequence_length);
         if (!same_ref || pos - prev_pos >= index_block_size) {
             if (same_ref) {
                 // save a little space by writing relative coordinates
@@ -270,27 +352,35 @@ static int tai_create_maf(LI *li, FILE *idx_fh, int64_t index_block_size) {
         alignment_destruct(p_alignment, 1);
     }
     free(prev_ref);
+    tai_summarizer_write(summarizer, idx_fh);
+    tai_summarizer_destruct(summarizer);
     return 0;
 }
     
-int tai_create(LI *li, FILE* idx_fh, int64_t index_block_size) {
-
+// read the TAF or MAF header, returning the input format (0 for TAF, 1 for MAF)
+static int tai_read_header(LI *li, bool *run_length_encode_bases) {
     int input_format = check_input_format(LI_peek_at_next_line(li));
     assert(input_format == 0 || input_format == 1);
-    
-    // read the TAF header
-    bool run_length_encode_bases = 0;
+
+    *run_length_encode_bases = 0;
     Tag *tag = NULL;
     if (input_format == 0) {
         tag = taf_read_header(li);
         Tag *t = tag_find(tag, "run_length_encode_bases");
         if(t != NULL && strcmp(t->value, "1") == 0) {
-            run_length_encode_bases = 1;
+            *run_length_encode_bases = 1;
         }
     } else {
         tag = maf_read_header(li);
     }
     tag_destruct(tag);
+    return input_format;
+}
+
+int tai_create(LI *li, FILE* idx_fh, int64_t index_block_size) {
+
+    bool run_length_encode_bases;
+    int input_format = tai_read_header(li, &run_length_encode_bases);
 
     if (input_format == 0) {
         return tai_create_taf(li, idx_fh, index_block_size, run_length_encode_bases);
@@ -301,78 +391,515 @@ int tai_create(LI *li, FILE* idx_fh, int64_t index_block_size) {
     return -1;
 }
 
-// basically all the information in the index file
+/*
+ * The binary index is an image of a Tai: a header, the table of the contigs sorted by name, the summaries of the
+ * contigs in order of the file, the positions on the contigs of the records (anchors) of the index, in order of contig
+ * and then position on the contig, the positions of the records in the indexed file, and the names of the contigs. The integers are in the byte order of the machine
+ * that wrote the index. A secondary index (see tai_create_secondary) has its own magic number, and following the
+ * positions of its records in the file their ends on the contigs, the maximum of the ends of the records of the
+ * contig up to each record, and the ends of the records in the file.
+ */
+#define TAI_BINARY_MAGIC "\211TAI\r\n\032\n"
+#define TAI_SECONDARY_MAGIC "\211TSI\r\n\032\n"
+#define TAI_BINARY_VERSION 2
+
+typedef struct _TaiBinaryHeader {
+    char magic[8];
+    int64_t version;
+    int64_t contig_number;
+    int64_t record_number;
+    int64_t summary_number;
+    int64_t names_length;
+} TaiBinaryHeader;
+
+// a record of the index as it is parsed from the text index, or made for the secondary index
 typedef struct _TaiRec {
-    char *name;
+    int64_t contig;
     int64_t seq_pos;
     int64_t file_pos;
+    int64_t seq_end; // Only used by the secondary index
+    int64_t file_end;
 } TaiRec;
 
 static int tai_record_cmp(const void *v1, const void *v2) {
-    TaiRec *tr1 = (TaiRec*)v1;
-    TaiRec *tr2 = (TaiRec*)v2;
-    int ret = strcmp(tr1->name, tr2->name);
-    if (ret == 0) {
-        if (tr1->seq_pos < tr2->seq_pos) {
-            ret = -1;
-        } else if (tr1->seq_pos > tr2->seq_pos) {
-            ret = 1;
+    const TaiRec *tr1 = v1, *tr2 = v2;
+    if (tr1->contig != tr2->contig) {
+        return tr1->contig < tr2->contig ? -1 : 1;
+    }
+    if (tr1->seq_pos != tr2->seq_pos) {
+        return tr1->seq_pos < tr2->seq_pos ? -1 : 1;
+    }
+    return tr1->file_pos < tr2->file_pos ? -1 : (tr1->file_pos > tr2->file_pos ? 1 : 0);
+}
+
+static int int64_cmp(const void *a, const void *b) {
+    int64_t i = *(const int64_t *)a, j = *(const int64_t *)b;
+    return i < j ? -1 : (i > j ? 1 : 0);
+}
+
+static int tai_name_cmp(const void *v1, const void *v2) {
+    return strcmp(*(char * const *)v1, *(char * const *)v2);
+}
+
+/*
+ * Point the arrays of the index into its image, checking the image is a complete binary index.
+ */
+static void tai_set_arrays(Tai *tai) {
+    TaiBinaryHeader *header = (TaiBinaryHeader *)tai->data;
+    if (tai->data_length < (int64_t)sizeof(TaiBinaryHeader) || (memcmp(header->magic, TAI_BINARY_MAGIC, 8) != 0 &&
+                                                                memcmp(header->magic, TAI_SECONDARY_MAGIC, 8) != 0)) {
+        st_errAbort("Not a binary .tai index\n");
+    }
+    bool secondary = memcmp(header->magic, TAI_SECONDARY_MAGIC, 8) == 0;
+    int64_t array_number = secondary ? 5 : 2;
+    if (header->version == 1) { // The version before the summaries of the contigs
+        st_errAbort("The binary .tai index was made by an older version of taffy, please run taffy index again\n");
+    }
+    if (header->version != TAI_BINARY_VERSION) {
+        st_errAbort("Unsupported binary .tai index version (or byte order): %" PRIi64 "\n", header->version);
+    }
+    tai->contig_number = header->contig_number;
+    tai->record_number = header->record_number;
+    tai->summary_number = header->summary_number;
+    int64_t names_length = header->names_length;
+    if (tai->contig_number < 0 || tai->record_number < 0 || tai->summary_number < 0 || names_length < 0 ||
+        tai->data_length != (int64_t)sizeof(TaiBinaryHeader) + tai->contig_number * (int64_t)sizeof(TaiContig) +
+                            tai->summary_number * (int64_t)sizeof(TaiContigSummary) +
+                            array_number * tai->record_number * (int64_t)sizeof(int64_t) + names_length ||
+        (names_length > 0 && tai->data[tai->data_length - 1] != '\0')) {
+        st_errAbort("Truncated or corrupt binary .tai index\n");
+    }
+    tai->contigs = (const TaiContig *)(tai->data + sizeof(TaiBinaryHeader));
+    tai->summaries = (const TaiContigSummary *)(tai->contigs + tai->contig_number);
+    tai->seq_pos = (const int64_t *)(tai->summaries + tai->summary_number);
+    tai->file_pos = tai->seq_pos + tai->record_number;
+    if (secondary) {
+        tai->seq_end = tai->file_pos + tai->record_number;
+        tai->max_end = tai->seq_end + tai->record_number;
+        tai->file_end = tai->max_end + tai->record_number;
+    }
+    tai->names = (const char *)(tai->seq_pos + array_number * tai->record_number);
+    for (int64_t i = 0; i < tai->contig_number; i++) {
+        const TaiContig *contig = &tai->contigs[i];
+        if (contig->name < 0 || contig->name >= names_length || contig->record_number <= 0 ||
+            contig->first_record < 0 || contig->first_record + contig->record_number > tai->record_number) {
+            st_errAbort("Corrupt binary .tai index\n");
+        }
+    }
+    for (int64_t i = 0; i < tai->summary_number; i++) {
+        if (tai->summaries[i].name < 0 || tai->summaries[i].name >= names_length) {
+            st_errAbort("Corrupt binary .tai index\n");
         }
     }
-    return ret;
 }
 
-static Tai *tai_construct() {
+/*
+ * Make the image of an index of the given records, whose contigs are indexes into names, and the summaries of the
+ * contigs (if summarizer is not NULL). Sorts the records.
+ */
+static Tai *tai_construct(bool maf, stList *names, TaiRec *records, int64_t record_number,
+                          TaiSummarizer *summarizer, bool secondary) {
+    // Sort the contigs by name, renumbering the records' contigs to their rank
+    int64_t contig_number = stList_length(names);
+    char **sorted_names = st_malloc((contig_number + 1) * sizeof(char *));
+    for (int64_t i = 0; i < contig_number; i++) {
+        sorted_names[i] = stList_get(names, i);
+    }
+    qsort(sorted_names, contig_number, sizeof(char *), tai_name_cmp);
+    int64_t *ranks = st_malloc((contig_number + 1) * sizeof(int64_t));
+    int64_t *name_offsets = st_malloc((contig_number + 1) * sizeof(int64_t)); // of the sorted names
+    int64_t names_length = 0;
+    for (int64_t i = 0; i < contig_number; i++) {
+        name_offsets[i] = names_length;
+        names_length += strlen(sorted_names[i]) + 1;
+        char *name = stList_get(names, i);
+        ranks[i] = (char **)bsearch(&name, sorted_names, contig_number, sizeof(char *), tai_name_cmp) - sorted_names;
+    }
+    // The names of the summaries are those of the contigs, bar any contigs without records, whose names follow them
+    int64_t summary_number = summarizer == NULL ? 0 : stList_length(summarizer->names);
+    int64_t *summary_name_offsets = st_malloc((summary_number + 1) * sizeof(int64_t));
+    int64_t contig_names_length = names_length;
+    for (int64_t i = 0; i < summary_number; i++) {
+        char *name = stList_get(summarizer->names, i);
+        char **sorted_name = bsearch(&name, sorted_names, contig_number, sizeof(char *), tai_name_cmp);
+        if (sorted_name != NULL) {
+            summary_name_offsets[i] = name_offsets[sorted_name - sorted_names];
+        } else {
+            summary_name_offsets[i] = names_length;
+            names_length += strlen(name) + 1;
+        }
+    }
+    for (int64_t i = 0; i < record_number; i++) {
+        records[i].contig = ranks[records[i].contig];
+    }
+    qsort(records, record_number, sizeof(TaiRec), tai_record_cmp);
+
+    // Lay out the image
     Tai *tai = st_calloc(1, sizeof(Tai));
-    tai->idx = stSortedSet_construct3(tai_record_cmp, free);
-    tai->names = stList_construct3(0, free);
+    tai->maf = maf;
+    int64_t array_number = secondary ? 5 : 2;
+    tai->data_length = sizeof(TaiBinaryHeader) + contig_number * sizeof(TaiContig) +
+                       summary_number * sizeof(TaiContigSummary) + array_number * record_number * sizeof(int64_t) +
+                       names_length;
+    tai->data = st_calloc(tai->data_length, 1);
+    TaiBinaryHeader *header = (TaiBinaryHeader *)tai->data;
+    memcpy(header->magic, secondary ? TAI_SECONDARY_MAGIC : TAI_BINARY_MAGIC, 8);
+    header->version = TAI_BINARY_VERSION;
+    header->contig_number = contig_number;
+    header->record_number = record_number;
+    header->summary_number = summary_number;
+    header->names_length = names_length;
+    TaiContig *contigs = (TaiContig *)(tai->data + sizeof(TaiBinaryHeader));
+    TaiContigSummary *summaries = (TaiContigSummary *)(contigs + contig_number);
+    int64_t *seq_pos = (int64_t *)(summaries + summary_number), *file_pos = seq_pos + record_number;
+    int64_t *seq_end = file_pos + record_number, *max_end = seq_end + record_number, *file_end = max_end + record_number;
+    char *contig_names = (char *)(seq_pos + array_number * record_number);
+    for (int64_t i = 0; i < contig_number; i++) {
+        contigs[i].name = name_offsets[i];
+        strcpy(contig_names + name_offsets[i], sorted_names[i]);
+    }
+    for (int64_t i = 0; i < summary_number; i++) {
+        summaries[i] = summarizer->summaries[i];
+        summaries[i].name = summary_name_offsets[i];
+        if (summary_name_offsets[i] >= contig_names_length) {
+            strcpy(contig_names + summary_name_offsets[i], stList_get(summarizer->names, i));
+        }
+    }
+    for (int64_t i = 0; i < record_number; i++) {
+        TaiContig *contig = &contigs[records[i].contig];
+        if (contig->record_number++ == 0) {
+            contig->first_record = i;
+        }
+        seq_pos[i] = records[i].seq_pos;
+        file_pos[i] = records[i].file_pos;
+        if (secondary) {
+            seq_end[i] = records[i].seq_end;
+            max_end[i] = contig->record_number == 1 || records[i].seq_end > max_end[i-1] ? records[i].seq_end : max_end[i-1];
+            file_end[i] = records[i].file_end;
+        }
+    }
+    free(sorted_names);
+    free(ranks);
+    free(name_offsets);
+    free(summary_name_offsets);
+    tai_set_arrays(tai);
     return tai;
 }
 
+bool tai_is_current(FILE *idx_fh, const char *file) {
+    struct stat idx_st, st;
+    return fstat(fileno(idx_fh), &idx_st) == 0 && stat(file, &st) == 0 && idx_st.st_mtime >= st.st_mtime;
+}
+
 void tai_destruct(Tai* tai) {
-    stSortedSet_destruct(tai->idx);
-    stList_destruct(tai->names);
+    if (tai->mapped) {
+        munmap(tai->data, tai->data_length);
+    } else {
+        free(tai->data);
+    }
     free(tai);
 }
 
-Tai *tai_load(FILE* idx_fh, bool maf) {
-    time_t start_time = time(NULL);
-    Tai *tai = tai_construct();
+/*
+ * Load a binary index, mapping it into memory if it is a file.
+ */
+static Tai *tai_load_binary(FILE *idx_fh, bool maf) {
+    Tai *tai = st_calloc(1, sizeof(Tai));
     tai->maf = maf;
+    int fd = fileno(idx_fh);
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED) {
+            tai->data = data;
+            tai->data_length = st.st_size;
+            tai->mapped = 1;
+        }
+    }
+    if (!tai->mapped) { // Read it into memory
+        int64_t capacity = 0;
+        size_t n;
+        do {
+            if (tai->data_length == capacity) {
+                capacity = 2 * capacity + 65536;
+                tai->data = st_realloc(tai->data, capacity);
+            }
+            n = fread(tai->data + tai->data_length, 1, capacity - tai->data_length, idx_fh);
+            tai->data_length += n;
+        } while (n > 0);
+    }
+    tai_set_arrays(tai);
+    return tai;
+}
+
+/*
+ * Returns non-zero if the index file is a binary index, without moving the position in the file.
+ */
+static bool tai_is_binary(FILE *idx_fh) {
+    char magic[8];
+    ssize_t n = pread(fileno(idx_fh), magic, 8, 0);
+    if (n >= 0) {
+        return n == 8 && (memcmp(magic, TAI_BINARY_MAGIC, 8) == 0 || memcmp(magic, TAI_SECONDARY_MAGIC, 8) == 0);
+    }
+    // Can not read ahead in a stream, but the first byte of the magic number is never the first of a text index
+    int c = getc(idx_fh);
+    if (c != EOF) {
+        ungetc(c, idx_fh);
+    }
+    return c == (unsigned char)TAI_BINARY_MAGIC[0];
+}
+
+/*
+ * Load an index of either kind, primary or secondary.
+ */
+static Tai *tai_load_2(FILE* idx_fh, bool maf) {
+    time_t start_time = time(NULL);
+    if (tai_is_binary(idx_fh)) {
+        Tai *tai = tai_load_binary(idx_fh, maf);
+        st_logInfo("Loaded binary .tai index in %" PRIi64 " seconds\n", time(NULL) - start_time);
+        return tai;
+    }
+    stList *names = stList_construct3(0, free);
+    stHash *contigs = stHash_construct3(stHash_stringKey, stHash_stringEqualKey, NULL, NULL); // name to contig + 1
+    int64_t record_number = 0, record_capacity = 0;
+    TaiRec *records = NULL;
     LI* li = LI_construct(idx_fh);
     char *line;
-    TaiRec *prev_rec = NULL;
+    TaiRec prev_rec = { -1, 0, 0, 0, 0 }; // A copy, as records moves as it grows
+    TaiSummarizer *summarizer = tai_summarizer_construct(0);
     while ((line = LI_get_next_line(li)) != NULL) {
         stList* tokens = stString_splitByString(line, "\t");
+        if (strcmp(stList_get(tokens, 0), "#contig") == 0 && stList_length(tokens) == 8) { // A summary of a contig
+            TaiContigSummary *summary = tai_summarizer_get(summarizer, stList_get(tokens, 1));
+            summary->sequence_length = atol(stList_get(tokens, 2));
+            summary->start = atol(stList_get(tokens, 3));
+            summary->end = atol(stList_get(tokens, 4));
+            summary->aligned_bases = atol(stList_get(tokens, 5));
+            summary->interval_number = atol(stList_get(tokens, 6));
+            summary->run_number = atol(stList_get(tokens, 7));
+            stList_destruct(tokens);
+            free(line);
+            continue;
+        }
         if (stList_length(tokens) != 3) {
             fprintf(stderr, "Skipping tai line that does not have 3 columns: %s\n", line);
+            stList_destruct(tokens);
+            free(line);
             continue;
         }
-        TaiRec* rec = (TaiRec*)st_calloc(1, sizeof(TaiRec));
+        if (record_number == record_capacity) {
+            record_capacity = 2 * record_capacity + 1024;
+            records = st_realloc(records, record_capacity * sizeof(TaiRec));
+        }
+        TaiRec* rec = &records[record_number++];
         rec->seq_pos = atol(stList_get(tokens, 1));
         rec->file_pos = atol(stList_get(tokens, 2));
         char *name = (char*)stList_get(tokens, 0);
         if (strcmp(name, "*") == 0) {
-            if (prev_rec == NULL) {
+            if (prev_rec.contig < 0) {
                 fprintf(stderr, "Unable to deduce name from tai line: %s\n", line);
                 exit(1);
             }
-            rec->name = prev_rec->name;
-            rec->seq_pos += prev_rec->seq_pos;
-            rec->file_pos += prev_rec->file_pos;
+            rec->contig = prev_rec.contig;
+            rec->seq_pos += prev_rec.seq_pos;
+            rec->file_pos += prev_rec.file_pos;
         } else {
-            rec->name = stString_copy(stList_get(tokens, 0));
-            stList_append(tai->names, rec->name);
+            int64_t contig = (int64_t)stHash_search(contigs, name);
+            if (contig == 0) { // Not seen before
+                stList_append(names, stString_copy(name));
+                contig = stList_length(names);
+                stHash_insert(contigs, stList_peek(names), (void *)contig);
+            }
+            rec->contig = contig - 1;
         }
-        stSortedSet_insert(tai->idx, rec);
         stList_destruct(tokens);
-        prev_rec = rec;
+        free(line);
+        prev_rec = *rec;
     }
     LI_destruct(li);
+    Tai *tai = tai_construct(maf, names, records, record_number, summarizer, 0);
+    tai_summarizer_destruct(summarizer);
+    stHash_destruct(contigs);
+    stList_destruct(names);
+    free(records);
     st_logInfo("Loaded .tai index in %" PRIi64 " seconds\n", time(NULL) - start_time);
     return tai;
 }
 
+Tai *tai_load(FILE* idx_fh, bool maf) {
+    Tai *tai = tai_load_2(idx_fh, maf);
+    if (tai->seq_end != NULL) {
+        st_errAbort("The index is a secondary (.tsi) index, not a .tai index\n");
+    }
+    return tai;
+}
+
+Tai *tai_load_secondary(FILE* idx_fh, bool maf) {
+    Tai *tai = tai_load_2(idx_fh, maf);
+    if (tai->seq_end == NULL) {
+        st_errAbort("The index is not a secondary (.tsi) index\n");
+    }
+    return tai;
+}
+
+int tai_create_binary(LI *li, FILE *idx_fh, int64_t index_block_size) {
+    // Make the text index, then load it and write out its image
+    FILE *text_fh = tmpfile();
+    if (text_fh == NULL) {
+        st_errAbort("Unable to make a temporary file for the index\n");
+    }
+    int ret = tai_create(li, text_fh, index_block_size);
+    rewind(text_fh);
+    Tai *tai = tai_load(text_fh, 0);
+    fclose(text_fh);
+    if (fwrite(tai->data, 1, tai->data_length, idx_fh) != (size_t)tai->data_length) {
+        st_errAbort("Unable to write the binary index\n");
+    }
+    tai_destruct(tai);
+    return ret;
+}
+
+struct _TaiWriter {
+    bool maf;
+    int64_t index_block_size;
+    stList *names; // The contigs of the records, in the order they are first seen
+    int64_t *contigs; // For each record the index of its contig in names,
+    int64_t *seq_pos; // its position on the contig,
+    int64_t *positions; // and the position of its block in the output, as given by LW_tell
+    int64_t record_number;
+    int64_t max_record_number;
+    TaiSummarizer *summarizer; // The summaries of the contigs of every block
+};
+
+TaiWriter *tai_writer_construct(bool maf, int64_t index_block_size) {
+    TaiWriter *writer = st_calloc(1, sizeof(TaiWriter));
+    writer->maf = maf;
+    writer->index_block_size = index_block_size;
+    writer->names = stList_construct3(0, free);
+    writer->summarizer = tai_summarizer_construct(0);
+    return writer;
+}
+
+void tai_writer_destruct(TaiWriter *writer) {
+    stList_destruct(writer->names);
+    free(writer->contigs);
+    free(writer->seq_pos);
+    free(writer->positions);
+    tai_summarizer_destruct(writer->summarizer);
+    free(writer);
+}
+
+void tai_writer_add_block(TaiWriter *writer, Alignment *alignment, int64_t repeat_coordinates_every_n_columns,
+                          LW *lw) {
+    if (alignment->row != NULL) {
+        Alignment_Row *row = alignment->row;
+        tai_summarizer_add(writer->summarizer, row->sequence_name, row->start, row->length, row->sequence_length);
+    }
+    // A TAF can only be sought to at its anchors, which is where tai_create_taf puts its records
+    if (alignment->row == NULL || (!writer->maf && !taf_block_is_anchor(alignment, repeat_coordinates_every_n_columns))) {
+        return;
+    }
+    Alignment_Row *row = alignment->row;
+    if (row->strand != 1) {
+        fprintf(stderr, "Can't index output because reference (row 0) sequence found on negative strand\n");
+        exit(1);
+    }
+    // as tai_create_taf and tai_create_maf, add a record for a new contig, or one >= index_block_size bases on from
+    // the last record
+    int64_t contig_number = stList_length(writer->names);
+    bool same_ref = contig_number > 0 && strcmp(row->sequence_name, stList_peek(writer->names)) == 0;
+    if (same_ref && row->start - writer->seq_pos[writer->record_number-1] < writer->index_block_size) {
+        return;
+    }
+    if (!same_ref) {
+        stList_append(writer->names, stString_copy(row->sequence_name));
+    }
+    if (writer->record_number == writer->max_record_number) {
+        writer->max_record_number = writer->max_record_number * 2 + 64;
+        writer->contigs = st_realloc(writer->contigs, writer->max_record_number * sizeof(int64_t));
+        writer->seq_pos = st_realloc(writer->seq_pos, writer->max_record_number * sizeof(int64_t));
+        writer->positions = st_realloc(writer->positions, writer->max_record_number * sizeof(int64_t));
+    }
+    writer->contigs[writer->record_number] = stList_length(writer->names) - 1;
+    writer->seq_pos[writer->record_number] = row->start;
+    // as tai_create_maf, the position of a MAF block is that of the line read before it: the header at the start of
+    // the file for the first block, otherwise the blank line ending the block before it
+    int64_t position = LW_tell(lw);
+    if (writer->maf) {
+        position = writer->record_number == 0 ? 0 : position - 1;
+    }
+    writer->positions[writer->record_number++] = position;
+}
+
+void tai_writer_write(TaiWriter *writer, LW *lw, const char *output_file) {
+    // convert the positions in the output to positions in the file, e.g. virtual offsets if it is compressed
+    LW_file_positions(lw, output_file, writer->positions, writer->record_number);
+
+    char *idx_path = tai_path(output_file);
+    FILE *idx_fh = fopen(idx_path, "w");
+    if (idx_fh == NULL) {
+        fprintf(stderr, "Unable to open index file for writing: %s\n", idx_path);
+        exit(1);
+    }
+    for (int64_t i = 0; i < writer->record_number; i++) {
+        if (i > 0 && writer->contigs[i] == writer->contigs[i-1]) {
+            // save a little space by writing relative coordinates
+            fprintf(idx_fh, "*\t%" PRIi64 "\t%" PRIi64 "\n", writer->seq_pos[i] - writer->seq_pos[i-1],
+                    writer->positions[i] - writer->positions[i-1]);
+        } else {
+            fprintf(idx_fh, "%s\t%" PRIi64 "\t%" PRIi64 "\n", (char *)stList_get(writer->names, writer->contigs[i]),
+                    writer->seq_pos[i], writer->positions[i]);
+        }
+    }
+    tai_summarizer_write(writer->summarizer, idx_fh);
+    fclose(idx_fh);
+    free(idx_path);
+}
+
+/*
+ * Returns the name of the contig of the index
+ */
+static const char *tai_contig_name(Tai *tai, const TaiContig *contig) {
+    return tai->names + contig->name;
+}
+
+/*
+ * Find the contig of the index with the given name, or NULL if it is not in the index.
+ */
+static const TaiContig *tai_find_contig(Tai *tai, const char *name) {
+    int64_t i = 0, j = tai->contig_number; // Search [i, j)
+    while (i < j) {
+        int64_t k = i + (j - i) / 2;
+        int c = strcmp(tai_contig_name(tai, &tai->contigs[k]), name);
+        if (c == 0) {
+            return &tai->contigs[k];
+        }
+        if (c < 0) {
+            i = k + 1;
+        } else {
+            j = k;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Returns the index of the first record of the contig whose position on the contig is greater than pos, or the index
+ * of the record following the contig's records if there is none.
+ */
+static int64_t tai_search_greater_than(Tai *tai, const TaiContig *contig, int64_t pos) {
+    int64_t i = contig->first_record, j = contig->first_record + contig->record_number; // Search [i, j)
+    while (i < j) {
+        int64_t k = i + (j - i) / 2;
+        if (tai->seq_pos[k] <= pos) {
+            i = k + 1;
+        } else {
+            j = k;
+        }
+    }
+    return i;
+}
+
 // dummy function to let us toggle between maf/taf reading at runtime (by providing a
 // maf reader with same interface as taf reader)
 static Alignment *maf_read_block_3(Alignment *p_block, bool run_length_encode_bases, LI *li) {
@@ -383,108 +910,335 @@ static Alignment *maf_read_block_3(Alignment *p_block, bool run_length_encode_ba
     return alignment;
 }
 
-TaiIt *tai_iterator(Tai* tai, LI *li, bool run_length_encode_bases, const char *contig, int64_t start, int64_t length) {
+// the position of the block that will be read next, as the index records it
+static int64_t tai_block_position(LI *li, bool maf) {
+    return maf ? LI_tell(li) : LI_tell_next(li);
+}
+
+// the forward strand interval [*start, *end) of the sequence covered by the row
+static void row_forward_interval(Alignment_Row *row, int64_t *start, int64_t *end) {
+    if (row->strand) {
+        *start = row->start;
+        *end = row->start + row->length;
+    } else {
+        *start = row->sequence_length - (row->start + row->length);
+        *end = row->sequence_length - row->start;
+    }
+}
+
+// add the open records, the intervals of each sequence within the current segment, to the records of the index
+static void tai_flush_secondary_records(stHash *open_records, TaiRec **records, int64_t *record_number,
+                                        int64_t *record_capacity) {
+    stHashIterator *it = stHash_getIterator(open_records);
+    char *name;
+    while ((name = stHash_getNext(it)) != NULL) {
+        if (*record_number == *record_capacity) {
+            *record_capacity = 2 * *record_capacity + 1024;
+            *records = st_realloc(*records, *record_capacity * sizeof(TaiRec));
+        }
+        (*records)[(*record_number)++] = *(TaiRec *)stHash_search(open_records, name);
+    }
+    stHash_destructIterator(it);
+    stHash_destruct(open_records);
+}
+
+int tai_create_secondary(Tai *tai, LI *li, FILE *idx_fh) {
+    bool run_length_encode_bases;
+    int input_format = tai_read_header(li, &run_length_encode_bases);
+    assert((input_format == 1) == tai->maf);
+
+    // the segments of the file are delimited by the anchors of the primary index, in order of position in the file
+    int64_t *anchors = st_malloc((tai->record_number + 1) * sizeof(int64_t));
+    memcpy(anchors, tai->file_pos, tai->record_number * sizeof(int64_t));
+    qsort(anchors, tai->record_number, sizeof(int64_t), int64_cmp);
+    int64_t anchor_number = 0;
+    for (int64_t i = 0; i < tai->record_number; i++) {
+        if (anchor_number == 0 || anchors[i] != anchors[anchor_number - 1]) {
+            anchors[anchor_number++] = anchors[i];
+        }
+    }
+
+    // scan the blocks, recording for each segment the interval of each sequence aligned within it
+    stList *names = stList_construct3(0, free);
+    stHash *contigs = stHash_construct3(stHash_stringKey, stHash_stringEqualKey, NULL, NULL); // name to contig + 1
+    stHash *open_records = stHash_construct3(stHash_stringKey, stHash_stringEqualKey, NULL, free);
+    TaiSummarizer *summarizer = tai_summarizer_construct(1);
+    int64_t record_number = 0, record_capacity = 0, segment = -1;
+    TaiRec *records = NULL;
+    Alignment* (*maftaf_read_block)(Alignment*, bool, LI*) = tai->maf ? maf_read_block_3 : taf_read_block;
+    Alignment *alignment, *p_alignment = NULL;
+    int64_t file_pos = tai_block_position(li, tai->maf);
+    while ((alignment = maftaf_read_block(p_alignment, run_length_encode_bases, li)) != NULL) {
+        // the segment is that of the last anchor at or before the block
+        int64_t i = 0, j = anchor_number;
+        while (i < j) {
+            int64_t k = i + (j - i) / 2;
+            if (anchors[k] <= file_pos) {
+                i = k + 1;
+            } else {
+                j = k;
+            }
+        }
+        if (i - 1 != segment) {
+            tai_flush_secondary_records(open_records, &records, &record_number, &record_capacity);
+            open_records = stHash_construct3(stHash_stringKey, stHash_stringEqualKey, NULL, free);
+            segment = i - 1;
+        }
+        if (segment >= 0) { // blocks before the first anchor can not be sought to, but there should be none
+            for (Alignment_Row *row = alignment->row; row != NULL; row = row->n_row) {
+                if (row->length == 0) {
+                    continue;
+                }
+                int64_t start, end;
+                row_forward_interval(row, &start, &end);
+                tai_summarizer_add(summarizer, row->sequence_name, start, end - start, row->sequence_length);
+                TaiRec *rec = stHash_search(open_records, row->sequence_name);
+                if (rec == NULL) {
+                    int64_t contig = (int64_t)stHash_search(contigs, row->sequence_name);
+                    if (contig == 0) { // Not seen before
+                        stList_append(names, stString_copy(row->sequence_name));
+                        contig = stList_length(names);
+                        stHash_insert(contigs, stList_peek(names), (void *)contig);
+                    }
+                    rec = st_malloc(sizeof(TaiRec));
+                    rec->contig = contig - 1;
+                    rec->seq_pos = start;
+                    rec->seq_end = end;
+                    rec->file_pos = anchors[segment];
+                    rec->file_end = segment + 1 < anchor_number ? anchors[segment + 1] : -1;
+                    stHash_insert(open_records, stList_get(names, contig - 1), rec);
+                } else {
+                    rec->seq_pos = start < rec->seq_pos ? start : rec->seq_pos;
+                    rec->seq_end = end > rec->seq_end ? end : rec->seq_end;
+                }
+            }
+        }
+        if (p_alignment != NULL) {
+            alignment_recycle(p_alignment, 1, li);
+        }
+        p_alignment = alignment;
+        file_pos = tai_block_position(li, tai->maf);
+    }
+    if (p_alignment != NULL) {
+        alignment_recycle(p_alignment, 1, li);
+    }
+    tai_flush_secondary_records(open_records, &records, &record_number, &record_capacity);
+
+    Tai *secondary = tai_construct(tai->maf, names, records, record_number, summarizer, 1);
+    if (fwrite(secondary->data, 1, secondary->data_length, idx_fh) != (size_t)secondary->data_length) {
+        st_errAbort("Unable to write the secondary index\n");
+    }
+    tai_destruct(secondary);
+    tai_summarizer_destruct(summarizer);
+    stHash_destruct(contigs);
+    stList_destruct(names);
+    free(records);
+    free(anchors);
+    return 0;
+}
+
+// a copy of the block, not linked to any other, for a regions iterator to keep unclipped once the block is returned
+static Alignment *alignment_copy(Alignment *alignment) {
+    alignment_make_row_bases(alignment);
+    Alignment *copy = st_calloc(1, sizeof(Alignment));
+    copy->row_number = alignment->row_number;
+    copy->column_number = alignment->column_number;
+    Alignment_Row **p_row = &copy->row;
+    for (Alignment_Row *row = alignment->row; row != NULL; row = row->n_row) {
+        Alignment_Row *row_copy = alignment_row_construct(copy);
+        alignment_row_set_sequence_name(row_copy, row->sequence_name_interned ? row->sequence_name :
+                                                  stString_copy(row->sequence_name), row->sequence_name_interned);
+        row_copy->start = row->start;
+        row_copy->length = row->length;
+        row_copy->sequence_length = row->sequence_length;
+        row_copy->strand = row->strand;
+        row_copy->bases = stString_copy(row->bases);
+        row_copy->left_gap_sequence = row->left_gap_sequence != NULL ? stString_copy(row->left_gap_sequence) : NULL;
+        row_copy->bases_since_coordinates_reported = row->bases_since_coordinates_reported;
+        *p_row = row_copy;
+        p_row = &row_copy->n_row;
+    }
+    Tag **column_tags = alignment_get_column_tags(alignment);
+    copy->column_tags = st_calloc(copy->column_number, sizeof(Tag *));
+    copy->column_tags_size = copy->column_number * sizeof(Tag *);
+    for (int64_t i = 0; i < copy->column_number; i++) {
+        Tag **p_tag = &copy->column_tags[i];
+        for (Tag *tag = column_tags[i]; tag != NULL; tag = tag->n_tag) {
+            *p_tag = tag_construct(tag->key, tag->value, NULL);
+            p_tag = &(*p_tag)->n_tag;
+        }
+    }
+    return copy;
+}
+
+// cut the links between the rows of a block and those of the block to its left
+static void alignment_unlink_left(Alignment *alignment) {
+    for (Alignment_Row *row = alignment->row; row != NULL; row = row->n_row) {
+        if (row->l_row != NULL) {
+            row->l_row->r_row = NULL;
+            row->l_row = NULL;
+        }
+    }
+}
+
+/*
+ * Whether the region of the iterator can be found by reading on from the given kept block, at block_pos in the file,
+ * rather than from tair_1, the index's anchor for the region: the block must start on the region's sequence no later
+ * than the region, so that the blocks before it do not overlap the region, and be no earlier in the file than the anchor.
+ */
+static bool tai_iterator_can_read_on(TaiIt *tai_it, Tai *tai, Alignment *block, int64_t block_pos, int64_t tair_1) {
+    return block != NULL && strcmp(block->row->sequence_name, tai_it->name) == 0 &&
+           block->row->start <= tai_it->start && tai->file_pos[tair_1] <= block_pos;
+}
+
+/*
+ * Set the first block of the iterator's region, at block_pos in the file, keeping a copy of it for a batch of regions
+ */
+static void tai_iterator_found(TaiIt *tai_it, LI *li, Alignment *alignment, int64_t block_pos) {
+    tai_it->alignment = alignment;
+    tai_it->alignment_pos = block_pos;
+    if (tai_it->retain_last_block) {
+        tai_it->first_block = alignment_copy(alignment);
+        tai_it->first_block_pos = block_pos;
+        tai_it->first_block_next_pos = tai_block_position(li, tai_it->maf);
+    }
+}
+
+/*
+ * Point the iterator at a region: find the first block overlapping it, reading on from the block kept from the last
+ * region if that is no further back in the file than the anchor the index gives, otherwise seeking to the anchor.
+ */
+static void tai_iterator_query(TaiIt *tai_it, Tai *tai, LI *li, const char *contig, int64_t start, int64_t length) {
     time_t start_time = time(NULL);
-    TaiIt *tai_it = st_calloc(1, sizeof(TaiIt));
-    tai_it->maf = tai->maf;
 
     // parse the region into the iterator
+    free(tai_it->name);
     tai_it->name = stString_copy(contig);
     tai_it->start = start;
     tai_it->end = length < 0 ? LONG_MAX : start + length;
-    tai_it->run_length_encode_bases = run_length_encode_bases;
     tai_it->alignment = NULL;
     tai_it->p_alignment = NULL;
 
     // no sense querying anything if length is empty
     if (length <= 0) {
-        return tai_it;
+        return;
     }
 
-    // look up the region in the taf index, which takes a dummy record
-    TaiRec qr;
-    qr.name = tai_it->name;
-    qr.seq_pos = tai_it->start;
-
-    TaiRec *tair_1 = stSortedSet_searchLessThanOrEqual(tai->idx, &qr);
-    if (tair_1 == NULL) {
-        // This will be null even if the query overlaps the first record in the index
-        // so we explicitly double check below (ie query 0-10 but index starts at 5)
-        tair_1 = stSortedSet_getFirst(tai->idx);
-        if (strcmp(tair_1->name, tai_it->name) != 0 || tai_it->end < tair_1->seq_pos) {
-            // there's no chance of finding the region as its contig isn't
-            // in the index or its start position is too low
-            // up to caller to spit out an error
-            return tai_it;
+    // look up the region in the taf index: the last record of the contig at or before the start of the region
+    const TaiContig *tai_contig = tai_find_contig(tai, tai_it->name);
+    if (tai_contig == NULL) {
+        // there's no chance of finding the region as its contig isn't
+        // in the index, up to caller to spit out an error
+        return;
+    }
+    int64_t tair_1 = tai_search_greater_than(tai, tai_contig, tai_it->start) - 1;
+    if (tair_1 < tai_contig->first_record) {
+        // the query can still overlap the first record of the contig
+        // so we explicitly double check (ie query 0-10 but index starts at 5)
+        tair_1 = tai_contig->first_record;
+        if (tai_it->end < tai->seq_pos[tair_1]) {
+            // its start position is too low
+            return;
         }
     }
 
-    // sorted set doesn't let us iterate, so we use a second lookup to get
-    // the next record
-    TaiRec qr2;
-    qr2.name = tai_it->name;
-    qr2.seq_pos = tai_it->end;
-    TaiRec *tair_2 = stSortedSet_searchGreaterThanOrEqual(tai->idx, &qr2);
-    st_logInfo("Queried the in-memory .tai index in %" PRIi64 " seconds\n", time(NULL) - start_time);
+    // and the first record at or after the end of the region, if any, beyond which the region can not be
+    int64_t tair_2 = tai_search_greater_than(tai, tai_contig, tai_it->end - 1);
+    if (tair_2 == tai->record_number || tai->file_pos[tair_2] <= tai->file_pos[tair_1]) {
+        // the contig is the last in the index, or the next contig is earlier in the file
+        tair_2 = -1;
+    }
+    st_logInfo("Queried the .tai index in %" PRIi64 " seconds\n", time(NULL) - start_time);
 
     // now we know that the start of our region is somewhere in [tair_1, tair_2)
     // (with the possibility of tair_2 not existing)
 
-    // move to the first record in our file
-    start_time = time(NULL);
-    LI_seek(li, tair_1->file_pos);
-    st_logInfo("Seeked to the queried anchor position with taf file in %" PRIi64 " seconds\n", time(NULL) - start_time);
-    LI_get_next_line(li);
-
     // all maf / taf logic toggling is handled right here
-    Alignment* (*maftaf_read_block)(Alignment*, bool, LI*) = maf_read_block_3;
-    if (!tai_it->maf) {
-        maftaf_read_block = taf_read_block;
-        // force taf to start a new alignment at our current file position by making
-        // sure all coordinates are expressed as insertions
-        change_s_coordinates_to_i(LI_peek_at_next_line(li));
+    Alignment* (*maftaf_read_block)(Alignment*, bool, LI*) = tai_it->maf ? maf_read_block_3 : taf_read_block;
+
+    Alignment *alignment = NULL;
+    Alignment *p_alignment = NULL;
+    int64_t p_alignment_pos = 0;
+    Alignment *last_block = tai_it->last_block, *first_block = tai_it->first_block;
+    tai_it->last_block = NULL;
+    tai_it->first_block = NULL;
+    if (tai_iterator_can_read_on(tai_it, tai, last_block, tai_it->last_block_pos, tair_1)) {
+        // the blocks from the anchor up to the kept block end before the region, so rather than seeking back to the
+        // anchor read on from the kept block, which li is positioned after
+        p_alignment = last_block;
+        p_alignment_pos = tai_it->last_block_pos;
+        last_block = NULL;
+    } else if (tai_iterator_can_read_on(tai_it, tai, first_block, tai_it->first_block_pos, tair_1)) {
+        // likewise, but seeking back to the block after the first block of the last region
+        p_alignment = first_block;
+        p_alignment_pos = tai_it->first_block_pos;
+        first_block = NULL;
+        LI_seek(li, tai_it->first_block_next_pos);
+        int64_t line_length;
+        LI_get_next_line_span(li, &line_length); // load the line at the seeked position
     }
-    
+    if (last_block != NULL) {
+        alignment_destruct(last_block, true);
+    }
+    if (first_block != NULL) {
+        alignment_destruct(first_block, true);
+    }
+    if (p_alignment != NULL) {
+        if (p_alignment->row->start + p_alignment->row->length > tai_it->start) {
+            // the kept block itself overlaps the region
+            tai_iterator_found(tai_it, li, p_alignment, p_alignment_pos);
+            return;
+        }
+    } else {
+        // move to the first record in our file
+        start_time = time(NULL);
+        LI_seek(li, tai->file_pos[tair_1]);
+        st_logInfo("Seeked to the queried anchor position with taf file in %" PRIi64 " seconds\n", time(NULL) - start_time);
+        int64_t line_length;
+        LI_get_next_line_span(li, &line_length); // load the line at the seeked position
+        if (!tai_it->maf) {
+            // force taf to start a new alignment at our current file position by making
+            // sure all coordinates are expressed as insertions
+            change_s_coordinates_to_i(LI_peek_at_next_line(li));
+        }
+    }
+
     // now we have to scan forward until we overlap actually the region
     // TODO: this will surely need speeding up with binary search for giant files...
     //       but i think that's best done once tests are set up based on the simpler version
     start_time = time(NULL);
     size_t scan_block_count = 0;
-    tai_it->alignment = NULL;
-    tai_it->p_alignment = NULL;
-    Alignment *alignment = NULL;
-    Alignment *p_alignment = NULL;
     int64_t file_pos = LI_tell(li);
+    int64_t block_pos = tai_block_position(li, tai_it->maf);
     while((alignment = maftaf_read_block(p_alignment, tai_it->run_length_encode_bases, li)) != NULL) {
         ++scan_block_count;
-        if (tair_2 && file_pos >= tair_2->file_pos) {
+        if (p_alignment != NULL) {
+            // cut off p_alignment, so the block, which may be kept or returned, does not point at its freed rows.
+            // Its coordinates are absolute, as read relative to p_alignment
+            alignment_unlink_left(alignment);
+            alignment_destruct(p_alignment, true);
+        }
+        p_alignment = NULL;
+        if (tair_2 >= 0 && file_pos >= tai->file_pos[tair_2]) {
             // we've gone past our query region: there's no hope
-            alignment_destruct(alignment, true);
-            if (p_alignment) {
-                alignment_destruct(p_alignment, true);
+            if (tai_it->retain_last_block) { // but the block may be the start of the next region
+                tai_it->last_block = alignment;
+                tai_it->last_block_pos = block_pos;
+            } else {
+                alignment_destruct(alignment, true);
             }
-            alignment = NULL;
-            p_alignment = NULL;
             break;
-        } else {
-            if (p_alignment != NULL) {
-                alignment_destruct(p_alignment, true);
-            }
-            p_alignment = alignment;
-            if (strcmp(alignment->row->sequence_name, qr.name) == 0 &&
-                alignment->row->start < tai_it->end &&
-                (alignment->row->start + alignment->row->length) > tai_it->start) {
-                // important: need to cut off p_alignment to get our absolute coordinates
-                for (Alignment_Row *row = alignment->row; row != NULL; row = row->n_row) {
-                    row->l_row = NULL;
-                }
-                // we've found an intersection at "alignment"
-                tai_it->alignment = alignment;
-                p_alignment = NULL;
-                break;
-            }
         }
+        if (strcmp(alignment->row->sequence_name, tai_it->name) == 0 &&
+            alignment->row->start < tai_it->end &&
+            (alignment->row->start + alignment->row->length) > tai_it->start) {
+            // we've found an intersection at "alignment"
+            tai_iterator_found(tai_it, li, alignment, block_pos);
+            break;
+        }
+        p_alignment = alignment;
         file_pos = LI_tell(li);
+        block_pos = tai_block_position(li, tai_it->maf);
     }
     if (p_alignment != NULL) {
         alignment_destruct(p_alignment, true);
@@ -492,10 +1246,37 @@ TaiIt *tai_iterator(Tai* tai, LI *li, bool run_length_encode_bases, const char *
     }
 
     st_logInfo("Scanned %" PRIi64 " blocks to find region start in %" PRIi64 " seconds\n", scan_block_count, time(NULL) - start_time);
-    
+}
+
+TaiIt *tai_iterator(Tai* tai, LI *li, bool run_length_encode_bases, const char *contig, int64_t start, int64_t length) {
+    TaiIt *tai_it = st_calloc(1, sizeof(TaiIt));
+    tai_it->maf = tai->maf;
+    tai_it->run_length_encode_bases = run_length_encode_bases;
+    tai_iterator_query(tai_it, tai, li, contig, start, length);
     return tai_it;
 }
 
+TaiIt *tai_regions_iterator(Tai *tai, bool run_length_encode_bases) {
+    TaiIt *tai_it = st_calloc(1, sizeof(TaiIt));
+    tai_it->maf = tai->maf;
+    tai_it->run_length_encode_bases = run_length_encode_bases;
+    tai_it->retain_last_block = true;
+    return tai_it;
+}
+
+void tai_iterator_next_region(TaiIt *tai_it, Tai *tai, LI *li, const char *contig, int64_t start, int64_t length) {
+    assert(tai_it->retain_last_block && !tai_it->secondary);
+    if (tai_it->alignment != NULL) {
+        // the last region was not read to the end, so li is not where the kept block says it is
+        alignment_destruct(tai_it->alignment, true);
+        if (tai_it->last_block != NULL) {
+            alignment_destruct(tai_it->last_block, true);
+            tai_it->last_block = NULL;
+        }
+    }
+    tai_iterator_query(tai_it, tai, li, contig, start, length);
+}
+
 /** 
  * clip an alignment, assumes start/end overlap aln and would leave a non-empty remainder
  * returns 0: no cut
@@ -506,6 +1287,8 @@ TaiIt *tai_iterator(Tai* tai, LI *li, bool run_length_encode_bases, const char *
 static unsigned int clip_alignment(Alignment *aln, Alignment *p_aln, int64_t start, int64_t end) {
 
     unsigned int ret = 0;
+    alignment_invalidate_column_bases(aln);
+    Tag **column_tags = alignment_get_column_tags(aln); // parse any tags, as read they are of the unclipped columns
     // clip the left side
     int64_t left_trim = start - aln->row->start;
     if (left_trim > 0) {
@@ -532,12 +1315,16 @@ static unsigned int clip_alignment(Alignment *aln, Alignment *p_aln, int64_t sta
             if (row->length == 0) {
                 row->bases[0] = '\0';
             } else {
-                char *bases = row->bases;
-                row->bases = stString_getSubString(bases, cut_point, strlen(row->bases) - cut_point);
-                free(bases);
+                alignment_row_set_bases(row, stString_getSubString(row->bases, cut_point, strlen(row->bases) - cut_point));
             }
             assert(strlen(row->bases) >= row->length);            
         }
+        // and the tags of the columns cut
+        for (int64_t col = 0; col < cut_point; ++col) {
+            tag_destruct(column_tags[col]);
+        }
+        memmove(column_tags, column_tags + cut_point, (aln->column_number - cut_point) * sizeof(Tag *));
+        aln->column_number -= cut_point;
     }
 
     //clip the right side
@@ -564,12 +1351,14 @@ static unsigned int clip_alignment(Alignment *aln, Alignment *p_aln, int64_t sta
             if (row->length == 0) {
                 row->bases[0] = '\0';
             } else {
-                char *bases = row->bases;
-                row->bases = stString_getSubString(bases, 0, cut_point + 1);
-                free(bases);
+                alignment_row_set_bases(row, stString_getSubString(row->bases, 0, cut_point + 1));
             }
             assert(strlen(row->bases) >= row->length);
         }
+        for (int64_t col = cut_point + 1; col < aln->column_number; ++col) {
+            tag_destruct(column_tags[col]);
+        }
+        aln->column_number = cut_point + 1;
     }
 
     // now we make sure any deleted rows are unlinked from prev alignment.
@@ -589,7 +1378,7 @@ static unsigned int clip_alignment(Alignment *aln, Alignment *p_aln, int64_t sta
     for (Alignment_Row *row = aln->row; row != NULL; row = row->n_row) {
         if (row->length == 0) {
             assert(strlen(row->bases) == 0);
-            row->bases = (char*)st_calloc(aln->column_number + 1, sizeof(char));
+            alignment_row_set_bases(row, (char*)st_calloc(aln->column_number + 1, sizeof(char)));
             for (int64_t i = 0; i < aln->column_number; ++i) {
                 row->bases[i] = '-';
             }
@@ -600,11 +1389,128 @@ static unsigned int clip_alignment(Alignment *aln, Alignment *p_aln, int64_t sta
     return ret;
 }
 
+// returns non-zero if a row of the block aligns some of the interval [start, end) of the named sequence
+static bool alignment_overlaps(Alignment *alignment, const char *name, int64_t start, int64_t end) {
+    for (Alignment_Row *row = alignment->row; row != NULL; row = row->n_row) {
+        int64_t row_start, row_end;
+        row_forward_interval(row, &row_start, &row_end);
+        if (row->length > 0 && row_start < end && row_end > start && strcmp(row->sequence_name, name) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Read the next block of the segments of a secondary iterator that overlaps the region, or NULL if there are no more.
+ * tai_it->p_alignment is the last block read, which is only kept linked to the next block if both are returned, and
+ * which is freed once the next is read if it is not returned.
+ */
+static Alignment *tai_secondary_read_block(TaiIt *tai_it, LI *li) {
+    Alignment* (*maftaf_read_block)(Alignment*, bool, LI*) = tai_it->maf ? maf_read_block_3 : taf_read_block;
+    while (tai_it->segment < tai_it->segment_number) {
+        if (!tai_it->in_segment) { // move to the start of the segment, unless reading on from the last block read
+            if (tai_it->p_alignment == NULL ||
+                tai_block_position(li, tai_it->maf) != tai_it->segment_starts[tai_it->segment]) {
+                LI_seek(li, tai_it->segment_starts[tai_it->segment]);
+                int64_t line_length;
+                LI_get_next_line_span(li, &line_length); // load the line at the seeked position
+                if (!tai_it->maf) {
+                    change_s_coordinates_to_i(LI_peek_at_next_line(li));
+                }
+                if (tai_it->p_alignment != NULL && !tai_it->p_returned) {
+                    alignment_destruct(tai_it->p_alignment, true);
+                }
+                tai_it->p_alignment = NULL;
+            }
+            tai_it->in_segment = 1;
+        }
+        int64_t end = tai_it->segment_ends[tai_it->segment];
+        Alignment *alignment = NULL;
+        if ((end < 0 || tai_block_position(li, tai_it->maf) < end) &&
+            (alignment = maftaf_read_block(tai_it->p_alignment, tai_it->run_length_encode_bases, li)) != NULL) {
+            bool overlaps = alignment_overlaps(alignment, tai_it->name, tai_it->start, tai_it->end);
+            if (tai_it->p_alignment != NULL && (!tai_it->p_returned || !overlaps)) {
+                alignment_unlink_left(alignment);
+                if (!tai_it->p_returned) {
+                    alignment_destruct(tai_it->p_alignment, true);
+                }
+            }
+            tai_it->p_alignment = alignment;
+            tai_it->p_returned = overlaps;
+            if (overlaps) {
+                return alignment;
+            }
+        } else { // the end of the segment
+            tai_it->in_segment = 0;
+            tai_it->segment++;
+        }
+    }
+    if (tai_it->p_alignment != NULL && !tai_it->p_returned) {
+        alignment_destruct(tai_it->p_alignment, true);
+    }
+    tai_it->p_alignment = NULL;
+    return NULL;
+}
+
+TaiIt *tai_secondary_iterator(Tai *secondary, LI *li, bool run_length_encode_bases, const char *sequence,
+                              int64_t start, int64_t length) {
+    assert(secondary->seq_end != NULL);
+    TaiIt *tai_it = st_calloc(1, sizeof(TaiIt));
+    tai_it->maf = secondary->maf;
+    tai_it->name = stString_copy(sequence);
+    tai_it->start = start;
+    tai_it->end = length < 0 ? LONG_MAX : start + length;
+    tai_it->run_length_encode_bases = run_length_encode_bases;
+    tai_it->secondary = 1;
+
+    const TaiContig *tai_contig = tai_find_contig(secondary, sequence);
+    if (length == 0 || tai_contig == NULL) {
+        return tai_it;
+    }
+
+    // the records overlapping the region start before its end, and walking back from the last of those we can stop
+    // once no earlier record ends after the region's start
+    tai_it->segment_starts = st_malloc(tai_contig->record_number * sizeof(int64_t));
+    tai_it->segment_ends = st_malloc(tai_contig->record_number * sizeof(int64_t));
+    int64_t *segments = st_malloc(2 * tai_contig->record_number * sizeof(int64_t)), segment_number = 0; // start, end
+    for (int64_t i = tai_search_greater_than(secondary, tai_contig, tai_it->end - 1) - 1;
+         i >= tai_contig->first_record && secondary->max_end[i] > tai_it->start; i--) {
+        if (secondary->seq_end[i] > tai_it->start) {
+            segments[2 * segment_number] = secondary->file_pos[i];
+            segments[2 * segment_number++ + 1] = secondary->file_end[i];
+        }
+    }
+
+    // the segments in order of the file, those that follow on from one another being joined so their blocks stay linked
+    qsort(segments, segment_number, 2 * sizeof(int64_t), int64_cmp);
+    for (int64_t i = 0; i < segment_number; i++) {
+        int64_t segment_start = segments[2 * i], segment_end = segments[2 * i + 1];
+        if (tai_it->segment_number > 0 && tai_it->segment_ends[tai_it->segment_number - 1] == segment_start) {
+            tai_it->segment_ends[tai_it->segment_number - 1] = segment_end;
+        } else {
+            tai_it->segment_starts[tai_it->segment_number] = segment_start;
+            tai_it->segment_ends[tai_it->segment_number++] = segment_end;
+        }
+    }
+    free(segments);
+    st_logInfo("Queried the secondary index for %" PRIi64 " segments\n", tai_it->segment_number);
+
+    tai_it->alignment = tai_secondary_read_block(tai_it, li);
+    return tai_it;
+}
+
 Alignment *tai_next(TaiIt *tai_it, LI *li) {    
     if (tai_it->alignment == NULL) {
         return NULL;
     }
 
+    if (tai_it->secondary) { // return the blocks whole, reading ahead to the next
+        Alignment *alignment = tai_it->alignment;
+        tai_it->alignment = tai_secondary_read_block(tai_it, li);
+        return alignment;
+    }
+
     // start by clamping the alignment block to the region
     assert(strcmp(tai_it->alignment->row->sequence_name, tai_it->name) == 0);
     
@@ -619,12 +1525,24 @@ Alignment *tai_next(TaiIt *tai_it, LI *li) {
     // scan forward
     if (tai_it->alignment->row->start + tai_it->alignment->row->length > tai_it->end) {
         tai_it->alignment = NULL;
+        if (tai_it->retain_last_block) { // keep the block unclipped, as the next region may overlap it too
+            tai_it->last_block = alignment_copy(tai_it->p_alignment);
+            tai_it->last_block_pos = tai_it->alignment_pos;
+        }
     } else {
+        int64_t block_pos = tai_block_position(li, tai_it->maf);
         tai_it->alignment = maftaf_read_block(tai_it->p_alignment, tai_it->run_length_encode_bases, li);
+        tai_it->alignment_pos = block_pos;
         if (tai_it->alignment != NULL &&
             (strcmp(tai_it->alignment->row->sequence_name, tai_it->name) != 0 ||
              tai_it->alignment->row->start >= tai_it->end)) {
-            alignment_destruct(tai_it->alignment, true);
+            if (tai_it->retain_last_block) { // keep the block, from which the next region may be read on
+                alignment_unlink_left(tai_it->alignment);
+                tai_it->last_block = tai_it->alignment;
+                tai_it->last_block_pos = block_pos;
+            } else {
+                alignment_destruct(tai_it->alignment, true);
+            }
             tai_it->alignment = NULL;
         }
     }
@@ -640,14 +1558,40 @@ bool tai_has_next(TaiIt *tai_it) {
 }
 
 void tai_iterator_destruct(TaiIt *tai_it) {
+    if (tai_it->last_block != NULL) {
+        alignment_destruct(tai_it->last_block, true);
+    }
+    if (tai_it->first_block != NULL) {
+        alignment_destruct(tai_it->first_block, true);
+    }
     free(tai_it->name);
+    free(tai_it->segment_starts);
+    free(tai_it->segment_ends);
     free(tai_it);
 }
 
+const TaiContigSummary *tai_contig_summary(Tai *tai, int64_t i, const char **name) {
+    if (i < 0 || i >= tai->summary_number) {
+        return NULL;
+    }
+    *name = tai->names + tai->summaries[i].name;
+    return &tai->summaries[i];
+}
+
 stHash *tai_sequence_lengths(Tai *tai, LI *li) {
-    // read the header
+    stHash *seq_to_len = stHash_construct3(stHash_stringKey, stHash_stringEqualKey, free, NULL);
+    if (tai->summary_number > 0) { // the summaries of the contigs have their lengths
+        for (int64_t i = 0; i < tai->summary_number; i++) {
+            stHash_insert(seq_to_len, stString_copy(tai->names + tai->summaries[i].name),
+                          (void*)tai->summaries[i].sequence_length);
+        }
+        return seq_to_len;
+    }
+
+    // otherwise read the header
     LI_seek(li, 0);
-    LI_get_next_line(li);
+    int64_t length;
+    LI_get_next_line_span(li, &length); // load the line at the seeked position
     int input_format = check_input_format(LI_peek_at_next_line(li));
     assert(input_format == 0 || input_format == 1);
     assert((input_format == 1) == tai->maf);
@@ -668,41 +1612,452 @@ stHash *tai_sequence_lengths(Tai *tai, LI *li) {
     if (!tai->maf) {
         maftaf_read_block = taf_read_block;
     }
-    
-    stHash *seq_to_len = stHash_construct3(stHash_stringKey, stHash_stringEqualKey, free, NULL);
 
-    // dummy record for querying the set
-    TaiRec qr;
-    qr.seq_pos = 0;
+    // the index keeps a table of the sequence names, which is handy here
+    // we iterate that, using the position index to hook into the first record of
+    // each name
+    for (int64_t i = 0; i < tai->contig_number; ++i) {
+        const TaiContig *contig = &tai->contigs[i];
+        const char *seq = tai_contig_name(tai, contig);
+        LI_seek(li, tai->file_pos[contig->first_record]);
+        LI_get_next_line_span(li, &length); // load the line at the seeked position
+
+        if (!tai->maf) {
+            // force taf to start a new alignment at our current file position by making
+            // sure all coordinates are expressed as insertions
+            change_s_coordinates_to_i(LI_peek_at_next_line(li));
+        }
+
+        Alignment *alignment = maftaf_read_block(NULL, run_length_encode_bases, li);
+        assert(alignment != NULL);
+
+        Alignment_Row *row = alignment->row;
+        assert(row != NULL);
+        assert(strcmp(row->sequence_name, seq) == 0);
+        stHash_insert(seq_to_len, stString_copy(row->sequence_name), (void*)row->sequence_length);
+        alignment_destruct(alignment, 1);
+    }
+
+    assert(stHash_size(seq_to_len) == tai->contig_number);
+    return seq_to_len;
+}
+
+/*
+ * A chunk of a TAF file, from one index anchor up to the next chunk's, parsed by a worker of a TaiReader.
+ */
+typedef struct _TaiReaderChunk {
+    int64_t start; // The position of the first line of the chunk
+    int64_t end; // The position of the first line of the next chunk, or -1 if this is the last chunk
+    char *anchor_line; // The coordinates line at the start of the chunk as it is in the file, or NULL if the chunk
+    // is the first, and so is not parsed from an anchor
+    stList *blocks; // The blocks parsed from the chunk, in order
+    bool parsed;
+} TaiReaderChunk;
+
+struct _TaiReader {
+    char *file;
+    bool run_length_encode_bases;
+    TaiReaderChunk *chunks;
+    int64_t chunk_number;
+    int64_t next_chunk_to_parse;
+    int64_t chunk; // The chunk the next block is returned from
+    int64_t block; // The index in the chunk's blocks of the next block returned
+    int64_t window; // Chunks are only parsed if fewer than this many chunks ahead of chunk
+    Alignment *p_alignment; // The last block returned
+    pthread_t *threads;
+    int64_t thread_number;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond; // Signalled when a chunk is parsed or finished with
+    bool stop;
+};
+
+static int64_t tai_file_offset(int64_t position) {
+#ifdef USE_HTSLIB
+    return position >> 16; // The offset in the compressed file of a bgzf virtual offset
+#else
+    return position;
+#endif
+}
+
+static void tai_reader_parse_chunk(TaiReader *reader, TaiReaderChunk *chunk, LI *li) {
+    LI_seek(li, chunk->start);
+    int64_t length;
+    LI_get_next_line_span(li, &length); // load the line at the seeked position
+    if(chunk->anchor_line != NULL) {
+        // force taf to start a new alignment at the anchor by making sure all coordinates are expressed as
+        // insertions, the rows being linked to the previous chunk's as they are returned
+        change_s_coordinates_to_i(LI_peek_at_next_line(li));
+    }
+    Alignment *alignment, *p_alignment = NULL;
+    while((chunk->end < 0 || LI_tell_next(li) < chunk->end) &&
+          (alignment = taf_read_block(p_alignment, reader->run_length_encode_bases, li)) != NULL) {
+        stList_append(chunk->blocks, alignment);
+        p_alignment = alignment;
+    }
+}
+
+static void *tai_reader_worker(void *arg) {
+    TaiReader *reader = arg;
+    FILE *fh = fopen(reader->file, "r");
+    if(fh == NULL) {
+        st_errAbort("Unable to open input file: %s\n", reader->file);
+    }
+    LI *li = LI_construct(fh);
+    pthread_mutex_lock(&reader->mutex);
+    while(1) {
+        while(!reader->stop && reader->next_chunk_to_parse < reader->chunk_number &&
+              reader->next_chunk_to_parse >= reader->chunk + reader->window) { // Don't get too far ahead
+            pthread_cond_wait(&reader->cond, &reader->mutex);
+        }
+        if(reader->stop || reader->next_chunk_to_parse >= reader->chunk_number) {
+            break;
+        }
+        TaiReaderChunk *chunk = &reader->chunks[reader->next_chunk_to_parse++];
+        pthread_mutex_unlock(&reader->mutex);
+        tai_reader_parse_chunk(reader, chunk, li);
+        pthread_mutex_lock(&reader->mutex);
+        chunk->parsed = 1;
+        pthread_cond_broadcast(&reader->cond);
+    }
+    pthread_mutex_unlock(&reader->mutex);
+    LI_destruct(li);
+    fclose(fh);
+    return NULL;
+}
 
-    // the index keeps a set of sequence names, which is handy here
-    // we iterate that, using the position index to hook into the first occurrence of
-    // each name.  but we add every sequence name we can find for each block, not just reference
-    for (int64_t i = 0; i < stList_length(tai->names); ++i) {
-        char *seq = (char*)stList_get(tai->names, i);
-        if (stHash_search(seq_to_len, seq) == NULL) {
-            qr.name = seq;
-            TaiRec *tair = stSortedSet_searchGreaterThanOrEqual(tai->idx, &qr);
-            assert(tair != NULL);
-            LI_seek(li, tair->file_pos);
-            LI_get_next_line(li);
+TaiReader *tai_reader_construct(Tai *tai, const char *file, int64_t start, bool run_length_encode_bases,
+                                int64_t thread_number, int64_t chunk_size) {
+    assert(!tai->maf);
+    TaiReader *reader = st_calloc(1, sizeof(TaiReader));
+    reader->file = stString_copy(file);
+    reader->run_length_encode_bases = run_length_encode_bases;
+    pthread_mutex_init(&reader->mutex, NULL);
+    pthread_cond_init(&reader->cond, NULL);
 
-            if (!tai->maf) {
-                // force taf to start a new alignment at our current file position by making
-                // sure all coordinates are expressed as insertions
-                change_s_coordinates_to_i(LI_peek_at_next_line(li));
+    // Get the anchors in file order, checking they are within the file
+    int64_t anchor_number = tai->record_number;
+    int64_t *anchors = st_malloc((anchor_number + 1) * sizeof(int64_t));
+    memcpy(anchors, tai->file_pos, anchor_number * sizeof(int64_t));
+    qsort(anchors, anchor_number, sizeof(int64_t), int64_cmp);
+    struct stat st;
+    if(stat(file, &st) != 0 || (anchor_number > 0 && (anchors[0] < 0 ||
+                                                      tai_file_offset(anchors[anchor_number-1]) >= st.st_size))) {
+        fprintf(stderr, "The index of %s has positions beyond the end of the file, so is not used\n", file);
+        free(anchors);
+        tai_reader_destruct(reader);
+        return NULL;
+    }
+
+    // Split the file at anchors at least chunk_size bytes apart, the first chunk starting at start
+    reader->chunks = st_calloc(anchor_number + 1, sizeof(TaiReaderChunk));
+    reader->chunks[0].start = start;
+    reader->chunk_number = 1;
+    for(int64_t i=0; i<anchor_number; i++) {
+        if(anchors[i] > start && tai_file_offset(anchors[i]) - tai_file_offset(start) >= chunk_size) {
+            reader->chunks[reader->chunk_number - 1].end = anchors[i];
+            reader->chunks[reader->chunk_number++].start = anchors[i];
+            start = anchors[i];
+        }
+    }
+    reader->chunks[reader->chunk_number - 1].end = -1;
+    free(anchors);
+
+    // Get the anchor line of each chunk after the first, to link its first block to the previous chunk's last
+    FILE *fh = fopen(file, "r");
+    if(fh == NULL) {
+        st_errAbort("Unable to open input file: %s\n", file);
+    }
+    LI *li = LI_construct(fh);
+    bool anchored = 1;
+    for(int64_t i=0; i<reader->chunk_number; i++) {
+        TaiReaderChunk *chunk = &reader->chunks[i];
+        chunk->blocks = stList_construct();
+        if(i > 0 && anchored) {
+            LI_seek(li, chunk->start);
+            int64_t length;
+            LI_get_next_line_span(li, &length); // load the line at the seeked position
+            char *line = LI_peek_at_next_line(li);
+            int64_t anchor_start;
+            bool strand;
+            char *sequence_name = line == NULL ? NULL : taf_parse_anchor_line(line, strlen(line),
+                                                                              run_length_encode_bases,
+                                                                              &anchor_start, &strand);
+            if(sequence_name == NULL) { // The index does not point at an anchor line, so is not of this file
+                anchored = 0;
+                continue;
             }
-            
-            Alignment *alignment = maftaf_read_block(NULL, run_length_encode_bases, li);
-            assert(alignment != NULL);
+            free(sequence_name);
+            chunk->anchor_line = stString_copy(line);
+        }
+    }
+    LI_destruct(li);
+    fclose(fh);
+    if(!anchored) {
+        fprintf(stderr, "The index of %s does not point at anchor lines of the file, so is not used\n", file);
+        tai_reader_destruct(reader);
+        return NULL;
+    }
 
-            Alignment_Row *row = alignment->row;
-            assert(row != NULL);
-            assert(strcmp(row->sequence_name, seq) == 0);
-            stHash_insert(seq_to_len, stString_copy(row->sequence_name), (void*)row->sequence_length);
+    // Start the workers
+    reader->thread_number = thread_number;
+    reader->window = 2 * thread_number;
+    reader->threads = st_malloc(thread_number * sizeof(pthread_t));
+    for(int64_t i=0; i<thread_number; i++) {
+        if(pthread_create(&reader->threads[i], NULL, tai_reader_worker, reader) != 0) {
+            st_errAbort("Unable to start %" PRIi64 " TAF parsing threads\n", thread_number);
         }
     }
+    return reader;
+}
 
-    assert(stHash_size(seq_to_len) == stList_length(tai->names));
-    return seq_to_len;
+TaiReader *tai_reader_open(const char *file, LI *li, bool run_length_encode_bases, int64_t thread_number) {
+    if(thread_number <= 1 || file == NULL) {
+        return NULL;
+    }
+    char *tai_fn = tai_path(file);
+    FILE *tai_fh = fopen(tai_fn, "r");
+    free(tai_fn);
+    if(tai_fh == NULL) {
+        return NULL;
+    }
+    if(!tai_is_current(tai_fh, file)) {
+        fprintf(stderr, "The index of %s is older than the file, so is not used to read it in parallel\n", file);
+        fclose(tai_fh);
+        return NULL;
+    }
+    Tai *tai = tai_load(tai_fh, 0);
+    fclose(tai_fh);
+    TaiReader *reader = tai_reader_construct(tai, file, LI_tell_next(li), run_length_encode_bases, thread_number,
+                                             TAI_READER_CHUNK_SIZE);
+    tai_destruct(tai);
+    return reader;
+}
+
+Alignment *tai_reader_next(TaiReader *reader) {
+    pthread_mutex_lock(&reader->mutex);
+    while(reader->chunk < reader->chunk_number) {
+        TaiReaderChunk *chunk = &reader->chunks[reader->chunk];
+        while(!chunk->parsed) {
+            pthread_cond_wait(&reader->cond, &reader->mutex);
+        }
+        if(reader->block < stList_length(chunk->blocks)) {
+            pthread_mutex_unlock(&reader->mutex);
+            Alignment *alignment = stList_get(chunk->blocks, reader->block++);
+            if(reader->block == 1 && chunk->anchor_line != NULL && reader->p_alignment != NULL) {
+                taf_link_block(reader->p_alignment, alignment, chunk->anchor_line, strlen(chunk->anchor_line));
+            }
+            reader->p_alignment = alignment;
+            return alignment;
+        }
+        // Done with the chunk, so let the workers parse another
+        stList_destruct(chunk->blocks);
+        chunk->blocks = NULL;
+        reader->chunk++;
+        reader->block = 0;
+        pthread_cond_broadcast(&reader->cond);
+    }
+    pthread_mutex_unlock(&reader->mutex);
+    reader->p_alignment = NULL;
+    return NULL;
+}
+
+void tai_reader_destruct(TaiReader *reader) {
+    pthread_mutex_lock(&reader->mutex);
+    reader->stop = 1;
+    pthread_cond_broadcast(&reader->cond);
+    pthread_mutex_unlock(&reader->mutex);
+    for(int64_t i=0; i<reader->thread_number; i++) {
+        pthread_join(reader->threads[i], NULL);
+    }
+    for(int64_t i=0; i<reader->chunk_number; i++) { // Clean up the blocks of any chunks not returned
+        TaiReaderChunk *chunk = &reader->chunks[i];
+        if(chunk->blocks != NULL) {
+            for(int64_t j=i == reader->chunk ? reader->block : 0; j<stList_length(chunk->blocks); j++) {
+                alignment_destruct(stList_get(chunk->blocks, j), 1);
+            }
+            stList_destruct(chunk->blocks);
+        }
+        free(chunk->anchor_line);
+    }
+    pthread_mutex_destroy(&reader->mutex);
+    pthread_cond_destroy(&reader->cond);
+    free(reader->chunks);
+    free(reader->threads);
+    free(reader->file);
+    free(reader);
+}
+
+/*
+ * The blocks of a region of a TaiRegionReader, appended by the worker reading the region as they are read
+ */
+typedef struct _TaiRegionReaderRegion {
+    stList *blocks;
+    int64_t next_block; // The index in blocks of the next block returned
+    bool read; // Set once all the blocks of the region have been read
+} TaiRegionReaderRegion;
+
+struct _TaiRegionReader {
+    char *file;
+    Tai *tai;
+    bool run_length_encode_bases;
+    TaiRegion *regions;
+    TaiRegionReaderRegion *region_blocks;
+    int64_t region_number;
+    int64_t *group_starts; // The first region of each group of regions of the same sequence, and then region_number
+    int64_t group_number;
+    int64_t next_group_to_read;
+    int64_t region; // The region the next block is returned from
+    int64_t block_number; // The number of blocks read and not yet returned
+    int64_t max_block_number; // Workers reading regions after region wait while there are this many blocks
+    pthread_t *threads;
+    int64_t thread_number;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond; // Signalled when a block is read or returned
+    bool stop;
+};
+
+/*
+ * Hand a block of region i to the reader, then wait while the reader holds enough blocks, unless the region is the one
+ * being returned from. Returns false if the reader is being stopped.
+ */
+static bool tai_region_reader_add_block(TaiRegionReader *reader, int64_t i, Alignment *alignment) {
+    pthread_mutex_lock(&reader->mutex);
+    stList_append(reader->region_blocks[i].blocks, alignment);
+    reader->block_number++;
+    pthread_cond_broadcast(&reader->cond);
+    while(!reader->stop && i > reader->region && reader->block_number >= reader->max_block_number) {
+        pthread_cond_wait(&reader->cond, &reader->mutex);
+    }
+    bool stop = reader->stop;
+    pthread_mutex_unlock(&reader->mutex);
+    return !stop;
+}
+
+static void *tai_region_reader_worker(void *arg) {
+    TaiRegionReader *reader = arg;
+    FILE *fh = fopen(reader->file, "r");
+    if(fh == NULL) {
+        st_errAbort("Unable to open input file: %s\n", reader->file);
+    }
+    LI *li = LI_construct(fh);
+    TaiIt *tai_it = tai_regions_iterator(reader->tai, reader->run_length_encode_bases);
+    pthread_mutex_lock(&reader->mutex);
+    while(!reader->stop && reader->next_group_to_read < reader->group_number) {
+        int64_t group = reader->next_group_to_read++;
+        pthread_mutex_unlock(&reader->mutex);
+        bool stop = 0;
+        for(int64_t i=reader->group_starts[group]; i<reader->group_starts[group+1] && !stop; i++) {
+            TaiRegion *region = &reader->regions[i];
+            tai_iterator_next_region(tai_it, reader->tai, li, region->sequence, region->start, region->length);
+            // Each block is handed on once the next is read, as tai_next may change the last block it returned until
+            // then
+            Alignment *alignment, *p_alignment = NULL;
+            while(!stop && (alignment = tai_next(tai_it, li)) != NULL) {
+                if(p_alignment != NULL) {
+                    stop = !tai_region_reader_add_block(reader, i, p_alignment);
+                }
+                p_alignment = alignment;
+            }
+            pthread_mutex_lock(&reader->mutex);
+            if(p_alignment != NULL) {
+                stList_append(reader->region_blocks[i].blocks, p_alignment);
+                reader->block_number++;
+            }
+            reader->region_blocks[i].read = 1;
+            pthread_cond_broadcast(&reader->cond);
+            pthread_mutex_unlock(&reader->mutex);
+        }
+        pthread_mutex_lock(&reader->mutex);
+    }
+    pthread_mutex_unlock(&reader->mutex);
+    if(tai_it->alignment != NULL) { // Stopped part way through a region
+        alignment_destruct(tai_it->alignment, 1);
+    }
+    tai_iterator_destruct(tai_it);
+    LI_destruct(li);
+    fclose(fh);
+    return NULL;
+}
+
+TaiRegionReader *tai_region_reader_construct(Tai *tai, const char *file, TaiRegion *regions, int64_t region_number,
+                                             bool run_length_encode_bases, int64_t thread_number) {
+    TaiRegionReader *reader = st_calloc(1, sizeof(TaiRegionReader));
+    reader->file = stString_copy(file);
+    reader->tai = tai;
+    reader->run_length_encode_bases = run_length_encode_bases;
+    reader->regions = regions;
+    reader->region_number = region_number;
+    reader->region_blocks = st_calloc(region_number, sizeof(TaiRegionReaderRegion));
+    reader->group_starts = st_malloc((region_number + 1) * sizeof(int64_t));
+    for(int64_t i=0; i<region_number; i++) {
+        reader->region_blocks[i].blocks = stList_construct();
+        if(i == 0 || strcmp(regions[i].sequence, regions[i-1].sequence) != 0) {
+            reader->group_starts[reader->group_number++] = i;
+        }
+    }
+    reader->group_starts[reader->group_number] = region_number;
+
+    // Start the workers, no more than there are groups to read
+    reader->thread_number = thread_number < reader->group_number ? thread_number : reader->group_number;
+    reader->max_block_number = TAI_REGION_READER_BLOCKS_PER_THREAD * (thread_number > 1 ? thread_number : 1);
+    pthread_mutex_init(&reader->mutex, NULL);
+    pthread_cond_init(&reader->cond, NULL);
+    reader->threads = st_malloc(reader->thread_number * sizeof(pthread_t));
+    for(int64_t i=0; i<reader->thread_number; i++) {
+        if(pthread_create(&reader->threads[i], NULL, tai_region_reader_worker, reader) != 0) {
+            st_errAbort("Unable to start %" PRIi64 " region reading threads\n", reader->thread_number);
+        }
+    }
+    return reader;
+}
+
+Alignment *tai_region_reader_next(TaiRegionReader *reader, int64_t *region) {
+    pthread_mutex_lock(&reader->mutex);
+    while(reader->region < reader->region_number) {
+        TaiRegionReaderRegion *region_blocks = &reader->region_blocks[reader->region];
+        while(!region_blocks->read && region_blocks->next_block == stList_length(region_blocks->blocks)) {
+            pthread_cond_wait(&reader->cond, &reader->mutex);
+        }
+        if(region_blocks->next_block < stList_length(region_blocks->blocks)) {
+            Alignment *alignment = stList_get(region_blocks->blocks, region_blocks->next_block++);
+            reader->block_number--;
+            *region = reader->region;
+            pthread_cond_broadcast(&reader->cond);
+            pthread_mutex_unlock(&reader->mutex);
+            return alignment;
+        }
+        // Done with the region, so let the workers of the following regions read on
+        stList_destruct(region_blocks->blocks);
+        region_blocks->blocks = NULL;
+        reader->region++;
+        pthread_cond_broadcast(&reader->cond);
+    }
+    pthread_mutex_unlock(&reader->mutex);
+    return NULL;
+}
+
+void tai_region_reader_destruct(TaiRegionReader *reader) {
+    pthread_mutex_lock(&reader->mutex);
+    reader->stop = 1;
+    pthread_cond_broadcast(&reader->cond);
+    pthread_mutex_unlock(&reader->mutex);
+    for(int64_t i=0; i<reader->thread_number; i++) {
+        pthread_join(reader->threads[i], NULL);
+    }
+    for(int64_t i=0; i<reader->region_number; i++) { // Clean up the blocks of any regions not returned
+        TaiRegionReaderRegion *region_blocks = &reader->region_blocks[i];
+        if(region_blocks->blocks != NULL) {
+            for(int64_t j=region_blocks->next_block; j<stList_length(region_blocks->blocks); j++) {
+                alignment_destruct(stList_get(region_blocks->blocks, j), 1);
+            }
+            stList_destruct(region_blocks->blocks);
+        }
+    }
+    pthread_mutex_destroy(&reader->mutex);
+    pthread_cond_destroy(&reader->cond);
+    free(reader->region_blocks);
+    free(reader->group_starts);
+    free(reader->threads);
+    free(reader->file);
+    free(reader);
 }
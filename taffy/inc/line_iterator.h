@@ -14,20 +14,64 @@ typedef struct BGZF BGZF;
 
 struct BGZF;
 
+struct _LI_Prefetch;
+
 typedef struct _LI {
 #ifdef USE_HTSLIB
     BGZF *bgzf;
 #else
     FILE *fh;
 #endif
-    char *line;
+    char *line; // the next line, or NULL if at EOF. Not NUL terminated if it points into a memory mapped file
+    int64_t line_length; // length of line, unless line_peeked is true
+    bool line_peeked; // true if line has been returned by LI_peek_at_next_line, and so may have been edited in place
+    char *buffers[2]; // reusable line buffers, we alternate between them so the last line returned stays valid
+    size_t buffer_capacities[2];
+    int64_t buffer_index; // the buffer holding line (if line is not memory mapped)
+    char *data; // the memory mapped file, or NULL if reading through a stream
+    int64_t data_length;
+    int64_t data_offset; // offset in data of the line following line
     int64_t prev_pos; // position before reading the current buffer
     int64_t pos;      // position after reading the curent buffer    
+    struct _LI_Prefetch *prefetch; // if not NULL, lines are read ahead of the parser by a background thread
+    void *alignment_pool; // if not NULL, the allocations of blocks recycled for reuse by the blocks read next (see
+    // alignment_recycle in taf.h), opaque to the line iterator,
+    void (*alignment_pool_destruct)(void *alignment_pool); // and the function that frees them
 } LI;
 
-
+/*
+ * Make a line iterator. If fh is an uncompressed, regular file the file is memory mapped and lines are
+ * returned without copying them, otherwise lines are read through a stream (using bgzf if compiled with
+ * htslib).
+ */
 LI *LI_construct(FILE *fh);
 
+/*
+ * As LI_construct, but if compiled with htslib and thread_number > 1 decompresses bgzipped input
+ * using a pool of thread_number threads. If prefetch > 0 and the input is read through a stream, a background
+ * thread reads (and decompresses) up to prefetch blocks of lines ahead of those being parsed, so that I/O
+ * and parsing overlap.
+ */
+LI *LI_construct2(FILE *fh, int64_t thread_number, int64_t prefetch);
+
+/*
+ * The number of threads the command line tools use for bgzf decompression and compression, set by
+ * the global taffy --threads option.
+ */
+extern int64_t taffy_thread_number;
+
+/*
+ * The number of blocks of lines the command line tools read ahead of the parser, set by the global
+ * taffy --prefetch option.
+ */
+extern int64_t taffy_prefetch;
+
+/*
+ * The maximum number of blocks the command line tools encode for output ahead of writing them when using
+ * threads, set by the global taffy --blocksInFlight option. If 0, a default number per thread.
+ */
+extern int64_t taffy_blocks_in_flight;
+
 void LI_destruct(LI *li);
 
 /*
@@ -37,16 +81,34 @@ void LI_destruct(LI *li);
 bool LI_indexable(LI *li);
 
 /*
- * Get the next line from the file or NULL if at EOF.
+ * Get the next line from the file or NULL if at EOF. The returned string is owned by the caller.
  */
 char *LI_get_next_line(LI *li);
 
+/*
+ * As LI_get_next_line, but returns a borrowed span of the line: the pointer is owned by the iterator, its length is
+ * returned in length and it is not necessarily NUL terminated. The span is valid until the next call to
+ * LI_get_next_line_span, LI_get_next_line or LI_seek.
+ */
+char *LI_get_next_line_span(LI *li, int64_t *length);
+
 /*
  * Peek at the next line, a call to peek will not get the next line from the file. In this way it can
- * be used to look ahead at the next line in the iteration sequence.
+ * be used to look ahead at the next line in the iteration sequence. The returned string is NUL terminated
+ * and owned by the iterator. It can be edited in place, provided it is not lengthened.
  */
 char *LI_peek_at_next_line(LI *li);
 
+/*
+ * As LI_peek_at_next_line, but returns a borrowed span that is not necessarily NUL terminated.
+ */
+char *LI_peek_at_next_line_span(LI *li, int64_t *length);
+
+/*
+ * Split a span of a line into whitespace separated tokens, as stString_split, but without
+ * requiring the span to be NUL terminated.
+ */
+stList *LI_split_span(const char *line, int64_t length);
 
 /*
  * Go to position in file
@@ -58,6 +120,11 @@ void LI_seek(LI *li, int64_t position);
  */
 int64_t LI_tell(LI *li);
 
+/*
+ * Tell the position in the file of the next line (that LI_peek_at_next_line returns), which LI_seek can return to
+ */
+int64_t LI_tell_next(LI *li);
+
 
 /*
  * Writer for maf and taf block and header writing
@@ -68,16 +135,84 @@ typedef struct _LW {
 #ifdef USE_HTSLIB
     BGZF *bgzf;
 #endif
+    char *buffer; // output buffered before being written to the stream in large chunks
+    int64_t buffer_length;
+    int64_t buffer_capacity;
+    int64_t position; // The number of bytes (uncompressed) written to the stream
 } LW;
 
 /*
  * Make a LW object. If use_compression is true and compiled with htslib will use bgzf compression on the stream.
+ * If fh is NULL the output is kept in memory, in lw->buffer[0, lw->buffer_length), for the caller to copy out and
+ * reset, e.g. so that output can be formatted on worker threads and then written in order.
  */
 LW *LW_construct(FILE *fh, bool use_compression);
 
+/*
+ * As LW_construct, but if using compression compresses blocks in parallel using a pool of thread_number threads
+ * (if thread_number > 1) at the given compression level (0-9, or -1 for the default level). The output is
+ * standard bgzf either way.
+ */
+LW *LW_construct2(FILE *fh, bool use_compression, int64_t thread_number, int64_t compression_level);
+
+/*
+ * The bgzf compression level the command line tools use, set by the global taffy --compressionLevel option.
+ */
+extern int64_t taffy_compression_level;
+
 void LW_destruct(LW *lw, bool clean_up_file_handle);
 
+/*
+ * Write a printf style formatted string.
+ */
 int LW_write(LW *lw, const char *string, ...);
 
+/*
+ * Faster, format free alternatives to LW_write for writing the common types.
+ */
+void LW_write_char(LW *lw, char c);
+
+/*
+ * Write c, n times.
+ */
+void LW_write_char_run(LW *lw, char c, int64_t n);
+
+void LW_write_bytes(LW *lw, const char *bytes, int64_t length);
+
+void LW_write_string(LW *lw, const char *string);
+
+void LW_write_int64(LW *lw, int64_t i);
+
+void LW_write_newline(LW *lw);
+
+/*
+ * Get room for at least length more bytes at the end of the output, for writers that format a whole line at once
+ * in place. Once written, the bytes are added to the output with LW_commit.
+ */
+char *LW_reserve(LW *lw, int64_t length);
+
+/*
+ * Add the length bytes written to the space returned by LW_reserve to the output.
+ */
+void LW_commit(LW *lw, int64_t length);
+
+/*
+ * Write any buffered output to the underlying stream.
+ */
+void LW_flush(LW *lw);
+
+/*
+ * The position in the (uncompressed) output of the next byte written.
+ */
+int64_t LW_tell(LW *lw);
+
+/*
+ * Convert positions in the uncompressed output written to lw, as given by LW_tell, to the positions in the output
+ * file, at the path file, that LI_seek seeks to: if the output is bgzf compressed these are the virtual offsets of
+ * the positions, found with the bgzf index built as the output is written, otherwise they are unchanged. Call once
+ * all the output has been written, before LW_destruct.
+ */
+void LW_file_positions(LW *lw, const char *file, int64_t *positions, int64_t position_number);
+
 #endif /* STLINE_ITERATOR_H_ */
 
@@ -21,11 +21,36 @@ struct _tag {
 
 typedef struct _row Alignment_Row;
 
+typedef struct _alignment_arena Alignment_Arena; // Allocator for the rows of a block, see alignment_row_construct
+
+typedef struct _base_run { // A run of identical bases down a column of an alignment
+    char base;
+    int64_t length;
+} Base_Run;
+
 typedef struct _alignment {
     int64_t row_number; // Convenient counter of number rows in the alignment
     int64_t column_number; // Convenient counter of number of columns in this alignment
     Alignment_Row *row; // An alignment is just a sequence of rows
-    Tag **column_tags; // The tags for each column, each stored as a sequence of tags
+    Tag **column_tags; // The tags for each column, each stored as a sequence of tags. NULL if the tags have
+    // not yet been parsed, see alignment_get_column_tags
+    char *column_tag_text; // If not NULL, the unparsed text of the tags of the columns as read
+    int64_t *column_tag_text_starts; // If column_tag_text is not NULL, the tags of column i are the text from
+    // column_tag_text[column_tag_text_starts[i]] up to column_tag_text[column_tag_text_starts[i+1]]
+    char *bases; // If not NULL, a row major matrix of the bases of the rows, each row's bases (NUL terminated)
+    // following the previous row's. Rows whose bases_matrix is this matrix have bases that are views into it
+    char *column_bases; // If not NULL, a column major (column_number x row_number, not NUL terminated) copy of
+    // the bases, as read by taf_read_block or built on demand by alignment_get_column_bases
+    bool row_bases_pending; // If true, the bases of the rows are yet to be made from column_bases (or from
+    // column_runs if column_bases is NULL), see alignment_make_row_bases
+    Base_Run *column_runs; // If not NULL, the bases of the columns as runs, as read from run length encoded input
+    // or built on demand by alignment_get_column_runs
+    int64_t *column_run_starts; // If column_runs is not NULL, the runs of column i are column_runs[column_run_starts[i]]
+    // up to (but excluding) column_runs[column_run_starts[i+1]]
+    int64_t column_tags_size, column_tag_text_size, column_tag_text_starts_size, column_bases_size, column_runs_size,
+            column_run_starts_size; // The sizes in bytes allocated for the buffers above (or less, if not known),
+    // at which alignment_recycle gives them back to be reused
+    Alignment_Arena *arena; // If not NULL, the arena the rows of the block are allocated from
 } Alignment;
 
 struct _row { // Each row encodes the information about an aligned sequence
@@ -40,6 +65,11 @@ struct _row { // Each row encodes the information about an aligned sequence
     Alignment_Row *n_row;  // the next row in the alignment
     int64_t bases_since_coordinates_reported; // this number is used by taf write coordinates to
     // indicate how many bases ago were the row's coordinates printed
+    char *bases_matrix; // If not NULL, bases is a view into this reference counted matrix (see
+    // alignment_bases_matrix_construct) rather than being owned by the row
+    bool sequence_name_interned; // If true, sequence_name is from sequence_name_intern, and so is shared rather
+    // than being owned by the row
+    Alignment_Arena *arena; // If not NULL, the row was allocated from this arena by alignment_row_construct
 };
 
 /*
@@ -80,10 +110,65 @@ Tag *tag_remove(Tag *first_tag, char *key);
 Tag *tag_parse(char *tag_string, char *delimiter, Tag *p_tag);
 
 /*
- * Clean up the memory for an alignment
+ * Clean up the memory for an alignment.
+ *
+ * The rows, bases matrix, sequence names and column tag text of a block are each one allocation shared by the block
+ * (see alignment_row_construct, alignment_bases_matrix_construct, sequence_name_intern), but if cleanup_rows is
+ * true each row is still visited: to unlink it from the rows of the adjacent blocks, which may outlive it, and to
+ * free any left gap sequence or uninterned name it owns. Column tags are only freed one by one if they were parsed.
  */
 void alignment_destruct(Alignment *alignment, bool cleanup_rows);
 
+/*
+ * As alignment_destruct, but rather than freeing the allocations of the alignment (the block itself, the arena of
+ * its rows, its bases matrix and its column buffers) keep them with the line iterator the alignment was read from,
+ * to be reused by the next block read from it. Allocations still referenced elsewhere, such as by rows that
+ * outlive the block, are not reused. Streaming through a file recycling each block once done with it, blocks are
+ * read without allocating, the buffers only growing for a block larger than any before it. If li is NULL the block
+ * is freed, as by alignment_destruct.
+ */
+void alignment_recycle(Alignment *alignment, bool cleanup_rows, LI *li);
+
+/*
+ * The allocations of recycled blocks kept by a line iterator, see alignment_recycle.
+ */
+typedef struct _alignment_pool Alignment_Pool;
+
+typedef enum _alignment_pool_buffer {
+    ALIGNMENT_POOL_BASES_MATRIX, // A matrix from alignment_bases_matrix_construct
+    ALIGNMENT_POOL_COLUMN_BASES,
+    ALIGNMENT_POOL_COLUMN_RUNS,
+    ALIGNMENT_POOL_COLUMN_RUN_STARTS,
+    ALIGNMENT_POOL_COLUMN_TAGS,
+    ALIGNMENT_POOL_COLUMN_TAG_TEXT,
+    ALIGNMENT_POOL_COLUMN_TAG_TEXT_STARTS,
+    ALIGNMENT_POOL_ROWS, // Scratch space for the rows of a block as it is parsed
+    ALIGNMENT_POOL_BUFFER_NUMBER
+} Alignment_Pool_Buffer;
+
+/*
+ * Get an empty alignment for a block being read from li, reusing a recycled one if there is one. In this and the
+ * functions below li may be NULL, in which case nothing is reused.
+ */
+Alignment *alignment_pool_take_alignment(LI *li);
+
+/*
+ * Take a recycled buffer of the given kind from li, setting *size to its size in bytes. Returns NULL (and sets *size
+ * to zero) if there is none.
+ */
+void *alignment_pool_take_buffer(LI *li, Alignment_Pool_Buffer kind, int64_t *size);
+
+/*
+ * Get column tags for a block being read from li with the given number of columns, all NULL, reusing recycled ones if
+ * there are any. Sets *size to the size in bytes allocated for them.
+ */
+Tag **alignment_pool_take_column_tags(LI *li, int64_t column_number, int64_t *size);
+
+/*
+ * Give a buffer of size bytes to li for reuse, freeing it if li already has a larger one of the kind.
+ */
+void alignment_pool_return_buffer(LI *li, Alignment_Pool_Buffer kind, void *buffer, int64_t size);
+
 /*
  * Use the O(ND) alignment to diff the rows between two alignments and connect together their rows
  * so that we can determine which rows in the right_alignment are a continuation of rows in the
@@ -140,6 +225,88 @@ char *alignment_get_column(Alignment *alignment, int64_t column_index);
  */
 int32_t *alignment_get_column_as_int_array(Alignment *alignment, int64_t column_index);
 
+/*
+ * Get the tags of the columns of the alignment, parsing them first if they were read but have not yet been
+ * parsed. Use this rather than reading alignment->column_tags directly.
+ */
+Tag **alignment_get_column_tags(Alignment *alignment);
+
+/*
+ * Get the bases of the alignment in column major order, the bases of column i being the row_number characters
+ * starting at i * row_number. Built from the rows (or the runs read) on first use and cached in
+ * alignment->column_bases, so code that edits the rows or their bases must call alignment_invalidate_column_bases
+ * before doing so. The TAF writers only use the cached copies of blocks whose rows are yet to be made.
+ */
+char *alignment_get_column_bases(Alignment *alignment);
+
+/*
+ * Get the bases of a column of the alignment as runs of identical bases, setting *run_number to the number of runs.
+ * Adjacent runs may have the same base if they were read that way. The runs of run length encoded input are kept
+ * as read, otherwise they are built from the column major bases on first use and cached like them.
+ */
+Base_Run *alignment_get_column_runs(Alignment *alignment, int64_t column_index, int64_t *run_number);
+
+/*
+ * Discard any cached column major copies (column bases and runs) of the bases of the alignment, first making the
+ * bases of the rows from them if they are yet to be made.
+ */
+void alignment_invalidate_column_bases(Alignment *alignment);
+
+/*
+ * Make the bases of the rows of a block read by taf_read_block, which reads only the column major bases and
+ * transposes them into the rows (see alignment_set_bases_matrix) when they are first needed. Must be called before
+ * the bases of the rows are read or changed. Does nothing if the rows already have their bases.
+ */
+void alignment_make_row_bases(Alignment *alignment);
+
+/*
+ * Allocate a row major matrix of row_number rows of column_number bases, each row followed by a NUL, for
+ * alignment_set_bases_matrix. The matrix is reference counted, being freed when the alignment and all the rows
+ * that view it have been destroyed.
+ */
+char *alignment_bases_matrix_construct(int64_t row_number, int64_t column_number);
+
+/*
+ * Resize a matrix from alignment_bases_matrix_construct (or construct one, if matrix is NULL) that is not yet in use
+ * by an alignment, keeping the bases of the rows that fit. The matrix is only reallocated if it grows beyond the
+ * size previously allocated.
+ */
+char *alignment_bases_matrix_resize(char *matrix, int64_t row_number, int64_t column_number);
+
+/*
+ * Make the matrix (from alignment_bases_matrix_construct, filled in) the bases of the alignment, setting the
+ * bases of each row to be a view of the corresponding row of the matrix.
+ */
+void alignment_set_bases_matrix(Alignment *alignment, char *matrix);
+
+/*
+ * Replace the bases of a row with the given string, which the row then owns, cleaning up the previous bases.
+ */
+void alignment_row_set_bases(Alignment_Row *row, char *bases);
+
+/*
+ * Get the interned copy of the sequence name name[0, length). Interned names are kept in a process wide pool and are
+ * never freed, so every row (of every block, from every reader) with the same sequence shares one copy of its name
+ * and two interned names are equal only if they are the same pointer. Safe to call from multiple threads; each thread
+ * caches the names it has interned, so only takes the pool's lock for a name new to it.
+ */
+char *sequence_name_intern(const char *name, int64_t length);
+
+/*
+ * Replace the sequence name of a row, cleaning up the previous name. If interned is false the row takes ownership of
+ * the name.
+ */
+void alignment_row_set_sequence_name(Alignment_Row *row, char *sequence_name, bool interned);
+
+/*
+ * Make a new row (zeroed, like st_calloc) for the alignment, allocated from the alignment's arena. The row need not
+ * be added to the alignment and may outlive it: it is cleaned up with alignment_row_destruct like any other row,
+ * the arena being freed once the alignment and all of the rows allocated from it have been destroyed. As each row
+ * holds a reference to the arena there is no call to detach a row from its block; a row kept beyond its block,
+ * such as one added to another block, just keeps the arena's memory alive until it is destroyed.
+ */
+Alignment_Row *alignment_row_construct(Alignment *alignment);
+
 /*
  * Cleanup a row
  */
@@ -162,7 +329,8 @@ char *alignment_row_to_string(Alignment_Row *row);
 char *alignment_to_string(Alignment *alignment);
 
 /*
- * Replace bases that match the reference with a mask character.
+ * Replace bases that match the reference with a mask character. If the bases of the rows are yet to be made the
+ * columns (or runs) read are masked instead.
  */
 void alignment_mask_reference_bases(Alignment *alignment, char mask_char);
 
@@ -181,6 +349,40 @@ Tag *maf_read_header(LI *li);
  */
 Alignment *maf_read_block(LI *li);
 
+/*
+ * A reader of the blocks of a maf file that parses them in parallel: a pool of worker threads take turns to read
+ * batches of blocks from the line iterator as text, and then parse them while the others read and parse the batches
+ * that follow. The blocks are returned in order, and, as with maf_read_block, are not linked to one another.
+ */
+typedef struct _MafReader MafReader;
+
+/*
+ * The size in bytes of the batches of blocks a MafReader reads and parses at a time
+ */
+#define MAF_READER_BATCH_SIZE 1000000
+
+/*
+ * Make a reader of the maf blocks of li, whose header has been read, parsing batches of at least batch_size bytes
+ * with thread_number threads. li must not be read from until the reader is destructed.
+ */
+MafReader *maf_reader_construct(LI *li, int64_t thread_number, int64_t batch_size);
+
+/*
+ * If thread_number > 1 make a reader of the maf blocks of li, otherwise return NULL, in which case the blocks should
+ * be read with maf_read_block.
+ */
+MafReader *maf_reader_open(LI *li, int64_t thread_number);
+
+/*
+ * Get the next maf block, or NULL if there are no more.
+ */
+Alignment *maf_reader_next(MafReader *reader);
+
+/*
+ * Stop the workers and free the reader, and any blocks it has not returned
+ */
+void maf_reader_destruct(MafReader *reader);
+
 /*
  * Write a maf header line
  */
@@ -199,10 +401,88 @@ void maf_write_block2(Alignment *alignment, LW *lw, bool color_bases);
 /*
  * Write a block as PAF. Each PAF row reflects a pairwise alignment in the block.  The all_to_all flag
  * toggles whether we write every possible pairwise alignment, or just each non-ref to ref alignment
- * where ref is the first row in the block
+ * where ref is the first row in the block. If all_to_all, pairs of rows with nothing aligned are skipped.
  */
 void paf_write_block(Alignment *alignment, LW *lw, bool all_to_all, bool cs_cigar);
 
+/*
+ * A writer of blocks as PAF, as paf_write_block, that writes the pairwise alignments of blocks with many rows (as
+ * written all_to_all) in parallel. Pairs of rows are written in the same order as paf_write_block writes them.
+ * If all_to_all, pairs of rows that have no column in which both have a base, and so nothing aligned, are skipped.
+ */
+typedef struct _PafWriter PafWriter;
+
+/*
+ * Make a PAF writer writing to lw, using thread_number threads if thread_number > 1.
+ */
+PafWriter *paf_writer_construct(LW *lw, bool all_to_all, bool cs_cigar, int64_t thread_number);
+
+/*
+ * Write a block as PAF.
+ */
+void paf_writer_write_block(PafWriter *writer, Alignment *alignment);
+
+/*
+ * Stop the threads of the writer and free it. Does not clean up lw.
+ */
+void paf_writer_destruct(PafWriter *writer);
+
+/*
+ * Writes a block to lw, given the block before it (NULL for the first block). Run by a BlockWriter on its threads, so
+ * must only read the blocks.
+ */
+typedef void (*BlockWriterEncoder)(Alignment *p_alignment, Alignment *alignment, LW *lw, void *extra);
+
+/*
+ * Run by a BlockWriter on each block as it is given to the writer, in order, on the calling thread. Any changes to
+ * a block that depend on the blocks before it, such as taf_update_coordinates_reported, are made here.
+ */
+typedef void (*BlockWriterPrepare)(Alignment *alignment, void *extra);
+
+/*
+ * Run by a BlockWriter on each block, in order, on the calling thread, just before the block is written out to the
+ * writer's lw, e.g. to note the position in the output (LW_tell) at which the block starts. As the blocks before it
+ * may have been given to the writer after it was, must only read the block and the block before it.
+ */
+typedef void (*BlockWriterBeforeWrite)(Alignment *alignment, void *extra);
+
+/*
+ * A writer of blocks that encodes them (e.g. with taf_write_block3, maf_write_block2 or paf_write_block) on a pool of
+ * threads, each block to its own buffer, writing the buffers out in the order the blocks were given. At most a given
+ * number of blocks are in flight, being encoded or waiting to be written, at a time, bounding the memory used.
+ *
+ * The writer takes ownership of the blocks given to it, freeing each once the block after it is written (recycling it,
+ * see alignment_recycle, if the writer has a line iterator). As a block may be read until then a block should be
+ * given only once it will not be changed, i.e. after the block following it has been read and linked to it.
+ */
+typedef struct _BlockWriter BlockWriter;
+
+/*
+ * The number of blocks in flight per thread of a BlockWriter, by default
+ */
+#define BLOCK_WRITER_BLOCKS_PER_THREAD 4
+
+/*
+ * Make a block writer writing to lw using thread_number threads, with at most max_blocks_in_flight blocks in
+ * flight (if 0, BLOCK_WRITER_BLOCKS_PER_THREAD per thread). If thread_number <= 1 the blocks are encoded directly to
+ * lw as they are given. prepare and before_write may be NULL. If li is not NULL the blocks are recycled to it, in which
+ * case they must have been read from it.
+ */
+BlockWriter *block_writer_construct(LW *lw, BlockWriterPrepare prepare, BlockWriterEncoder encode,
+                                    BlockWriterBeforeWrite before_write, void *extra, LI *li,
+                                    int64_t thread_number, int64_t max_blocks_in_flight);
+
+/*
+ * Give the writer the next block to write.
+ */
+void block_writer_write(BlockWriter *writer, Alignment *alignment);
+
+/*
+ * Write out the blocks in flight, then stop the threads of the writer and free it, and the last block. Does not
+ * clean up lw.
+ */
+void block_writer_destruct(BlockWriter *writer);
+
 /*
  * Read a taf header line
  */
@@ -219,6 +499,13 @@ Tag *taf_read_header_2(LI *li, bool *run_length_encode_bases);
  */
 Alignment *taf_read_block(Alignment *p_block, bool run_length_encode_bases, LI *li);
 
+/*
+ * Link the rows of a block that was read without its previous block (as when parsing from an index anchor, see
+ * tai.h) to the rows of the previous block, p_block, as if it had been read following p_block. line[0, length) is the
+ * coordinates line the block was read from, as it is in the file.
+ */
+void taf_link_block(Alignment *p_block, Alignment *block, const char *line, int64_t length);
+
 /*
  * Write a taf header line
  */
@@ -236,6 +523,27 @@ void taf_write_block(Alignment *p_alignment, Alignment *alignment, bool run_leng
 void taf_write_block2(Alignment *p_alignment, Alignment *alignment, bool run_length_encode_bases,
                       int64_t repeat_coordinates_every_n_columns, LW *lw, bool color_bases, bool omit_coordinates);
 
+/*
+ * Sets the bases_since_coordinates_reported counters of the rows of a block, which taf_write_block2 does before
+ * writing it. Must be run on the blocks in order, as each block's counters follow from those of the block before.
+ */
+void taf_update_coordinates_reported(Alignment *alignment, int64_t repeat_coordinates_every_n_columns);
+
+/*
+ * Returns non-zero if the first line of the block as taf_write_block2 writes it (with the same
+ * repeat_coordinates_every_n_columns) is an anchor line, giving the coordinates of every row, which an index can point
+ * to. Like taf_write_block3, only reads the block and the counters of the block before it.
+ */
+bool taf_block_is_anchor(Alignment *alignment, int64_t repeat_coordinates_every_n_columns);
+
+/*
+ * As taf_write_block2, but only reads the blocks, without updating the row counters (see
+ * taf_update_coordinates_reported, which must have been run on the block first unless omitting coordinates). Blocks
+ * can therefore be written by this function on different threads, e.g. by a BlockWriter.
+ */
+void taf_write_block3(Alignment *p_alignment, Alignment *alignment, bool run_length_encode_bases,
+                      int64_t repeat_coordinates_every_n_columns, LW *lw, bool color_bases, bool omit_coordinates);
+
 
 // the following are low-level functions used in indexing.  they could
 // potentially be better put in an "internal" header
@@ -255,6 +563,26 @@ bool has_coordinates(stList *tokens, int64_t *j);
 char *parse_coordinates(int64_t *j, stList *tokens, int64_t *start, bool *strand,
                         int64_t *sequence_length);
 
+/**
+ * If the TAF column line[0, length) is an anchor line, giving the coordinates of every row (all "i" like on the first
+ * line, or all "s" like on a repeat-coordinates-every-n-columns line), return the sequence name of the first (reference)
+ * row (newly allocated) and set its start and strand. Otherwise returns NULL. Lines without coordinates are rejected
+ * with a byte search, without tokenizing them, and only the coordinates of the first row are parsed.
+ */
+char *taf_parse_anchor_line(const char *line, int64_t length, bool run_length_encode_bases, int64_t *start,
+                            bool *strand);
+
+/**
+ * Follow the first (reference) row of the blocks of a TAF through the column line[0, length), without parsing the
+ * block: sets base to the base of the first row in the column ('\0' if the block has no rows) and applies the
+ * coordinate operations of the line, if it has any, to the coordinates of the first row. *start is the position of
+ * the next base of the row and *sequence_name its name (interned, see sequence_name_intern), which is set to NULL if
+ * the row is deleted and the row after it becomes the first, whose coordinates are not known. Returns non-zero if
+ * the line has coordinate operations.
+ */
+bool taf_parse_first_row(const char *line, int64_t length, char *base, char **sequence_name, int64_t *start,
+                         bool *strand, int64_t *sequence_length);
+
 /**
  * Sniff file format from header line.  returns:
  *  0: taf
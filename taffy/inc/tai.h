@@ -36,14 +36,64 @@ Anc0.Anc0refChr11	10007	1447404025502
 Anc0.Anc0refChr11	20008	30064728450
 Anc0.Anc0refChr11	30085	30064782171
  *
+ * Following the records, the index gives a summary of each reference contig, in the order the contigs are first
+ * found in the file, on lines of the form:
+
+#contig	Anc0.Anc0refChr11	50000	0	40085	40085	1	1
+
+ * giving the name of the contig, its length, the interval [start, end) of it aligned in the file, the number of its
+ * bases aligned, the number of intervals of it the blocks cover, contiguous blocks making one interval (as taffy
+ * stats -b reports them), and the number of runs of consecutive blocks of the contig. An index made by an older
+ * version of taffy has no summaries.
+ *
+ * An index can also be written in a binary format (see tai_create_binary), holding the same records as packed arrays,
+ * which is memory mapped and binary searched, rather than parsed, when it is loaded.
  */
 
 #include "line_iterator.h"
 
+/*
+ * A contig of the index, with the records of the index on it
+ */
+typedef struct _TaiContig {
+    int64_t name; // The offset of the name in the index's names
+    int64_t first_record;
+    int64_t record_number;
+} TaiContig;
+
+/*
+ * The summary of a contig of the indexed file, see above
+ */
+typedef struct _TaiContigSummary {
+    int64_t name; // The offset of the name in the index's names
+    int64_t sequence_length;
+    int64_t start; // The start of the first block of the contig,
+    int64_t end; // the end of the last,
+    int64_t aligned_bases; // the number of bases of the contig in the blocks (end - start if there are no gaps),
+    int64_t interval_number; // the number of intervals of contiguous blocks of it,
+    int64_t run_number; // and the number of runs of consecutive blocks of it (0 in a secondary index)
+} TaiContigSummary;
+
+/*
+ * The index, as packed arrays searched with binary search. The arrays point into an image of the index,
+ * which is either a binary index mapped into memory or made from a text index as it is loaded.
+ */
 typedef struct _Tai {
-    stSortedSet *idx;
-    stList *names; // just to keep track of memory -- we only keep one instance of each sequence name
     bool maf;
+    int64_t contig_number;
+    const TaiContig *contigs; // sorted by name
+    int64_t record_number;
+    const int64_t *seq_pos; // The position on its contig of each record, in order of contig then position
+    const int64_t *file_pos; // The position in the file of each record
+    const int64_t *seq_end; // For a secondary index (otherwise NULL), the end on its contig of each record,
+    const int64_t *max_end; // the maximum end of the records of its contig up to and including each record,
+    const int64_t *file_end; // and the position in the file of the end of each record (-1 if the end of the file)
+    int64_t summary_number; // The number of summaries of contigs, 0 if the index has none
+    const TaiContigSummary *summaries; // in the order the contigs are first found in the file
+    const char *names;
+    char *data; // The image
+    int64_t data_length;
+    bool mapped;
 } Tai;
 
 typedef struct _TaiIt {
@@ -55,6 +105,26 @@ typedef struct _TaiIt {
     Alignment *p_alignment;
     bool run_length_encode_bases;
     bool maf;
+    // for an iterator of a secondary index, the segments of the file [start, end) with blocks that may overlap the
+    // region, in order (an end of -1 being the end of the file)
+    bool secondary;
+    int64_t *segment_starts;
+    int64_t *segment_ends;
+    int64_t segment_number;
+    int64_t segment; // The segment being read
+    bool in_segment; // Set once the reading of the segment has begun
+    bool p_returned; // Set if p_alignment, the last block read, is returned by the iterator
+    int64_t alignment_pos; // The position in the file of alignment, as the index records positions
+    // for an iterator of a batch of regions (see tai_regions_iterator), the last block read but not returned, or a
+    // copy of the last block returned if that runs past the end of the region, kept unclipped to read on from
+    bool retain_last_block;
+    Alignment *last_block;
+    int64_t last_block_pos; // The position of last_block in the file
+    // and a copy of the first block of the region, unclipped, with its position and that of the block after it, so
+    // that a next region overlapping the region can be read on from it after seeking back
+    Alignment *first_block;
+    int64_t first_block_pos;
+    int64_t first_block_next_pos;
 } TaiIt;
 
 
@@ -79,10 +149,71 @@ char *tai_parse_region(const char* region, int64_t *start, int64_t *length);
 int tai_create(LI *li, FILE* idx_fh, int64_t index_block_size);
 
 /*
- * Load the index from disk
+ * As tai_create, but write a binary index, which is mapped into memory when loaded rather than parsed.
+ */
+int tai_create_binary(LI *li, FILE* idx_fh, int64_t index_block_size);
+
+/*
+ * The default number of bases of a contig between the records of an index
+ */
+#define TAI_DEFAULT_INDEX_BLOCK_SIZE 10000
+
+/*
+ * A writer of the index of a TAF or MAF as it is written, so that the output need not be read back to index it.
+ * Each block is given to the writer just before it is written, and once the whole output is written the index is
+ * written next to it, the same as tai_create would make of it (a text index).
+ */
+typedef struct _TaiWriter TaiWriter;
+
+TaiWriter *tai_writer_construct(bool maf, int64_t index_block_size);
+
+void tai_writer_destruct(TaiWriter *writer);
+
+/*
+ * Add the block to the summaries of the contigs, and to the records of the index if need be, called just before the
+ * block is written to lw. For a TAF,
+ * repeat_coordinates_every_n_columns is that the block is written with (see taf_block_is_anchor), and the block
+ * before it must have been written.
+ */
+void tai_writer_add_block(TaiWriter *writer, Alignment *alignment, int64_t repeat_coordinates_every_n_columns,
+                          LW *lw);
+
+/*
+ * Once all the output has been written to lw, write the index to tai_path(output_file), where output_file is the
+ * file lw writes to. Must be called before LW_destruct.
+ */
+void tai_writer_write(TaiWriter *writer, LW *lw, const char *output_file);
+
+/* Return taf_path + .tsi, the path of the secondary index
+ */
+char *tai_secondary_path(const char *taf_path);
+
+/*
+ * Make a secondary index of a TAF or MAF, written to "idx_fh" in binary, given tai, its (primary) index.
+ * Where the primary index is of the reference (first) rows of the blocks, the secondary index is of every sequence
+ * of every row: the file is split into segments at the anchors of the primary index, and for each sequence and
+ * segment in which the sequence is aligned it records the interval of the sequence (on the forward strand) aligned
+ * by the blocks of the segment. Likewise it has a summary of every sequence, in forward strand coordinates. li must be
+ * positioned at the start of the file.
+ */
+int tai_create_secondary(Tai *tai, LI *li, FILE *idx_fh);
+
+/*
+ * Load the index from disk, either a text or binary index. Exits with an error if it is a secondary index.
  */
 Tai *tai_load(FILE* idx_fh, bool maf);
 
+/*
+ * Load a secondary index, made by tai_create_secondary, from disk. Exits with an error if it is not a secondary index.
+ */
+Tai *tai_load_secondary(FILE* idx_fh, bool maf);
+
+/*
+ * Returns non-zero if the index, open as idx_fh, was modified no earlier than the file it indexes, and so may be used
+ * for it. An index older than its file is stale if the file was rewritten after it was indexed.
+ */
+bool tai_is_current(FILE *idx_fh, const char *file);
+
 /*
  * Free the index
  */
@@ -96,6 +227,33 @@ void tai_destruct(Tai* idx);
  */
 TaiIt *tai_iterator(Tai* idx, LI *li, bool run_length_encode_bases, const char *contig, int64_t start, int64_t length);
 
+/*
+ * Query a secondary index, loaded with tai_load_secondary, for the blocks with a row aligning some of a region of any
+ * sequence (given in forward strand coordinates). Unlike those of tai_iterator, the blocks are not clipped to the
+ * region, and blocks that are not adjacent in the file are not linked. As with tai_iterator, start is 0-based and
+ * length can be -1 for everything.
+ */
+TaiIt *tai_secondary_iterator(Tai *secondary, LI *li, bool run_length_encode_bases, const char *sequence,
+                              int64_t start, int64_t length);
+
+/*
+ * Make an iterator for a batch of regions of the reference, each queried in turn with tai_iterator_next_region.
+ * Initially it has no region, tai_next returning NULL.
+ */
+TaiIt *tai_regions_iterator(Tai *tai, bool run_length_encode_bases);
+
+/*
+ * Move a regions iterator on to the next region, as if a new iterator were made for it with tai_iterator, except
+ * that where possible the blocks are read on from where the last region's left off rather than seeking back to an
+ * anchor of the index: the iterator keeps the last block it read, and if the region is on its sequence, starts no
+ * earlier than it and the index's anchor for the region is no later in the file, the blocks are read on from it.
+ * Failing that, the same is tried with the first block of the last region, seeking back to the block after it. So
+ * given regions sorted by sequence and start, regions sharing an anchor are read in one pass, or nearly so if they
+ * overlap, and a block overlapping several regions is rarely parsed more than once. The blocks returned are owned by
+ * the caller, as with tai_iterator.
+ */
+void tai_iterator_next_region(TaiIt *tai_it, Tai *tai, LI *li, const char *contig, int64_t start, int64_t length);
+
 /*
  * Iterate through a region as obtained via the iterator
  */
@@ -112,8 +270,98 @@ bool tai_has_next(TaiIt *tai_it);
 void tai_iterator_destruct(TaiIt *tai_it);
 
 /**
- * Return a map of Sequence name to Length. Only reference (ie indexed) sequences are returned
+ * Return a map of Sequence name to Length. Only reference (ie indexed) sequences are returned. If the index has
+ * summaries of the contigs the lengths are taken from them, otherwise the first block of each contig is read from li.
  */
 stHash *tai_sequence_lengths(Tai *idx, LI *li);
 
+/*
+ * Get the summary of the i-th contig of the index, in the order the contigs are found in the file, setting name to its
+ * name. Returns NULL if i is not less than idx->summary_number, e.g. if the index has no summaries.
+ */
+const TaiContigSummary *tai_contig_summary(Tai *idx, int64_t i, const char **name);
+
+/*
+ * A reader of the blocks of a TAF file that parses the file in parallel: the file is split into chunks at anchors of
+ * its index, each anchor being a coordinates line giving the coordinates of every row, and the chunks are parsed by a
+ * pool of worker threads, each reading the file through its own line iterator. The blocks are returned in order, the
+ * rows of the first block of each chunk being linked to those of the last block of the previous chunk, so that they
+ * are the same as those taf_read_block returns reading the file from start to finish.
+ */
+typedef struct _TaiReader TaiReader;
+
+/*
+ * The size in bytes (of the file, which may be compressed) of the chunks a TaiReader splits a file into
+ */
+#define TAI_READER_CHUNK_SIZE 4000000
+
+/*
+ * Make a reader of the blocks of the TAF file, from position start (following the header) to the end of the file,
+ * parsing chunks of at least chunk_size bytes with thread_number threads. tai is the index of the file, which is not
+ * needed once the reader is made. Returns NULL, saying why, if the index is not of the file: if a position of it is
+ * beyond the end of the file, or is not that of an anchor line.
+ */
+TaiReader *tai_reader_construct(Tai *tai, const char *file, int64_t start, bool run_length_encode_bases,
+                                int64_t thread_number, int64_t chunk_size);
+
+/*
+ * If thread_number > 1 and the TAF file has an index, no older than the file, make a reader of its blocks following
+ * the header, which has been read from li. Otherwise (or if tai_reader_construct finds the index is not of the file)
+ * return NULL, in which case the blocks should be read from li with taf_read_block.
+ */
+TaiReader *tai_reader_open(const char *file, LI *li, bool run_length_encode_bases, int64_t thread_number);
+
+/*
+ * Get the next block, or NULL if there are no more. As with taf_read_block, the previous block returned must not be
+ * cleaned up until the next has been returned.
+ */
+Alignment *tai_reader_next(TaiReader *reader);
+
+/*
+ * Stop the workers and free the reader, and any blocks it has not returned
+ */
+void tai_reader_destruct(TaiReader *reader);
+
+/*
+ * A region of a sequence, 0-based and half-open like BED
+ */
+typedef struct _TaiRegion {
+    char *sequence;
+    int64_t start;
+    int64_t length;
+} TaiRegion;
+
+/*
+ * A reader of the blocks of a batch of regions of the reference of an indexed TAF or MAF file that extracts the regions
+ * in parallel: the regions, which should be sorted by sequence and start, are split into groups of consecutive regions
+ * of the same sequence, and the groups are read by a pool of worker threads, each reading the file through its own line
+ * iterator and regions iterator (see tai_regions_iterator). The blocks of each region are returned in order, as
+ * tai_next would return them, the regions in turn.
+ */
+typedef struct _TaiRegionReader TaiRegionReader;
+
+/*
+ * The number of blocks of regions after the one being returned a TaiRegionReader holds per thread before its workers wait
+ */
+#define TAI_REGION_READER_BLOCKS_PER_THREAD 64
+
+/*
+ * Make a reader of the blocks of the given regions of the file, of which tai is the index, reading with thread_number
+ * threads. The index and the regions are not copied, so must outlive the reader.
+ */
+TaiRegionReader *tai_region_reader_construct(Tai *tai, const char *file, TaiRegion *regions, int64_t region_number,
+                                             bool run_length_encode_bases, int64_t thread_number);
+
+/*
+ * Get the next block, setting region to the index of the region it is of, or return NULL if there are no more.
+ * Regions with no blocks are skipped. As with tai_next, the blocks are owned by the caller, and consecutive blocks of a
+ * region are linked, so the previous block returned must not be cleaned up until the next has been returned.
+ */
+Alignment *tai_region_reader_next(TaiRegionReader *reader, int64_t *region);
+
+/*
+ * Stop the workers and free the reader, and any blocks it has not returned
+ */
+void tai_region_reader_destruct(TaiRegionReader *reader);
+
 #endif
@@ -2,6 +2,7 @@ from taffy._taffy_cffi import ffi, lib
 import numpy as np
 import torch
 from collections import deque
+import weakref
 
 def _to_py_string(s):
     """ Convert a cffi string into a Python string in Python3 """
@@ -47,9 +48,12 @@ def _get_c_file_handle(file_string_or_handle, modifier_string="r"):
 class Alignment:
     """ Represents an alignment block. See taf.h """
 
-    def __init__(self, c_alignment=None, py_row=None):
+    def __init__(self, c_alignment=None, py_row=None, reader=None):
         self._c_alignment = c_alignment
         self._py_row = py_row
+        # The reader the alignment was read from, if any, which recycles it. A weak reference, as the reader holds the
+        # last alignment it returned
+        self._reader = weakref.ref(reader) if reader is not None else None
 
     def row_number(self):
         """ Number of rows in the alignment block """
@@ -66,14 +70,14 @@ class Alignment:
     def column_tags(self, column_index):
         """ The tags for the given column index, represented as a dictionary of strings """
         assert 0 <= column_index < self.column_number()  # Check column index is valid
-        return _c_tags_to_dictionary(self._c_alignment.column_tags[column_index]) \
-            if self._c_alignment.column_tags != ffi.NULL else {}
+        return _c_tags_to_dictionary(lib.alignment_get_column_tags(self._c_alignment)[column_index])
 
     def set_column_tags(self, column_index, tags):
         """ Set the tags for a given column index using a dictionary of tags """
         assert 0 <= column_index < self.column_number()  # Check column index is valid
-        lib.tag_destruct(self._c_alignment.column_tags[column_index])  # Clean up the old tags
-        self._c_alignment.column_tags[column_index] = _dictionary_to_c_tags(tags)
+        c_column_tags = lib.alignment_get_column_tags(self._c_alignment)
+        lib.tag_destruct(c_column_tags[column_index])  # Clean up the old tags
+        c_column_tags[column_index] = _dictionary_to_c_tags(tags)
 
     def get_column(self, column_index):
         """ Get a column of the alignment as a string. Use negative coordinates to get columns
@@ -118,7 +122,13 @@ class Alignment:
         return sequence_names
 
     def __del__(self):
-        lib.alignment_destruct(self._c_alignment, 0)  # Cleans up the underlying C alignment structure
+        self._py_row = None  # Release the rows first, so that if nothing else holds them their memory can be reused
+        reader = self._reader() if self._reader is not None else None
+        if reader is not None and reader.c_li_handle is not None:
+            # Hand the underlying C alignment structure back to the still open reader, to reuse for the next block
+            lib.alignment_recycle(self._c_alignment, 0, reader.c_li_handle)
+        else:
+            lib.alignment_destruct(self._c_alignment, 0)  # Cleans up the underlying C alignment structure
 
     def __str__(self):
         return _to_py_string(lib.alignment_to_string(self._c_alignment))
@@ -140,6 +150,12 @@ class Alignment:
         return RowIter(self.first_row())
 
 
+# Python strings for the interned (see taf.h) sequence names of rows, keyed by the address of the interned name,
+# emptied when it reaches _MAX_INTERNED_SEQUENCE_NAMES names so that it does not grow without bound
+_interned_sequence_names = {}
+_MAX_INTERNED_SEQUENCE_NAMES = 100000
+
+
 class Row:
     """ Represents a row of an alignment block. See taf.h """
 
@@ -150,6 +166,14 @@ class Row:
 
     def sequence_name(self):
         """ The name of the sequence for the row """
+        if self._c_row.sequence_name_interned:  # Interned names are never freed, so convert each just once
+            key = int(ffi.cast("uintptr_t", self._c_row.sequence_name))
+            name = _interned_sequence_names.get(key)
+            if name is None:
+                if len(_interned_sequence_names) >= _MAX_INTERNED_SEQUENCE_NAMES:
+                    _interned_sequence_names.clear()
+                name = _interned_sequence_names[key] = _to_py_string(self._c_row.sequence_name)
+            return name
         return _to_py_string(self._c_row.sequence_name)
 
     def start(self):
@@ -203,6 +227,24 @@ class TafIndex:
     def __del__(self):
         lib.tai_destruct(self._c_taf_index)  # Clean up the underlying C
 
+    def get_contig_summaries(self):
+        """ Get the summaries of the reference contigs of the indexed file, in the order the contigs are found in the
+        file, each a tuple (sequence_name, sequence_length, start, end, aligned_bases, interval_number, run_number),
+        where [start, end) is the interval of the contig aligned, aligned_bases the number of its bases in the
+        alignment, interval_number the number of intervals of contiguous blocks of it and run_number the number of
+        runs of consecutive blocks of it. Returns None if the index has no summaries (being made by an older version
+        of taffy).
+        """
+        summaries = []
+        c_name = ffi.new("char **")
+        while True:
+            c_summary = lib.tai_contig_summary(self._c_taf_index, len(summaries), c_name)
+            if c_summary == ffi.NULL:
+                break
+            summaries.append((_to_py_string(c_name[0]), c_summary.sequence_length, c_summary.start, c_summary.end,
+                              c_summary.aligned_bases, c_summary.interval_number, c_summary.run_number))
+        return summaries if summaries else None
+
 
 class AlignmentReader:
     """ Taf or maf alignment parser.
@@ -220,6 +262,7 @@ class AlignmentReader:
         that specify the range to retrieve. Will be retrieved in order.
         """
         self.p_c_alignment = ffi.NULL  # The previous C alignment returned
+        self.p_py_alignment = None  # The previous alignment returned, held so that it is not recycled while in use
         self.p_c_rows_to_py_rows = {}  # Hash from C rows to Python rows of the previous
         # alignment block, allowing linking of rows between blocks
         self.file = file
@@ -250,10 +293,11 @@ class AlignmentReader:
                 assert start >= 0  # The start coordinate must be valid
                 assert length >= 0  # The length must be valid
                 assert len(sequence_intervals) > 0  # Must contain at least one interval
-                self._c_taf_index_it = lib.tai_iterator(taf_index._c_taf_index,
-                                                        self.c_li_handle,
-                                                        self.use_run_length_encoding,
-                                                        _to_c_string(sequence_name), start, length)
+                # The one iterator is moved on from interval to interval, so that intervals sharing anchors of the
+                # index are read in one pass
+                self._c_taf_index_it = lib.tai_regions_iterator(taf_index._c_taf_index, self.use_run_length_encoding)
+                lib.tai_iterator_next_region(self._c_taf_index_it, taf_index._c_taf_index, self.c_li_handle,
+                                             _to_c_string(sequence_name), start, length)
             else:
                 self._c_taf_index_it = None  # Case we have an empty iteration
         else:
@@ -292,19 +336,20 @@ class AlignmentReader:
                 raise StopIteration  # We're done
             # Otherwise, get next interval
             sequence_name, start, length = self.sequence_intervals[self.sequence_interval_index]
-            # Make new iterator for next interval
+            # Move the iterator on to the next interval
             self.p_c_alignment = ffi.NULL  # Remove reference to prior alignment
-            lib.tai_iterator_destruct(self._c_taf_index_it)  # Cleanup old iterator
-            self._c_taf_index_it = lib.tai_iterator(self.taf_index._c_taf_index,
-                                                    self.c_li_handle,
-                                                    self.use_run_length_encoding,
-                                                    _to_c_string(sequence_name), start, length)
+            self.p_py_alignment = None
+            lib.tai_iterator_next_region(self._c_taf_index_it, self.taf_index._c_taf_index, self.c_li_handle,
+                                         _to_c_string(sequence_name), start, length)
             return self.__next__()
 
         # If maf use O(ND) algorithm to link to any prior alignment block
         if (not self.taf_not_maf) and self.p_c_alignment != ffi.NULL:
             lib.alignment_link_adjacent(self.p_c_alignment, c_alignment, 1)
 
+        # The Python rows may outlive the C alignment, so make the bases of the rows now rather than when first needed
+        lib.alignment_make_row_bases(c_alignment)
+
         # Now add in the rows
         c_row, p_py_row, first_py_row = c_alignment.row, None, None
         while c_row != ffi.NULL:
@@ -321,10 +366,11 @@ class AlignmentReader:
             c_row = c_row.n_row  # Move to the next row
 
         # Now convert the new alignment into Python
-        py_alignment = Alignment(c_alignment=c_alignment, py_row=first_py_row)
+        py_alignment = Alignment(c_alignment=c_alignment, py_row=first_py_row, reader=self)
 
         # Set the new prior alignment / rows
         self.p_c_alignment = c_alignment
+        self.p_py_alignment = py_alignment
 
         return py_alignment
 
@@ -335,7 +381,10 @@ class AlignmentReader:
         """ Close any associated underlying file """
         if self.taf_index:
             lib.tai_iterator_destruct(self._c_taf_index_it)
-        lib.LI_destruct(self.c_li_handle)  # Cleanup the allocated line iterator
+        self.p_c_alignment = ffi.NULL
+        self.p_py_alignment = None
+        lib.LI_destruct(self.c_li_handle)  # Cleanup the allocated line iterator, and any recycled alignments
+        self.c_li_handle = None
         if self.file_string_not_handle:  # Close the underlying file handle
             lib.fclose(self.c_file_handle)
 
@@ -346,11 +395,19 @@ class AlignmentReader:
         self.close()
 
 
-def get_reference_sequence_intervals(alignment_reader):
+def get_reference_sequence_intervals(alignment_reader, taf_index=None):
     """ Generates a sequence of reference sequence intervals by scanning through the alignment_reader.
     Each generated value is of the form (seq_name, start, length). Length is the number of
     reference bases in blocks within the interval (e.g. ignores unaligned ref gaps).
+    If taf_index, the index of the whole file the alignment_reader reads, is given and summarizes its contigs, the
+    intervals are taken from the index without reading the alignment.
     """
+    summaries = taf_index.get_contig_summaries() if taf_index else None
+    if summaries and all(run_number == 1 for *_, run_number in summaries):
+        # Each contig is a single run of consecutive blocks, so an interval
+        for seq_name, _, start, _, aligned_bases, _, _ in summaries:
+            yield seq_name, start, aligned_bases
+        return
     seq_intervals = []
     p_ref_seq, p_ref_start, p_ref_length = None, 0, 0
     for alignment in alignment_reader:  # For each alignment block
@@ -522,12 +579,16 @@ def get_window_iterator(alignment_reader,
                     q.popleft()  # Remove from the left end of the window
 
 
-def write_taf_index_file(taf_file, index_file, index_block_size=10000):
-    """ Create a taf index file """
+def write_taf_index_file(taf_file, index_file, index_block_size=10000, binary=False):
+    """ Create a taf index file. If binary is True the index is written in the binary format, which is memory mapped
+    rather than parsed when loaded by TafIndex """
     c_taf_file_handle = _get_c_file_handle(taf_file)
     c_li_handle = lib.LI_construct(c_taf_file_handle)
     c_index_file_handle = _get_c_file_handle(index_file, "w")
-    lib.tai_create(c_li_handle, c_index_file_handle, index_block_size)
+    if binary:
+        lib.tai_create_binary(c_li_handle, c_index_file_handle, index_block_size)
+    else:
+        lib.tai_create(c_li_handle, c_index_file_handle, index_block_size)
     lib.LI_destruct(c_li_handle)  # Cleanup the allocated line iterator
     if isinstance(taf_file, str):  # Close the underlying file handle if opened
         lib.fclose(c_taf_file_handle)
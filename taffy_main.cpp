@@ -19,7 +19,7 @@ extern int taf_coverage_main(int argc, char *argv[]);
 
 void usage() {
     fprintf(stderr, "taffy: toolkit for working with TAF and MAF multiple alignment files\n\n");
-    fprintf(stderr, "usage: taffy <command> [options]\n\n");
+    fprintf(stderr, "usage: taffy [global options] <command> [options]\n\n");
     fprintf(stderr, "available commands:\n");
     fprintf(stderr, "    view           MAF / TAF conversion and region extraction\n");
     fprintf(stderr, "    norm           normalize TAF blocks\n");
@@ -30,6 +30,12 @@ void usage() {
     fprintf(stderr, "    coverage       print coverage statistics of a given genome in a TAF file\n");
     fprintf(stderr, "    annotate       annotate a TAF file with labels from a wiggle file\n");
     fprintf(stderr, "\n");
+    fprintf(stderr, "global options (can also be given after the command):\n");
+    fprintf(stderr, "    --threads N             number of threads to use for bgzip decompression and compression, parsing MAF and indexed TAF input and encoding output, by default: %" PRIi64 "\n", taffy_thread_number);
+    fprintf(stderr, "    --compressionLevel N    bgzip compression level (0-9) of compressed output, by default htslib's default level\n");
+    fprintf(stderr, "    --prefetch N            read up to N blocks of input lines ahead of parsing on a background thread, by default: %" PRIi64 " (off)\n", taffy_prefetch);
+    fprintf(stderr, "    --blocksInFlight N      encode up to N blocks of output at a time when using threads, by default %d per thread\n", BLOCK_WRITER_BLOCKS_PER_THREAD);
+    fprintf(stderr, "\n");
 
 #ifdef USE_HTSLIB
     fprintf(stderr, "all commands accept uncompressed or bgzipped TAF input\n");
@@ -39,7 +45,67 @@ void usage() {
     fprintf(stderr, "\nrun taffy <command> -h to show the given command's interface\n\n");
 }
 
+/*
+ * Get the value of the global option with the given name from argv[*i], either given as "--name value" or
+ * "--name=value", incrementing *i if the value is the next argument. Returns NULL if argv[*i] is not the option.
+ */
+static char *get_global_option(int argc, char *argv[], int *i, const char *name) {
+    int64_t n = strlen(name);
+    if (strncmp(argv[*i], name, n) != 0) {
+        return NULL;
+    }
+    if (argv[*i][n] == '=') {
+        return argv[*i] + n + 1;
+    }
+    if (argv[*i][n] != '\0') {
+        return NULL;
+    }
+    if (*i + 1 >= argc) {
+        fprintf(stderr, "%s requires a value\n", name);
+        exit(1);
+    }
+    return argv[++(*i)];
+}
+
+/*
+ * Parse an integer option value in the range [min, max], exiting if it is invalid.
+ */
+static int64_t parse_global_option_value(const char *name, const char *value, int64_t min, int64_t max) {
+    char *end;
+    int64_t i = strtol(value, &end, 10);
+    if (*value == '\0' || *end != '\0' || i < min || i > max) {
+        fprintf(stderr, "Invalid value for %s: %s\n", name, value);
+        exit(1);
+    }
+    return i;
+}
+
+/*
+ * Parse the global options out of the command line, which can appear before or after the command,
+ * removing them from argv. Returns the new number of arguments.
+ */
+static int parse_global_options(int argc, char *argv[]) {
+    int j = 1;
+    for (int i = 1; i < argc; i++) {
+        char *value;
+        if ((value = get_global_option(argc, argv, &i, "--threads")) != NULL) {
+            taffy_thread_number = parse_global_option_value("--threads", value, 1, 1024);
+        } else if ((value = get_global_option(argc, argv, &i, "--compressionLevel")) != NULL) {
+            taffy_compression_level = parse_global_option_value("--compressionLevel", value, 0, 9);
+        } else if ((value = get_global_option(argc, argv, &i, "--prefetch")) != NULL) {
+            taffy_prefetch = parse_global_option_value("--prefetch", value, 0, 1024);
+        } else if ((value = get_global_option(argc, argv, &i, "--blocksInFlight")) != NULL) {
+            taffy_blocks_in_flight = parse_global_option_value("--blocksInFlight", value, 1, 1000000);
+        } else {
+            argv[j++] = argv[i];
+        }
+    }
+    argv[j] = NULL;
+    return j;
+}
+
 int main(int argc, char *argv[]) {
+    argc = parse_global_options(argc, argv);
 
     if (argc < 2) {
         usage();
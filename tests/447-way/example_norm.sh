@@ -65,26 +65,21 @@ time ${taffy_root}/scripts/tree_to_sort_file.py --out_file $filter_file --no_lea
 # Sort/dedup/filter the alignment to create a temporary alignment file in which each species is present exactly once, then
 # apply taffy annotate to add the phyloP tags
 # This creates the no masking alignment file
-time ${taffy_root}/bin/taffy sort -i ${alignment_file} -n ${sort_file} -p ${sort_file} -d ${sort_file} | ${taffy_root}/bin/taffy annotate -w ${wig_file} --tagName phyloP --refPrefix hg38. -c | ${taffy_root}/bin/taffy view -c --runLengthEncodeBases > ${no_masking_alignment_file}
-time ${taffy_root}/bin/taffy index -i ${no_masking_alignment_file}
+time ${taffy_root}/bin/taffy sort -i ${alignment_file} -n ${sort_file} -p ${sort_file} -d ${sort_file} | ${taffy_root}/bin/taffy annotate -w ${wig_file} --tagName phyloP --refPrefix hg38. -c | ${taffy_root}/bin/taffy view -c --runLengthEncodeBases -I -o ${no_masking_alignment_file}
 
-# Now build the additional final alignment files and indexes
+# Now build the additional final alignment files, each indexed as it is written
 
 # (2) Reference masking of bases
-time ${taffy_root}/bin/taffy view -i ${no_masking_alignment_file} -a -c > ${reference_masking_with_ancestors_alignment_file}
-time ${taffy_root}/bin/taffy index -i ${reference_masking_with_ancestors_alignment_file}
+time ${taffy_root}/bin/taffy view -i ${no_masking_alignment_file} -a -c -I -o ${reference_masking_with_ancestors_alignment_file}
 
 # (3) Lineage masking of bases
-time ${taffy_root}/bin/taffy view -i ${no_masking_alignment_file} -t $rerooted_tree_file -b -c > ${lineage_masking_alignment_file}
-time ${taffy_root}/bin/taffy index -i ${lineage_masking_alignment_file}
+time ${taffy_root}/bin/taffy view -i ${no_masking_alignment_file} -t $rerooted_tree_file -b -c -I -o ${lineage_masking_alignment_file}
 
 # (4) No masking bases, no ancestors
-time ${taffy_root}/bin/taffy sort -i ${no_masking_alignment_file} -f ${filter_file} -c > ${no_masking_no_ancestors_alignment_file}
-time ${taffy_root}/bin/taffy index -i ${no_masking_no_ancestors_alignment_file}
+time ${taffy_root}/bin/taffy sort -i ${no_masking_alignment_file} -f ${filter_file} -c -I -o ${no_masking_no_ancestors_alignment_file}
 
 # (5) Reference masking of bases, no ancestors
-time ${taffy_root}/bin/taffy sort -i ${no_masking_alignment_file} -f ${filter_file} -c | ${taffy_root}/bin/taffy view -a -c > ${reference_masking_no_ancestors_alignment_file}
-time ${taffy_root}/bin/taffy index -i ${reference_masking_no_ancestors_alignment_file}
+time ${taffy_root}/bin/taffy sort -i ${no_masking_alignment_file} -f ${filter_file} -c | ${taffy_root}/bin/taffy view -a -c -I -o ${reference_masking_no_ancestors_alignment_file}
 
 # Print stats about the starting and final alignment as a sanity check
 
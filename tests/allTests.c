@@ -15,6 +15,7 @@ CuSuite* view_test_suite(void);
 CuSuite* sort_test_suite(void);
 CuSuite* coverage_test_suite(void);
 CuSuite* wiggle_test_suite(void);
+CuSuite* line_iterator_test_suite(void);
 
 static int allTests(void) {
     CuString *output = CuStringNew();
@@ -27,6 +28,7 @@ static int allTests(void) {
     CuSuiteAddSuite(suite, sort_test_suite());
     CuSuiteAddSuite(suite, coverage_test_suite());
     CuSuiteAddSuite(suite, wiggle_test_suite());
+    CuSuiteAddSuite(suite, line_iterator_test_suite());
 
     CuSuiteRun(suite);
     CuSuiteSummary(suite, output);
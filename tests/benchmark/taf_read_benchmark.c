@@ -0,0 +1,152 @@
+/*
+ * Microbenchmark of the TAF parser: times taf_read_block reading every block of a TAF file, reporting the
+ * input MB/s. If no TAF file is given a synthetic one with the given number of rows is generated and used.
+ *
+ * usage: tafReadBenchmark [-i TAF_FILE | -r ROWS] [-n REPETITIONS]
+ */
+
+#include "taf.h"
+#include "sonLib.h"
+#include <getopt.h>
+#include <time.h>
+
+static double seconds(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+/*
+ * Write a synthetic TAF with row_number rows, in which a few rows are substituted or gapped in each block.
+ */
+static void write_synthetic_taf(char *file, int64_t row_number, int64_t block_number, bool run_length_encode_bases) {
+    LW *lw = LW_construct(fopen(file, "w"), 0);
+    Tag *tag = tag_construct("version", "1", NULL);
+    if (run_length_encode_bases) {
+        tag = tag_construct("run_length_encode_bases", "1", tag);
+    }
+    taf_write_header(tag, lw);
+    tag_destruct(tag);
+    int64_t *starts = st_calloc(row_number, sizeof(int64_t));
+    int64_t *names = st_calloc(row_number, sizeof(int64_t));
+    for (int64_t i = 0; i < row_number; i++) {
+        names[i] = i;
+    }
+    Alignment *p_alignment = NULL;
+    for (int64_t b = 0; b < block_number; b++) {
+        Alignment *alignment = st_calloc(1, sizeof(Alignment));
+        alignment->row_number = row_number;
+        alignment->column_number = 1 + st_randomInt(0, 100);
+        alignment->column_tags = st_calloc(alignment->column_number, sizeof(Tag *));
+        Alignment_Row **p_row = &alignment->row;
+        for (int64_t i = 0; i < row_number; i++) {
+            if (st_random() < 0.01) { // Switch to a new sequence
+                names[i] += row_number;
+                starts[i] = 0;
+            }
+            if (st_random() < 0.01) { // Leave an unaligned gap
+                starts[i] += st_randomInt(1, 10);
+            }
+            Alignment_Row *row = st_calloc(1, sizeof(Alignment_Row));
+            row->sequence_name = stString_print("genome%" PRIi64 ".chr%" PRIi64, i, names[i]);
+            row->start = starts[i];
+            row->strand = 1;
+            row->sequence_length = 1000000000;
+            row->bases = st_malloc(alignment->column_number + 1);
+            for (int64_t j = 0; j < alignment->column_number; j++) {
+                // Mostly the same base down each column, to give runs for run length encoding
+                row->bases[j] = st_random() < 0.05 ? '-' : "ACGT"[(j + (st_random() < 0.1)) % 4];
+                row->length += row->bases[j] != '-';
+            }
+            row->bases[alignment->column_number] = '\0';
+            starts[i] += row->length;
+            *p_row = row;
+            p_row = &row->n_row;
+        }
+        if (p_alignment != NULL) {
+            alignment_link_adjacent(p_alignment, alignment, 1);
+        }
+        taf_write_block(p_alignment, alignment, run_length_encode_bases, 10000, lw);
+        if (p_alignment != NULL) {
+            alignment_destruct(p_alignment, 1);
+        }
+        p_alignment = alignment;
+    }
+    if (p_alignment != NULL) {
+        alignment_destruct(p_alignment, 1);
+    }
+    free(starts);
+    free(names);
+    LW_destruct(lw, 1);
+}
+
+static void benchmark(char *file, int64_t repetitions) {
+    double total_time = 0.0;
+    int64_t total_bytes = 0, block_number = 0;
+    for (int64_t r = 0; r < repetitions; r++) {
+        FILE *fh = fopen(file, "r");
+        if (fh == NULL) {
+            fprintf(stderr, "Unable to open %s\n", file);
+            exit(1);
+        }
+        fseek(fh, 0, SEEK_END);
+        total_bytes += ftell(fh);
+        rewind(fh);
+        double start = seconds();
+        LI *li = LI_construct(fh);
+        bool run_length_encode_bases;
+        Tag *tag = taf_read_header_2(li, &run_length_encode_bases);
+        Alignment *alignment, *p_alignment = NULL;
+        while ((alignment = taf_read_block(p_alignment, run_length_encode_bases, li)) != NULL) {
+            if (p_alignment != NULL) {
+                alignment_recycle(p_alignment, 1, li);
+            }
+            p_alignment = alignment;
+            block_number++;
+        }
+        if (p_alignment != NULL) {
+            alignment_recycle(p_alignment, 1, li);
+        }
+        tag_destruct(tag);
+        LI_destruct(li);
+        total_time += seconds() - start;
+        fclose(fh);
+    }
+    printf("%s\t%" PRIi64 "\t%" PRIi64 "\t%.3f\t%.1f\n", file, total_bytes, block_number, total_time,
+           total_bytes / 1000000.0 / total_time);
+}
+
+int main(int argc, char *argv[]) {
+    char *input_file = NULL;
+    int64_t row_number = 500, repetitions = 5;
+    int64_t key;
+    while ((key = getopt(argc, argv, "i:r:n:h")) != -1) {
+        switch (key) {
+            case 'i':
+                input_file = optarg;
+                break;
+            case 'r':
+                row_number = atol(optarg);
+                break;
+            case 'n':
+                repetitions = atol(optarg);
+                break;
+            default:
+                fprintf(stderr, "usage: tafReadBenchmark [-i TAF_FILE | -r ROWS] [-n REPETITIONS]\n");
+                return key == 'h' ? 0 : 1;
+        }
+    }
+
+    printf("file\tbytes\tblocks\tseconds\tMB/s\n");
+    if (input_file != NULL) {
+        benchmark(input_file, repetitions);
+    } else {
+        char *synthetic_file = "./tafReadBenchmark.taf";
+        for (int64_t rle = 0; rle <= 1; rle++) {
+            write_synthetic_taf(synthetic_file, row_number, 2000, rle);
+            benchmark(synthetic_file, repetitions);
+        }
+        remove(synthetic_file);
+    }
+    return 0;
+}
@@ -0,0 +1,88 @@
+/*
+ * Microbenchmark of the TAF writer: loads a MAF or TAF file into memory then times taf_write_block writing
+ * every block out, reporting the output MB/s with and without run length encoded bases.
+ *
+ * usage: tafWriteBenchmark INPUT_FILE [REPETITIONS]
+ */
+
+#include "taf.h"
+#include "sonLib.h"
+#include <time.h>
+
+static double seconds(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static stList *read_blocks(LI *li) {
+    int input_format = check_input_format(LI_peek_at_next_line(li));
+    if (input_format == 2) {
+        fprintf(stderr, "Input not supported: unable to detect ##maf or #taf header\n");
+        exit(1);
+    }
+    bool run_length_encode_bases = 0;
+    Tag *tag = input_format == 1 ? maf_read_header(li) : taf_read_header_2(li, &run_length_encode_bases);
+    tag_destruct(tag);
+
+    stList *blocks = stList_construct();
+    Alignment *alignment, *p_alignment = NULL;
+    while ((alignment = input_format == 1 ? maf_read_block(li) :
+                        taf_read_block(p_alignment, run_length_encode_bases, li)) != NULL) {
+        if (input_format == 1 && p_alignment != NULL) {
+            alignment_link_adjacent(p_alignment, alignment, 1);
+        }
+        stList_append(blocks, alignment);
+        p_alignment = alignment;
+    }
+    return blocks;
+}
+
+static void benchmark(stList *blocks, bool run_length_encode_bases, int64_t repetitions) {
+    FILE *out = tmpfile();
+    double total_time = 0.0;
+    int64_t total_bytes = 0;
+    for (int64_t r = 0; r < repetitions; r++) {
+        rewind(out);
+        LW *lw = LW_construct(out, 0);
+        double start = seconds();
+        for (int64_t i = 0; i < stList_length(blocks); i++) {
+            taf_write_block(i > 0 ? stList_get(blocks, i - 1) : NULL, stList_get(blocks, i),
+                            run_length_encode_bases, 10000, lw);
+        }
+        LW_destruct(lw, 0);
+        total_time += seconds() - start;
+        total_bytes += ftell(out);
+    }
+    fclose(out);
+    printf("%s\t%" PRIi64 "\t%.3f\t%.1f\n", run_length_encode_bases ? "rle" : "plain", total_bytes, total_time,
+           total_bytes / 1000000.0 / total_time);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: tafWriteBenchmark INPUT_FILE [REPETITIONS]\n");
+        return 1;
+    }
+    int64_t repetitions = argc > 2 ? atol(argv[2]) : 5;
+
+    FILE *input = fopen(argv[1], "r");
+    if (input == NULL) {
+        fprintf(stderr, "Unable to open %s\n", argv[1]);
+        return 1;
+    }
+    LI *li = LI_construct(input);
+    stList *blocks = read_blocks(li);
+    LI_destruct(li);
+    fclose(input);
+
+    printf("mode\tbytes\tseconds\tMB/s\n");
+    benchmark(blocks, 0, repetitions);
+    benchmark(blocks, 1, repetitions);
+
+    for (int64_t i = 0; i < stList_length(blocks); i++) {
+        alignment_destruct(stList_get(blocks, i), 1);
+    }
+    stList_destruct(blocks);
+    return 0;
+}
@@ -0,0 +1,33 @@
+#!/usr/bin/env bash
+
+### Benchmark the throughput of taffy view and taffy stats -a on a bgzipped TAF/MAF file as the number
+### of decompression threads (the global --threads option) rises.
+###
+### usage: threads_benchmark.sh TAFFY_ROOT INPUT_FILE [MAX_THREADS]
+
+# Get the taffy root directory, the (bgzipped) alignment to read and the maximum thread count
+taffy_root=$1
+input_file=$2
+max_threads=${3:-16}
+
+# exit when any command fails
+set -e
+
+taffy=${taffy_root}/bin/taffy
+input_bytes=$(wc -c < ${input_file})
+
+# Run a command, printing its wall clock seconds and the input MB/s
+time_command() {
+    local start=$(date +%s.%N)
+    "$@" > /dev/null
+    local end=$(date +%s.%N)
+    awk -v s=${start} -v e=${end} -v b=${input_bytes} 'BEGIN { printf "%.2f\t%.1f", e - s, b / 1000000 / (e - s) }'
+}
+
+printf "command\tthreads\tseconds\tinput_MB/s\n"
+threads=1
+while [ ${threads} -le ${max_threads} ]; do
+    printf "view\t%d\t%s\n" ${threads} "$(time_command ${taffy} --threads ${threads} view -i ${input_file})"
+    printf "stats -a\t%d\t%s\n" ${threads} "$(time_command ${taffy} --threads ${threads} stats -a -i ${input_file})"
+    threads=$((threads * 2))
+done
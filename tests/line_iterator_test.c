@@ -0,0 +1,138 @@
+#include "CuTest.h"
+#include "taf.h"
+#include "sonLib.h"
+
+/*
+ * Reads all the lines of file using a line iterator, reading ahead if prefetch > 0, and checks they match the
+ * lines of example_file read with stdio. If seekable, also checks we can seek back to the lines.
+ */
+static void test_line_iterator(CuTest *testCase, FILE *file, bool seekable, int64_t prefetch) {
+    char *example_file = "./tests/evolverMammals.maf";
+    FILE *file_copy = fopen(example_file, "r");
+    LI *li = LI_construct2(file, 1, prefetch);
+    stList *positions = stList_construct3(0, free);
+    stList *lines = stList_construct3(0, free);
+    char *line;
+    while((line = stFile_getLineFromFile(file_copy)) != NULL) {
+        // Peek and then get the line as a borrowed span
+        CuAssertStrEquals(testCase, line, LI_peek_at_next_line(li));
+        int64_t length;
+        char *span = LI_get_next_line_span(li, &length);
+        CuAssertIntEquals(testCase, strlen(line), length);
+        CuAssertTrue(testCase, strncmp(line, span, length) == 0);
+        int64_t *position = st_malloc(sizeof(int64_t));
+        *position = LI_tell(li);
+        stList_append(positions, position);
+        stList_append(lines, line);
+    }
+    CuAssertTrue(testCase, LI_peek_at_next_line(li) == NULL);
+    CuAssertTrue(testCase, LI_get_next_line(li) == NULL);
+
+    // Check we can seek back to each line
+    if(seekable) {
+        for(int64_t i=stList_length(lines)-1; i>=0; i-=7) {
+            LI_seek(li, *(int64_t *)stList_get(positions, i));
+            free(LI_get_next_line(li));
+            line = LI_get_next_line(li);
+            CuAssertStrEquals(testCase, stList_get(lines, i), line);
+            CuAssertIntEquals(testCase, *(int64_t *)stList_get(positions, i), LI_tell(li));
+            free(line);
+        }
+    }
+
+    stList_destruct(positions);
+    stList_destruct(lines);
+    LI_destruct(li);
+    fclose(file_copy);
+}
+
+static void test_line_iterator_mmap(CuTest *testCase) {
+    FILE *file = fopen("./tests/evolverMammals.maf", "r");
+    test_line_iterator(testCase, file, 1, 0);
+    fclose(file);
+}
+
+static void test_line_iterator_stream(CuTest *testCase) {
+    FILE *file = popen("cat ./tests/evolverMammals.maf", "r");
+    test_line_iterator(testCase, file, 0, 0);
+    pclose(file);
+}
+
+static void test_line_iterator_prefetch_stream(CuTest *testCase) {
+    FILE *file = popen("cat ./tests/evolverMammals.maf", "r");
+    test_line_iterator(testCase, file, 0, 2);
+    pclose(file);
+}
+
+static void test_line_iterator_prefetch_seek(CuTest *testCase) {
+    // Write a (bgzipped, if compiled with htslib) copy of the file, which is read through a stream
+    char *example_file = "./tests/evolverMammals.maf", *temp_copy = "./tests/line_iterator_test.maf.gz";
+    FILE *file = fopen(example_file, "r");
+    LW *lw = LW_construct(fopen(temp_copy, "w"), 1);
+    char *line;
+    while((line = stFile_getLineFromFile(file)) != NULL) {
+        LW_write_string(lw, line);
+        LW_write_newline(lw);
+        free(line);
+    }
+    LW_destruct(lw, 1);
+    fclose(file);
+
+    file = fopen(temp_copy, "r");
+    test_line_iterator(testCase, file, 1, 1);
+    fclose(file);
+    remove(temp_copy);
+}
+
+/*
+ * Writes a file using the typed line writer primitives, mixed with formatted writes and spanning many flushes,
+ * and checks it matches the same file written with stdio.
+ */
+static void test_line_writer(CuTest *testCase) {
+    char *lw_file = "./tests/line_writer_test.txt", *stdio_file = "./tests/line_writer_test_stdio.txt";
+    LW *lw = LW_construct(fopen(lw_file, "w"), 0);
+    FILE *fh = fopen(stdio_file, "w");
+    for(int64_t i=0; i<200000; i++) {
+        int64_t j = (i % 2 == 0 ? 1 : -1) * i * i * i;
+        LW_write_string(lw, "row");
+        LW_write_char(lw, '\t');
+        LW_write_int64(lw, j);
+        LW_write_char(lw, ' ');
+        LW_write_char_run(lw, 'A' + i % 26, i % 50);
+        LW_write(lw, " %" PRIi64 " %s", i, "x");
+        LW_write_bytes(lw, "yz", i % 3);
+        LW_write_newline(lw);
+        fprintf(fh, "row\t%" PRIi64 " ", j);
+        for(int64_t k=0; k<i%50; k++) {
+            fputc('A' + i % 26, fh);
+        }
+        fprintf(fh, " %" PRIi64 " %s%.*s\n", i, "x", (int)(i % 3), "yz");
+    }
+    LW_write_int64(lw, INT64_MIN);
+    LW_write_newline(lw);
+    fprintf(fh, "%" PRIi64 "\n", INT64_MIN);
+    LW_destruct(lw, 1);
+    fclose(fh);
+
+    FILE *lw_fh = fopen(lw_file, "r"), *stdio_fh = fopen(stdio_file, "r");
+    char *line, *line2;
+    while((line = stFile_getLineFromFile(stdio_fh)) != NULL) {
+        line2 = stFile_getLineFromFile(lw_fh);
+        CuAssertTrue(testCase, line2 != NULL);
+        CuAssertStrEquals(testCase, line, line2);
+        free(line); free(line2);
+    }
+    CuAssertTrue(testCase, stFile_getLineFromFile(lw_fh) == NULL);
+    fclose(lw_fh); fclose(stdio_fh);
+    remove(lw_file); remove(stdio_file);
+}
+
+CuSuite* line_iterator_test_suite(void) {
+    CuSuite* suite = CuSuiteNew();
+    SUITE_ADD_TEST(suite, test_line_iterator_mmap);
+    SUITE_ADD_TEST(suite, test_line_iterator_stream);
+    SUITE_ADD_TEST(suite, test_line_iterator_prefetch_stream);
+    SUITE_ADD_TEST(suite, test_line_iterator_prefetch_seek);
+    SUITE_ADD_TEST(suite, test_line_writer);
+    return suite;
+}
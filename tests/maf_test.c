@@ -65,9 +65,50 @@ static void test_maf_without_compression(CuTest *testCase) {
     test_maf(testCase, 0);
 }
 
+static void test_maf_reader(CuTest *testCase) {
+    // Check the blocks parsed in parallel, in small batches, are the same as those read sequentially
+    char *example_file = "./tests/evolverMammals.maf";
+    FILE *file = fopen(example_file, "r"), *file2 = fopen(example_file, "r");
+    LI *li = LI_construct(file), *li2 = LI_construct(file2);
+    tag_destruct(maf_read_header(li));
+    tag_destruct(maf_read_header(li2));
+    MafReader *reader = maf_reader_construct(li2, 4, 10000);
+    Alignment *alignment, *alignment2;
+    int64_t block_number = 0;
+    while((alignment = maf_read_block(li)) != NULL) {
+        alignment2 = maf_reader_next(reader);
+        CuAssertTrue(testCase, alignment2 != NULL);
+        CuAssertIntEquals(testCase, alignment->row_number, alignment2->row_number);
+        CuAssertIntEquals(testCase, alignment->column_number, alignment2->column_number);
+        Alignment_Row *row = alignment->row, *row2 = alignment2->row;
+        while(row != NULL) {
+            CuAssertTrue(testCase, row2 != NULL);
+            CuAssertStrEquals(testCase, row->sequence_name, row2->sequence_name);
+            CuAssertIntEquals(testCase, row->start, row2->start);
+            CuAssertIntEquals(testCase, row->length, row2->length);
+            CuAssertIntEquals(testCase, row->sequence_length, row2->sequence_length);
+            CuAssertIntEquals(testCase, row->strand, row2->strand);
+            CuAssertStrEquals(testCase, row->bases, row2->bases);
+            row = row->n_row; row2 = row2->n_row;
+        }
+        CuAssertTrue(testCase, row2 == NULL);
+        alignment_destruct(alignment, 1);
+        alignment_destruct(alignment2, 1);
+        block_number++;
+    }
+    CuAssertTrue(testCase, block_number > 0);
+    CuAssertTrue(testCase, maf_reader_next(reader) == NULL);
+    maf_reader_destruct(reader);
+    LI_destruct(li);
+    LI_destruct(li2);
+    fclose(file);
+    fclose(file2);
+}
+
 CuSuite* maf_test_suite(void) {
     CuSuite* suite = CuSuiteNew();
     SUITE_ADD_TEST(suite, test_maf_with_compression);
     SUITE_ADD_TEST(suite, test_maf_without_compression);
+    SUITE_ADD_TEST(suite, test_maf_reader);
     return suite;
 }
@@ -1,5 +1,6 @@
 #include "CuTest.h"
 #include "taf.h"
+#include "tai.h"
 #include "sonLib.h"
 
 #ifdef USE_HTSLIB
@@ -30,16 +31,16 @@ void check_tags(CuTest *testCase, Tag *t, Tag *j) {
     CuAssertTrue(testCase, j == NULL);
 }
 
-static void test_taf(CuTest *testCase) {
+static void test_taf_2(CuTest *testCase, int64_t thread_number, int64_t prefetch, bool run_length_encode_bases) {
     // Example maf file
     char *example_file = "./tests/evolverMammals.maf"; // "./tests/chr2_KI270776v1_alt.maf.1"; // "./tests/chr2_KI270893v1_alt.maf"; //"./tests/chr2_KI270776v1_alt.maf";
     char *temp_copy = "./tests/evolverMammals.taf.gz"; //"./tests/chr2_KI270776v1_alt.taf.1"; // "./tests/chr2_KI270893v1_alt.taf"; //"./tests/chr2_KI270776v1_alt.taf";
-    bool run_length_encode_bases = 0;
+    char *temp_copy2 = "./tests/evolverMammals.rewritten.taf"; // The taf read back and written out again
     stList *column_tags = stList_construct3(0, (void (*)(void *))tag_destruct);
 
     // Write out the taf file
     FILE *file = fopen(example_file, "r");
-    LW *lw = LW_construct(fopen(temp_copy, "w"), 1);
+    LW *lw = LW_construct2(fopen(temp_copy, "w"), 1, thread_number, -1);
     Alignment *alignment, *p_alignment = NULL;
     LI *li_maf = LI_construct(file);
     Tag *tags = maf_read_header(li_maf);
@@ -75,24 +76,31 @@ static void test_taf(CuTest *testCase) {
     // Now parse the taf
     file = fopen(example_file, "r");
     FILE *file_copy = fopen(temp_copy, "r");
-    LI *li = LI_construct(file_copy);
+    LI *li = LI_construct2(file_copy, thread_number, prefetch);
     Alignment *alignment2 = NULL;
     Alignment *p_alignment2 = NULL;
     int64_t column_index = 0;
     li_maf = LI_construct(file);
+    LW *lw2 = LW_construct(fopen(temp_copy2, "w"), 0);
     while((alignment = maf_read_block(li_maf)) != NULL) {
         // Alignment *taf_read_block(Alignment *p_block, bool run_length_encode_bases, LI *li)
         alignment2 = taf_read_block(p_alignment2, run_length_encode_bases, li);
         CuAssertTrue(testCase, alignment2 != NULL);
+        // Write the block out again before its tags are parsed, so the tags are written as they were read
+        taf_write_block(p_alignment2, alignment2, run_length_encode_bases, 1000, lw2);
         // Check that the blocks are the same
         CuAssertIntEquals(testCase, alignment->row_number, alignment2->row_number);
         CuAssertIntEquals(testCase, alignment->column_number, alignment2->column_number);
 
         // Check the rows
+        alignment_make_row_bases(alignment2);
         Alignment_Row *row = alignment->row, *row2 = alignment2->row;
         while(row != NULL) {
             CuAssertTrue(testCase, row2 != NULL);
             CuAssertStrEquals(testCase, row->sequence_name, row2->sequence_name);
+            // Names are interned, so rows with the same sequence share one copy of the name
+            CuAssertTrue(testCase, row->sequence_name_interned && row2->sequence_name_interned);
+            CuAssertTrue(testCase, row->sequence_name == row2->sequence_name);
             CuAssertIntEquals(testCase, row->start, row2->start);
             CuAssertIntEquals(testCase, row->length, row2->length);
             CuAssertIntEquals(testCase, row->sequence_length, row2->sequence_length);
@@ -102,9 +110,28 @@ static void test_taf(CuTest *testCase) {
         }
         CuAssertTrue(testCase, row2 == NULL);
 
+        // Check the columns are the same, the maf block's being transposed from its rows while the taf block's
+        // are those parsed
+        for(int64_t i=0; i<alignment2->column_number; i++) {
+            char *column = alignment_get_column(alignment, i), *column2 = alignment_get_column(alignment2, i);
+            CuAssertStrEquals(testCase, column, column2);
+            // Check the runs of the column, as read if run length encoded, expand to the column
+            int64_t run_number, j = 0;
+            Base_Run *runs = alignment_get_column_runs(alignment2, i, &run_number);
+            for(int64_t k=0; k<run_number; k++) {
+                CuAssertTrue(testCase, runs[k].length > 0);
+                for(int64_t l=0; l<runs[k].length; l++) {
+                    CuAssertTrue(testCase, column[j++] == runs[k].base);
+                }
+            }
+            CuAssertIntEquals(testCase, alignment2->row_number, j);
+            free(column);
+            free(column2);
+        }
+
         // Check the tags are the same
         for(int64_t i=0; i<alignment2->column_number; i++) {
-            check_tags(testCase, alignment2->column_tags[i], stList_get(column_tags, column_index++));
+            check_tags(testCase, alignment_get_column_tags(alignment2)[i], stList_get(column_tags, column_index++));
         }
 
         alignment_destruct(alignment, 1);
@@ -123,10 +150,1043 @@ static void test_taf(CuTest *testCase) {
     LI_destruct(li);
     fclose(file);
     LI_destruct(li_maf);
+    LW_destruct(lw2, 1);
+
+    // Check the rewritten blocks, whose tags were never parsed, are the same as those originally written
+    file = fopen(temp_copy, "r");
+    FILE *file2 = fopen(temp_copy2, "r");
+    li = LI_construct(file);
+    LI *li2 = LI_construct(file2);
+    free(LI_get_next_line(li)); // Skip the header, which was not rewritten
+    char *line, *line2;
+    while((line = LI_get_next_line(li)) != NULL) {
+        line2 = LI_get_next_line(li2);
+        CuAssertTrue(testCase, line2 != NULL);
+        CuAssertStrEquals(testCase, line, line2);
+        free(line);
+        free(line2);
+    }
+    CuAssertTrue(testCase, LI_get_next_line(li2) == NULL);
+    LI_destruct(li);
+    LI_destruct(li2);
+    fclose(file);
+    fclose(file2);
+    remove(temp_copy2);
+}
+
+static void test_taf(CuTest *testCase) {
+    test_taf_2(testCase, 1, 0, 0);
+}
+
+static void test_taf_multithreaded(CuTest *testCase) {
+    // Compress and decompress using bgzf thread pools, reading ahead on a background thread
+    test_taf_2(testCase, 4, 2, 0);
+}
+
+static void test_taf_run_length_encoded(CuTest *testCase) {
+    test_taf_2(testCase, 1, 0, 1);
+}
+
+/*
+ * Write the example maf out as an uncompressed taf file
+ */
+static void write_example_taf(char *taf_file, bool run_length_encode_bases) {
+    FILE *file = fopen("./tests/evolverMammals.maf", "r");
+    LI *li_maf = LI_construct(file);
+    LW *lw = LW_construct(fopen(taf_file, "w"), 0);
+    Tag *tags = maf_read_header(li_maf);
+    if (run_length_encode_bases) {
+        tags = tag_construct("run_length_encode_bases", "1", tags);
+    }
+    taf_write_header(tags, lw);
+    tag_destruct(tags);
+    Alignment *alignment, *p_alignment = NULL;
+    while((alignment = maf_read_block(li_maf)) != NULL) {
+        if(p_alignment != NULL) {
+            alignment_link_adjacent(p_alignment, alignment, 1);
+        }
+        taf_write_block(p_alignment, alignment, run_length_encode_bases, 1000, lw);
+        if(p_alignment != NULL) {
+            alignment_destruct(p_alignment, 1);
+        }
+        p_alignment = alignment;
+    }
+    if(p_alignment != NULL) {
+        alignment_destruct(p_alignment, 1);
+    }
+    LW_destruct(lw, 1);
+    LI_destruct(li_maf);
+    fclose(file);
+}
+
+static void test_taf_parallel_read_2(CuTest *testCase, bool run_length_encode_bases, int64_t thread_number) {
+    char *temp_copy = "./tests/evolverMammals.parallel.taf";
+    char *temp_index = "./tests/evolverMammals.parallel.taf.tai";
+
+    // Write out the taf file, uncompressed
+    write_example_taf(temp_copy, run_length_encode_bases);
+
+    // Index it, finely, so that there are many anchors to split the file at
+    FILE *index_file = fopen(temp_index, "w");
+    FILE *file = fopen(temp_copy, "r");
+    LI *li = LI_construct(file);
+    tai_create(li, index_file, 100);
+    LI_destruct(li);
+    fclose(file);
+    fclose(index_file);
+
+    // Read the file sequentially and in parallel, in small chunks, checking the blocks are the same
+    index_file = fopen(temp_index, "r");
+    Tai *tai = tai_load(index_file, 0);
+    fclose(index_file);
+    file = fopen(temp_copy, "r");
+    li = LI_construct(file);
+    bool rle;
+    tag_destruct(taf_read_header_2(li, &rle));
+    CuAssertTrue(testCase, rle == run_length_encode_bases);
+    TaiReader *reader = tai_reader_construct(tai, temp_copy, LI_tell_next(li), rle, thread_number, 1000);
+    tai_destruct(tai);
+    Alignment *alignment, *p_alignment = NULL, *alignment2, *p_alignment2 = NULL;
+    int64_t block_number = 0;
+    while((alignment = taf_read_block(p_alignment, rle, li)) != NULL) {
+        alignment2 = tai_reader_next(reader);
+        CuAssertTrue(testCase, alignment2 != NULL);
+        CuAssertIntEquals(testCase, alignment->row_number, alignment2->row_number);
+        CuAssertIntEquals(testCase, alignment->column_number, alignment2->column_number);
+        alignment_make_row_bases(alignment);
+        alignment_make_row_bases(alignment2);
+        Alignment_Row *row = alignment->row, *row2 = alignment2->row;
+        while(row != NULL) {
+            CuAssertTrue(testCase, row2 != NULL);
+            CuAssertStrEquals(testCase, row->sequence_name, row2->sequence_name);
+            CuAssertIntEquals(testCase, row->start, row2->start);
+            CuAssertIntEquals(testCase, row->length, row2->length);
+            CuAssertIntEquals(testCase, row->sequence_length, row2->sequence_length);
+            CuAssertIntEquals(testCase, row->strand, row2->strand);
+            CuAssertStrEquals(testCase, row->bases, row2->bases);
+            // The rows must be linked to the same rows of the previous block, including across chunk boundaries
+            CuAssertTrue(testCase, (row->l_row == NULL) == (row2->l_row == NULL));
+            if(row->l_row != NULL) {
+                CuAssertStrEquals(testCase, row->l_row->sequence_name, row2->l_row->sequence_name);
+                CuAssertIntEquals(testCase, row->l_row->start, row2->l_row->start);
+                CuAssertTrue(testCase, row2->l_row->r_row == row2);
+            }
+            row = row->n_row; row2 = row2->n_row;
+        }
+        CuAssertTrue(testCase, row2 == NULL);
+        if(p_alignment != NULL) {
+            alignment_destruct(p_alignment, 1);
+            alignment_destruct(p_alignment2, 1);
+        }
+        p_alignment = alignment;
+        p_alignment2 = alignment2;
+        block_number++;
+    }
+    if(p_alignment != NULL) {
+        alignment_destruct(p_alignment, 1);
+        alignment_destruct(p_alignment2, 1);
+    }
+    CuAssertTrue(testCase, block_number > 0);
+    CuAssertTrue(testCase, tai_reader_next(reader) == NULL);
+    tai_reader_destruct(reader);
+    LI_destruct(li);
+    fclose(file);
+    remove(temp_copy);
+    remove(temp_index);
+}
+
+static void test_taf_parallel_read(CuTest *testCase) {
+    test_taf_parallel_read_2(testCase, 0, 4);
+}
+
+static void test_taf_parallel_read_run_length_encoded(CuTest *testCase) {
+    test_taf_parallel_read_2(testCase, 1, 3);
+}
+
+/*
+ * Make a block of random bases, with runs of bases down the columns and no gaps in the first (reference) row, and
+ * random column tags.
+ */
+static Alignment *make_random_block(int64_t row_number, int64_t column_number) {
+    Alignment *alignment = st_calloc(1, sizeof(Alignment));
+    alignment->row_number = row_number;
+    alignment->column_number = column_number;
+    Alignment_Row **p_row = &alignment->row;
+    for(int64_t i=0; i<row_number; i++) {
+        Alignment_Row *row = alignment_row_construct(alignment);
+        alignment_row_set_sequence_name(row, stString_print("seq%" PRIi64, i), 0);
+        row->sequence_length = 1000000;
+        row->strand = 1;
+        row->bases = st_malloc(column_number + 1);
+        row->bases[column_number] = '\0';
+        *p_row = row;
+        p_row = &row->n_row;
+    }
+    alignment->column_tags = st_calloc(column_number, sizeof(Tag *));
+    for(int64_t j=0; j<column_number; j++) {
+        char base = '-';
+        for(Alignment_Row *row = alignment->row; row != NULL; row = row->n_row) {
+            if(row == alignment->row) {
+                base = "ACGT"[st_randomInt(0, 4)];
+            }
+            else if(st_random() > 0.7) {
+                base = "ACGT-"[st_randomInt(0, 5)];
+            }
+            row->bases[j] = base;
+            row->length += base != '-';
+        }
+        char *tag_string = get_random_tags();
+        stList *tokens = stString_split(tag_string);
+        alignment->column_tags[j] = parse_tags(tokens, 0, ":");
+        stList_destruct(tokens);
+        free(tag_string);
+    }
+    return alignment;
+}
+
+static void check_blocks_equal(CuTest *testCase, Alignment *alignment, Alignment *alignment2) {
+    CuAssertIntEquals(testCase, alignment->row_number, alignment2->row_number);
+    CuAssertIntEquals(testCase, alignment->column_number, alignment2->column_number);
+    alignment_make_row_bases(alignment);
+    alignment_make_row_bases(alignment2);
+    Alignment_Row *row = alignment->row, *row2 = alignment2->row;
+    while(row != NULL) {
+        CuAssertTrue(testCase, row2 != NULL);
+        CuAssertStrEquals(testCase, row->sequence_name, row2->sequence_name);
+        CuAssertIntEquals(testCase, row->start, row2->start);
+        CuAssertIntEquals(testCase, row->length, row2->length);
+        CuAssertStrEquals(testCase, row->bases, row2->bases);
+        row = row->n_row; row2 = row2->n_row;
+    }
+    CuAssertTrue(testCase, row2 == NULL);
+    Tag **column_tags = alignment_get_column_tags(alignment), **column_tags2 = alignment_get_column_tags(alignment2);
+    for(int64_t i=0; i<alignment->column_number; i++) {
+        check_tags(testCase, column_tags[i], column_tags2[i]);
+    }
+}
+
+static void test_alignment_recycle_2(CuTest *testCase, bool run_length_encode_bases) {
+    // Blocks that shrink and grow, in rows and in columns, so that each block reuses the buffers of blocks both
+    // smaller and larger than it
+    char *temp_copy = "./tests/recycle.taf";
+    int64_t shapes[][2] = { { 20, 200 }, { 2, 3 }, { 50, 500 }, { 1, 1 }, { 10, 1000 }, { 30, 20 }, { 3, 700 },
+                            { 60, 2 }, { 1, 900 } };
+    int64_t block_number = sizeof(shapes) / sizeof(shapes[0]);
+    LW *lw = LW_construct(fopen(temp_copy, "w"), 0);
+    Tag *tags = run_length_encode_bases ? tag_construct("run_length_encode_bases", "1", NULL) : NULL;
+    taf_write_header(tags, lw);
+    tag_destruct(tags);
+    Alignment *alignment, *p_alignment = NULL;
+    for(int64_t i=0; i<block_number; i++) {
+        alignment = make_random_block(shapes[i][0], shapes[i][1]);
+        taf_write_block(p_alignment, alignment, run_length_encode_bases, 1000, lw);
+        if(p_alignment != NULL) {
+            alignment_destruct(p_alignment, 1);
+        }
+        p_alignment = alignment;
+    }
+    alignment_destruct(p_alignment, 1);
+    LW_destruct(lw, 1);
+
+    // Read the file twice, recycling the blocks of one read, checking the blocks are the same
+    FILE *file = fopen(temp_copy, "r"), *file2 = fopen(temp_copy, "r");
+    LI *li = LI_construct(file), *li2 = LI_construct(file2);
+    bool rle;
+    tag_destruct(taf_read_header_2(li, &rle));
+    tag_destruct(taf_read_header_2(li2, &rle));
+    CuAssertTrue(testCase, rle == run_length_encode_bases);
+    Alignment *alignment2, *p_alignment2 = NULL;
+    p_alignment = NULL;
+    int64_t i = 0;
+    while((alignment = taf_read_block(p_alignment, rle, li)) != NULL) {
+        alignment2 = taf_read_block(p_alignment2, rle, li2);
+        CuAssertTrue(testCase, alignment2 != NULL);
+        CuAssertIntEquals(testCase, shapes[i][0], alignment->row_number);
+        CuAssertIntEquals(testCase, shapes[i][1], alignment->column_number);
+        check_blocks_equal(testCase, alignment, alignment2);
+        if(p_alignment != NULL) {
+            // Make the caches of the column bases and runs, masking some blocks so their runs are remade, before
+            // recycling the block
+            if(i % 2 == 0) {
+                alignment_mask_reference_bases(p_alignment, '*');
+            }
+            int64_t run_number;
+            alignment_get_column_runs(p_alignment, 0, &run_number);
+            alignment_get_column_bases(p_alignment);
+            alignment_recycle(p_alignment, 1, li);
+            alignment_destruct(p_alignment2, 1);
+        }
+        p_alignment = alignment;
+        p_alignment2 = alignment2;
+        i++;
+    }
+    CuAssertIntEquals(testCase, block_number, i);
+    CuAssertTrue(testCase, taf_read_block(p_alignment2, rle, li2) == NULL);
+    alignment_recycle(p_alignment, 1, li);
+    alignment_destruct(p_alignment2, 1);
+    LI_destruct(li);
+    LI_destruct(li2);
+    fclose(file);
+    fclose(file2);
+    remove(temp_copy);
+}
+
+static void test_alignment_recycle(CuTest *testCase) {
+    test_alignment_recycle_2(testCase, 0);
+}
+
+static void test_alignment_recycle_run_length_encoded(CuTest *testCase) {
+    test_alignment_recycle_2(testCase, 1);
+}
+
+/*
+ * Get the blocks of a region from an index of the example taf file, as strings
+ */
+static stList *get_region(Tai *tai, char *taf_file, char *contig, int64_t start, int64_t length) {
+    FILE *file = fopen(taf_file, "r");
+    LI *li = LI_construct(file);
+    tag_destruct(tai->maf ? maf_read_header(li) : taf_read_header(li));
+    stList *blocks = stList_construct3(0, free);
+    TaiIt *tai_it = tai_iterator(tai, li, 0, contig, start, length);
+    Alignment *alignment, *p_alignment = NULL;
+    while((alignment = tai_next(tai_it, li)) != NULL) {
+        stList_append(blocks, alignment_to_string(alignment));
+        if(p_alignment != NULL) {
+            alignment_destruct(p_alignment, 1);
+        }
+        p_alignment = alignment;
+    }
+    if(p_alignment != NULL) {
+        alignment_destruct(p_alignment, 1);
+    }
+    tai_iterator_destruct(tai_it);
+    LI_destruct(li);
+    fclose(file);
+    return blocks;
+}
+
+static void test_tai_binary(CuTest *testCase) {
+    char *taf_file = "./tests/evolverMammals.binary.taf";
+    char *index_files[] = { "./tests/evolverMammals.binary.taf.tai", "./tests/evolverMammals.binary.taf.tai.bin" };
+    write_example_taf(taf_file, 0);
+
+    // Write a text and a binary index
+    Tai *tais[2];
+    for(int64_t binary=0; binary<2; binary++) {
+        FILE *file = fopen(taf_file, "r");
+        LI *li = LI_construct(file);
+        FILE *index_file = fopen(index_files[binary], "w");
+        if(binary) {
+            tai_create_binary(li, index_file, 100);
+        }
+        else {
+            tai_create(li, index_file, 100);
+        }
+        fclose(index_file);
+        LI_destruct(li);
+        fclose(file);
+        index_file = fopen(index_files[binary], "r");
+        tais[binary] = tai_load(index_file, 0);
+        fclose(index_file);
+    }
+
+    // The binary index is mapped, and is the same as the text index
+    CuAssertTrue(testCase, !tais[0]->mapped);
+    CuAssertTrue(testCase, tais[1]->mapped);
+    CuAssertTrue(testCase, tais[0]->contig_number > 0);
+    CuAssertTrue(testCase, tais[0]->record_number >= tais[0]->contig_number);
+    CuAssertIntEquals(testCase, tais[0]->data_length, tais[1]->data_length);
+    CuAssertTrue(testCase, memcmp(tais[0]->data, tais[1]->data, tais[0]->data_length) == 0);
+    for(int64_t i=0; i<tais[1]->contig_number; i++) { // The contigs are sorted, their records in order
+        const TaiContig *contig = &tais[1]->contigs[i];
+        if(i > 0) {
+            CuAssertTrue(testCase, strcmp(tais[1]->names + tais[1]->contigs[i-1].name, tais[1]->names + contig->name) < 0);
+        }
+        for(int64_t j=contig->first_record+1; j<contig->first_record+contig->record_number; j++) {
+            CuAssertTrue(testCase, tais[1]->seq_pos[j-1] <= tais[1]->seq_pos[j]);
+        }
+    }
+
+    // Regions are the same read with either
+    char *contigs[] = { "Anc0.Anc0refChr0", "Anc0.Anc0refChr0", "Anc0.Anc0refChr0", "not_a_contig" };
+    int64_t starts[] = { 0, 90, 10, 0 }, lengths[] = { 100, 20, 1000000, 10 };
+    for(int64_t i=0; i<4; i++) {
+        stList *blocks = get_region(tais[0], taf_file, contigs[i], starts[i], lengths[i]);
+        stList *blocks2 = get_region(tais[1], taf_file, contigs[i], starts[i], lengths[i]);
+        CuAssertIntEquals(testCase, stList_length(blocks), stList_length(blocks2));
+        CuAssertTrue(testCase, i == 3 || stList_length(blocks) > 0);
+        for(int64_t j=0; j<stList_length(blocks); j++) {
+            CuAssertStrEquals(testCase, stList_get(blocks, j), stList_get(blocks2, j));
+        }
+        stList_destruct(blocks);
+        stList_destruct(blocks2);
+    }
+
+    tai_destruct(tais[0]);
+    tai_destruct(tais[1]);
+    remove(taf_file);
+    remove(index_files[0]);
+    remove(index_files[1]);
+}
+
+/*
+ * Get the blocks of a region of any sequence from a secondary index, as strings, checking the blocks are only linked
+ * to the previous block returned
+ */
+static stList *get_secondary_region(CuTest *testCase, Tai *tsi, char *file_name, const char *sequence, int64_t start,
+                                    int64_t length) {
+    FILE *file = fopen(file_name, "r");
+    LI *li = LI_construct(file);
+    tag_destruct(tsi->maf ? maf_read_header(li) : taf_read_header(li));
+    stList *blocks = stList_construct3(0, free);
+    TaiIt *tai_it = tai_secondary_iterator(tsi, li, 0, sequence, start, length);
+    Alignment *alignment, *p_alignment = NULL;
+    while((alignment = tai_next(tai_it, li)) != NULL) {
+        for(Alignment_Row *row = alignment->row; row != NULL; row = row->n_row) {
+            if(row->l_row != NULL) {
+                CuAssertTrue(testCase, row->l_row->r_row == row);
+                Alignment_Row *l_row = p_alignment != NULL ? p_alignment->row : NULL;
+                while(l_row != NULL && l_row != row->l_row) {
+                    l_row = l_row->n_row;
+                }
+                CuAssertTrue(testCase, l_row != NULL);
+            }
+        }
+        stList_append(blocks, alignment_to_string(alignment));
+        if(p_alignment != NULL) {
+            alignment_destruct(p_alignment, 1);
+        }
+        p_alignment = alignment;
+    }
+    if(p_alignment != NULL) {
+        alignment_destruct(p_alignment, 1);
+    }
+    tai_iterator_destruct(tai_it);
+    LI_destruct(li);
+    fclose(file);
+    return blocks;
+}
+
+/*
+ * Get the blocks with a row aligning some of a region of any sequence by reading the whole file, as strings
+ */
+static stList *scan_secondary_region(char *file_name, bool maf, const char *sequence, int64_t start, int64_t length) {
+    FILE *file = fopen(file_name, "r");
+    LI *li = LI_construct(file);
+    tag_destruct(maf ? maf_read_header(li) : taf_read_header(li));
+    stList *blocks = stList_construct3(0, free);
+    Alignment *alignment, *p_alignment = NULL;
+    while((alignment = maf ? maf_read_block(li) : taf_read_block(p_alignment, 0, li)) != NULL) {
+        for(Alignment_Row *row = alignment->row; row != NULL; row = row->n_row) {
+            int64_t row_start = row->strand ? row->start : row->sequence_length - (row->start + row->length);
+            if(row->length > 0 && strcmp(row->sequence_name, sequence) == 0 && row_start < start + length &&
+               row_start + row->length > start) {
+                stList_append(blocks, alignment_to_string(alignment));
+                break;
+            }
+        }
+        if(p_alignment != NULL) {
+            alignment_destruct(p_alignment, 1);
+        }
+        p_alignment = alignment;
+    }
+    if(p_alignment != NULL) {
+        alignment_destruct(p_alignment, 1);
+    }
+    LI_destruct(li);
+    fclose(file);
+    return blocks;
+}
+
+static void test_tai_secondary(CuTest *testCase) {
+    char *taf_file = "./tests/evolverMammals.secondary.taf";
+    char *files[] = { taf_file, "./tests/evolverMammals.maf" };
+    char *index_file_name = "./tests/evolverMammals.secondary.tai";
+    char *secondary_file_name = "./tests/evolverMammals.secondary.tsi";
+    write_example_taf(taf_file, 0);
+
+    for(int64_t maf=0; maf<2; maf++) {
+        // Index the file finely, then make the secondary index within the anchors of the index
+        FILE *file = fopen(files[maf], "r");
+        LI *li = LI_construct(file);
+        FILE *index_file = fopen(index_file_name, "w");
+        tai_create(li, index_file, 100);
+        fclose(index_file);
+        index_file = fopen(index_file_name, "r");
+        Tai *tai = tai_load(index_file, maf);
+        fclose(index_file);
+        LI_seek(li, 0);
+        int64_t line_length;
+        LI_get_next_line_span(li, &line_length); // load the line at the seeked position
+        FILE *secondary_file = fopen(secondary_file_name, "w");
+        tai_create_secondary(tai, li, secondary_file);
+        fclose(secondary_file);
+        LI_destruct(li);
+        fclose(file);
+        secondary_file = fopen(secondary_file_name, "r");
+        Tai *tsi = tai_load_secondary(secondary_file, maf);
+        fclose(secondary_file);
+        CuAssertTrue(testCase, tsi->mapped && tsi->seq_end != NULL && tai->seq_end == NULL);
+        CuAssertTrue(testCase, tsi->contig_number > tai->contig_number);
+
+        // Every region of every sequence gets the blocks that align it, as a scan of the file does
+        int64_t starts[] = { 0, 0, 50, 1000 }, lengths[] = { -1, 10, 60, 1 };
+        for(int64_t i=0; i<tsi->contig_number; i++) {
+            const char *sequence = tsi->names + tsi->contigs[i].name;
+            for(int64_t j=0; j<4; j++) {
+                stList *blocks = get_secondary_region(testCase, tsi, files[maf], sequence, starts[j], lengths[j]);
+                stList *blocks2 = scan_secondary_region(files[maf], maf, sequence, starts[j],
+                                                        lengths[j] < 0 ? LONG_MAX - starts[j] : lengths[j]);
+                CuAssertIntEquals(testCase, stList_length(blocks2), stList_length(blocks));
+                CuAssertTrue(testCase, j > 0 || stList_length(blocks) > 0);
+                for(int64_t k=0; k<stList_length(blocks); k++) {
+                    CuAssertStrEquals(testCase, stList_get(blocks2, k), stList_get(blocks, k));
+                }
+                stList_destruct(blocks);
+                stList_destruct(blocks2);
+            }
+        }
+        stList *blocks = get_secondary_region(testCase, tsi, files[maf], "not_a_sequence", 0, 10);
+        CuAssertIntEquals(testCase, 0, stList_length(blocks));
+        stList_destruct(blocks);
+        tai_destruct(tai);
+        tai_destruct(tsi);
+    }
+    remove(taf_file);
+    remove(index_file_name);
+    remove(secondary_file_name);
+}
+
+/*
+ * Check the left links of a block returned by a region iterator are to the block returned before it, if any, which
+ * has not yet been freed.
+ */
+static void check_left_links(CuTest *testCase, Alignment *alignment, Alignment *p_alignment) {
+    for(Alignment_Row *row = alignment->row; row != NULL; row = row->n_row) {
+        if(row->l_row != NULL) {
+            CuAssertTrue(testCase, p_alignment != NULL);
+            Alignment_Row *l_row = p_alignment->row;
+            while(l_row != NULL && l_row != row->l_row) {
+                l_row = l_row->n_row;
+            }
+            CuAssertTrue(testCase, l_row != NULL);
+            CuAssertTrue(testCase, l_row->r_row == row);
+        }
+    }
+}
+
+/*
+ * Check that each of the sorted regions read by a regions iterator and by a reader of the regions with threads gets
+ * the same blocks as a query of it alone, and that the regions flagged empty get none.
+ */
+static void check_tai_regions(CuTest *testCase, char *file_name, bool maf, char **contigs, int64_t *starts,
+                              int64_t *lengths, bool *empty, int64_t region_number) {
+    char *index_file_name = "./tests/evolverMammals.regions.tai";
+    for(int64_t index_block_size=1; index_block_size<=100; index_block_size *= 100) {
+        FILE *file = fopen(file_name, "r");
+        LI *li = LI_construct(file);
+        FILE *index_file = fopen(index_file_name, "w");
+        tai_create(li, index_file, index_block_size);
+        fclose(index_file);
+        index_file = fopen(index_file_name, "r");
+        Tai *tai = tai_load(index_file, maf);
+        fclose(index_file);
+
+        // Each region gets the same blocks as a query of it alone
+        LI_seek(li, 0);
+        int64_t line_length;
+        LI_get_next_line_span(li, &line_length); // load the line at the seeked position
+        tag_destruct(maf ? maf_read_header(li) : taf_read_header(li));
+        TaiIt *tai_it = tai_regions_iterator(tai, 0);
+        CuAssertTrue(testCase, !tai_has_next(tai_it));
+        for(int64_t i=0; i<region_number; i++) {
+            tai_iterator_next_region(tai_it, tai, li, contigs[i], starts[i], lengths[i]);
+            stList *blocks = get_region(tai, file_name, contigs[i], starts[i], lengths[i]);
+            CuAssertTrue(testCase, (stList_length(blocks) == 0) == empty[i]);
+            Alignment *alignment, *p_alignment = NULL;
+            int64_t j = 0;
+            while((alignment = tai_next(tai_it, li)) != NULL) {
+                CuAssertTrue(testCase, j < stList_length(blocks));
+                char *block = alignment_to_string(alignment);
+                CuAssertStrEquals(testCase, stList_get(blocks, j++), block);
+                free(block);
+                // The first block of a region, which may have been kept from the last region, is not linked to a block
+                // the caller no longer has
+                check_left_links(testCase, alignment, p_alignment);
+                if(p_alignment != NULL) {
+                    alignment_destruct(p_alignment, 1);
+                }
+                p_alignment = alignment;
+            }
+            if(p_alignment != NULL) {
+                alignment_destruct(p_alignment, 1);
+            }
+            CuAssertIntEquals(testCase, stList_length(blocks), j);
+            stList_destruct(blocks);
+        }
+        tai_iterator_destruct(tai_it);
+
+        // And the same blocks read by a reader of the regions with threads
+        TaiRegion *regions = st_malloc(region_number * sizeof(TaiRegion));
+        int64_t last_region = -1;
+        for(int64_t i=0; i<region_number; i++) {
+            regions[i] = (TaiRegion){ contigs[i], starts[i], lengths[i] };
+            last_region = empty[i] ? last_region : i;
+        }
+        TaiRegionReader *reader = tai_region_reader_construct(tai, file_name, regions, region_number, 0, 3);
+        Alignment *alignment, *p_alignment = NULL;
+        int64_t region, p_region = -1, j = 0;
+        stList *blocks = NULL;
+        while((alignment = tai_region_reader_next(reader, &region)) != NULL) {
+            if(region != p_region) { // on to the next region with blocks
+                CuAssertTrue(testCase, region > p_region);
+                if(blocks != NULL) {
+                    CuAssertIntEquals(testCase, stList_length(blocks), j);
+                    stList_destruct(blocks);
+                }
+                blocks = get_region(tai, file_name, contigs[region], starts[region], lengths[region]);
+                p_region = region;
+                j = 0;
+            }
+            CuAssertTrue(testCase, j < stList_length(blocks));
+            char *block = alignment_to_string(alignment);
+            CuAssertStrEquals(testCase, stList_get(blocks, j++), block);
+            free(block);
+            if(p_alignment != NULL) {
+                alignment_destruct(p_alignment, 1);
+            }
+            p_alignment = alignment;
+        }
+        if(p_alignment != NULL) {
+            alignment_destruct(p_alignment, 1);
+        }
+        CuAssertIntEquals(testCase, last_region, p_region);
+        CuAssertIntEquals(testCase, stList_length(blocks), j);
+        stList_destruct(blocks);
+        tai_region_reader_destruct(reader);
+        free(regions);
+
+        tai_destruct(tai);
+        LI_destruct(li);
+        fclose(file);
+    }
+    remove(index_file_name);
+}
+
+/*
+ * Write the example alignment as MAF and TAF with a gap in the reference, by moving the reference rows of the blocks
+ * from the given one on along by gap_length.
+ */
+static void write_example_with_gap(char *maf_file, char *taf_file, int64_t gap_block, int64_t gap_length) {
+    FILE *file = fopen("./tests/evolverMammals.maf", "r");
+    LI *li = LI_construct(file);
+    LW *maf_lw = LW_construct(fopen(maf_file, "w"), 0), *taf_lw = LW_construct(fopen(taf_file, "w"), 0);
+    Tag *tags = maf_read_header(li);
+    maf_write_header(tags, maf_lw);
+    taf_write_header(tags, taf_lw);
+    tag_destruct(tags);
+    Alignment *alignment, *p_alignment = NULL;
+    for(int64_t i=0; (alignment = maf_read_block(li)) != NULL; i++) {
+        if(i >= gap_block) {
+            alignment->row->start += gap_length;
+        }
+        if(p_alignment != NULL) {
+            alignment_link_adjacent(p_alignment, alignment, 1);
+        }
+        maf_write_block(alignment, maf_lw);
+        taf_write_block(p_alignment, alignment, 0, 1000, taf_lw);
+        if(p_alignment != NULL) {
+            alignment_destruct(p_alignment, 1);
+        }
+        p_alignment = alignment;
+    }
+    if(p_alignment != NULL) {
+        alignment_destruct(p_alignment, 1);
+    }
+    LW_destruct(maf_lw, 1);
+    LW_destruct(taf_lw, 1);
+    LI_destruct(li);
+    fclose(file);
+}
+
+static void test_tai_regions(CuTest *testCase) {
+    char *taf_file = "./tests/evolverMammals.regions.taf";
+    char *files[] = { taf_file, "./tests/evolverMammals.maf" };
+    write_example_taf(taf_file, 0);
+
+    // Sorted regions, some within the same block, some overlapping, and some not in the alignment
+    char *contigs[] = { "Anc0.Anc0refChr0", "Anc0.Anc0refChr0", "Anc0.Anc0refChr0", "Anc0.Anc0refChr0",
+                        "Anc0.Anc0refChr0", "Anc0.Anc0refChr0", "Anc0.Anc0refChr0", "Anc0.Anc0refChr0",
+                        "Anc0.Anc0refChr0", "not_a_contig", "Anc0.Anc0refChr0" };
+    int64_t starts[] = { 0, 5, 48, 55, 60, 61, 90, 117, 200, 0, 0 }, lengths[] = { 10, 15, 5, 1, 2, 29, 5, 83, 10, 10, 200 };
+    bool empty[] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 0 };
+    for(int64_t maf=0; maf<2; maf++) {
+        check_tai_regions(testCase, files[maf], maf, contigs, starts, lengths, empty, 11);
+    }
+    remove(taf_file);
+
+    // With the reference rows of the last two blocks moved along to leave a gap, [87, 107), before them. The block
+    // after a region in the gap is kept for the next region, which reads on from it
+    char *gap_files[] = { "./tests/evolverMammals.gap.taf", "./tests/evolverMammals.gap.maf" };
+    write_example_with_gap(gap_files[1], gap_files[0], 4, 20);
+    char *gap_contigs[] = { "Anc0.Anc0refChr0", "Anc0.Anc0refChr0", "Anc0.Anc0refChr0", "Anc0.Anc0refChr0",
+                            "Anc0.Anc0refChr0" };
+    int64_t gap_starts[] = { 60, 95, 108, 110, 128 }, gap_lengths[] = { 2, 5, 5, 15, 2 };
+    bool gap_empty[] = { 0, 1, 0, 0, 0 };
+    for(int64_t maf=0; maf<2; maf++) {
+        check_tai_regions(testCase, gap_files[maf], maf, gap_contigs, gap_starts, gap_lengths, gap_empty, 5);
+        remove(gap_files[maf]);
+    }
+}
+
+/*
+ * Check an index written by a TaiWriter is the same as that made by tai_create, and is of more than one block.
+ */
+static void check_index_files_equal(CuTest *testCase, char *index_file_name, char *index_file_name2) {
+    FILE *index_file1 = fopen(index_file_name, "r"), *index_file2 = fopen(index_file_name2, "r");
+    char *line, *line2;
+    int64_t line_number = 0;
+    while((line = stFile_getLineFromFile(index_file1)) != NULL) {
+        line2 = stFile_getLineFromFile(index_file2);
+        CuAssertPtrNotNull(testCase, line2);
+        CuAssertStrEquals(testCase, line2, line);
+        free(line);
+        free(line2);
+        line_number++;
+    }
+    CuAssertTrue(testCase, stFile_getLineFromFile(index_file2) == NULL);
+    CuAssertTrue(testCase, line_number > 1);
+    fclose(index_file1);
+    fclose(index_file2);
+}
+
+static void test_tai_writer(CuTest *testCase) {
+    char *out_file = "./tests/evolverMammals.writer.out";
+    char *index_file_name = "./tests/evolverMammals.writer.out.tai";
+    char *index_file_name2 = "./tests/evolverMammals.writer.tai";
+
+    for(int64_t maf=0; maf<2; maf++) {
+        // Write the example alignment as TAF or MAF, indexing it as it is written
+        FILE *file = fopen("./tests/evolverMammals.maf", "r");
+        LI *li = LI_construct(file);
+        LW *lw = LW_construct(fopen(out_file, "w"), 0);
+        Tag *tags = maf_read_header(li);
+        maf ? maf_write_header(tags, lw) : taf_write_header(tags, lw);
+        tag_destruct(tags);
+        TaiWriter *tai_writer = tai_writer_construct(maf, 1);
+        Alignment *alignment, *p_alignment = NULL;
+        while((alignment = maf_read_block(li)) != NULL) {
+            if(p_alignment != NULL) {
+                alignment_link_adjacent(p_alignment, alignment, 1);
+            }
+            tai_writer_add_block(tai_writer, alignment, 10, lw);
+            maf ? maf_write_block(alignment, lw) : taf_write_block(p_alignment, alignment, 0, 10, lw);
+            if(p_alignment != NULL) {
+                alignment_destruct(p_alignment, 1);
+            }
+            p_alignment = alignment;
+        }
+        if(p_alignment != NULL) {
+            alignment_destruct(p_alignment, 1);
+        }
+        tai_writer_write(tai_writer, lw, out_file);
+        tai_writer_destruct(tai_writer);
+        LW_destruct(lw, 1);
+        LI_destruct(li);
+        fclose(file);
+
+        // The index is the same as that made by reading back the output
+        file = fopen(out_file, "r");
+        li = LI_construct(file);
+        FILE *index_file = fopen(index_file_name2, "w");
+        tai_create(li, index_file, 1);
+        fclose(index_file);
+        LI_destruct(li);
+        fclose(file);
+        check_index_files_equal(testCase, index_file_name, index_file_name2);
+    }
+    remove(out_file);
+    remove(index_file_name);
+    remove(index_file_name2);
+}
+
+#ifdef USE_HTSLIB
+static void test_tai_writer_compressed(CuTest *testCase) {
+    char *out_file = "./tests/tai_writer.taf.gz";
+    char *index_file_name = "./tests/tai_writer.taf.gz.tai";
+    char *index_file_name2 = "./tests/tai_writer.tai";
+
+    // Write random blocks as bgzf compressed TAF, longer than one bgzf block and compressed on a pool of threads,
+    // indexing it as it is written, so that the positions in the index are virtual offsets in different bgzf blocks
+    LW *lw = LW_construct2(fopen(out_file, "w"), 1, 4, -1);
+    taf_write_header(NULL, lw);
+    TaiWriter *tai_writer = tai_writer_construct(0, 1);
+    int64_t starts[10] = { 0 };
+    Alignment *alignment, *p_alignment = NULL;
+    for(int64_t i=0; i<1000; i++) {
+        alignment = make_random_block(10, 100);
+        int64_t j = 0;
+        for(Alignment_Row *row = alignment->row; row != NULL; row = row->n_row) { // Follow on from the last block
+            row->start = starts[j];
+            starts[j++] += row->length;
+        }
+        if(p_alignment != NULL) {
+            alignment_link_adjacent(p_alignment, alignment, 1);
+        }
+        tai_writer_add_block(tai_writer, alignment, 10, lw);
+        taf_write_block(p_alignment, alignment, 0, 10, lw);
+        if(p_alignment != NULL) {
+            alignment_destruct(p_alignment, 1);
+        }
+        p_alignment = alignment;
+    }
+    alignment_destruct(p_alignment, 1);
+    CuAssertTrue(testCase, LW_tell(lw) > 4 * 65536);
+    tai_writer_write(tai_writer, lw, out_file);
+    tai_writer_destruct(tai_writer);
+    LW_destruct(lw, 1);
+
+    // The index is the same as that made by reading back the compressed output
+    FILE *file = fopen(out_file, "r");
+    LI *li = LI_construct(file);
+    FILE *index_file = fopen(index_file_name2, "w");
+    tai_create(li, index_file, 1);
+    fclose(index_file);
+    LI_destruct(li);
+    fclose(file);
+    check_index_files_equal(testCase, index_file_name, index_file_name2);
+    remove(out_file);
+    remove(index_file_name);
+    remove(index_file_name2);
+}
+#endif
+
+static void test_taf_parse_anchor_line(CuTest *testCase) {
+    char *lines[] = { "ACG", // No coordinates
+                      "ACG ; i 0 a.chr1 10 + 100 i 1 b.chr1 5 - 50 i 2 c.chr1 0 + 10", // Every row
+                      "ACG ; s 0 a.chr1 10 + 100 s 1 b.chr1 5 - 50 s 2 c.chr1 0 + 10 @ k:v", // Every row, with tags
+                      "ACG ; i 1 b.chr1 5 - 50", // Not every row
+                      "ACG ; s 0 a.chr1 10 + 100 g 1 2 s 2 c.chr1 0 + 10", // A row with only a gap
+                      "ACG @ k:;", // Tags only
+                      "A 2 C 1 ; i 0 a.chr1 12 + 100 i 1 b.chr1 5 - 50 i 2 c.chr1 0 + 10" }; // Run length encoded
+    int64_t expected_starts[] = { -1, 10, 10, -1, -1, -1, 12 };
+    for(int64_t i=0; i<7; i++) {
+        int64_t start = -1;
+        bool strand = 0;
+        char *sequence_name = taf_parse_anchor_line(lines[i], strlen(lines[i]), i == 6, &start, &strand);
+        CuAssertTrue(testCase, (sequence_name != NULL) == (expected_starts[i] >= 0));
+        if(sequence_name != NULL) {
+            CuAssertStrEquals(testCase, "a.chr1", sequence_name);
+            CuAssertIntEquals(testCase, expected_starts[i], start);
+            CuAssertTrue(testCase, strand);
+            free(sequence_name);
+        }
+    }
+}
+
+static void test_tai_summaries(CuTest *testCase) {
+    // A TAF whose reference row has a gap, moves to another contig, is deleted and replaced, and returns to its first
+    // contig, plain or run length encoded
+    char *lines[2][7] = { { "#taf version:1", "AC ; i 0 a.chr1 0 + 100 i 1 b.chr1 0 + 50", "A-", "GG ; g 0 5",
+                            "T- ; s 0 a.chr2 10 + 40", "-C ; d 0 i 0 a.chr1 20 + 100", "CA" },
+                          { "#taf version:1 run_length_encode_bases:1",
+                            "A 1 C 1 ; i 0 a.chr1 0 + 100 i 1 b.chr1 0 + 50", "A 1 - 1", "G 2 ; g 0 5",
+                            "T 1 - 1 ; s 0 a.chr2 10 + 40",
+                            "- 1 C 1 ; d 0 i 0 a.chr1 20 + 100", "C 1 A 1" } };
+    char *taf_file = "./tests/summaries.taf", *index_file_name = "./tests/summaries.taf.tai";
+    for(int64_t rle=0; rle<2; rle++) {
+        for(int64_t deleted=0; deleted<2; deleted++) { // If deleted, a last line's reference row is not known
+            FILE *file = fopen(taf_file, "w");
+            for(int64_t i=0; i<7; i++) {
+                fprintf(file, "%s\n", lines[rle][i]);
+            }
+            if(deleted) {
+                fprintf(file, "%s\n", rle ? "T 2 ; d 0" : "TT ; d 0");
+            }
+            fclose(file);
+            for(int64_t binary=0; binary<2; binary++) {
+                file = fopen(taf_file, "r");
+                LI *li = LI_construct(file);
+                FILE *index_file = fopen(index_file_name, "w");
+                binary ? tai_create_binary(li, index_file, 1) : tai_create(li, index_file, 1);
+                fclose(index_file);
+                LI_destruct(li);
+                fclose(file);
+                index_file = fopen(index_file_name, "r");
+                Tai *tai = tai_load(index_file, 0);
+                fclose(index_file);
+                if(deleted) { // The contigs can not be summarized
+                    CuAssertIntEquals(testCase, 0, tai->summary_number);
+                    tai_destruct(tai);
+                    continue;
+                }
+                // The intervals are [0, 2), [7, 8) and [20, 21) of a.chr1 and [10, 11) of a.chr2, as taffy stats -b
+                // would find them
+                CuAssertIntEquals(testCase, 2, tai->summary_number);
+                const char *name;
+                const TaiContigSummary *summary = tai_contig_summary(tai, 0, &name);
+                CuAssertStrEquals(testCase, "a.chr1", name);
+                int64_t expected[] = { 100, 0, 21, 4, 3, 2 };
+                int64_t found[] = { summary->sequence_length, summary->start, summary->end, summary->aligned_bases,
+                                    summary->interval_number, summary->run_number };
+                for(int64_t i=0; i<6; i++) {
+                    CuAssertIntEquals(testCase, expected[i], found[i]);
+                }
+                summary = tai_contig_summary(tai, 1, &name);
+                CuAssertStrEquals(testCase, "a.chr2", name);
+                int64_t expected2[] = { 40, 10, 11, 1, 1, 1 };
+                int64_t found2[] = { summary->sequence_length, summary->start, summary->end, summary->aligned_bases,
+                                     summary->interval_number, summary->run_number };
+                for(int64_t i=0; i<6; i++) {
+                    CuAssertIntEquals(testCase, expected2[i], found2[i]);
+                }
+                CuAssertTrue(testCase, tai_contig_summary(tai, 2, &name) == NULL);
+
+                // The sequence lengths are those of the summaries, including that of a.chr2, which has no anchor
+                stHash *seq_to_len = tai_sequence_lengths(tai, NULL);
+                CuAssertIntEquals(testCase, 2, stHash_size(seq_to_len));
+                CuAssertIntEquals(testCase, 40, (int64_t)stHash_search(seq_to_len, "a.chr2"));
+                stHash_destruct(seq_to_len);
+                tai_destruct(tai);
+            }
+        }
+    }
+    remove(taf_file);
+    remove(index_file_name);
+}
+
+static void test_taf_parse_first_row(CuTest *testCase) {
+    char *lines[] = { "ACG", "ACG ; i 0 a.chr1 10 + 100 i 1 b.chr1 5 - 50", "A-G ; g 0 2 s 1 b.chr1 5 - 50",
+                      "-CG ; G 0 AC", "ACG ; i 1 b.chr1 5 - 50 @ k:v", "CG ; d 0", "GG ; i 0 c.chr1 3 + 30",
+                      "A 2 C 1 ; s 0 a.chr1 12 + 100", " ; d 0 d 0" };
+    char expected_bases[] = { 'A', 'A', 'A', '-', 'A', 'C', 'G', 'A', '\0' };
+    bool expected_coordinates[] = { 0, 1, 1, 1, 1, 1, 1, 1, 1 };
+    char *expected_names[] = { NULL, "a.chr1", "a.chr1", "a.chr1", "a.chr1", NULL, "c.chr1", "a.chr1", NULL };
+    int64_t expected_starts[] = { -1, 10, 12, 14, 14, 14, 3, 12, 12 };
+    char *sequence_name = NULL;
+    int64_t start = -1, sequence_length = 0;
+    bool strand = 0;
+    for(int64_t i=0; i<9; i++) {
+        char base;
+        bool coordinates = taf_parse_first_row(lines[i], strlen(lines[i]), &base, &sequence_name, &start, &strand,
+                                               &sequence_length);
+        CuAssertIntEquals(testCase, expected_coordinates[i], coordinates);
+        CuAssertIntEquals(testCase, expected_bases[i], base);
+        CuAssertIntEquals(testCase, expected_starts[i], start);
+        CuAssertTrue(testCase, (sequence_name == NULL) == (expected_names[i] == NULL));
+        if(sequence_name != NULL) {
+            CuAssertStrEquals(testCase, expected_names[i], sequence_name);
+            CuAssertTrue(testCase, strand);
+        }
+    }
+}
+
+static void block_writer_test_prepare(Alignment *alignment, void *extra) {
+    if(*(int64_t *)extra == 0) {
+        taf_update_coordinates_reported(alignment, 1000);
+    }
+}
+
+static void block_writer_test_encode(Alignment *p_alignment, Alignment *alignment, LW *lw, void *extra) {
+    int64_t format = *(int64_t *)extra;
+    if(format == 0) {
+        taf_write_block3(p_alignment, alignment, 1, 1000, lw, 0, 0);
+    }
+    else if(format == 1) {
+        maf_write_block2(alignment, lw, 0);
+    }
+    else {
+        paf_write_block(alignment, lw, format == 3, 0);
+    }
+}
+
+/*
+ * Write the blocks of the example maf in the given format (0: taf, 1: maf, 2: paf, 3: all-to-all paf) to an
+ * in-memory buffer, with a block writer if thread_number > 0, otherwise directly. Returns the output.
+ */
+static char *write_blocks(int64_t format, int64_t thread_number, int64_t max_blocks_in_flight) {
+    FILE *file = fopen("./tests/evolverMammals.maf", "r");
+    LI *li = LI_construct(file);
+    tag_destruct(maf_read_header(li));
+    LW *lw = LW_construct(NULL, 0);
+    BlockWriter *writer = thread_number > 0 ? block_writer_construct(lw, block_writer_test_prepare,
+                                                                     block_writer_test_encode, NULL, &format, li,
+                                                                     thread_number, max_blocks_in_flight) : NULL;
+    Alignment *alignment, *p_alignment = NULL, *pp_alignment = NULL;
+    while(1) {
+        alignment = maf_read_block(li);
+        if(p_alignment != NULL) {
+            if(alignment != NULL) {
+                alignment_link_adjacent(p_alignment, alignment, 1);
+            }
+            if(writer != NULL) { // Given once linked to the next block
+                block_writer_write(writer, p_alignment);
+            }
+            else {
+                if(format == 0) {
+                    taf_write_block2(pp_alignment, p_alignment, 1, 1000, lw, 0, 0);
+                }
+                else {
+                    block_writer_test_encode(pp_alignment, p_alignment, lw, &format);
+                }
+                if(pp_alignment != NULL) {
+                    alignment_destruct(pp_alignment, 1);
+                }
+            }
+        }
+        if(alignment == NULL) {
+            break;
+        }
+        pp_alignment = p_alignment;
+        p_alignment = alignment;
+    }
+    if(writer != NULL) {
+        block_writer_destruct(writer);
+    }
+    else if(p_alignment != NULL) {
+        alignment_destruct(p_alignment, 1);
+    }
+    char *output = stString_getSubString(lw->buffer, 0, lw->buffer_length);
+    LW_destruct(lw, 0);
+    LI_destruct(li);
+    fclose(file);
+    return output;
+}
+
+static void test_block_writer(CuTest *testCase) {
+    // The blocks written in parallel, or by a writer without threads, must be the same as those written directly
+    for(int64_t format=0; format<4; format++) {
+        char *expected = write_blocks(format, 0, 0);
+        CuAssertTrue(testCase, strlen(expected) > 0);
+        int64_t thread_numbers[] = { 1, 4, 3 }, blocks_in_flight[] = { 0, 0, 1 };
+        for(int64_t i=0; i<3; i++) {
+            char *output = write_blocks(format, thread_numbers[i], blocks_in_flight[i]);
+            CuAssertStrEquals(testCase, expected, output);
+            free(output);
+        }
+        free(expected);
+    }
 }
 
 CuSuite* taf_test_suite(void) {
     CuSuite* suite = CuSuiteNew();
     SUITE_ADD_TEST(suite, test_taf);
+    SUITE_ADD_TEST(suite, test_taf_multithreaded);
+    SUITE_ADD_TEST(suite, test_taf_run_length_encoded);
+    SUITE_ADD_TEST(suite, test_taf_parallel_read);
+    SUITE_ADD_TEST(suite, test_taf_parallel_read_run_length_encoded);
+    SUITE_ADD_TEST(suite, test_alignment_recycle);
+    SUITE_ADD_TEST(suite, test_alignment_recycle_run_length_encoded);
+    SUITE_ADD_TEST(suite, test_block_writer);
+    SUITE_ADD_TEST(suite, test_taf_parse_anchor_line);
+    SUITE_ADD_TEST(suite, test_tai_binary);
+    SUITE_ADD_TEST(suite, test_tai_secondary);
+    SUITE_ADD_TEST(suite, test_tai_regions);
+    SUITE_ADD_TEST(suite, test_tai_writer);
+#ifdef USE_HTSLIB
+    SUITE_ADD_TEST(suite, test_tai_writer_compressed);
+#endif
+    SUITE_ADD_TEST(suite, test_tai_summaries);
+    SUITE_ADD_TEST(suite, test_taf_parse_first_row);
     return suite;
 }
@@ -167,7 +167,7 @@ class TafTest(unittest.TestCase):
     def test_maf_to_taf_compressed(self):
         self.test_maf_to_taf(compress_file=True)
 
-    def make_taf_and_taf_index(self, compress_file=False, taf_not_maf=True):
+    def make_taf_and_taf_index(self, compress_file=False, taf_not_maf=True, binary=False):
         # Convert MAF to TAF (or just write MAF if not taf_not_maf)
         with AlignmentReader(self.test_maf_file) as mp:
             maf_header_tags = mp.get_header()  # Get the maf header tags
@@ -178,7 +178,7 @@ class TafTest(unittest.TestCase):
                     tw.write_alignment(a)  # Write a corresponding output block
 
         # Write the index file
-        write_taf_index_file(taf_file=self.test_taf_file, index_file=self.test_index_file)
+        write_taf_index_file(taf_file=self.test_taf_file, index_file=self.test_index_file, binary=binary)
 
         # Make the Taf Index object
         taf_index = TafIndex(self.test_index_file, not taf_not_maf)
@@ -197,11 +197,11 @@ class TafTest(unittest.TestCase):
             sequence_intervals.append(("Anc0.Anc0refChr0", start, length))
         return sequence_intervals, total_length
 
-    def test_taf_index(self, compress_file=False, taf_not_maf=True):
+    def test_taf_index(self, compress_file=False, taf_not_maf=True, binary=False):
         """ Index a taf file then load a portion of the file with the
          AlignmentReader """
         # Make the Taf Index object and the taf file
-        taf_index = self.make_taf_and_taf_index(compress_file=False, taf_not_maf=True)
+        taf_index = self.make_taf_and_taf_index(compress_file=False, taf_not_maf=True, binary=binary)
 
         # Create a taf/maf reader
         with AlignmentReader(self.test_taf_file, taf_index=taf_index, sequence_intervals=(("Anc0.Anc0refChr0",
@@ -262,6 +262,9 @@ class TafTest(unittest.TestCase):
     def test_taf_index_compression(self):
         self.test_taf_index(compress_file=True)
 
+    def test_taf_index_binary(self):
+        self.test_taf_index(binary=True)
+
     def test_maf_index(self):
         self.test_taf_index(compress_file=False, taf_not_maf=False)
 
@@ -359,6 +362,22 @@ class TafTest(unittest.TestCase):
                 seq_intervals = list(taffy.lib.get_reference_sequence_intervals(tp))
                 self.assertEqual(seq_intervals, [("Anc0.Anc0refChr0", start, length)])
 
+    def test_get_reference_sequence_intervals_from_index(self):
+        """ Tests the get_reference_sequence_intervals method gives the same intervals from the summaries of the
+        contigs in the index as from a scan of the alignment.
+        """
+        for binary in (False, True):
+            taf_index = self.make_taf_and_taf_index(compress_file=False, taf_not_maf=True, binary=binary)
+            summaries = taf_index.get_contig_summaries()
+            self.assertIsNotNone(summaries)
+            with AlignmentReader(self.test_taf_file) as tp:
+                seq_intervals = list(taffy.lib.get_reference_sequence_intervals(tp))
+            self.assertEqual([(seq_name, start, aligned_bases) for seq_name, _, start, _, aligned_bases, _, _ in
+                              summaries], seq_intervals)
+            with AlignmentReader(self.test_taf_file) as tp:
+                self.assertEqual(list(taffy.lib.get_reference_sequence_intervals(tp, taf_index=taf_index)),
+                                 seq_intervals)
+
     def test_torchDatasetAlignmentIteratorMini_Maf(self, is_maf=True, use_one_hot=False):
         """ Tests the PyTorch dataset alignment iterator with some hand made examples """
         test_taf_file = (pathlib.Path().absolute() / "../tests/evolverMammals.taf.mini.annotated").as_posix()
@@ -101,9 +101,69 @@ static void test_ref_diffs(CuTest *testCase) {
     }
 }
 
+static void test_paf_parallel(CuTest *testCase) {
+    // Make a maf block with enough rows to be written in parallel, some rows only having bases in the first or
+    // second half of the columns so that some pairs of rows have nothing aligned
+    char *example_file = "./tests/paf_parallel_test.maf";
+    FILE *fh = fopen(example_file, "w");
+    fprintf(fh, "##maf version=1\n\na\n");
+    int64_t row_number = 60, column_number = 80;
+    for(int64_t i=0; i<row_number; i++) {
+        char bases[81];
+        int64_t length = 0;
+        for(int64_t j=0; j<column_number; j++) {
+            bool gap = st_random() < 0.2 || (i % 3 == 0 && j >= column_number / 2) || (i % 3 == 1 && j < column_number / 2);
+            bases[j] = gap ? '-' : "ACGT"[st_randomInt(0, 4)];
+            length += !gap;
+        }
+        bases[column_number] = '\0';
+        fprintf(fh, "s\tseq%" PRIi64 ".chr1\t%" PRIi64 "\t%" PRIi64 "\t%c\t1000\t%s\n", i, i, length,
+                i % 2 ? '+' : '-', bases);
+    }
+    fclose(fh);
+    fh = fopen(example_file, "r");
+    LI *li = LI_construct(fh);
+    tag_destruct(maf_read_header(li));
+    Alignment *alignment = maf_read_block(li);
+    CuAssertTrue(testCase, alignment != NULL);
+    CuAssertIntEquals(testCase, row_number, alignment->row_number);
+
+    // Check the pairs written in parallel are those written by paf_write_block, in the same order
+    for(int64_t all_to_all=0; all_to_all<=1; all_to_all++) {
+        for(int64_t cs_cigar=0; cs_cigar<=1; cs_cigar++) {
+            LW *lw = LW_construct(NULL, 0), *lw2 = LW_construct(NULL, 0);
+            paf_write_block(alignment, lw, all_to_all, cs_cigar);
+            PafWriter *writer = paf_writer_construct(lw2, all_to_all, cs_cigar, 4);
+            paf_writer_write_block(writer, alignment);
+            paf_writer_destruct(writer);
+            CuAssertIntEquals(testCase, lw->buffer_length, lw2->buffer_length);
+            CuAssertTrue(testCase, memcmp(lw->buffer, lw2->buffer, lw->buffer_length) == 0);
+            // Pairs of rows without aligned bases are skipped if all_to_all, otherwise every row is written
+            int64_t line_number = 0;
+            for(int64_t i=0; i<lw->buffer_length; i++) {
+                line_number += lw->buffer[i] == '\n';
+            }
+            CuAssertTrue(testCase, line_number > 0);
+            if(all_to_all) {
+                CuAssertTrue(testCase, line_number < row_number * (row_number - 1) / 2);
+            }
+            else {
+                CuAssertIntEquals(testCase, row_number - 1, line_number);
+            }
+            LW_destruct(lw, 0);
+            LW_destruct(lw2, 0);
+        }
+    }
+    alignment_destruct(alignment, 1);
+    LI_destruct(li);
+    fclose(fh);
+    remove(example_file);
+}
+
 CuSuite* view_test_suite(void) {
     CuSuite* suite = CuSuiteNew();
     SUITE_ADD_TEST(suite, test_paf);
+    SUITE_ADD_TEST(suite, test_paf_parallel);
     SUITE_ADD_TEST(suite, test_lineage_diffs);
     SUITE_ADD_TEST(suite, test_ref_diffs);
     return suite;